@@ -0,0 +1,164 @@
+/*
+ * accel_bench.c -- benchmark for looking up accelerators of menu items
+ * 
+ * Copyright 2025 Daniel Kondor <kondor.dani@gmail.com>
+ * 
+ * This is free and unencumbered software released into the public domain.
+ * 
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ * 
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Builds a menu tree with many items with accelerators (without any
+ * D-Bus or GTK), some of them shared by several items of which only
+ * some are enabled and visible, and measures how long it takes to index
+ * it and to look up key presses (see menu_accel.h). A lookup runs for
+ * each key press while the app is active, so it should take well under
+ * a microsecond. It also checks that items sharing an accelerator with
+ * disabled or hidden items are found.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <glib.h>
+#include <menu_tree.h>
+#include <menu_accel.h>
+
+static const char* const mods[] = { "<Primary>", "<Primary><Shift>", "<Alt>", "<Primary><Alt>", "<Super>" };
+static const char* const keys[] = {
+	"a", "b", "c", "d", "e", "f", "g", "h", "i", "j", "k", "l", "m", "n", "o", "p", "q", "r", "s",
+	"t", "u", "v", "w", "x", "y", "z", "0", "1", "2", "3", "4", "5", "6", "7", "8", "9", "F1",
+	"F2", "F3", "F4", "F5", "F6", "F7", "F8", "F9", "F10", "F11", "F12", "Delete", "plus"
+};
+
+#define N_ACCELS (G_N_ELEMENTS(mods) * G_N_ELEMENTS(keys))
+
+static void accel_name(char* buf, size_t size, unsigned int i) {
+	snprintf(buf, size, "%s%s", mods[i % G_N_ELEMENTS(mods)], keys[(i / G_N_ELEMENTS(mods)) % G_N_ELEMENTS(keys)]);
+}
+
+/* check that the accelerator accel finds node */
+static int check(struct menu_accel* ma, const char* accel, guint32 node, const char* what) {
+	guint keyval;
+	GdkModifierType m;
+	menu_accel_parse(accel, &keyval, &m);
+	guint32 found = menu_accel_lookup(ma, keyval, m);
+	if(found == node) return 0;
+	fprintf(stderr, "%s: %s found node %u instead of %u!\n", what, accel, found, node);
+	return 1;
+}
+
+/* usage: accel_bench [items] [every n-th has an accelerator] [lookups] */
+int main(int argc, char** argv) {
+	unsigned int n = (argc > 1) ? (unsigned int)strtoul(argv[1], NULL, 10) : 20000;
+	unsigned int every = (argc > 2) ? (unsigned int)strtoul(argv[2], NULL, 10) : 10;
+	unsigned int n_lookups = (argc > 3) ? (unsigned int)strtoul(argv[3], NULL, 10) : 1000000;
+	if(!every) every = 1;
+	unsigned int i;
+	char accel[64];
+	int ret = 0;
+	
+	/* 1. a tree with n items in 50 submenus; every n-th item has an
+	 * accelerator, and every third of those is disabled or hidden */
+	struct menu_tree* tree = menu_tree_new();
+	guint32 menu = MENU_TREE_NONE;
+	unsigned int n_accels = 0;
+	for(i = 0; i < n; i++) {
+		if(!(i % MAX(n / 50, 1))) menu = menu_tree_append(tree, MENU_TREE_ROOT, MENU_NODE_SUBMENU, -1, "_Menu",
+			NULL, NULL, MENU_NODE_ENABLED | MENU_NODE_VISIBLE);
+		unsigned int flags = MENU_NODE_ENABLED | MENU_NODE_VISIBLE;
+		if(!(i % every)) {
+			if(n_accels % 3 == 1) flags &= ~MENU_NODE_ENABLED;
+			else if(n_accels % 3 == 2) flags &= ~MENU_NODE_VISIBLE;
+		}
+		guint32 node = menu_tree_append(tree, menu, MENU_NODE_ITEM, -1, "_Item", NULL, NULL, flags);
+		if(i % every) continue;
+		accel_name(accel, sizeof(accel), n_accels++);
+		menu_tree_set_accel(tree, node, accel);
+	}
+	
+	struct menu_accel* ma = menu_accel_new();
+	gint64 t0 = g_get_monotonic_time();
+	menu_accel_set_tree(ma, tree);
+	gint64 t1 = g_get_monotonic_time();
+	printf("index:   %u items with %u accelerators (%u distinct) in %.3f ms\n", n,
+		menu_accel_get_n_accels(ma), (unsigned int)MIN(n_accels, N_ACCELS), (t1 - t0) / 1000.0);
+	if(menu_accel_get_n_accels(ma) != n_accels) {
+		fprintf(stderr, "%u accelerators indexed instead of %u!\n", menu_accel_get_n_accels(ma), n_accels);
+		ret = 1;
+	}
+	
+	/* 2. the same accelerator on a disabled, a hidden and an enabled item */
+	guint32 extra = menu_tree_append(tree, MENU_TREE_ROOT, MENU_NODE_SUBMENU, -1, "_Extra",
+		NULL, NULL, MENU_NODE_ENABLED | MENU_NODE_VISIBLE);
+	guint32 disabled = menu_tree_append(tree, extra, MENU_NODE_ITEM, -1, "_Disabled", NULL, NULL, MENU_NODE_VISIBLE);
+	guint32 hidden = menu_tree_append(tree, extra, MENU_NODE_ITEM, -1, "_Hidden", NULL, NULL, MENU_NODE_ENABLED);
+	guint32 enabled = menu_tree_append(tree, extra, MENU_NODE_ITEM, -1, "_Enabled", NULL, NULL,
+		MENU_NODE_ENABLED | MENU_NODE_VISIBLE);
+	const char* shared = "<Primary><Alt><Shift>x";
+	menu_tree_set_accel(tree, disabled, shared);
+	menu_tree_set_accel(tree, hidden, shared);
+	menu_tree_set_accel(tree, enabled, shared);
+	menu_tree_children_changed(tree, extra);
+	ret |= check(ma, shared, enabled, "shared");
+	/* none of them can be used: the first one is found */
+	menu_tree_set_flags(tree, enabled, 0);
+	ret |= check(ma, shared, disabled, "none usable");
+	menu_tree_set_flags(tree, hidden, MENU_NODE_ENABLED | MENU_NODE_VISIBLE);
+	ret |= check(ma, shared, hidden, "shown");
+	menu_tree_remove(tree, hidden);
+	menu_tree_children_changed(tree, extra);
+	menu_tree_set_flags(tree, enabled, MENU_NODE_ENABLED | MENU_NODE_VISIBLE);
+	ret |= check(ma, shared, enabled, "removed");
+	menu_tree_set_accel(tree, disabled, NULL);
+	menu_tree_set_flags(tree, enabled, 0);
+	ret |= check(ma, shared, enabled, "only one");
+	
+	/* 3. looking up key presses, about half of them without an item */
+	guint* keyvals = g_new(guint, 2 * N_ACCELS);
+	GdkModifierType* masks = g_new(GdkModifierType, 2 * N_ACCELS);
+	for(i = 0; i < 2 * N_ACCELS; i++) {
+		accel_name(accel, sizeof(accel), i % N_ACCELS);
+		menu_accel_parse(accel, keyvals + i, masks + i);
+		/* a different modifier, which no accelerator uses */
+		if(i >= N_ACCELS) masks[i] |= GDK_HYPER_MASK;
+	}
+	GRand* rnd = g_rand_new_with_seed(12345);
+	unsigned int found = 0;
+	t0 = g_get_monotonic_time();
+	for(i = 0; i < n_lookups; i++) {
+		guint32 j = (guint32)g_rand_int_range(rnd, 0, (gint32)(2 * N_ACCELS));
+		if(menu_accel_lookup(ma, keyvals[j], masks[j]) != MENU_TREE_NONE) found++;
+	}
+	t1 = g_get_monotonic_time();
+	g_rand_free(rnd);
+	if(n_lookups) printf("lookup:  %u keys (%u found), %.1f ns each\n", n_lookups, found,
+		(t1 - t0) * 1000.0 / n_lookups);
+	
+	g_free(keyvals);
+	g_free(masks);
+	menu_accel_free(ma);
+	menu_tree_free(tree);
+	return ret;
+}
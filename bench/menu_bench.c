@@ -0,0 +1,580 @@
+/*
+ * menu_bench.c -- benchmark for fetching and showing large exported menus
+ * 
+ * Copyright 2025 Daniel Kondor <kondor.dani@gmail.com>
+ * 
+ * This is free and unencumbered software released into the public domain.
+ * 
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ * 
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/*
+ * Starts a private D-Bus daemon and a fixture exporter process (this
+ * same program, started with --export) that publishes synthetic menus
+ * with both the org.gtk.Menus and com.canonical.dbusmenu interfaces.
+ * Then measures the time until the full menu is available on our side
+ * and (if GTK can be initialized) the time until a popup menu built
+ * from it is mapped.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <glib.h>
+#include <gio/gio.h>
+#include <gtk/gtk.h>
+#include <libdbusmenu-glib/client.h>
+#include <libdbusmenu-glib/menuitem.h>
+#include <libdbusmenu-glib/server.h>
+#include <libdbusmenu-gtk/menu.h>
+#include <dbusmenu_lazy.h>
+#include <gmenu_source.h>
+#include <menu_render.h>
+
+
+#define FIXTURE_NAME "org.example.MenuFixture"
+#define TIMEOUT_MS 30000
+
+/* one synthetic menu */
+struct fixture {
+	unsigned int n_items;
+	unsigned int depth;
+	unsigned int width; /* number of items in each (sub)menu */
+};
+
+/* default set of fixtures: number of items and depth */
+static const unsigned int default_fixtures[][2] = {
+	{10, 1}, {100, 2}, {1000, 4}, {10000, 4}, {10000, 8}
+};
+
+
+/* total number of items in a tree with the given width and depth */
+static unsigned long long tree_capacity(unsigned int width, unsigned int depth) {
+	unsigned long long total = 0, level = 1;
+	unsigned int i;
+	for(i = 0; i < depth; i++) {
+		level *= width;
+		total += level;
+		if(total > 1000000000ULL) break;
+	}
+	return total;
+}
+
+static void fixture_init(struct fixture* f, unsigned int n_items, unsigned int depth) {
+	f->n_items = n_items ? n_items : 1;
+	f->depth = depth ? depth : 1;
+	f->width = 1;
+	while(tree_capacity(f->width, f->depth) < f->n_items) f->width++;
+}
+
+
+/* exporter side */
+
+static void build_gmenu(GMenu* menu, GActionMap* actions, const struct fixture* f,
+		unsigned int level, unsigned int* remaining) {
+	unsigned int i;
+	for(i = 0; i < f->width && *remaining; i++) {
+		unsigned int id = f->n_items - *remaining;
+		(*remaining)--;
+		char label[32];
+		snprintf(label, sizeof(label), "Item %u", id);
+		if(level + 1 < f->depth && *remaining) {
+			GMenu* sub = g_menu_new();
+			build_gmenu(sub, actions, f, level + 1, remaining);
+			g_menu_append_submenu(menu, label, G_MENU_MODEL(sub));
+			g_object_unref(sub);
+		}
+		else {
+			char name[32];
+			char detailed[40];
+			snprintf(name, sizeof(name), "action%u", id);
+			snprintf(detailed, sizeof(detailed), "app.%s", name);
+			GSimpleAction* action = g_simple_action_new(name, NULL);
+			g_action_map_add_action(actions, G_ACTION(action));
+			g_object_unref(action);
+			g_menu_append(menu, label, detailed);
+		}
+	}
+}
+
+static void build_dbusmenu(DbusmenuMenuitem* parent, const struct fixture* f,
+		unsigned int level, unsigned int* remaining) {
+	unsigned int i;
+	for(i = 0; i < f->width && *remaining; i++) {
+		unsigned int id = f->n_items - *remaining;
+		(*remaining)--;
+		char label[32];
+		snprintf(label, sizeof(label), "Item %u", id);
+		DbusmenuMenuitem* item = dbusmenu_menuitem_new();
+		dbusmenu_menuitem_property_set(item, DBUSMENU_MENUITEM_PROP_LABEL, label);
+		if(level + 1 < f->depth && *remaining) {
+			dbusmenu_menuitem_property_set(item, DBUSMENU_MENUITEM_PROP_CHILD_DISPLAY,
+				DBUSMENU_MENUITEM_CHILD_DISPLAY_SUBMENU);
+			build_dbusmenu(item, f, level + 1, remaining);
+		}
+		dbusmenu_menuitem_child_append(parent, item);
+		g_object_unref(item);
+	}
+}
+
+static int run_exporter(int argc, char** argv) {
+	GError* err = NULL;
+	GDBusConnection* conn = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, &err);
+	if(!conn) {
+		fprintf(stderr, "Exporter cannot connect to DBus: %s\n", err->message);
+		return 1;
+	}
+	
+	int i;
+	for(i = 0; i + 1 < argc; i += 2) {
+		struct fixture f;
+		fixture_init(&f, (unsigned int)strtoul(argv[i], NULL, 10), (unsigned int)strtoul(argv[i+1], NULL, 10));
+		unsigned int k = (unsigned int)i / 2;
+		
+		GMenu* menu = g_menu_new();
+		GSimpleActionGroup* actions = g_simple_action_group_new();
+		unsigned int remaining = f.n_items;
+		build_gmenu(menu, G_ACTION_MAP(actions), &f, 0, &remaining);
+		
+		char* path = g_strdup_printf("/org/example/fixture%u/menubar", k);
+		if(!g_dbus_connection_export_menu_model(conn, path, G_MENU_MODEL(menu), &err)) {
+			fprintf(stderr, "Cannot export menu: %s\n", err->message);
+			g_clear_error(&err);
+		}
+		g_free(path);
+		path = g_strdup_printf("/org/example/fixture%u", k);
+		if(!g_dbus_connection_export_action_group(conn, path, G_ACTION_GROUP(actions), &err)) {
+			fprintf(stderr, "Cannot export actions: %s\n", err->message);
+			g_clear_error(&err);
+		}
+		g_free(path);
+		
+		DbusmenuMenuitem* root = dbusmenu_menuitem_new();
+		remaining = f.n_items;
+		build_dbusmenu(root, &f, 0, &remaining);
+		path = g_strdup_printf("/MenuBar/%u", k);
+		DbusmenuServer* server = dbusmenu_server_new(path);
+		dbusmenu_server_set_root(server, root);
+		g_free(path);
+		/* note: exported objects are kept until we are killed */
+	}
+	
+	g_bus_own_name_on_connection(conn, FIXTURE_NAME, G_BUS_NAME_OWNER_FLAGS_NONE, NULL, NULL, NULL, NULL);
+	GMainLoop* loop = g_main_loop_new(NULL, FALSE);
+	g_main_loop_run(loop);
+	return 0;
+}
+
+
+/* measurement side */
+
+static gboolean timeout_cb(gpointer data) {
+	*(int*)data = 1;
+	return G_SOURCE_REMOVE;
+}
+
+/* run the main loop until done(data) returns nonzero or we time out */
+static int wait_for(int (*done)(void*), void* data, guint timeout_ms) {
+	int timed_out = 0;
+	guint id = g_timeout_add(timeout_ms, timeout_cb, &timed_out);
+	while(!done(data) && !timed_out) g_main_context_iteration(NULL, TRUE);
+	if(!timed_out) g_source_remove(id);
+	return done(data);
+}
+
+static int int64_nonzero(void* data) {
+	return *(gint64*)data != 0;
+}
+
+static void name_appeared_cb(G_GNUC_UNUSED GDBusConnection* conn, G_GNUC_UNUSED const char* name,
+		G_GNUC_UNUSED const char* owner, gpointer data) {
+	*(gint64*)data = 1;
+}
+
+
+struct gmenu_loader {
+	GPtrArray* models;
+	unsigned int items;
+	unsigned int expected;
+};
+
+static void gmenu_watch(struct gmenu_loader* l, GMenuModel* model);
+
+static void gmenu_items_changed(GMenuModel* model, gint position, gint removed, gint added, gpointer data) {
+	struct gmenu_loader* l = (struct gmenu_loader*)data;
+	l->items += added;
+	l->items -= removed;
+	gint i;
+	for(i = position; i < position + added; i++) {
+		GMenuModel* sub = g_menu_model_get_item_link(model, i, G_MENU_LINK_SUBMENU);
+		if(sub) {
+			gmenu_watch(l, sub);
+			g_object_unref(sub);
+		}
+	}
+}
+
+static void gmenu_watch(struct gmenu_loader* l, GMenuModel* model) {
+	g_ptr_array_add(l->models, g_object_ref(model));
+	g_signal_connect(model, "items-changed", G_CALLBACK(gmenu_items_changed), l);
+	/* note: this also subscribes to changes in this menu */
+	gint n = g_menu_model_get_n_items(model);
+	if(n > 0) gmenu_items_changed(model, 0, 0, n, l);
+}
+
+static int gmenu_loaded(void* data) {
+	struct gmenu_loader* l = (struct gmenu_loader*)data;
+	return l->items >= l->expected;
+}
+
+static void gmenu_loader_clear(struct gmenu_loader* l) {
+	unsigned int i;
+	for(i = 0; i < l->models->len; i++) {
+		GMenuModel* model = (GMenuModel*)g_ptr_array_index(l->models, i);
+		g_signal_handlers_disconnect_by_data(model, l);
+		g_object_unref(model);
+	}
+	g_ptr_array_free(l->models, TRUE);
+}
+
+
+struct dbusmenu_loader {
+	DbusmenuClient* client;
+	unsigned int expected;
+	int changed;
+	int done;
+};
+
+static unsigned int dbusmenu_count(DbusmenuMenuitem* item) {
+	unsigned int n = 0;
+	GList* l;
+	for(l = dbusmenu_menuitem_get_children(item); l; l = l->next)
+		n += 1 + dbusmenu_count((DbusmenuMenuitem*)l->data);
+	return n;
+}
+
+static void dbusmenu_layout_cb(G_GNUC_UNUSED DbusmenuClient* client, gpointer data) {
+	((struct dbusmenu_loader*)data)->changed = 1;
+}
+
+static int dbusmenu_loaded(void* data) {
+	struct dbusmenu_loader* l = (struct dbusmenu_loader*)data;
+	if(l->changed) {
+		l->changed = 0;
+		DbusmenuMenuitem* root = dbusmenu_client_get_root(l->client);
+		l->done = root && dbusmenu_count(root) >= l->expected;
+	}
+	return l->done;
+}
+
+
+struct gtkmenu_loader {
+	GtkWidget* menu;
+	unsigned int expected;
+};
+
+static int gtkmenu_loaded(void* data) {
+	struct gtkmenu_loader* l = (struct gtkmenu_loader*)data;
+	GList* children = gtk_container_get_children(GTK_CONTAINER(l->menu));
+	unsigned int n = g_list_length(children);
+	g_list_free(children);
+	return n >= l->expected;
+}
+
+struct tree_loader {
+	struct menu_tree* tree;
+	unsigned int expected;
+};
+
+static int tree_loaded(void* data) {
+	struct tree_loader* l = (struct tree_loader*)data;
+	return menu_tree_get_n_items(l->tree) >= l->expected;
+}
+
+static gboolean map_event_cb(G_GNUC_UNUSED GtkWidget* widget, G_GNUC_UNUSED GdkEvent* event, gpointer data) {
+	*(gint64*)data = g_get_monotonic_time();
+	return FALSE;
+}
+
+/* pop up the menu and return the time when it is mapped (or 0 on timeout) */
+static gint64 popup_menu(GtkWidget* menu, GtkWidget* anchor) {
+	gint64 mapped = 0;
+	GtkWidget* toplevel = gtk_widget_get_toplevel(menu);
+	gulong id = g_signal_connect(toplevel, "map-event", G_CALLBACK(map_event_cb), &mapped);
+	gtk_widget_show_all(menu);
+	gtk_menu_popup_at_widget(GTK_MENU(menu), anchor, GDK_GRAVITY_SOUTH_WEST, GDK_GRAVITY_NORTH_WEST, NULL);
+	wait_for(int64_nonzero, &mapped, TIMEOUT_MS);
+	g_signal_handler_disconnect(toplevel, id);
+	gtk_menu_popdown(GTK_MENU(menu));
+	return mapped;
+}
+
+
+/* times of one run, in us (negative if not measured) */
+struct run_times {
+	double gmenu_ready;
+	double gmenu_popup;
+	double tree_popup;
+	double tree_bytes; /* memory used by the tree, per item */
+	double dbusmenu_ready;
+	double dbusmenu_popup;
+	double lazy_popup;
+};
+
+static void run_once(GDBusConnection* conn, const struct fixture* f, unsigned int k,
+		GtkWidget* anchor, struct run_times* t) {
+	char* menu_path = g_strdup_printf("/org/example/fixture%u/menubar", k);
+	char* dbusmenu_path = g_strdup_printf("/MenuBar/%u", k);
+	char* name = g_strdup(FIXTURE_NAME);
+	gint64 t0, t1;
+	t->gmenu_ready = t->gmenu_popup = t->tree_popup = t->tree_bytes = -1.0;
+	t->dbusmenu_ready = t->dbusmenu_popup = t->lazy_popup = -1.0;
+	
+	/* 1. org.gtk.Menus -- activation: get the full menu model */
+	struct gmenu_loader gl = { g_ptr_array_new(), 0, f->n_items };
+	t0 = g_get_monotonic_time();
+	GDBusMenuModel* model = g_dbus_menu_model_get(conn, name, menu_path);
+	gmenu_watch(&gl, G_MENU_MODEL(model));
+	if(wait_for(gmenu_loaded, &gl, TIMEOUT_MS)) t->gmenu_ready = g_get_monotonic_time() - t0;
+	
+	/* click: build the menu widgets and show them */
+	if(anchor && t->gmenu_ready >= 0.0) {
+		t0 = g_get_monotonic_time();
+		GtkWidget* menu = gtk_menu_new_from_model(G_MENU_MODEL(model));
+		g_object_ref_sink(menu);
+		gtk_menu_attach_to_widget(GTK_MENU(menu), anchor, NULL);
+		t1 = popup_menu(menu, anchor);
+		if(t1) t->gmenu_popup = t1 - t0;
+		gtk_menu_detach(GTK_MENU(menu));
+		gtk_widget_destroy(menu);
+		g_object_unref(menu);
+	}
+	
+	/* the same, but with our own menu tree and renderer */
+	if(t->gmenu_ready >= 0.0) {
+		t0 = g_get_monotonic_time();
+		struct gmenu_source* gs = gmenu_source_new(G_MENU_MODEL(model));
+		struct tree_loader tl = { gmenu_source_get_tree(gs), f->n_items };
+		if(wait_for(tree_loaded, &tl, TIMEOUT_MS)) {
+			t->tree_bytes = (double)menu_tree_get_memory(tl.tree) / f->n_items;
+			if(anchor) {
+				struct menu_render* mr = menu_render_new(tl.tree, NULL);
+				GtkWidget* menu = GTK_WIDGET(menu_render_get_menu(mr));
+				gtk_menu_attach_to_widget(GTK_MENU(menu), anchor, NULL);
+				t1 = popup_menu(menu, anchor);
+				if(t1) t->tree_popup = t1 - t0;
+				gtk_menu_detach(GTK_MENU(menu));
+				menu_render_free(mr);
+			}
+		}
+		gmenu_source_free(gs);
+	}
+	gmenu_loader_clear(&gl);
+	g_object_unref(model);
+	
+	/* 2. com.canonical.dbusmenu -- activation: get the full layout */
+	struct dbusmenu_loader dl = { NULL, f->n_items, 0, 0 };
+	t0 = g_get_monotonic_time();
+	dl.client = dbusmenu_client_new(name, dbusmenu_path);
+	g_signal_connect(dl.client, DBUSMENU_CLIENT_SIGNAL_LAYOUT_UPDATED, G_CALLBACK(dbusmenu_layout_cb), &dl);
+	if(wait_for(dbusmenu_loaded, &dl, TIMEOUT_MS)) t->dbusmenu_ready = g_get_monotonic_time() - t0;
+	g_signal_handlers_disconnect_by_data(dl.client, &dl);
+	g_object_unref(dl.client);
+	
+	/* click: the GTK menu fetches the layout itself, so this includes that */
+	if(anchor) {
+		t0 = g_get_monotonic_time();
+		struct gtkmenu_loader ml = { GTK_WIDGET(dbusmenu_gtkmenu_new(name, dbusmenu_path)), 0 };
+		ml.expected = (f->n_items < f->width) ? f->n_items : f->width;
+		g_object_ref_sink(ml.menu);
+		gtk_menu_attach_to_widget(GTK_MENU(ml.menu), anchor, NULL);
+		if(wait_for(gtkmenu_loaded, &ml, TIMEOUT_MS)) {
+			t1 = popup_menu(ml.menu, anchor);
+			if(t1) t->dbusmenu_popup = t1 - t0;
+		}
+		gtk_menu_detach(GTK_MENU(ml.menu));
+		gtk_widget_destroy(ml.menu);
+		g_object_unref(ml.menu);
+	}
+	
+	/* 3. com.canonical.dbusmenu, only fetching the top level */
+	if(anchor) {
+		t0 = g_get_monotonic_time();
+		struct dbusmenu_lazy* lazy = dbusmenu_lazy_new(conn, name, dbusmenu_path, TIMEOUT_MS);
+		struct menu_render* mr = menu_render_new(dbusmenu_lazy_get_tree(lazy), NULL);
+		struct gtkmenu_loader ml = { GTK_WIDGET(menu_render_get_menu(mr)), 0 };
+		ml.expected = (f->n_items < f->width) ? f->n_items : f->width;
+		gtk_menu_attach_to_widget(GTK_MENU(ml.menu), anchor, NULL);
+		if(wait_for(gtkmenu_loaded, &ml, TIMEOUT_MS)) {
+			t1 = popup_menu(ml.menu, anchor);
+			if(t1) t->lazy_popup = t1 - t0;
+		}
+		gtk_menu_detach(GTK_MENU(ml.menu));
+		menu_render_free(mr);
+		dbusmenu_lazy_free(lazy);
+	}
+	
+	g_free(name);
+	g_free(menu_path);
+	g_free(dbusmenu_path);
+}
+
+static int cmp_double(const void* a, const void* b) {
+	double x = *(const double*)a;
+	double y = *(const double*)b;
+	return (x > y) - (x < y);
+}
+
+/* print median, min and max of the measured values in ms */
+static void report(const char* what, double* values, unsigned int n) {
+	unsigned int i, j = 0;
+	for(i = 0; i < n; i++) if(values[i] >= 0.0) values[j++] = values[i];
+	if(!j) {
+		printf("  %-16s not measured\n", what);
+		return;
+	}
+	qsort(values, j, sizeof(double), cmp_double);
+	printf("  %-16s median %9.2f ms  min %9.2f ms  max %9.2f ms\n", what,
+		values[j / 2] / 1000.0, values[0] / 1000.0, values[j - 1] / 1000.0);
+}
+
+
+int main(int argc, char** argv) {
+	if(argc > 1 && !strcmp(argv[1], "--export")) return run_exporter(argc - 2, argv + 2);
+	
+	/* arguments: number of runs, followed by pairs of number of items and depth */
+	unsigned int runs = (argc > 1) ? (unsigned int)strtoul(argv[1], NULL, 10) : 5;
+	if(!runs) runs = 1;
+	GArray* fixtures = g_array_new(FALSE, FALSE, sizeof(struct fixture));
+	int i;
+	for(i = 2; i + 1 < argc; i += 2) {
+		struct fixture f;
+		fixture_init(&f, (unsigned int)strtoul(argv[i], NULL, 10), (unsigned int)strtoul(argv[i+1], NULL, 10));
+		g_array_append_val(fixtures, f);
+	}
+	if(!fixtures->len) for(i = 0; i < (int)G_N_ELEMENTS(default_fixtures); i++) {
+		struct fixture f;
+		fixture_init(&f, default_fixtures[i][0], default_fixtures[i][1]);
+		g_array_append_val(fixtures, f);
+	}
+	
+	/* private bus -- this sets DBUS_SESSION_BUS_ADDRESS for us and the exporter */
+	GTestDBus* test_bus = g_test_dbus_new(G_TEST_DBUS_NONE);
+	g_test_dbus_up(test_bus);
+	g_setenv("NO_AT_BRIDGE", "1", TRUE);
+	
+	GError* err = NULL;
+	GDBusConnection* conn = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, &err);
+	if(!conn) {
+		fprintf(stderr, "Cannot connect to DBus: %s\n", err->message);
+		g_test_dbus_stop(test_bus);
+		return 1;
+	}
+	
+	/* start the exporter */
+	GPtrArray* args = g_ptr_array_new_with_free_func(g_free);
+	char* self = g_file_read_link("/proc/self/exe", NULL);
+	g_ptr_array_add(args, self ? self : g_strdup(argv[0]));
+	g_ptr_array_add(args, g_strdup("--export"));
+	unsigned int k;
+	for(k = 0; k < fixtures->len; k++) {
+		struct fixture* f = &g_array_index(fixtures, struct fixture, k);
+		g_ptr_array_add(args, g_strdup_printf("%u", f->n_items));
+		g_ptr_array_add(args, g_strdup_printf("%u", f->depth));
+	}
+	g_ptr_array_add(args, NULL);
+	GPid pid;
+	if(!g_spawn_async(NULL, (char**)args->pdata, NULL, G_SPAWN_DEFAULT, NULL, NULL, &pid, &err)) {
+		fprintf(stderr, "Cannot start exporter: %s\n", err->message);
+		g_test_dbus_stop(test_bus);
+		return 1;
+	}
+	g_ptr_array_free(args, TRUE);
+	
+	gint64 appeared = 0;
+	guint watch = g_bus_watch_name_on_connection(conn, FIXTURE_NAME, G_BUS_NAME_WATCHER_FLAGS_NONE,
+		name_appeared_cb, NULL, &appeared, NULL);
+	int ret = 0;
+	if(!wait_for(int64_nonzero, &appeared, TIMEOUT_MS)) {
+		fprintf(stderr, "Exporter did not start!\n");
+		ret = 1;
+	}
+	g_bus_unwatch_name(watch);
+	
+	/* GTK is optional: without a display, we only measure fetching menus */
+	GtkWidget* win = NULL;
+	GtkWidget* anchor = NULL;
+	if(!ret && gtk_init_check(NULL, NULL)) {
+		win = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+		anchor = gtk_button_new_with_label("Menu");
+		gtk_container_add(GTK_CONTAINER(win), anchor);
+		gint64 mapped = 0;
+		g_signal_connect(win, "map-event", G_CALLBACK(map_event_cb), &mapped);
+		gtk_widget_show_all(win);
+		if(!wait_for(int64_nonzero, &mapped, TIMEOUT_MS)) anchor = NULL;
+		g_signal_handlers_disconnect_by_data(win, &mapped);
+	}
+	else if(!ret) printf("Cannot initialize GTK, popup times will not be measured\n");
+	
+	for(k = 0; !ret && k < fixtures->len; k++) {
+		struct fixture* f = &g_array_index(fixtures, struct fixture, k);
+		double* values = g_new(double, 6 * runs);
+		double tree_bytes = -1.0;
+		unsigned int r;
+		for(r = 0; r < runs; r++) {
+			struct run_times t;
+			run_once(conn, f, k, anchor, &t);
+			values[r] = t.gmenu_ready;
+			values[runs + r] = t.gmenu_popup;
+			values[2*runs + r] = t.dbusmenu_ready;
+			values[3*runs + r] = t.dbusmenu_popup;
+			values[4*runs + r] = t.lazy_popup;
+			values[5*runs + r] = t.tree_popup;
+			if(t.tree_bytes >= 0.0) tree_bytes = t.tree_bytes;
+		}
+		printf("%u items, depth %u (%u items per menu):\n", f->n_items, f->depth, f->width);
+		report("gmenu ready", values, runs);
+		report("gmenu popup", values + runs, runs);
+		report("tree popup", values + 5*runs, runs);
+		report("dbusmenu ready", values + 2*runs, runs);
+		report("dbusmenu popup", values + 3*runs, runs);
+		report("lazy popup", values + 4*runs, runs);
+		/* note: this does not depend on the run */
+		if(tree_bytes >= 0.0) printf("  %-16s %9.1f bytes per item\n", "tree memory", tree_bytes);
+		g_free(values);
+	}
+	
+	if(win) gtk_widget_destroy(win);
+	kill(pid, SIGTERM);
+	g_spawn_close_pid(pid);
+	g_object_unref(conn);
+	/* note: we do not wait for all connections to be closed here */
+	g_test_dbus_stop(test_bus);
+	g_object_unref(test_bus);
+	g_array_free(fixtures, TRUE);
+	return ret;
+}
+
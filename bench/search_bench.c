@@ -0,0 +1,173 @@
+/*
+ * search_bench.c -- benchmark for indexing and searching large menus
+ * 
+ * Copyright 2025 Daniel Kondor <kondor.dani@gmail.com>
+ * 
+ * This is free and unencumbered software released into the public domain.
+ * 
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ * 
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Builds a menu tree with tens of thousands of items (without any D-Bus
+ * or GTK) and measures how long it takes to index it and changes to it
+ * (see menu_search.h). Changes should be indexed within a frame (16.7 ms
+ * at 60 Hz), even if tens of thousands of items are added at once, and
+ * the index should not keep growing while items are replaced without
+ * anyone searching.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <malloc.h>
+#include <glib.h>
+#include <menu_tree.h>
+#include <menu_search.h>
+
+#define FRAME_US 16667
+
+static const char* const words[] = {
+	"Open", "Save", "Close", "Export", "Import", "Print", "Preview", "Settings",
+	"Window", "Document", "Image", "Layer", "Filter", "Select", "Copy", "Paste"
+};
+
+static const char* const queries[] = { "op", "save doc", "export image 12", "layr filtr", "window 4242" };
+
+/* add n items to the given submenu, numbered from first */
+static void add_items(struct menu_tree* tree, guint32 menu, unsigned int first, unsigned int n) {
+	unsigned int i;
+	char label[64];
+	for(i = first; i < first + n; i++) {
+		snprintf(label, sizeof(label), "%s _%s %u", words[i % G_N_ELEMENTS(words)],
+			words[(i / G_N_ELEMENTS(words)) % G_N_ELEMENTS(words)], i);
+		menu_tree_append(tree, menu, MENU_NODE_ITEM, -1, label, NULL, NULL, MENU_NODE_ENABLED | MENU_NODE_VISIBLE);
+	}
+}
+
+static guint32 add_menu(struct menu_tree* tree, unsigned int i) {
+	char label[32];
+	snprintf(label, sizeof(label), "_Menu %u", i);
+	return menu_tree_append(tree, MENU_TREE_ROOT, MENU_NODE_SUBMENU, -1, label, NULL, NULL,
+		MENU_NODE_ENABLED | MENU_NODE_VISIBLE);
+}
+
+static size_t heap_used(void) {
+	struct mallinfo2 mi = mallinfo2();
+	return mi.uordblks;
+}
+
+static int cmp_int64(const void* a, const void* b) {
+	gint64 x = *(const gint64*)a;
+	gint64 y = *(const gint64*)b;
+	return (x > y) - (x < y);
+}
+
+static void report_frame(const char* what, gint64 us) {
+	printf("%-8s %9.2f ms (%s a frame)\n", what, us / 1000.0, (us <= FRAME_US) ? "within" : "more than");
+}
+
+/* usage: search_bench [items] [menus] [rounds] */
+int main(int argc, char** argv) {
+	unsigned int n = (argc > 1) ? (unsigned int)strtoul(argv[1], NULL, 10) : 50000;
+	unsigned int n_menus = (argc > 2) ? (unsigned int)strtoul(argv[2], NULL, 10) : 50;
+	unsigned int rounds = (argc > 3) ? (unsigned int)strtoul(argv[3], NULL, 10) : 500;
+	if(!n_menus) n_menus = 1;
+	unsigned int per_menu = MAX(n / n_menus, 1);
+	unsigned int chunk = MAX(per_menu / 4, 1);
+	unsigned int next = 0; /* number of the next item */
+	unsigned int i, j;
+	int ret = 0;
+	
+	/* 1. index an existing tree */
+	struct menu_tree* tree = menu_tree_new();
+	guint32* menus = g_new(guint32, n_menus + 1);
+	for(i = 0; i < n_menus; i++) {
+		menus[i] = add_menu(tree, i);
+		add_items(tree, menus[i], next, per_menu);
+		next += per_menu;
+	}
+	unsigned int expected = n_menus * per_menu;
+	struct menu_search* ms = menu_search_new();
+	gint64 t0 = g_get_monotonic_time();
+	menu_search_add_tree(ms, tree, "bench");
+	gint64 t1 = g_get_monotonic_time();
+	printf("items:   %u in %u menus\n", expected, n_menus);
+	report_frame("index", t1 - t0);
+	
+	/* 2. add as many items again in a new submenu, in one change */
+	menus[n_menus] = add_menu(tree, n_menus);
+	add_items(tree, menus[n_menus], next, expected);
+	next += expected;
+	t0 = g_get_monotonic_time();
+	menu_tree_children_changed(tree, MENU_TREE_ROOT);
+	t1 = g_get_monotonic_time();
+	report_frame("add", t1 - t0);
+	expected *= 2;
+	
+	/* 3. replace some items of a random submenu in each round, without
+	 * searching, so that the index is only compacted when updated */
+	size_t mem0 = heap_used();
+	gint64* times = g_new(gint64, rounds ? rounds : 1);
+	GRand* rnd = g_rand_new_with_seed(12345);
+	for(i = 0; i < rounds; i++) {
+		guint32 menu = menus[g_rand_int_range(rnd, 0, (gint32)n_menus)];
+		for(j = 0; j < chunk; j++) {
+			const struct menu_node* m = menu_tree_get_node(tree, menu);
+			if(m->first_child == MENU_TREE_NONE) break;
+			menu_tree_remove(tree, m->first_child);
+		}
+		add_items(tree, menu, next, j);
+		next += j;
+		t0 = g_get_monotonic_time();
+		menu_tree_children_changed(tree, menu);
+		times[i] = g_get_monotonic_time() - t0;
+	}
+	size_t mem1 = heap_used();
+	g_rand_free(rnd);
+	if(rounds) {
+		qsort(times, rounds, sizeof(gint64), cmp_int64);
+		printf("replace: %u rounds of %u items, median %.3f ms, max %.3f ms, heap %+.1f MiB\n", rounds, chunk,
+			times[rounds / 2] / 1000.0, times[rounds - 1] / 1000.0, ((double)mem1 - (double)mem0) / 1048576.0);
+	}
+	g_free(times);
+	if(menu_search_get_n_items(ms) != expected) {
+		fprintf(stderr, "%u items indexed instead of %u!\n", menu_search_get_n_items(ms), expected);
+		ret = 1;
+	}
+	
+	/* 4. searching */
+	struct menu_search_result results[20];
+	for(i = 0; i < G_N_ELEMENTS(queries); i++) {
+		t0 = g_get_monotonic_time();
+		guint found = menu_search_query(ms, queries[i], results, G_N_ELEMENTS(results));
+		t1 = g_get_monotonic_time();
+		printf("query:   %-16s %2u results in %7.3f ms\n", queries[i], found, (t1 - t0) / 1000.0);
+	}
+	
+	menu_search_remove_tree(ms, tree);
+	menu_search_free(ms);
+	menu_tree_free(tree);
+	g_free(menus);
+	return ret;
+}
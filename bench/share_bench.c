@@ -0,0 +1,218 @@
+/*
+ * share_bench.c -- cost of sharing toplevels with other processes
+ * 
+ * Copyright 2025 Daniel Kondor <kondor.dani@gmail.com>
+ * 
+ * This is free and unencumbered software released into the public domain.
+ * 
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ * 
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <wayland-client.h>
+#include <glib.h>
+#include <foreign_toplevel.h>
+#include <toplevel_share.h>
+#include "standin.h"
+
+
+/* a client of the share, with its own thread and main context */
+struct reader {
+	const char* path;
+	GThread* thread;
+	GMainContext* context;
+	GMainLoop* loop;
+	struct toplevel_share_client* c;
+	gint ready;        /* connected (1) or failed (-1) */
+	unsigned long wakeups;
+	unsigned long failed;  /* reads that did not succeed */
+	unsigned long errors;  /* inconsistent snapshots seen */
+	guint64 serial;
+	/* result of the current read */
+	unsigned int bad;
+};
+
+static void reader_read(void* data, const struct toplevel_share_view* view) {
+	struct reader* r = (struct reader*)data;
+	struct toplevel_snapshot_entry e;
+	unsigned int i;
+	r->bad = 0;
+	/* note: the stand-in annotates all toplevels, with parents created earlier */
+	for(i = 0; i < view->n_toplevels; i++)
+		if(!(toplevel_share_view_get(view, i, &e) && e.props.app_id && e.parent <= e.id)) r->bad++;
+	if(view->serial < r->serial) r->bad++;
+	r->serial = view->serial;
+}
+
+static void reader_cb(void* data, struct toplevel_share_client* c) {
+	struct reader* r = (struct reader*)data;
+	r->wakeups++;
+	if(!toplevel_share_client_read(c, reader_read, r)) r->failed++;
+	else if(r->bad) r->errors++;
+}
+
+static gpointer reader_thread(gpointer data) {
+	struct reader* r = (struct reader*)data;
+	GError* err = NULL;
+	g_main_context_push_thread_default(r->context);
+	r->c = toplevel_share_client_new(r->path, r->context, reader_cb, r, &err);
+	if(!r->c) {
+		fprintf(stderr, "%s\n", err->message);
+		g_error_free(err);
+		g_atomic_int_set(&(r->ready), -1);
+	}
+	else {
+		g_atomic_int_set(&(r->ready), 1);
+		g_main_loop_run(r->loop);
+		toplevel_share_client_free(r->c);
+	}
+	g_main_context_pop_thread_default(r->context);
+	return NULL;
+}
+
+/* run the activation storm while sharing with n_clients clients (or not sharing at all) */
+static int run(const char* path, unsigned int n, unsigned int n_act, int sharing, unsigned int n_clients) {
+	struct standin* s = standin_new();
+	if(!s) return 0;
+	struct wl_display* dpy = wl_display_connect_to_fd(standin_get_client_fd(s));
+	if(!dpy) {
+		fprintf(stderr, "Cannot connect to the stand-in!\n");
+		standin_free(s);
+		return 0;
+	}
+	struct toplevel_manager* gr = toplevel_manager_new_for_display(dpy);
+	if(!gr) {
+		wl_display_disconnect(dpy);
+		standin_free(s);
+		return 0;
+	}
+	standin_create_toplevels(s, n, 4, 1);
+	standin_pump(s, dpy);
+	
+	struct toplevel_share* share = NULL;
+	struct reader* readers = g_new0(struct reader, n_clients ? n_clients : 1);
+	unsigned int i, connected = 0;
+	int ret = 1;
+	if(sharing) {
+		GError* err = NULL;
+		share = toplevel_share_new(gr, path, &err);
+		if(!share) {
+			fprintf(stderr, "%s\n", err->message);
+			g_error_free(err);
+			ret = 0;
+			n_clients = 0;
+		}
+	}
+	for(i = 0; i < n_clients; i++) {
+		struct reader* r = &(readers[i]);
+		r->path = path;
+		r->context = g_main_context_new();
+		r->loop = g_main_loop_new(r->context, FALSE);
+		r->thread = g_thread_new("share-client", reader_thread, r);
+	}
+	/* note: connections are accepted on our main context */
+	for(i = 0; i < n_clients; ) {
+		g_main_context_iteration(NULL, FALSE);
+		int ready = g_atomic_int_get(&(readers[i].ready));
+		if(ready) {
+			if(ready > 0) connected++;
+			i++;
+		}
+		else g_usleep(100);
+	}
+	while(toplevel_share_get_n_clients(share) < connected) g_main_context_iteration(NULL, TRUE);
+	
+	unsigned int* ids = g_new(unsigned int, n_act ? n_act : 1);
+	uint32_t rnd = 12345;
+	standin_random_ids(ids, n_act, n, &rnd);
+	unsigned long ev0 = standin_get_events_sent(s);
+	int64_t t0 = standin_now_ns();
+	standin_activate(s, ids, n_act);
+	standin_pump(s, dpy);
+	int64_t t1 = standin_now_ns();
+	unsigned long events = standin_get_events_sent(s) - ev0;
+	g_free(ids);
+	
+	/* let the clients catch up before stopping them */
+	g_usleep(100000);
+	unsigned long wakeups = 0, failed = 0, errors = 0;
+	for(i = 0; i < n_clients; i++) {
+		struct reader* r = &(readers[i]);
+		g_main_loop_quit(r->loop);
+		g_thread_join(r->thread);
+		g_main_loop_unref(r->loop);
+		g_main_context_unref(r->context);
+		wakeups += r->wakeups;
+		failed += r->failed;
+		errors += r->errors;
+	}
+	
+	if(!sharing) printf("no sharing: ");
+	else printf("%3u clients:", connected);
+	printf(" %8lu events in %8.2f ms (%.0f events/s)", events, (t1 - t0) / 1e6,
+		(t1 > t0) ? events * 1e9 / (t1 - t0) : 0.0);
+	if(connected) printf(", %.0f reads per client (%lu failed, %lu inconsistent)",
+		(double)wakeups / connected, failed, errors);
+	printf("\n");
+	if(errors) ret = 0;
+	
+	toplevel_share_free(share);
+	g_free(readers);
+	toplevel_manager_free(gr);
+	wl_display_roundtrip(dpy);
+	wl_display_disconnect(dpy);
+	standin_free(s);
+	return ret;
+}
+
+/*
+ * usage: share_bench [toplevels] [activations] [max clients]
+ * Compares processing activations without sharing them, and while
+ * sharing them with 0, 1, 4, ... clients.
+ */
+int main(int argc, char** argv) {
+	unsigned int n = (argc > 1) ? (unsigned int)strtoul(argv[1], NULL, 10) : 500;
+	unsigned int n_act = (argc > 2) ? (unsigned int)strtoul(argv[2], NULL, 10) : 5000;
+	unsigned int max_clients = (argc > 3) ? (unsigned int)strtoul(argv[3], NULL, 10) : 64;
+	if(!n) n = 1;
+	
+	char* dir = g_dir_make_tmp("share_bench_XXXXXX", NULL);
+	if(!dir) {
+		fprintf(stderr, "Cannot create a temporary directory!\n");
+		return 1;
+	}
+	char* path = g_build_filename(dir, "socket", NULL);
+	int ret = run(path, n, n_act, 0, 0);
+	unsigned int k;
+	for(k = 0; ret && k <= max_clients; k = k ? 4 * k : 1) ret = run(path, n, n_act, 1, k);
+	g_free(path);
+	rmdir(dir);
+	g_free(dir);
+	return ret ? 0 : 1;
+}
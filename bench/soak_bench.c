@@ -0,0 +1,300 @@
+/*
+ * soak_bench.c -- long-running test of opening and closing toplevels
+ * 
+ * Copyright 2025 Daniel Kondor <kondor.dani@gmail.com>
+ * 
+ * This is free and unencumbered software released into the public domain.
+ * 
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ * 
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <wayland-client.h>
+#include <glib.h>
+#include <gio/gio.h>
+#include <foreign_toplevel.h>
+#include <menu_cache.h>
+#include "standin.h"
+
+/* allowed growth after the warmup; note: some growth is expected from
+ * fragmentation of the heap, this should only catch steady leaks */
+#define SOAK_MAX_HEAP_GROWTH (256 * 1024)
+#define SOAK_MAX_RSS_GROWTH (4 * 1024 * 1024)
+
+/* the manager is freed and created again after this many cycles */
+#define SOAK_RECREATE 1000
+
+/* number of recent apps whose menus are prefetched when testing with
+ * menus; this is more than what fits in the default budget */
+#define SOAK_PREFETCH 16
+
+/* time to wait for the manager to release everything after closing
+ * all toplevels (in microseconds) */
+#define SOAK_SETTLE_TIMEOUT 1000000
+
+
+/* variants of the test, all run one after the other */
+enum soak_mode {
+	SOAK_PLAIN,    /* events dispatched by us */
+	SOAK_THREADED, /* with TOPLEVEL_MANAGER_THREADED */
+	SOAK_MENUS     /* menu proxies acquired for the active and recent apps */
+};
+
+static const char* const soak_mode_names[] = { "plain", "threaded", "menus" };
+
+struct soak {
+	struct standin* s;
+	struct wl_display* dpy;
+	struct toplevel_manager* gr;
+	struct menu_cache* cache; /* only for SOAK_MENUS */
+	enum soak_mode mode;
+	size_t budget;
+	unsigned long callbacks;
+};
+
+static void active_cb(void* data, struct toplevel_manager* gr) {
+	struct soak* x = (struct soak*)data;
+	x->callbacks++;
+	/* note: this is how the main program gets the menu of the active app */
+	if(x->cache) {
+		toplevel_manager_get_menu_model(gr);
+		toplevel_manager_get_app_actions(gr);
+		toplevel_manager_get_window_actions(gr);
+	}
+}
+
+static int manager_start(struct soak* x) {
+	x->gr = toplevel_manager_new_full(x->dpy, (x->mode == SOAK_THREADED) ? TOPLEVEL_MANAGER_THREADED : 0);
+	if(!x->gr) return 0;
+	toplevel_manager_set_callback(x->gr, active_cb, x);
+	toplevel_manager_set_memory_budget(x->gr, x->budget);
+	if(x->cache) {
+		toplevel_manager_set_menu_cache(x->gr, x->cache);
+		toplevel_manager_set_prefetch(x->gr, SOAK_PREFETCH);
+	}
+	return 1;
+}
+
+/* add the counters of the current manager to total and free it */
+static void manager_stop(struct soak* x, struct toplevel_manager_stats* total) {
+	struct toplevel_manager_stats st;
+	toplevel_manager_get_stats(x->gr, &st);
+	total->activations += st.activations;
+	total->callbacks += st.callbacks;
+	total->evictions += st.evictions;
+	total->dropped += st.dropped;
+	toplevel_manager_free(x->gr);
+	x->gr = NULL;
+	/* process the finished event */
+	wl_display_roundtrip(x->dpy);
+}
+
+/* run the callbacks, menu prefetching and releasing proxies on the main context */
+static void run_idle(void) {
+	while(g_main_context_iteration(NULL, FALSE));
+}
+
+/* wait until the manager released all toplevels and menu proxies after
+ * they were closed; in threaded mode, events are processed on its thread
+ * and proxies are released on the main context, so this can take a while */
+static void manager_settle(struct soak* x, struct toplevel_manager_stats* st) {
+	gint64 end = g_get_monotonic_time() + SOAK_SETTLE_TIMEOUT;
+	while(1) {
+		run_idle();
+		toplevel_manager_get_stats(x->gr, st);
+		if(!(st->strings || st->menus) || g_get_monotonic_time() > end) break;
+		g_usleep(100);
+	}
+	/* make sure that the stand-in processed the requests destroying the handles */
+	wl_display_roundtrip(x->dpy);
+}
+
+static size_t rss(void) {
+	unsigned long size, resident;
+	FILE* f = fopen("/proc/self/statm", "r");
+	if(!f) return 0;
+	int ret = fscanf(f, "%lu %lu", &size, &resident);
+	fclose(f);
+	return (ret == 2) ? resident * (size_t)sysconf(_SC_PAGESIZE) : 0;
+}
+
+/* run the given number of cycles with a new manager; returns whether
+ * everything was released and memory use was flat */
+static int soak_run(struct soak* x, unsigned int cycles, unsigned int n, unsigned int n_act) {
+	unsigned int warmup = cycles / 10;
+	if(!warmup) warmup = 1;
+	if(!manager_start(x)) return 0;
+	
+	struct toplevel_manager_stats total;
+	memset(&total, 0, sizeof(total));
+	unsigned int* ids = g_new(unsigned int, n_act ? n_act : 1);
+	uint32_t rnd = 12345;
+	size_t heap0 = 0, rss0 = 0, rss_max = 0;
+	unsigned long leaked = 0; /* cycles after which handles were left */
+	unsigned long unreleased = 0; /* cycles after which strings or menus were left */
+	unsigned int menus_max = 0;
+	unsigned long ev0 = standin_get_events_sent(x->s);
+	int64_t t0 = standin_now_ns();
+	unsigned int i;
+	
+	for(i = 0; i < cycles; i++) {
+		standin_create_toplevels(x->s, n, 4, 1);
+		standin_pump(x->s, x->dpy);
+		standin_random_ids(ids, n_act, n, &rnd);
+		standin_activate(x->s, ids, n_act);
+		standin_pump(x->s, x->dpy);
+		run_idle();
+		
+		struct toplevel_manager_stats st;
+		toplevel_manager_get_stats(x->gr, &st);
+		if(st.menus > menus_max) menus_max = st.menus;
+		
+		standin_close_all(x->s);
+		standin_pump(x->s, x->dpy);
+		manager_settle(x, &st);
+		if(standin_get_live_handles(x->s)) leaked++;
+		if(st.strings || st.menus) unreleased++;
+		
+		if((i + 1) % SOAK_RECREATE == 0) {
+			manager_stop(x, &total);
+			if(!manager_start(x)) {
+				fprintf(stderr, "Cannot create the manager again after %u cycles!\n", i + 1);
+				break;
+			}
+		}
+		
+		if(i + 1 == warmup) {
+			heap0 = standin_heap_used();
+			rss0 = rss();
+		}
+		if(i + 1 >= warmup) {
+			size_t r = rss();
+			if(r > rss_max) rss_max = r;
+		}
+	}
+	
+	int64_t t1 = standin_now_ns();
+	unsigned long events = standin_get_events_sent(x->s) - ev0;
+	size_t heap1 = standin_heap_used();
+	size_t rss1 = rss();
+	if(x->gr) manager_stop(x, &total);
+	g_free(ids);
+	unsigned int live = standin_get_live_handles(x->s);
+	
+	printf("%s:\n", soak_mode_names[x->mode]);
+	printf("cycles:    %u of %u toplevels, %u activations (%lu toplevels opened)\n",
+		i, n, n_act, (unsigned long)i * n);
+	printf("events:    %lu in %.2f s (%.0f events/s)\n", events, (t1 - t0) / 1e9,
+		(t1 > t0) ? events * 1e9 / (t1 - t0) : 0.0);
+	printf("callbacks: %lu for %lu activations\n", total.callbacks, total.activations);
+	printf("heap:      %zu bytes after warmup, %zu at the end (%+ld)\n",
+		heap0, heap1, (long)heap1 - (long)heap0);
+	printf("rss:       %zu KiB after warmup, %zu KiB at the end (%+ld KiB), %zu KiB max\n",
+		rss0 / 1024, rss1 / 1024, ((long)rss1 - (long)rss0) / 1024, rss_max / 1024);
+	printf("handles:   %u live at the end, left after %lu cycles\n", live, leaked);
+	printf("released:  strings or menu proxies left after %lu cycles\n", unreleased);
+	printf("budget:    %zu KiB, %u menu proxies held at most, %lu released, %lu toplevels dropped\n",
+		x->budget / 1024, menus_max, total.evictions, total.dropped);
+	
+	int ret = 1;
+	if(i < cycles) ret = 0;
+	if(live || leaked || unreleased) {
+		fprintf(stderr, "Toplevels were not released!\n");
+		ret = 0;
+	}
+	if(heap1 > heap0 + SOAK_MAX_HEAP_GROWTH || rss1 > rss0 + SOAK_MAX_RSS_GROWTH) {
+		fprintf(stderr, "Memory use was not flat!\n");
+		ret = 0;
+	}
+	/* note: prefetching asks for more menus than fit in the budget */
+	if(x->cache && x->budget && !total.evictions) {
+		fprintf(stderr, "The memory budget was not enforced!\n");
+		ret = 0;
+	}
+	return ret;
+}
+
+/*
+ * usage: soak_bench [cycles] [toplevels] [activations] [budget]
+ * Each cycle opens the given number of toplevels (with D-Bus annotations),
+ * activates them in a random order and closes them. This is done with
+ * events processed on the main thread, then on a separate thread, and
+ * then with menu proxies created on a private bus (the bus names in the
+ * annotations have no owners, so proxies are not fetching anything). The
+ * memory budget of the manager is given in KiB.
+ */
+int main(int argc, char** argv) {
+	unsigned int cycles = (argc > 1) ? (unsigned int)strtoul(argv[1], NULL, 10) : 20000;
+	unsigned int n = (argc > 2) ? (unsigned int)strtoul(argv[2], NULL, 10) : 50;
+	unsigned int n_act = (argc > 3) ? (unsigned int)strtoul(argv[3], NULL, 10) : 100;
+	size_t budget = (argc > 4) ? (size_t)strtoul(argv[4], NULL, 10) * 1024 : 256 * 1024;
+	if(!n) n = 1;
+	
+	struct soak x;
+	memset(&x, 0, sizeof(x));
+	x.budget = budget;
+	x.s = standin_new();
+	if(!x.s) return 1;
+	x.dpy = wl_display_connect_to_fd(standin_get_client_fd(x.s));
+	if(!x.dpy) {
+		fprintf(stderr, "Cannot connect to the stand-in!\n");
+		standin_free(x.s);
+		return 1;
+	}
+	
+	int ret = soak_run(&x, cycles, n, n_act);
+	x.mode = SOAK_THREADED;
+	if(ret) ret = soak_run(&x, cycles, n, n_act);
+	
+	if(ret) {
+		/* private bus -- this sets DBUS_SESSION_BUS_ADDRESS for us */
+		GTestDBus* test_bus = g_test_dbus_new(G_TEST_DBUS_NONE);
+		g_test_dbus_up(test_bus);
+		GError* err = NULL;
+		GDBusConnection* conn = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, &err);
+		if(conn) {
+			x.mode = SOAK_MENUS;
+			x.cache = menu_cache_new(conn);
+			ret = soak_run(&x, cycles, n, n_act);
+			menu_cache_free(x.cache);
+			x.cache = NULL;
+			g_object_unref(conn);
+		}
+		else {
+			fprintf(stderr, "Cannot connect to DBus: %s\n", err->message);
+			g_error_free(err);
+			ret = 0;
+		}
+		g_test_dbus_down(test_bus);
+		g_object_unref(test_bus);
+	}
+	
+	wl_display_disconnect(x.dpy);
+	standin_free(x.s);
+	return ret ? 0 : 1;
+}
@@ -0,0 +1,690 @@
+/*
+ * standin.c -- minimal in-process stand-in for a compositor supporting wlr-foreign-toplevel
+ * 
+ * Copyright 2025 Daniel Kondor <kondor.dani@gmail.com>
+ * 
+ * This is free and unencumbered software released into the public domain.
+ * 
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ * 
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <malloc.h>
+#include <sys/socket.h>
+#include <wayland-server.h>
+#include <wayland-client-core.h>
+#include <glib.h>
+#include "wlr-foreign-toplevel-management-unstable-v1-server-protocol.h"
+#include "standin.h"
+#include <toplevel_trace.h>
+
+
+enum standin_cmd {
+	STANDIN_CMD_NONE,
+	STANDIN_CMD_CREATE,
+	STANDIN_CMD_ACTIVATE,
+	STANDIN_CMD_MOVE,
+	STANDIN_CMD_CLOSE_ALL,
+	STANDIN_CMD_REPLAY,
+	STANDIN_CMD_QUIT
+};
+
+struct standin_toplevel {
+	struct standin* s;
+	struct wl_resource* resource;
+	unsigned int root;
+	int parent; /* index of the parent or -1 */
+	int output; /* index of the output it is on or -1 */
+	int closed; /* removed from toplevels, freed when its resource is destroyed */
+};
+
+/* an output and the client's resource for it (if bound) */
+struct standin_output {
+	struct wl_global* global;
+	struct wl_resource* resource;
+};
+
+struct standin {
+	struct wl_display* display;
+	struct wl_global* global;
+	struct wl_client* client;
+	struct wl_resource* manager;
+	struct standin_output outputs[STANDIN_N_OUTPUTS];
+	unsigned int next_output; /* for the next parent chain created */
+	int client_fd;
+	int cmd_pipe[2];
+	GThread* thread;
+	
+	/* everything below is protected by lock */
+	GMutex lock;
+	GCond cond;
+	int busy;
+	enum standin_cmd cmd;
+	unsigned int n;
+	unsigned int chain_len;
+	int annotate;
+	unsigned int* ids;
+	struct toplevel_trace_reader* trace;
+	
+	GPtrArray* toplevels; /* struct standin_toplevel* */
+	GArray* activation_ns; /* int64_t, indexed by root */
+	unsigned long events;
+	unsigned int live_handles;
+	int active; /* index of the active toplevel or -1 */
+};
+
+
+/* requests from the client -- we do not care about these */
+
+static void handle_noop(G_GNUC_UNUSED struct wl_client* client, G_GNUC_UNUSED struct wl_resource* resource) {
+}
+
+static void handle_activate(G_GNUC_UNUSED struct wl_client* client, G_GNUC_UNUSED struct wl_resource* resource,
+		G_GNUC_UNUSED struct wl_resource* seat) {
+}
+
+static void handle_set_rectangle(G_GNUC_UNUSED struct wl_client* client, G_GNUC_UNUSED struct wl_resource* resource,
+		G_GNUC_UNUSED struct wl_resource* surface, G_GNUC_UNUSED int32_t x, G_GNUC_UNUSED int32_t y,
+		G_GNUC_UNUSED int32_t width, G_GNUC_UNUSED int32_t height) {
+}
+
+static void handle_set_fullscreen(G_GNUC_UNUSED struct wl_client* client, G_GNUC_UNUSED struct wl_resource* resource,
+		G_GNUC_UNUSED struct wl_resource* output) {
+}
+
+static void handle_destroy(G_GNUC_UNUSED struct wl_client* client, struct wl_resource* resource) {
+	wl_resource_destroy(resource);
+}
+
+static const struct zwlr_foreign_toplevel_handle_v1_interface handle_impl = {
+	.set_maximized    = handle_noop,
+	.unset_maximized  = handle_noop,
+	.set_minimized    = handle_noop,
+	.unset_minimized  = handle_noop,
+	.activate         = handle_activate,
+	.close            = handle_noop,
+	.set_rectangle    = handle_set_rectangle,
+	.destroy          = handle_destroy,
+	.set_fullscreen   = handle_set_fullscreen,
+	.unset_fullscreen = handle_noop,
+};
+
+static void handle_resource_destroy(struct wl_resource* resource) {
+	struct standin_toplevel* tl = (struct standin_toplevel*)wl_resource_get_user_data(resource);
+	if(!tl) return;
+	tl->resource = NULL;
+	g_mutex_lock(&(tl->s->lock));
+	tl->s->live_handles--;
+	g_mutex_unlock(&(tl->s->lock));
+	if(tl->closed) g_free(tl);
+}
+
+static void manager_stop(G_GNUC_UNUSED struct wl_client* client, struct wl_resource* resource) {
+	zwlr_foreign_toplevel_manager_v1_send_finished(resource);
+	wl_resource_destroy(resource);
+}
+
+static const struct zwlr_foreign_toplevel_manager_v1_interface manager_impl = {
+	.stop = manager_stop,
+};
+
+static void manager_resource_destroy(struct wl_resource* resource) {
+	struct standin* s = (struct standin*)wl_resource_get_user_data(resource);
+	if(s && s->manager == resource) s->manager = NULL;
+}
+
+static void manager_bind(struct wl_client* client, void* data, uint32_t version, uint32_t id) {
+	struct standin* s = (struct standin*)data;
+	struct wl_resource* resource = wl_resource_create(client,
+		&zwlr_foreign_toplevel_manager_v1_interface, (int)version, id);
+	if(!resource) {
+		wl_client_post_no_memory(client);
+		return;
+	}
+	wl_resource_set_implementation(resource, &manager_impl, s, manager_resource_destroy);
+	/* we only support one client and one instance */
+	s->manager = resource;
+}
+
+static const struct wl_output_interface output_impl = {
+	.release = handle_destroy,
+};
+
+static void output_resource_destroy(struct wl_resource* resource) {
+	struct standin_output* o = (struct standin_output*)wl_resource_get_user_data(resource);
+	if(o && o->resource == resource) o->resource = NULL;
+}
+
+static void output_bind(struct wl_client* client, void* data, uint32_t version, uint32_t id) {
+	struct standin_output* o = (struct standin_output*)data;
+	struct wl_resource* resource = wl_resource_create(client, &wl_output_interface, (int)version, id);
+	if(!resource) {
+		wl_client_post_no_memory(client);
+		return;
+	}
+	wl_resource_set_implementation(resource, &output_impl, o, output_resource_destroy);
+	/* note: the geometry and modes do not matter for toplevels */
+	if(version >= WL_OUTPUT_DONE_SINCE_VERSION) wl_output_send_done(resource);
+	o->resource = resource;
+}
+
+
+/* generating events -- these run on the stand-in's thread */
+
+static unsigned long send_state(struct wl_resource* resource, int activated) {
+	struct wl_array state;
+	wl_array_init(&state);
+	if(activated) {
+		uint32_t* st = (uint32_t*)wl_array_add(&state, sizeof(uint32_t));
+		if(st) *st = ZWLR_FOREIGN_TOPLEVEL_HANDLE_V1_STATE_ACTIVATED;
+	}
+	zwlr_foreign_toplevel_handle_v1_send_state(resource, &state);
+	zwlr_foreign_toplevel_handle_v1_send_done(resource);
+	wl_array_release(&state);
+	return 2;
+}
+
+/* move a toplevel to the given output (-1 for none) if the client bound
+ * it; this has to be followed by a done event */
+static unsigned long set_output(struct standin* s, struct standin_toplevel* tl, int output) {
+	unsigned long events = 0;
+	if(!tl->resource || tl->output == output) return 0;
+	if(tl->output >= 0 && s->outputs[tl->output].resource) {
+		zwlr_foreign_toplevel_handle_v1_send_output_leave(tl->resource, s->outputs[tl->output].resource);
+		events++;
+	}
+	if(output >= 0 && s->outputs[output].resource) {
+		zwlr_foreign_toplevel_handle_v1_send_output_enter(tl->resource, s->outputs[output].resource);
+		events++;
+	}
+	tl->output = output;
+	return events;
+}
+
+/* add a new toplevel with the given parent (index or -1) and announce
+ * it to the client; its resource is NULL if this was not possible */
+static struct standin_toplevel* add_toplevel(struct standin* s, int parent_idx) {
+	struct standin_toplevel* tl = g_new0(struct standin_toplevel, 1);
+	tl->s = s;
+	tl->output = -1;
+	
+	g_mutex_lock(&(s->lock));
+	unsigned int idx = s->toplevels->len;
+	tl->parent = parent_idx;
+	if(parent_idx >= 0) {
+		struct standin_toplevel* parent = (struct standin_toplevel*)g_ptr_array_index(s->toplevels, parent_idx);
+		tl->root = parent->root;
+	}
+	else tl->root = idx;
+	g_ptr_array_add(s->toplevels, tl);
+	if(s->activation_ns->len <= idx) g_array_set_size(s->activation_ns, idx + 1);
+	g_mutex_unlock(&(s->lock));
+	
+	if(!s->manager) return tl;
+	tl->resource = wl_resource_create(s->client, &zwlr_foreign_toplevel_handle_v1_interface,
+		wl_resource_get_version(s->manager), 0);
+	if(!tl->resource) return tl;
+	wl_resource_set_implementation(tl->resource, &handle_impl, tl, handle_resource_destroy);
+	g_mutex_lock(&(s->lock));
+	s->live_handles++;
+	g_mutex_unlock(&(s->lock));
+	zwlr_foreign_toplevel_manager_v1_send_toplevel(s->manager, tl->resource);
+	return tl;
+}
+
+static unsigned long create_toplevels(struct standin* s, unsigned int n, unsigned int chain_len, int annotate) {
+	unsigned long events = 0;
+	unsigned int i;
+	if(!chain_len) chain_len = 1;
+	for(i = 0; i < n; i++) {
+		unsigned int idx = s->toplevels->len;
+		struct standin_toplevel* tl = add_toplevel(s, (i % chain_len) ? (int)idx - 1 : -1);
+		if(!tl->resource) continue;
+		struct standin_toplevel* parent = (tl->parent >= 0) ?
+			(struct standin_toplevel*)g_ptr_array_index(s->toplevels, tl->parent) : NULL;
+		
+		char app_id[64];
+		char bus_name[32];
+		char path[96];
+		snprintf(app_id, sizeof(app_id), "bench.app.%u", tl->root);
+		snprintf(bus_name, sizeof(bus_name), ":1.%u", tl->root + 100);
+		
+		zwlr_foreign_toplevel_handle_v1_send_title(tl->resource, app_id);
+		zwlr_foreign_toplevel_handle_v1_send_app_id(tl->resource, app_id);
+		events += 3;
+		if(parent && parent->resource) {
+			zwlr_foreign_toplevel_handle_v1_send_parent(tl->resource, parent->resource);
+			events++;
+		}
+		if(annotate) {
+			zwlr_foreign_toplevel_handle_v1_send_client_dbus_annotation(tl->resource,
+				"org.gtk.Actions", bus_name, "/org/gtk/Application/anonymous");
+			snprintf(path, sizeof(path), "/org/appmenu/gtk/window/%u", idx);
+			zwlr_foreign_toplevel_handle_v1_send_surface_dbus_annotation(tl->resource,
+				"org.gtk.Menus", bus_name, path);
+			snprintf(path, sizeof(path), "/org/gtk/Application/anonymous/window/%u", idx);
+			zwlr_foreign_toplevel_handle_v1_send_surface_dbus_annotation(tl->resource,
+				"org.gtk.Actions", bus_name, path);
+			snprintf(path, sizeof(path), "/MenuBar/%u", idx);
+			zwlr_foreign_toplevel_handle_v1_send_surface_dbus_annotation(tl->resource,
+				"com.canonical.dbusmenu", bus_name, path);
+			events += 4;
+		}
+		/* parent chains are put on the outputs in turn */
+		int output = parent ? parent->output : (int)s->next_output;
+		if(!parent) s->next_output = (s->next_output + 1) % STANDIN_N_OUTPUTS;
+		events += set_output(s, tl, output);
+		events += send_state(tl->resource, 0);
+	}
+	return events;
+}
+
+static unsigned long activate(struct standin* s, const unsigned int* ids, unsigned int n) {
+	unsigned long events = 0;
+	unsigned int i;
+	for(i = 0; i < n; i++) {
+		if(ids[i] >= s->toplevels->len) continue;
+		struct standin_toplevel* tl = (struct standin_toplevel*)g_ptr_array_index(s->toplevels, ids[i]);
+		if(!tl->resource) continue;
+		if(s->active >= 0 && s->active != (int)ids[i]) {
+			struct standin_toplevel* prev = (struct standin_toplevel*)g_ptr_array_index(s->toplevels, s->active);
+			if(prev->resource) events += send_state(prev->resource, 0);
+		}
+		g_mutex_lock(&(s->lock));
+		g_array_index(s->activation_ns, int64_t, tl->root) = standin_now_ns();
+		g_mutex_unlock(&(s->lock));
+		events += send_state(tl->resource, 1);
+		s->active = (int)ids[i];
+		/* send each activation separately, as a compositor would */
+		wl_client_flush(s->client);
+	}
+	return events;
+}
+
+static unsigned long move(struct standin* s, const unsigned int* ids, unsigned int n, unsigned int output) {
+	unsigned long events = 0;
+	unsigned int i;
+	if(output >= STANDIN_N_OUTPUTS) return 0;
+	for(i = 0; i < n; i++) {
+		if(ids[i] >= s->toplevels->len) continue;
+		struct standin_toplevel* tl = (struct standin_toplevel*)g_ptr_array_index(s->toplevels, ids[i]);
+		unsigned long moved = set_output(s, tl, (int)output);
+		if(!moved) continue;
+		zwlr_foreign_toplevel_handle_v1_send_done(tl->resource);
+		events += moved + 1;
+	}
+	return events;
+}
+
+static unsigned long close_all(struct standin* s) {
+	unsigned long events = 0;
+	unsigned int i;
+	/* close children before their parents */
+	for(i = s->toplevels->len; i > 0; i--) {
+		struct standin_toplevel* tl = (struct standin_toplevel*)g_ptr_array_index(s->toplevels, i - 1);
+		if(tl->resource) {
+			zwlr_foreign_toplevel_handle_v1_send_closed(tl->resource);
+			events++;
+		}
+	}
+	/* forget all toplevels, so that a long run does not accumulate them;
+	 * ones still known to the client are freed once it destroys them */
+	g_mutex_lock(&(s->lock));
+	for(i = s->toplevels->len; i > 0; i--) {
+		struct standin_toplevel* tl = (struct standin_toplevel*)g_ptr_array_steal_index_fast(s->toplevels, i - 1);
+		if(tl->resource) tl->closed = 1;
+		else g_free(tl);
+	}
+	g_array_set_size(s->activation_ns, 0);
+	g_mutex_unlock(&(s->lock));
+	s->active = -1;
+	s->next_output = 0;
+	return events;
+}
+
+/* send the events of a trace, mapping its toplevel IDs to new toplevels */
+static unsigned long replay(struct standin* s, struct toplevel_trace_reader* trace, int paced) {
+	unsigned long events = 0;
+	GPtrArray* map = g_ptr_array_new(); /* trace ID -> struct standin_toplevel* */
+	struct toplevel_trace_event ev;
+	int64_t start = standin_now_ns();
+	unsigned int i;
+	int ret;
+	
+	toplevel_trace_reader_rewind(trace);
+	while((ret = toplevel_trace_reader_next(trace, &ev)) > 0) {
+		if(paced) {
+			int64_t wait = start + ev.time_us * 1000 - standin_now_ns();
+			if(wait > 0) {
+				wl_client_flush(s->client);
+				g_usleep(wait / 1000);
+			}
+		}
+		if(ev.type == TOPLEVEL_TRACE_TOPLEVEL) {
+			if(ev.toplevel >= map->len) g_ptr_array_set_size(map, ev.toplevel + 1);
+			/* note: parents are sent separately, so all toplevels are roots here */
+			struct standin_toplevel* tl = add_toplevel(s, -1);
+			g_ptr_array_index(map, ev.toplevel) = tl;
+			if(tl->resource) events++;
+			continue;
+		}
+		
+		struct standin_toplevel* tl = (ev.toplevel < map->len) ?
+			(struct standin_toplevel*)g_ptr_array_index(map, ev.toplevel) : NULL;
+		if(!(tl && tl->resource)) continue;
+		struct standin_toplevel* parent = NULL;
+		struct standin_output* output = NULL;
+		struct wl_array state;
+		switch(ev.type) {
+			case TOPLEVEL_TRACE_TITLE:
+				zwlr_foreign_toplevel_handle_v1_send_title(tl->resource, ev.str[0] ? ev.str[0] : "");
+				break;
+			case TOPLEVEL_TRACE_APP_ID:
+				zwlr_foreign_toplevel_handle_v1_send_app_id(tl->resource, ev.str[0] ? ev.str[0] : "");
+				break;
+			case TOPLEVEL_TRACE_STATE:
+				wl_array_init(&state);
+				for(i = 0; i < ev.n_states; i++) {
+					uint32_t* st = (uint32_t*)wl_array_add(&state, sizeof(uint32_t));
+					if(st) *st = ev.states[i];
+					if(ev.states[i] == ZWLR_FOREIGN_TOPLEVEL_HANDLE_V1_STATE_ACTIVATED) {
+						g_mutex_lock(&(s->lock));
+						g_array_index(s->activation_ns, int64_t, tl->root) = standin_now_ns();
+						g_mutex_unlock(&(s->lock));
+					}
+				}
+				zwlr_foreign_toplevel_handle_v1_send_state(tl->resource, &state);
+				wl_array_release(&state);
+				break;
+			case TOPLEVEL_TRACE_PARENT:
+				if(ev.parent && ev.parent <= map->len)
+					parent = (struct standin_toplevel*)g_ptr_array_index(map, ev.parent - 1);
+				if(ev.parent && !(parent && parent->resource)) continue;
+				zwlr_foreign_toplevel_handle_v1_send_parent(tl->resource, parent ? parent->resource : NULL);
+				break;
+			case TOPLEVEL_TRACE_CLIENT_ANNOTATION:
+				zwlr_foreign_toplevel_handle_v1_send_client_dbus_annotation(tl->resource,
+					ev.str[0], ev.str[1], ev.str[2]);
+				break;
+			case TOPLEVEL_TRACE_SURFACE_ANNOTATION:
+				zwlr_foreign_toplevel_handle_v1_send_surface_dbus_annotation(tl->resource,
+					ev.str[0], ev.str[1], ev.str[2]);
+				break;
+			case TOPLEVEL_TRACE_DONE:
+				zwlr_foreign_toplevel_handle_v1_send_done(tl->resource);
+				/* send each batch separately, as a compositor would */
+				wl_client_flush(s->client);
+				break;
+			case TOPLEVEL_TRACE_CLOSED:
+				zwlr_foreign_toplevel_handle_v1_send_closed(tl->resource);
+				break;
+			case TOPLEVEL_TRACE_OUTPUT_ENTER:
+			case TOPLEVEL_TRACE_OUTPUT_LEAVE:
+				/* note: if more outputs were recorded, some are merged */
+				output = &(s->outputs[ev.output % STANDIN_N_OUTPUTS]);
+				if(!output->resource) continue;
+				if(ev.type == TOPLEVEL_TRACE_OUTPUT_ENTER)
+					zwlr_foreign_toplevel_handle_v1_send_output_enter(tl->resource, output->resource);
+				else zwlr_foreign_toplevel_handle_v1_send_output_leave(tl->resource, output->resource);
+				break;
+			default:
+				/* note: the manager finishing is not replayed */
+				continue;
+		}
+		events++;
+	}
+	if(ret < 0) fprintf(stderr, "Trace is corrupted, stopped replaying it!\n");
+	g_ptr_array_free(map, TRUE);
+	return events;
+}
+
+static int cmd_cb(int fd, G_GNUC_UNUSED uint32_t mask, void* data) {
+	struct standin* s = (struct standin*)data;
+	char c;
+	if(read(fd, &c, 1) != 1) return 0;
+	
+	g_mutex_lock(&(s->lock));
+	enum standin_cmd cmd = s->cmd;
+	unsigned int n = s->n;
+	unsigned int chain_len = s->chain_len;
+	int annotate = s->annotate;
+	unsigned int* ids = s->ids;
+	struct toplevel_trace_reader* trace = s->trace;
+	s->ids = NULL;
+	s->trace = NULL;
+	g_mutex_unlock(&(s->lock));
+	
+	unsigned long events = 0;
+	switch(cmd) {
+		case STANDIN_CMD_CREATE:
+			events = create_toplevels(s, n, chain_len, annotate);
+			break;
+		case STANDIN_CMD_ACTIVATE:
+			events = activate(s, ids, n);
+			break;
+		case STANDIN_CMD_MOVE:
+			/* note: chain_len is the output here */
+			events = move(s, ids, n, chain_len);
+			break;
+		case STANDIN_CMD_CLOSE_ALL:
+			events = close_all(s);
+			break;
+		case STANDIN_CMD_REPLAY:
+			/* note: n is used as a flag here */
+			events = replay(s, trace, n);
+			break;
+		case STANDIN_CMD_QUIT:
+			wl_display_terminate(s->display);
+			break;
+		case STANDIN_CMD_NONE:
+			break;
+	}
+	g_free(ids);
+	/* make sure everything is sent before reporting that we are done */
+	wl_display_flush_clients(s->display);
+	
+	g_mutex_lock(&(s->lock));
+	s->events += events;
+	s->cmd = STANDIN_CMD_NONE;
+	s->busy = 0;
+	g_cond_broadcast(&(s->cond));
+	g_mutex_unlock(&(s->lock));
+	return 0;
+}
+
+static gpointer server_thread(gpointer data) {
+	struct standin* s = (struct standin*)data;
+	wl_display_run(s->display);
+	return NULL;
+}
+
+static void standin_submit(struct standin* s, enum standin_cmd cmd, unsigned int n,
+		unsigned int chain_len, int annotate, unsigned int* ids, struct toplevel_trace_reader* trace) {
+	g_mutex_lock(&(s->lock));
+	while(s->busy) g_cond_wait(&(s->cond), &(s->lock));
+	s->busy = 1;
+	s->cmd = cmd;
+	s->n = n;
+	s->chain_len = chain_len;
+	s->annotate = annotate;
+	s->ids = ids;
+	s->trace = trace;
+	g_mutex_unlock(&(s->lock));
+	
+	char c = 0;
+	if(write(s->cmd_pipe[1], &c, 1) != 1) fprintf(stderr, "Cannot send command to the stand-in!\n");
+}
+
+
+struct standin* standin_new(void) {
+	struct standin* s = g_new0(struct standin, 1);
+	int fds[2];
+	unsigned int i;
+	s->cmd_pipe[0] = s->cmd_pipe[1] = -1;
+	s->active = -1;
+	g_mutex_init(&(s->lock));
+	g_cond_init(&(s->cond));
+	s->toplevels = g_ptr_array_new_with_free_func(g_free);
+	s->activation_ns = g_array_new(FALSE, TRUE, sizeof(int64_t));
+	
+	s->display = wl_display_create();
+	if(!s->display) goto err;
+	s->global = wl_global_create(s->display, &zwlr_foreign_toplevel_manager_v1_interface,
+		zwlr_foreign_toplevel_manager_v1_interface.version, s, manager_bind);
+	if(!s->global) goto err;
+	for(i = 0; i < STANDIN_N_OUTPUTS; i++) {
+		/* note: only version 3 (adding release) is implemented */
+		s->outputs[i].global = wl_global_create(s->display, &wl_output_interface, 3, &(s->outputs[i]), output_bind);
+		if(!s->outputs[i].global) goto err;
+	}
+	if(pipe(s->cmd_pipe)) goto err;
+	wl_event_loop_add_fd(wl_display_get_event_loop(s->display), s->cmd_pipe[0],
+		WL_EVENT_READABLE, cmd_cb, s);
+	
+	if(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds)) goto err;
+	s->client = wl_client_create(s->display, fds[0]);
+	if(!s->client) {
+		close(fds[0]);
+		close(fds[1]);
+		goto err;
+	}
+	s->client_fd = fds[1];
+	
+	s->thread = g_thread_new("standin", server_thread, s);
+	return s;
+	
+err:
+	fprintf(stderr, "Cannot create stand-in compositor!\n");
+	standin_free(s);
+	return NULL;
+}
+
+int standin_get_client_fd(struct standin* s) {
+	return s->client_fd;
+}
+
+void standin_create_toplevels(struct standin* s, unsigned int n, unsigned int chain_len, int annotate) {
+	standin_submit(s, STANDIN_CMD_CREATE, n, chain_len, annotate, NULL, NULL);
+}
+
+void standin_activate(struct standin* s, const unsigned int* ids, unsigned int n) {
+	standin_submit(s, STANDIN_CMD_ACTIVATE, n, 0, 0, g_memdup2(ids, n * sizeof(unsigned int)), NULL);
+}
+
+void standin_replay(struct standin* s, struct toplevel_trace_reader* trace, int paced) {
+	standin_submit(s, STANDIN_CMD_REPLAY, paced ? 1 : 0, 0, 0, NULL, trace);
+}
+
+void standin_move(struct standin* s, const unsigned int* ids, unsigned int n, unsigned int output) {
+	standin_submit(s, STANDIN_CMD_MOVE, n, output, 0, g_memdup2(ids, n * sizeof(unsigned int)), NULL);
+}
+
+void standin_close_all(struct standin* s) {
+	standin_submit(s, STANDIN_CMD_CLOSE_ALL, 0, 0, 0, NULL, NULL);
+}
+
+int standin_is_idle(struct standin* s) {
+	g_mutex_lock(&(s->lock));
+	int ret = !s->busy;
+	g_mutex_unlock(&(s->lock));
+	return ret;
+}
+
+void standin_wait(struct standin* s) {
+	g_mutex_lock(&(s->lock));
+	while(s->busy) g_cond_wait(&(s->cond), &(s->lock));
+	g_mutex_unlock(&(s->lock));
+}
+
+unsigned long standin_get_events_sent(struct standin* s) {
+	g_mutex_lock(&(s->lock));
+	unsigned long ret = s->events;
+	g_mutex_unlock(&(s->lock));
+	return ret;
+}
+
+unsigned int standin_get_live_handles(struct standin* s) {
+	g_mutex_lock(&(s->lock));
+	unsigned int ret = s->live_handles;
+	g_mutex_unlock(&(s->lock));
+	return ret;
+}
+
+int64_t standin_get_activation_time(struct standin* s, unsigned int root) {
+	int64_t ret = 0;
+	g_mutex_lock(&(s->lock));
+	if(root < s->activation_ns->len) ret = g_array_index(s->activation_ns, int64_t, root);
+	g_mutex_unlock(&(s->lock));
+	return ret;
+}
+
+void standin_free(struct standin* s) {
+	if(!s) return;
+	if(s->thread) {
+		standin_submit(s, STANDIN_CMD_QUIT, 0, 0, 0, NULL, NULL);
+		g_thread_join(s->thread);
+	}
+	if(s->display) {
+		wl_display_destroy_clients(s->display);
+		wl_display_destroy(s->display);
+	}
+	if(s->cmd_pipe[0] >= 0) close(s->cmd_pipe[0]);
+	if(s->cmd_pipe[1] >= 0) close(s->cmd_pipe[1]);
+	g_ptr_array_free(s->toplevels, TRUE);
+	g_array_free(s->activation_ns, TRUE);
+	g_mutex_clear(&(s->lock));
+	g_cond_clear(&(s->cond));
+	g_free(s);
+}
+
+
+void standin_pump(struct standin* s, struct wl_display* dpy) {
+	while(!standin_is_idle(s)) {
+		while(wl_display_prepare_read(dpy) != 0) wl_display_dispatch_pending(dpy);
+		wl_display_flush(dpy);
+		struct pollfd pfd = { .fd = wl_display_get_fd(dpy), .events = POLLIN, .revents = 0 };
+		if(poll(&pfd, 1, 10) > 0) wl_display_read_events(dpy);
+		else wl_display_cancel_read(dpy);
+		wl_display_dispatch_pending(dpy);
+	}
+	wl_display_roundtrip(dpy);
+}
+
+void standin_random_ids(unsigned int* ids, unsigned int n, unsigned int n_toplevels, uint32_t* seed) {
+	unsigned int i;
+	for(i = 0; i < n; i++) {
+		*seed = *seed * 1664525u + 1013904223u;
+		ids[i] = (*seed >> 8) % n_toplevels;
+	}
+}
+
+size_t standin_heap_used(void) {
+	struct mallinfo2 mi = mallinfo2();
+	return mi.uordblks;
+}
@@ -0,0 +1,146 @@
+/*
+ * standin.h -- minimal in-process stand-in for a compositor supporting wlr-foreign-toplevel
+ * 
+ * Copyright 2025 Daniel Kondor <kondor.dani@gmail.com>
+ * 
+ * This is free and unencumbered software released into the public domain.
+ * 
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ * 
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef STANDIN_H
+#define STANDIN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * The stand-in runs a Wayland server on its own thread, connected to
+ * a single client by a socket pair. It only implements the
+ * zwlr_foreign_toplevel_manager_v1 global (including the D-Bus
+ * annotation events) and a few wl_output globals (without any
+ * properties), and generates events on request. All functions below
+ * are called from the client's thread.
+ */
+struct standin;
+struct toplevel_trace_reader;
+struct wl_display;
+struct wl_output;
+
+/* number of outputs offered */
+#define STANDIN_N_OUTPUTS 2
+
+/* monotonic time in nanoseconds, shared between the stand-in and the benchmarks */
+static inline int64_t standin_now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * Create a new stand-in and start its thread. The client should
+ * connect to it using wl_display_connect_to_fd() with the fd returned
+ * by standin_get_client_fd().
+ */
+struct standin* standin_new(void);
+int standin_get_client_fd(struct standin* s);
+
+/*
+ * Announce n new toplevels. Every chain_len consecutive toplevels form
+ * a parent chain (the first one is the root) and share an app-id. If
+ * annotate is nonzero, D-Bus annotations are sent for each toplevel.
+ * Toplevels are identified by their index in the order they were created.
+ * Chains are put on the outputs in turn (the first one created after
+ * standin_close_all() on the first output), if the client bound them.
+ */
+void standin_create_toplevels(struct standin* s, unsigned int n, unsigned int chain_len, int annotate);
+
+/*
+ * Activate the given toplevels one after the other, deactivating the
+ * previously active one each time.
+ */
+void standin_activate(struct standin* s, const unsigned int* ids, unsigned int n);
+
+/* move the given toplevels to another output, as if dragged there */
+void standin_move(struct standin* s, const unsigned int* ids, unsigned int n, unsigned int output);
+
+/*
+ * Send the events recorded in a trace (see toplevel_trace.h) from its
+ * start, as new toplevels (outputs beyond the ones offered are mapped
+ * to these in turn). If paced is nonzero, the recorded timing is
+ * kept, otherwise events are sent as fast as possible. The trace is not
+ * owned and has to be kept until the stand-in is idle again.
+ */
+void standin_replay(struct standin* s, struct toplevel_trace_reader* trace, int paced);
+
+/*
+ * Close all toplevels. Toplevels created afterwards are numbered from
+ * zero again.
+ */
+void standin_close_all(struct standin* s);
+
+/*
+ * The above requests are processed asynchronously on the stand-in's
+ * thread; these can be used to check or wait until they are done.
+ * Only one request is processed at a time.
+ */
+int standin_is_idle(struct standin* s);
+void standin_wait(struct standin* s);
+
+/* number of events sent to the client so far */
+unsigned long standin_get_events_sent(struct standin* s);
+/* number of toplevel handles currently not destroyed by the client */
+unsigned int standin_get_live_handles(struct standin* s);
+/* time the last activation event was sent to any toplevel with the given root */
+int64_t standin_get_activation_time(struct standin* s, unsigned int root);
+
+/*
+ * Stop the stand-in's thread and free all resources. The client should
+ * disconnect before calling this.
+ */
+void standin_free(struct standin* s);
+
+/*
+ * Helpers for the benchmarks (the client side).
+ */
+
+/* process events on dpy until the stand-in is done with the current
+ * request and the client has received everything it sent; this also
+ * makes sure that the stand-in processed the client's requests */
+void standin_pump(struct standin* s, struct wl_display* dpy);
+
+/* bind the outputs of the stand-in, in order, so that toplevels are
+ * reported on them; this has to be done before creating toplevels.
+ * Returns the number bound (up to STANDIN_N_OUTPUTS). */
+unsigned int standin_bind_outputs(struct wl_display* dpy, struct wl_output** outputs);
+
+/* fill ids with n random toplevel indices below n_toplevels; the same
+ * seed gives the same sequence, and it is updated for the next call */
+void standin_random_ids(unsigned int* ids, unsigned int n, unsigned int n_toplevels, uint32_t* seed);
+
+/* bytes allocated on the heap (by malloc) */
+size_t standin_heap_used(void);
+
+#endif
+
@@ -0,0 +1,69 @@
+/*
+ * standin_client.c -- helpers for the clients of the stand-in that use the client protocol
+ * 
+ * Copyright 2025 Daniel Kondor <kondor.dani@gmail.com>
+ * 
+ * This is free and unencumbered software released into the public domain.
+ * 
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ * 
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+#include <wayland-client.h>
+#include <glib.h>
+#include "standin.h"
+
+/* note: this is separate from standin.c, since the client and server
+ * protocol headers cannot be included together */
+
+struct bind_outputs {
+	struct wl_output** outputs;
+	unsigned int n;
+};
+
+static void global_cb(void* data, struct wl_registry* registry, uint32_t name,
+		const char* interface, uint32_t version) {
+	struct bind_outputs* b = (struct bind_outputs*)data;
+	if(strcmp(interface, wl_output_interface.name) || b->n == STANDIN_N_OUTPUTS) return;
+	b->outputs[b->n++] = (struct wl_output*)wl_registry_bind(registry, name, &wl_output_interface, MIN(version, 3));
+}
+
+static void global_remove_cb(G_GNUC_UNUSED void* data, G_GNUC_UNUSED struct wl_registry* registry,
+		G_GNUC_UNUSED uint32_t name) {
+}
+
+static const struct wl_registry_listener registry_listener = {
+	.global = global_cb,
+	.global_remove = global_remove_cb,
+};
+
+unsigned int standin_bind_outputs(struct wl_display* dpy, struct wl_output** outputs) {
+	struct bind_outputs b = { outputs, 0 };
+	struct wl_registry* registry = wl_display_get_registry(dpy);
+	wl_registry_add_listener(registry, &registry_listener, &b);
+	/* note: globals are announced in the order they were created;
+	 * the second roundtrip makes sure the binds were processed */
+	wl_display_roundtrip(dpy);
+	wl_display_roundtrip(dpy);
+	wl_registry_destroy(registry);
+	return b.n;
+}
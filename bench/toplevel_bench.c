@@ -0,0 +1,301 @@
+/*
+ * toplevel_bench.c -- benchmark for processing toplevel events
+ * 
+ * Copyright 2025 Daniel Kondor <kondor.dani@gmail.com>
+ * 
+ * This is free and unencumbered software released into the public domain.
+ * 
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ * 
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wayland-client.h>
+#include <glib.h>
+#include <foreign_toplevel.h>
+#include "standin.h"
+
+
+struct bench {
+	struct standin* s;
+	struct wl_display* dpy;
+	GArray* latencies; /* int64_t, in ns */
+};
+
+static void active_cb(void* data, struct toplevel_manager* gr) {
+	struct bench* b = (struct bench*)data;
+	int64_t now = standin_now_ns();
+	const struct toplevel_properties* props = toplevel_manager_get_active_app(gr);
+	unsigned int root;
+	if(!(props && props->app_id && sscanf(props->app_id, "bench.app.%u", &root) == 1)) return;
+	int64_t sent = standin_get_activation_time(b->s, root);
+	if(sent > 0 && now >= sent) {
+		int64_t latency = now - sent;
+		g_array_append_val(b->latencies, latency);
+	}
+}
+
+/* reading snapshots on another thread while events are processed */
+struct reader {
+	struct toplevel_manager* gr;
+	gint stop;
+	unsigned long reads;
+	unsigned long distinct; /* different snapshots seen */
+	unsigned long errors;
+};
+
+static gpointer reader_thread(gpointer data) {
+	struct reader* r = (struct reader*)data;
+	guint64 last = 0;
+	while(!g_atomic_int_get(&(r->stop))) {
+		const struct toplevel_snapshot* snap = toplevel_manager_get_snapshot(r->gr);
+		if(!snap) continue;
+		r->reads++;
+		if(snap->serial != last) r->distinct++;
+		last = snap->serial;
+		/* the active app has to be one of the toplevels in the snapshot */
+		if(snap->active && (snap->active < snap->toplevels ||
+				snap->active >= snap->toplevels + snap->n_toplevels || !snap->active->props.app_id))
+			r->errors++;
+		toplevel_snapshot_unref(snap);
+	}
+	return NULL;
+}
+
+/* subscriber of an output */
+struct output_check {
+	unsigned long callbacks;
+	unsigned long cleared; /* called without an active app (after it was closed) */
+};
+
+static void output_cb(void* data, struct toplevel_manager* gr, struct wl_output* output,
+		G_GNUC_UNUSED unsigned int changes) {
+	struct output_check* c = (struct output_check*)data;
+	c->callbacks++;
+	if(!toplevel_manager_get_active_app_on_output(gr, output)) c->cleared++;
+}
+
+/* whether the active app on an output is the given root */
+static int output_has_root(struct toplevel_manager* gr, struct wl_output* output, unsigned int root) {
+	const struct toplevel_properties* props = toplevel_manager_get_active_app_on_output(gr, output);
+	unsigned int x;
+	return props && props->app_id && sscanf(props->app_id, "bench.app.%u", &x) == 1 && x == root;
+}
+
+static int cmp_int64(const void* a, const void* b) {
+	int64_t x = *(const int64_t*)a;
+	int64_t y = *(const int64_t*)b;
+	return (x > y) - (x < y);
+}
+
+static double percentile_us(GArray* sorted, double p) {
+	if(!sorted->len) return 0.0;
+	unsigned int i = (unsigned int)(p * (sorted->len - 1) + 0.5);
+	return g_array_index(sorted, int64_t, i) / 1000.0;
+}
+
+static void report_rate(const char* phase, unsigned long events, int64_t ns) {
+	double ms = ns / 1e6;
+	printf("%-10s %8lu events in %9.2f ms (%.0f events/s)\n", phase, events, ms,
+		ns ? events * 1e9 / ns : 0.0);
+}
+
+int main(int argc, char** argv) {
+	unsigned int n = (argc > 1) ? (unsigned int)strtoul(argv[1], NULL, 10) : 2000;
+	unsigned int n_act = (argc > 2) ? (unsigned int)strtoul(argv[2], NULL, 10) : 20000;
+	unsigned int chain_len = 4;
+	if(!n) n = 1;
+	
+	struct bench b = { NULL, NULL, NULL };
+	b.latencies = g_array_new(FALSE, FALSE, sizeof(int64_t));
+	b.s = standin_new();
+	if(!b.s) return 1;
+	b.dpy = wl_display_connect_to_fd(standin_get_client_fd(b.s));
+	if(!b.dpy) {
+		fprintf(stderr, "Cannot connect to the stand-in!\n");
+		standin_free(b.s);
+		return 1;
+	}
+	
+	struct toplevel_manager* gr = toplevel_manager_new_for_display(b.dpy);
+	if(!gr) {
+		wl_display_disconnect(b.dpy);
+		standin_free(b.s);
+		return 1;
+	}
+	toplevel_manager_set_callback(gr, active_cb, &b);
+	struct wl_output* outputs[STANDIN_N_OUTPUTS];
+	unsigned int n_outputs = standin_bind_outputs(b.dpy, outputs);
+	unsigned int i;
+	int ret = 0;
+	
+	/* 1. announce toplevels with annotations and parents */
+	size_t mem0 = standin_heap_used();
+	unsigned long ev0 = standin_get_events_sent(b.s);
+	int64_t t0 = standin_now_ns();
+	standin_create_toplevels(b.s, n, chain_len, 1);
+	standin_pump(b.s, b.dpy);
+	int64_t t1 = standin_now_ns();
+	size_t mem1 = standin_heap_used();
+	report_rate("create", standin_get_events_sent(b.s) - ev0, t1 - t0);
+	printf("memory:    %.0f bytes per toplevel (including the stand-in's own resources)\n",
+		(mem1 > mem0) ? (double)(mem1 - mem0) / n : 0.0);
+	struct toplevel_manager_stats st0, st1;
+	toplevel_manager_get_stats(gr, &st0);
+	printf("strings:   %lu distinct for %lu references, %zu bytes stored, %zu bytes saved\n",
+		st0.strings, st0.string_refs, st0.string_bytes, st0.string_bytes_saved);
+	
+	/* looking up toplevels by app-id and bus name (all toplevels in a
+	 * chain share them, the bus name should give the root) */
+	unsigned int n_chains = (n + chain_len - 1) / chain_len;
+	unsigned int n_lookups = 10000;
+	unsigned int wrong_lookups = 0;
+	const struct toplevel_properties* found[8];
+	char name[64];
+	t0 = standin_now_ns();
+	for(i = 0; i < n_lookups; i++) {
+		unsigned int root = (i % n_chains) * chain_len;
+		unsigned int x;
+		snprintf(name, sizeof(name), "bench.app.%u", root);
+		if(toplevel_manager_find_by_app_id(gr, name, found, G_N_ELEMENTS(found)) != MIN(chain_len, n - root))
+			wrong_lookups++;
+		snprintf(name, sizeof(name), ":1.%u", root + 100);
+		const struct toplevel_properties* props = toplevel_manager_find_by_bus_name(gr, name);
+		if(!(props && props->app_id && sscanf(props->app_id, "bench.app.%u", &x) == 1 && x == root))
+			wrong_lookups++;
+	}
+	t1 = standin_now_ns();
+	printf("lookups:   %u by app-id and bus name in %.2f ms, %u wrong\n",
+		2 * n_lookups, (t1 - t0) / 1e6, wrong_lookups);
+	if(wrong_lookups) ret = 1;
+	
+	/* 2. activation storm, switching between random toplevels */
+	unsigned int* ids = g_new(unsigned int, n_act ? n_act : 1);
+	uint32_t rnd = 12345;
+	standin_random_ids(ids, n_act, n, &rnd);
+	toplevel_manager_get_stats(gr, &st0);
+	ev0 = standin_get_events_sent(b.s);
+	t0 = standin_now_ns();
+	standin_activate(b.s, ids, n_act);
+	standin_pump(b.s, b.dpy);
+	t1 = standin_now_ns();
+	toplevel_manager_get_stats(gr, &st1);
+	g_free(ids);
+	report_rate("activate", standin_get_events_sent(b.s) - ev0, t1 - t0);
+	printf("callbacks: %lu for %lu activations (%lu coalesced)\n",
+		st1.callbacks - st0.callbacks, st1.activations - st0.activations, st1.coalesced - st0.coalesced);
+	g_array_sort(b.latencies, cmp_int64);
+	printf("latency:   p50 %.1f us, p90 %.1f us, p99 %.1f us, max %.1f us (%u samples)\n",
+		percentile_us(b.latencies, 0.5), percentile_us(b.latencies, 0.9),
+		percentile_us(b.latencies, 0.99), percentile_us(b.latencies, 1.0), b.latencies->len);
+	
+	/* 3. the same with snapshots published and read on another thread */
+	toplevel_manager_set_snapshots(gr, 1);
+	struct reader rd = { gr, 0, 0, 0, 0 };
+	GThread* rth = g_thread_new("snapshot reader", reader_thread, &rd);
+	ids = g_new(unsigned int, n_act ? n_act : 1);
+	standin_random_ids(ids, n_act, n, &rnd);
+	ev0 = standin_get_events_sent(b.s);
+	t0 = standin_now_ns();
+	standin_activate(b.s, ids, n_act);
+	standin_pump(b.s, b.dpy);
+	t1 = standin_now_ns();
+	g_atomic_int_set(&(rd.stop), 1);
+	g_thread_join(rth);
+	g_free(ids);
+	report_rate("snapshots", standin_get_events_sent(b.s) - ev0, t1 - t0);
+	printf("readers:   %lu snapshots read (%lu distinct), %lu inconsistent\n", rd.reads, rd.distinct, rd.errors);
+	toplevel_manager_set_snapshots(gr, 0);
+	
+	/* 4. per-output tracking: chain k is on output k % STANDIN_N_OUTPUTS, each
+	 * output should have the last one activated on it, also after
+	 * moving a chain to a different output */
+	struct output_check checks[STANDIN_N_OUTPUTS];
+	unsigned int sub_ids[STANDIN_N_OUTPUTS];
+	for(i = 0; i < n_outputs; i++) {
+		checks[i] = (struct output_check){ 0, 0 };
+		sub_ids[i] = toplevel_manager_add_output_callback(gr, outputs[i], output_cb, &(checks[i]));
+	}
+	ids = g_new(unsigned int, n_act ? n_act : 1);
+	standin_random_ids(ids, n_act, n, &rnd);
+	ev0 = standin_get_events_sent(b.s);
+	t0 = standin_now_ns();
+	standin_activate(b.s, ids, n_act);
+	standin_pump(b.s, b.dpy);
+	t1 = standin_now_ns();
+	report_rate("outputs", standin_get_events_sent(b.s) - ev0, t1 - t0);
+	unsigned int wrong = 0;
+	int seen[STANDIN_N_OUTPUTS] = { 0 };
+	for(i = n_act; i > 0; i--) {
+		unsigned int chain = ids[i - 1] / chain_len;
+		unsigned int out = chain % STANDIN_N_OUTPUTS;
+		/* only the last activation on each output counts */
+		if(out >= n_outputs || seen[out]) continue;
+		seen[out] = 1;
+		if(!output_has_root(gr, outputs[out], chain * chain_len)) wrong++;
+	}
+	g_free(ids);
+	if(n_outputs > 1) {
+		/* move the first chain to the next output and activate its root there */
+		unsigned int* chain0 = g_new(unsigned int, chain_len);
+		for(i = 0; i < chain_len; i++) chain0[i] = i;
+		standin_move(b.s, chain0, chain_len, 1);
+		standin_activate(b.s, chain0, 1);
+		standin_pump(b.s, b.dpy);
+		g_free(chain0);
+		if(!output_has_root(gr, outputs[1], 0)) wrong++;
+	}
+	unsigned long output_callbacks = 0;
+	for(i = 0; i < n_outputs; i++) output_callbacks += checks[i].callbacks;
+	printf("outputs:   %u bound, %lu callbacks, %u with a wrong active app\n", n_outputs, output_callbacks, wrong);
+	if(wrong) ret = 1;
+	
+	/* 5. close everything */
+	ev0 = standin_get_events_sent(b.s);
+	t0 = standin_now_ns();
+	standin_close_all(b.s);
+	standin_pump(b.s, b.dpy);
+	t1 = standin_now_ns();
+	report_rate("close", standin_get_events_sent(b.s) - ev0, t1 - t0);
+	/* subscribers have to be told that the active app on their output is gone */
+	for(i = 0; i < n_outputs; i++) {
+		if((checks[i].callbacks && !checks[i].cleared) || toplevel_manager_get_active_app_on_output(gr, outputs[i])) {
+			fprintf(stderr, "Output %u still has an active app after closing all toplevels!\n", i);
+			ret = 1;
+		}
+		toplevel_manager_remove_output_callback(gr, sub_ids[i]);
+		toplevel_manager_forget_output(gr, outputs[i]);
+		wl_output_release(outputs[i]);
+	}
+	
+	toplevel_manager_free(gr);
+	wl_display_roundtrip(b.dpy);
+	wl_display_disconnect(b.dpy);
+	standin_free(b.s);
+	g_array_free(b.latencies, TRUE);
+	return ret;
+}
+
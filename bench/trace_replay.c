@@ -0,0 +1,254 @@
+/*
+ * trace_replay.c -- replay recorded toplevel events through the stand-in
+ * 
+ * Copyright 2025 Daniel Kondor <kondor.dani@gmail.com>
+ * 
+ * This is free and unencumbered software released into the public domain.
+ * 
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ * 
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <wayland-client.h>
+#include <glib.h>
+#include <foreign_toplevel.h>
+#include <toplevel_trace.h>
+#include <metrics.h>
+#include "standin.h"
+
+
+/* a manager connected to its own stand-in */
+struct session {
+	struct standin* s;
+	struct wl_display* dpy;
+	struct toplevel_manager* gr;
+	struct wl_output* outputs[STANDIN_N_OUTPUTS];
+	unsigned int n_outputs;
+	/* hash of everything reported to the callbacks, to compare runs */
+	guint32 digest;
+	unsigned long callbacks;
+	unsigned long output_callbacks;
+};
+
+static void digest_add(struct session* x, const void* data, size_t len) {
+	const unsigned char* p = (const unsigned char*)data;
+	size_t i;
+	for(i = 0; i < len; i++) x->digest = (x->digest ^ p[i]) * 16777619u;
+}
+
+static void change_cb(void* data, struct toplevel_manager* gr, unsigned int changes) {
+	struct session* x = (struct session*)data;
+	const struct toplevel_properties* props = toplevel_manager_get_active_app(gr);
+	const char* app_id = (props && props->app_id) ? props->app_id : "";
+	digest_add(x, app_id, strlen(app_id) + 1);
+	digest_add(x, &changes, sizeof(changes));
+	x->callbacks++;
+}
+
+static void output_cb(void* data, struct toplevel_manager* gr, struct wl_output* output, unsigned int changes) {
+	struct session* x = (struct session*)data;
+	const struct toplevel_properties* props = toplevel_manager_get_active_app_on_output(gr, output);
+	const char* app_id = (props && props->app_id) ? props->app_id : "";
+	unsigned int i;
+	for(i = 0; i < x->n_outputs && x->outputs[i] != output; i++);
+	digest_add(x, &i, sizeof(i));
+	digest_add(x, app_id, strlen(app_id) + 1);
+	digest_add(x, &changes, sizeof(changes));
+	x->output_callbacks++;
+}
+
+static int session_start(struct session* x) {
+	memset(x, 0, sizeof(*x));
+	x->digest = 2166136261u;
+	x->s = standin_new();
+	if(!x->s) return 0;
+	x->dpy = wl_display_connect_to_fd(standin_get_client_fd(x->s));
+	if(!x->dpy) {
+		fprintf(stderr, "Cannot connect to the stand-in!\n");
+		standin_free(x->s);
+		return 0;
+	}
+	x->gr = toplevel_manager_new_for_display(x->dpy);
+	if(!x->gr) {
+		wl_display_disconnect(x->dpy);
+		standin_free(x->s);
+		return 0;
+	}
+	toplevel_manager_set_change_callback(x->gr, change_cb, x);
+	/* note: this has to be before any toplevels are sent */
+	x->n_outputs = standin_bind_outputs(x->dpy, x->outputs);
+	unsigned int i;
+	for(i = 0; i < x->n_outputs; i++) toplevel_manager_add_output_callback(x->gr, x->outputs[i], output_cb, x);
+	return 1;
+}
+
+static void session_end(struct session* x) {
+	toplevel_manager_free(x->gr);
+	unsigned int i;
+	for(i = 0; i < x->n_outputs; i++) wl_output_release(x->outputs[i]);
+	wl_display_roundtrip(x->dpy);
+	wl_display_disconnect(x->dpy);
+	standin_free(x->s);
+}
+
+/* record a synthetic workload, for running without a real trace; the
+ * digest of the callbacks seen while recording is stored in digest */
+static int record_synthetic(const char* path, unsigned int n, unsigned int n_act, guint32* digest) {
+	struct session x;
+	GError* err = NULL;
+	struct toplevel_trace_writer* w = toplevel_trace_writer_new(path, &err);
+	if(!w) {
+		fprintf(stderr, "%s\n", err->message);
+		g_error_free(err);
+		return 0;
+	}
+	if(!session_start(&x)) {
+		toplevel_trace_writer_free(w);
+		return 0;
+	}
+	toplevel_manager_set_trace(x.gr, w);
+	
+	standin_create_toplevels(x.s, n, 4, 1);
+	standin_pump(x.s, x.dpy);
+	unsigned int* ids = g_new(unsigned int, n_act ? n_act : 1);
+	uint32_t rnd = 12345;
+	standin_random_ids(ids, n_act, n, &rnd);
+	standin_activate(x.s, ids, n_act);
+	standin_pump(x.s, x.dpy);
+	/* move some of them to the next output and activate them there */
+	unsigned int n_move = MIN(n_act, 50);
+	unsigned int i;
+	for(i = 0; i < n_move; i++) {
+		standin_move(x.s, ids + i, 1, (ids[i] / 4 + 1) % STANDIN_N_OUTPUTS);
+		standin_activate(x.s, ids + i, 1);
+	}
+	standin_pump(x.s, x.dpy);
+	g_free(ids);
+	standin_close_all(x.s);
+	standin_pump(x.s, x.dpy);
+	
+	toplevel_manager_set_trace(x.gr, NULL);
+	guint64 events = toplevel_trace_writer_get_events(w);
+	*digest = x.digest;
+	session_end(&x);
+	if(!toplevel_trace_writer_free(w)) {
+		fprintf(stderr, "Error writing %s\n", path);
+		return 0;
+	}
+	printf("recorded:  %" G_GUINT64_FORMAT " events (%u toplevels, %u activations), digest %08x\n",
+		events, n, n_act, *digest);
+	return 1;
+}
+
+/* replay a trace; if expected is given, the callbacks have to be the
+ * same as when it was recorded */
+static int replay(const char* path, int paced, const guint32* expected) {
+	GError* err = NULL;
+	struct toplevel_trace_reader* r = toplevel_trace_reader_new(path, &err);
+	if(!r) {
+		fprintf(stderr, "%s\n", err->message);
+		g_error_free(err);
+		return 0;
+	}
+	struct session x;
+	if(!session_start(&x)) {
+		toplevel_trace_reader_free(r);
+		return 0;
+	}
+	struct metrics* m = metrics_new();
+	toplevel_manager_set_metrics(x.gr, m);
+	
+	unsigned long ev0 = standin_get_events_sent(x.s);
+	int64_t t0 = standin_now_ns();
+	standin_replay(x.s, r, paced);
+	standin_pump(x.s, x.dpy);
+	int64_t t1 = standin_now_ns();
+	unsigned long events = standin_get_events_sent(x.s) - ev0;
+	
+	struct toplevel_manager_stats st;
+	toplevel_manager_get_stats(x.gr, &st);
+	printf("replayed:  %8lu events in %9.2f ms (%.0f events/s)%s\n", events, (t1 - t0) / 1e6,
+		(t1 > t0) ? events * 1e9 / (t1 - t0) : 0.0, paced ? ", at the recorded pace" : "");
+	printf("callbacks: %lu for %lu activations (%lu coalesced), %lu for %u outputs, digest %08x\n",
+		x.callbacks, st.activations, st.coalesced, x.output_callbacks, x.n_outputs, x.digest);
+	metrics_print(m, stdout);
+	
+	int ret = 1;
+	if(expected && x.digest != *expected) {
+		fprintf(stderr, "The callbacks differ from the ones seen while recording (digest %08x)!\n", *expected);
+		ret = 0;
+	}
+	
+	toplevel_manager_set_metrics(x.gr, NULL);
+	session_end(&x);
+	metrics_free(m);
+	toplevel_trace_reader_free(r);
+	return ret;
+}
+
+/*
+ * usage: trace_replay [--paced] [trace]
+ * Without a trace (e.g. recorded by setting GLOBAL_MENU_TRACE for the
+ * main program), a synthetic one is recorded and replayed, and the
+ * callbacks have to be the same both times.
+ */
+int main(int argc, char** argv) {
+	int paced = 0;
+	const char* path = NULL;
+	int i;
+	for(i = 1; i < argc; i++) {
+		if(!strcmp(argv[i], "--paced")) paced = 1;
+		else path = argv[i];
+	}
+	
+	char* tmp = NULL;
+	guint32 digest = 0;
+	if(!path) {
+		GError* err = NULL;
+		int fd = g_file_open_tmp("toplevel_trace_XXXXXX", &tmp, &err);
+		if(fd < 0) {
+			fprintf(stderr, "%s\n", err->message);
+			g_error_free(err);
+			return 1;
+		}
+		close(fd);
+		if(!record_synthetic(tmp, 500, 5000, &digest)) {
+			unlink(tmp);
+			g_free(tmp);
+			return 1;
+		}
+		path = tmp;
+	}
+	
+	int ret = replay(path, paced, tmp ? &digest : NULL);
+	if(tmp) {
+		unlink(tmp);
+		g_free(tmp);
+	}
+	return ret ? 0 : 1;
+}
@@ -0,0 +1,54 @@
+/*
+ * dbus_export.c -- registering objects described by introspection XML
+ * 
+ * Copyright 2025 Daniel Kondor <kondor.dani@gmail.com>
+ * 
+ * This is free and unencumbered software released into the public domain.
+ * 
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ * 
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <dbus_export.h>
+
+
+int dbus_export_register(struct dbus_export* e, GDBusConnection* bus, const char* object_path,
+		const char* xml, const GDBusInterfaceVTable* vtable, gpointer data, GError** error) {
+	if(!(e && bus && object_path)) return 0;
+	dbus_export_unregister(e);
+	GDBusNodeInfo* info = g_dbus_node_info_new_for_xml(xml, error);
+	if(!info) return 0;
+	e->registration_id = g_dbus_connection_register_object(bus, object_path, info->interfaces[0],
+		vtable, data, NULL, error);
+	g_dbus_node_info_unref(info);
+	if(!e->registration_id) return 0;
+	e->bus = g_object_ref(bus);
+	return 1;
+}
+
+void dbus_export_unregister(struct dbus_export* e) {
+	if(!(e && e->bus)) return;
+	g_dbus_connection_unregister_object(e->bus, e->registration_id);
+	g_object_unref(e->bus);
+	e->bus = NULL;
+	e->registration_id = 0;
+}
@@ -0,0 +1,63 @@
+/*
+ * dbus_export.h -- registering objects described by introspection XML
+ * 
+ * Copyright 2025 Daniel Kondor <kondor.dani@gmail.com>
+ * 
+ * This is free and unencumbered software released into the public domain.
+ * 
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ * 
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef DBUS_EXPORT_H
+#define DBUS_EXPORT_H
+
+#include <gio/gio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* an object registered on a bus; zero-initialized when not registered */
+struct dbus_export {
+	GDBusConnection* bus;
+	guint registration_id;
+};
+
+/*
+ * Register an object at object_path on bus, implementing the first
+ * interface in the given introspection XML with vtable (called with
+ * data). If e was registered already, that registration is removed
+ * first. Returns nonzero on success.
+ */
+int dbus_export_register(struct dbus_export* e, GDBusConnection* bus, const char* object_path,
+		const char* xml, const GDBusInterfaceVTable* vtable, gpointer data, GError** error);
+
+/* remove the object registered by e (if any) */
+void dbus_export_unregister(struct dbus_export* e);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
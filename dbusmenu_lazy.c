@@ -0,0 +1,592 @@
+/*
+ * dbusmenu_lazy.c -- menus for com.canonical.dbusmenu, fetched on demand
+ * 
+ * Copyright 2025 Daniel Kondor <kondor.dani@gmail.com>
+ * 
+ * This is free and unencumbered software released into the public domain.
+ * 
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ * 
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <dbusmenu_lazy.h>
+#include <stdio.h>
+#include <string.h>
+
+#define DBUSMENU_INTERFACE "com.canonical.dbusmenu"
+
+/* state of submenus, stored in the data field of their node */
+enum lazy_state {
+	LAZY_LOADED = 1,  /* children were fetched at least once */
+	LAZY_LOADING = 2, /* AboutToShow or GetLayout is in progress */
+	LAZY_STALE = 4,   /* the layout changed since the last fetch */
+	LAZY_OPEN = 8,    /* the submenu is shown */
+	LAZY_FULL = 16    /* all descendants were fetched, and are kept up-to-date */
+};
+
+struct dbusmenu_lazy {
+	GDBusConnection* bus;
+	char* bus_name;
+	char* path;
+	GCancellable* cancellable;
+	int timeout_ms;
+	guint layout_updated_id;
+	guint props_updated_id;
+	struct menu_tree* tree;
+	GHashTable* revisions; /* ID of submenus -> revision of the layout fetched */
+	int fetched_all;
+};
+
+/* data for an asynchronous call; the item is looked up again on reply,
+ * since it might have been removed in the meantime */
+struct lazy_request {
+	struct dbusmenu_lazy* dm;
+	gint32 id;
+	int depth; /* for GetLayout */
+};
+
+
+static void item_get_layout(struct dbusmenu_lazy* dm, guint32 node, int depth);
+static void item_update(struct dbusmenu_lazy* dm, guint32 node);
+
+static guint32 item_state(struct dbusmenu_lazy* dm, guint32 node) {
+	return menu_tree_get_node(dm->tree, node)->data;
+}
+
+static void item_set_state(struct dbusmenu_lazy* dm, guint32 node, guint32 set, guint32 clear) {
+	menu_tree_set_data(dm->tree, node, (item_state(dm, node) | set) & ~clear);
+}
+
+/* whether changes should be fetched right away: the top level is kept
+ * up-to-date, so that it can be shown quickly, and also open submenus */
+static int item_wants_update(struct dbusmenu_lazy* dm, guint32 node) {
+	return node == MENU_TREE_ROOT || (item_state(dm, node) & LAZY_OPEN);
+}
+
+static void send_event(struct dbusmenu_lazy* dm, gint32 id, const char* event_id, guint32 timestamp) {
+	g_dbus_connection_call(dm->bus, dm->bus_name, dm->path, DBUSMENU_INTERFACE, "Event",
+		g_variant_new("(isvu)", id, event_id, g_variant_new_int32(0), timestamp),
+		NULL, G_DBUS_CALL_FLAGS_NO_AUTO_START, dm->timeout_ms, NULL, NULL, NULL);
+}
+
+/* get the flags of an item from its properties, keeping the ones not given */
+static unsigned int item_flags(GVariant* props, unsigned int flags) {
+	const char* toggle_type;
+	gboolean b;
+	gint32 state;
+	if(g_variant_lookup(props, "enabled", "b", &b))
+		flags = b ? (flags | MENU_NODE_ENABLED) : (flags & ~MENU_NODE_ENABLED);
+	if(g_variant_lookup(props, "visible", "b", &b))
+		flags = b ? (flags | MENU_NODE_VISIBLE) : (flags & ~MENU_NODE_VISIBLE);
+	if(g_variant_lookup(props, "toggle-type", "&s", &toggle_type)) {
+		flags &= ~(MENU_NODE_CHECK | MENU_NODE_RADIO);
+		if(!strcmp(toggle_type, "checkmark")) flags |= MENU_NODE_CHECK;
+		else if(!strcmp(toggle_type, "radio")) flags |= MENU_NODE_RADIO;
+	}
+	if(g_variant_lookup(props, "toggle-state", "i", &state)) {
+		/* 0: off, 1: on, anything else: indeterminate */
+		flags &= ~(MENU_NODE_TOGGLED | MENU_NODE_INCONSISTENT);
+		if(state == 1) flags |= MENU_NODE_TOGGLED;
+		else if(state) flags |= MENU_NODE_INCONSISTENT;
+	}
+	return flags;
+}
+
+static gboolean icon_is_bytes(GVariant* icon) {
+	const char* kind;
+	if(!(icon && g_variant_is_of_type(icon, G_VARIANT_TYPE("(sv)")))) return FALSE;
+	g_variant_get_child(icon, 0, "&s", &kind);
+	return !strcmp(kind, "bytes");
+}
+
+/*
+ * Get the icon of an item as a serialized GIcon from its properties:
+ * icon-data (PNG image) is stored as a GBytesIcon, icon-name as a
+ * GThemedIcon. Returns FALSE if the properties do not change the icon
+ * (old). The result is a new reference or NULL.
+ */
+static gboolean item_icon(GVariant* props, GVariant* old, GVariant** icon) {
+	const char* name = NULL;
+	gboolean has_name = g_variant_lookup(props, "icon-name", "&s", &name);
+	GVariant* data = g_variant_lookup_value(props, "icon-data", G_VARIANT_TYPE_BYTESTRING);
+	gboolean ret = FALSE;
+	*icon = NULL;
+	if(data && g_variant_n_children(data)) {
+		/* note: the data is not copied, it is decoded later by the renderer */
+		*icon = g_variant_ref_sink(g_variant_new("(sv)", "bytes", data));
+		ret = TRUE;
+	}
+	else if(has_name && *name) {
+		GIcon* gicon = g_themed_icon_new(name);
+		*icon = g_icon_serialize(gicon);
+		g_object_unref(gicon);
+		ret = TRUE;
+	}
+	/* note: an empty value only removes the same kind of icon, since
+	 * the other one may still be set */
+	else if(old) ret = icon_is_bytes(old) ? (data != NULL) : has_name;
+	if(data) g_variant_unref(data);
+	return ret;
+}
+
+/*
+ * Get the first shortcut of an item from its properties (e.g.
+ * [['Control', 'q']]) as an accelerator in the format used by GTK (e.g.
+ * "<Control>q"). Returns FALSE if the properties do not include it. The
+ * result is newly allocated or NULL.
+ */
+static gboolean item_accel(GVariant* props, char** accel) {
+	GVariant* shortcuts = g_variant_lookup_value(props, "shortcut", G_VARIANT_TYPE("aas"));
+	*accel = NULL;
+	if(!shortcuts) return FALSE;
+	if(g_variant_n_children(shortcuts)) {
+		GVariant* keys = g_variant_get_child_value(shortcuts, 0);
+		gsize i, n = g_variant_n_children(keys);
+		GString* str = g_string_new(NULL);
+		for(i = 0; i < n; i++) {
+			const char* key;
+			g_variant_get_child(keys, i, "&s", &key);
+			/* note: all but the last one are modifiers */
+			if(i + 1 < n) g_string_append_printf(str, "<%s>", key);
+			else g_string_append(str, key);
+		}
+		*accel = g_string_free(str, FALSE);
+		g_variant_unref(keys);
+	}
+	g_variant_unref(shortcuts);
+	return TRUE;
+}
+
+/* update an existing item; missing properties are left unchanged */
+static void item_apply_properties(struct dbusmenu_lazy* dm, guint32 node, GVariant* props) {
+	const struct menu_node* n = menu_tree_get_node(dm->tree, node);
+	const char* label;
+	GVariant* icon = NULL;
+	char* accel = NULL;
+	unsigned int flags = item_flags(props, n->flags);
+	gboolean icon_changed = (n->kind != MENU_NODE_SEPARATOR) && item_icon(props, n->icon, &icon);
+	gboolean accel_changed = (n->kind == MENU_NODE_ITEM) && item_accel(props, &accel);
+	if(n->kind != MENU_NODE_SEPARATOR && g_variant_lookup(props, "label", "&s", &label))
+		menu_tree_set_label(dm->tree, node, label);
+	menu_tree_set_flags(dm->tree, node, flags);
+	if(icon_changed) menu_tree_set_icon(dm->tree, node, icon);
+	if(accel_changed) menu_tree_set_accel(dm->tree, node, accel);
+	if(icon) g_variant_unref(icon);
+	g_free(accel);
+}
+
+/* reset properties removed by the app to their default values */
+static void item_reset_properties(struct dbusmenu_lazy* dm, guint32 node, const char* const* names) {
+	GVariantDict dict;
+	g_variant_dict_init(&dict, NULL);
+	for(; *names; names++) {
+		if(!strcmp(*names, "label")) g_variant_dict_insert(&dict, "label", "s", "");
+		else if(!strcmp(*names, "enabled")) g_variant_dict_insert(&dict, "enabled", "b", TRUE);
+		else if(!strcmp(*names, "visible")) g_variant_dict_insert(&dict, "visible", "b", TRUE);
+		else if(!strcmp(*names, "toggle-type")) g_variant_dict_insert(&dict, "toggle-type", "s", "");
+		else if(!strcmp(*names, "toggle-state")) g_variant_dict_insert(&dict, "toggle-state", "i", 0);
+		else if(!strcmp(*names, "icon-name")) g_variant_dict_insert(&dict, "icon-name", "s", "");
+		else if(!strcmp(*names, "icon-data"))
+			g_variant_dict_insert_value(&dict, "icon-data", g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE, NULL, 0, 1));
+		else if(!strcmp(*names, "shortcut"))
+			g_variant_dict_insert_value(&dict, "shortcut", g_variant_new_array(G_VARIANT_TYPE("as"), NULL, 0));
+	}
+	GVariant* props = g_variant_ref_sink(g_variant_dict_end(&dict));
+	item_apply_properties(dm, node, props);
+	g_variant_unref(props);
+}
+
+/* get the kind of an item from its properties */
+static enum menu_node_kind item_kind(GVariant* props) {
+	const char* type = NULL;
+	const char* children_display = NULL;
+	g_variant_lookup(props, "type", "&s", &type);
+	g_variant_lookup(props, "children-display", "&s", &children_display);
+	if(type && !strcmp(type, "separator")) return MENU_NODE_SEPARATOR;
+	/* note: the children are only fetched when the submenu is opened */
+	if(children_display && !strcmp(children_display, "submenu")) return MENU_NODE_SUBMENU;
+	return MENU_NODE_ITEM;
+}
+
+/* add a new item to the tree from the given properties */
+static guint32 item_new(struct dbusmenu_lazy* dm, guint32 parent, gint32 id, GVariant* props) {
+	const char* label = "";
+	enum menu_node_kind kind = item_kind(props);
+	if(kind == MENU_NODE_SEPARATOR) label = NULL;
+	else g_variant_lookup(props, "label", "&s", &label);
+	
+	/* note: IDs should be unique, but do not trust this; the tree
+	 * ignores items with an ID that is already used */
+	guint32 node = menu_tree_append(dm->tree, parent, kind, id, label, NULL, NULL,
+		item_flags(props, MENU_NODE_ENABLED | MENU_NODE_VISIBLE));
+	GVariant* icon = NULL;
+	if(node != MENU_TREE_NONE && kind != MENU_NODE_SEPARATOR && item_icon(props, NULL, &icon) && icon) {
+		menu_tree_set_icon(dm->tree, node, icon);
+		g_variant_unref(icon);
+	}
+	char* accel = NULL;
+	if(node != MENU_TREE_NONE && kind == MENU_NODE_ITEM && item_accel(props, &accel)) {
+		menu_tree_set_accel(dm->tree, node, accel);
+		g_free(accel);
+	}
+	return node;
+}
+
+/* replace all properties of an existing item (missing ones have their default values) */
+static void item_set_properties(struct dbusmenu_lazy* dm, guint32 node, GVariant* props) {
+	const struct menu_node* n = menu_tree_get_node(dm->tree, node);
+	const char* label = "";
+	GVariant* icon = NULL;
+	if(n->kind != MENU_NODE_SEPARATOR) {
+		g_variant_lookup(props, "label", "&s", &label);
+		menu_tree_set_label(dm->tree, node, label);
+		item_icon(props, NULL, &icon);
+		menu_tree_set_icon(dm->tree, node, icon);
+		if(icon) g_variant_unref(icon);
+	}
+	if(n->kind == MENU_NODE_ITEM) {
+		char* accel = NULL;
+		item_accel(props, &accel);
+		menu_tree_set_accel(dm->tree, node, accel);
+		g_free(accel);
+	}
+	menu_tree_set_flags(dm->tree, node, item_flags(props, MENU_NODE_ENABLED | MENU_NODE_VISIBLE));
+}
+
+/* revision of the layout last fetched for the submenu with the given ID */
+static int item_get_revision(struct dbusmenu_lazy* dm, gint32 id, guint32* revision) {
+	gpointer value;
+	if(!g_hash_table_lookup_extended(dm->revisions, GINT_TO_POINTER(id), NULL, &value)) return 0;
+	*revision = GPOINTER_TO_UINT(value);
+	return 1;
+}
+
+static void item_set_revision(struct dbusmenu_lazy* dm, gint32 id, guint32 revision) {
+	g_hash_table_insert(dm->revisions, GINT_TO_POINTER(id), GUINT_TO_POINTER(revision));
+}
+
+/* note: revisions can wrap around */
+static int revision_newer(guint32 a, guint32 b) {
+	return (gint32)(a - b) > 0;
+}
+
+static void item_set_children(struct dbusmenu_lazy* dm, guint32 node, GVariant* layout, int depth, guint32 revision);
+
+/* add the children of node from a layout returned by GetLayout, which
+ * includes depth levels (or all levels if depth is -1) */
+static void item_fill(struct dbusmenu_lazy* dm, guint32 node, GVariant* children, int depth, guint32 revision) {
+	gsize i, n = g_variant_n_children(children);
+	for(i = 0; i < n; i++) {
+		GVariant* child = g_variant_get_child_value(children, i);
+		GVariant* child_layout = g_variant_get_variant(child);
+		gint32 child_id;
+		GVariant* child_props;
+		GVariant* grandchildren;
+		g_variant_get(child_layout, "(i@a{sv}@av)", &child_id, &child_props, &grandchildren);
+		guint32 c = (child_id > 0) ? item_new(dm, node, child_id, child_props) : MENU_TREE_NONE;
+		if(c != MENU_TREE_NONE && depth != 1 && menu_tree_get_node(dm->tree, c)->kind == MENU_NODE_SUBMENU) {
+			item_fill(dm, c, grandchildren, depth - 1, revision);
+			item_set_revision(dm, child_id, revision);
+		}
+		g_variant_unref(grandchildren);
+		g_variant_unref(child_props);
+		g_variant_unref(child_layout);
+		g_variant_unref(child);
+	}
+	if(depth < 0) item_set_state(dm, node, LAZY_LOADED | LAZY_FULL, 0);
+	else item_set_state(dm, node, LAZY_LOADED, LAZY_FULL);
+}
+
+/*
+ * If the children in a new layout are the same items (same IDs and kinds,
+ * in the same order) as the current children of node, update them in
+ * place, so that renderers only need to update the affected widgets;
+ * returns zero without changing anything otherwise.
+ */
+static int item_update_children(struct dbusmenu_lazy* dm, guint32 node, GVariant* children, int depth, guint32 revision) {
+	gsize i, n = g_variant_n_children(children);
+	guint32 c = menu_tree_get_node(dm->tree, node)->first_child;
+	for(i = 0; i < n; i++) {
+		GVariant* child_layout;
+		gint32 child_id;
+		GVariant* child_props;
+		g_variant_get_child(children, i, "v", &child_layout);
+		g_variant_get(child_layout, "(i@a{sv}@av)", &child_id, &child_props, NULL);
+		const struct menu_node* cn = (c != MENU_TREE_NONE) ? menu_tree_get_node(dm->tree, c) : NULL;
+		int same = cn && cn->id == child_id && cn->kind == item_kind(child_props);
+		g_variant_unref(child_props);
+		g_variant_unref(child_layout);
+		if(!same) return 0;
+		c = cn->next;
+	}
+	if(c != MENU_TREE_NONE) return 0;
+	
+	c = menu_tree_get_node(dm->tree, node)->first_child;
+	for(i = 0; i < n; i++) {
+		GVariant* child_layout;
+		GVariant* child_props;
+		g_variant_get_child(children, i, "v", &child_layout);
+		g_variant_get(child_layout, "(i@a{sv}@av)", NULL, &child_props, NULL);
+		item_set_properties(dm, c, child_props);
+		const struct menu_node* cn = menu_tree_get_node(dm->tree, c);
+		if(depth != 1 && cn->kind == MENU_NODE_SUBMENU) item_set_children(dm, c, child_layout, depth - 1, revision);
+		g_variant_unref(child_props);
+		g_variant_unref(child_layout);
+		/* note: the node array might have been moved */
+		c = menu_tree_get_node(dm->tree, c)->next;
+	}
+	/* note: with depth >= 1, the descendants not fetched now are the same as before */
+	item_set_state(dm, node, (depth < 0) ? (LAZY_LOADED | LAZY_FULL) : LAZY_LOADED, 0);
+	return 1;
+}
+
+/* replace the children of node from a layout returned by GetLayout */
+static void item_set_children(struct dbusmenu_lazy* dm, guint32 node, GVariant* layout, int depth, guint32 revision) {
+	GVariant* children = g_variant_get_child_value(layout, 2);
+	item_set_revision(dm, menu_tree_get_node(dm->tree, node)->id, revision);
+	if(!item_update_children(dm, node, children, depth, revision)) {
+		menu_tree_clear_children(dm->tree, node);
+		item_fill(dm, node, children, depth, revision);
+		menu_tree_children_changed(dm->tree, node);
+	}
+	g_variant_unref(children);
+}
+
+static void get_layout_cb(GObject* source, GAsyncResult* res, gpointer data) {
+	struct lazy_request* req = (struct lazy_request*)data;
+	GError* err = NULL;
+	GVariant* ret = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), res, &err);
+	if(!ret && g_error_matches(err, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+		/* dm is already freed */
+		g_error_free(err);
+		g_free(req);
+		return;
+	}
+	
+	struct dbusmenu_lazy* dm = req->dm;
+	gint32 req_id = req->id;
+	guint32 node = menu_tree_find_id(dm->tree, req_id);
+	int depth = req->depth;
+	g_free(req);
+	if(!ret) {
+		fprintf(stderr, "Cannot get dbusmenu layout: %s\n", err->message);
+		g_error_free(err);
+		if(node != MENU_TREE_NONE) item_set_state(dm, node, 0, LAZY_LOADING);
+		return;
+	}
+	if(node != MENU_TREE_NONE) {
+		item_set_state(dm, node, 0, LAZY_LOADING);
+		guint32 revision, known;
+		GVariant* layout;
+		g_variant_get(ret, "(u@(ia{sv}av))", &revision, &layout);
+		/* note: a newer layout might have arrived already (e.g. while fetching all of them) */
+		if(!(item_get_revision(dm, req_id, &known) && revision_newer(known, revision)))
+			item_set_children(dm, node, layout, depth, revision);
+		g_variant_unref(layout);
+		/* the layout changed again while we were waiting */
+		if(item_state(dm, node) & LAZY_STALE) item_update(dm, node);
+	}
+	g_variant_unref(ret);
+}
+
+/* fetch a submenu whose layout changed if it should be kept up-to-date:
+ * the ones fetched with all their descendants are fetched the same way */
+static void item_update(struct dbusmenu_lazy* dm, guint32 node) {
+	if(item_state(dm, node) & LAZY_FULL) item_get_layout(dm, node, -1);
+	else if(item_wants_update(dm, node)) item_get_layout(dm, node, 1);
+}
+
+/* get the children of node, up to depth levels (-1: all of them) */
+static void item_get_layout(struct dbusmenu_lazy* dm, guint32 node, int depth) {
+	struct lazy_request* req = g_new(struct lazy_request, 1);
+	req->dm = dm;
+	req->id = menu_tree_get_node(dm->tree, node)->id;
+	req->depth = depth;
+	item_set_state(dm, node, LAZY_LOADING, LAZY_STALE);
+	g_dbus_connection_call(dm->bus, dm->bus_name, dm->path, DBUSMENU_INTERFACE, "GetLayout",
+		g_variant_new("(ii@as)", req->id, depth, g_variant_new_strv(NULL, 0)),
+		G_VARIANT_TYPE("(u(ia{sv}av))"), G_DBUS_CALL_FLAGS_NO_AUTO_START, dm->timeout_ms, dm->cancellable,
+		get_layout_cb, req);
+}
+
+static void about_to_show_cb(GObject* source, GAsyncResult* res, gpointer data) {
+	struct lazy_request* req = (struct lazy_request*)data;
+	GError* err = NULL;
+	GVariant* ret = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), res, &err);
+	if(!ret && g_error_matches(err, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+		g_error_free(err);
+		g_free(req);
+		return;
+	}
+	
+	struct dbusmenu_lazy* dm = req->dm;
+	guint32 node = menu_tree_find_id(dm->tree, req->id);
+	g_free(req);
+	gboolean need_update = FALSE;
+	if(ret) {
+		g_variant_get(ret, "(b)", &need_update);
+		g_variant_unref(ret);
+	}
+	/* note: AboutToShow is optional, we still fetch the layout if it fails */
+	else g_error_free(err);
+	
+	if(node == MENU_TREE_NONE) return;
+	guint32 state = item_state(dm, node);
+	if(need_update || !(state & LAZY_LOADED) || (state & LAZY_STALE)) item_get_layout(dm, node, 1);
+	else item_set_state(dm, node, 0, LAZY_LOADING);
+}
+
+/* called when a submenu is opened: let the app update it, and fetch it
+ * if it has changed or was never fetched */
+static void item_load(struct dbusmenu_lazy* dm, guint32 node) {
+	if(item_state(dm, node) & LAZY_LOADING) return;
+	struct lazy_request* req = g_new(struct lazy_request, 1);
+	req->dm = dm;
+	req->id = menu_tree_get_node(dm->tree, node)->id;
+	req->depth = 1;
+	item_set_state(dm, node, LAZY_LOADING, 0);
+	g_dbus_connection_call(dm->bus, dm->bus_name, dm->path, DBUSMENU_INTERFACE, "AboutToShow",
+		g_variant_new("(i)", req->id), G_VARIANT_TYPE("(b)"), G_DBUS_CALL_FLAGS_NO_AUTO_START, dm->timeout_ms,
+		dm->cancellable, about_to_show_cb, req);
+}
+
+
+/* called by the renderer */
+
+static void lazy_activate(void* data, struct menu_tree* tree, guint32 node, guint32 timestamp) {
+	const struct menu_node* n = menu_tree_get_node(tree, node);
+	/* note: items with submenus are "activated" when opening them */
+	if(n->kind == MENU_NODE_ITEM) send_event((struct dbusmenu_lazy*)data, n->id, "clicked", timestamp);
+}
+
+static void lazy_opened(void* data, G_GNUC_UNUSED struct menu_tree* tree, guint32 node, guint32 timestamp) {
+	struct dbusmenu_lazy* dm = (struct dbusmenu_lazy*)data;
+	/* the top level is always kept up-to-date */
+	if(node == MENU_TREE_ROOT) return;
+	item_set_state(dm, node, LAZY_OPEN, 0);
+	send_event(dm, menu_tree_get_node(dm->tree, node)->id, "opened", timestamp);
+	item_load(dm, node);
+}
+
+static void lazy_closed(void* data, G_GNUC_UNUSED struct menu_tree* tree, guint32 node, guint32 timestamp) {
+	struct dbusmenu_lazy* dm = (struct dbusmenu_lazy*)data;
+	if(node == MENU_TREE_ROOT) return;
+	item_set_state(dm, node, 0, LAZY_OPEN);
+	send_event(dm, menu_tree_get_node(dm->tree, node)->id, "closed", timestamp);
+}
+
+static const struct menu_tree_backend lazy_backend = { lazy_activate, lazy_opened, lazy_closed };
+
+
+static void layout_updated_cb(G_GNUC_UNUSED GDBusConnection* bus, G_GNUC_UNUSED const char* sender,
+		G_GNUC_UNUSED const char* path, G_GNUC_UNUSED const char* iface, G_GNUC_UNUSED const char* signal,
+		GVariant* params, gpointer data) {
+	struct dbusmenu_lazy* dm = (struct dbusmenu_lazy*)data;
+	guint32 revision;
+	gint32 parent;
+	g_variant_get(params, "(ui)", &revision, &parent);
+	/* we have fetched this or a newer version already */
+	guint32 known;
+	if(item_get_revision(dm, parent, &known) && !revision_newer(revision, known)) return;
+	guint32 node = menu_tree_find_id(dm->tree, parent);
+	if(node == MENU_TREE_NONE || menu_tree_get_node(dm->tree, node)->kind != MENU_NODE_SUBMENU) return;
+	/* submenus not fetched yet will be fetched when opened anyway */
+	guint32 state = item_state(dm, node);
+	if(!(state & (LAZY_LOADED | LAZY_LOADING))) return;
+	item_set_state(dm, node, LAZY_STALE, 0);
+	/* note: if loading, this is checked again when done */
+	if(!(state & LAZY_LOADING)) item_update(dm, node);
+}
+
+static void props_updated_cb(G_GNUC_UNUSED GDBusConnection* bus, G_GNUC_UNUSED const char* sender,
+		G_GNUC_UNUSED const char* path, G_GNUC_UNUSED const char* iface, G_GNUC_UNUSED const char* signal,
+		GVariant* params, gpointer data) {
+	struct dbusmenu_lazy* dm = (struct dbusmenu_lazy*)data;
+	GVariantIter* updated;
+	GVariantIter* removed;
+	gint32 id;
+	GVariant* props;
+	const char** names;
+	g_variant_get(params, "(a(ia{sv})a(ias))", &updated, &removed);
+	/* note: we only get here for items that were already fetched */
+	while(g_variant_iter_next(updated, "(i@a{sv})", &id, &props)) {
+		guint32 node = menu_tree_find_id(dm->tree, id);
+		if(node != MENU_TREE_NONE && node != MENU_TREE_ROOT) item_apply_properties(dm, node, props);
+		g_variant_unref(props);
+	}
+	while(g_variant_iter_next(removed, "(i^a&s)", &id, &names)) {
+		guint32 node = menu_tree_find_id(dm->tree, id);
+		if(node != MENU_TREE_NONE && node != MENU_TREE_ROOT) item_reset_properties(dm, node, names);
+		g_free(names);
+	}
+	g_variant_iter_free(updated);
+	g_variant_iter_free(removed);
+}
+
+struct dbusmenu_lazy* dbusmenu_lazy_new(GDBusConnection* bus, const char* bus_name,
+		const char* object_path, int timeout_ms) {
+	if(!(bus && bus_name && object_path)) return NULL;
+	struct dbusmenu_lazy* dm = g_new0(struct dbusmenu_lazy, 1);
+	dm->bus = g_object_ref(bus);
+	dm->bus_name = g_strdup(bus_name);
+	dm->path = g_strdup(object_path);
+	dm->cancellable = g_cancellable_new();
+	dm->timeout_ms = timeout_ms;
+	/* note: the root of the tree has ID 0, same as in dbusmenu */
+	dm->tree = menu_tree_new();
+	dm->revisions = g_hash_table_new(g_direct_hash, g_direct_equal);
+	menu_tree_set_backend(dm->tree, &lazy_backend, dm);
+	
+	dm->layout_updated_id = g_dbus_connection_signal_subscribe(bus, bus_name, DBUSMENU_INTERFACE,
+		"LayoutUpdated", object_path, NULL, G_DBUS_SIGNAL_FLAGS_NONE, layout_updated_cb, dm, NULL);
+	dm->props_updated_id = g_dbus_connection_signal_subscribe(bus, bus_name, DBUSMENU_INTERFACE,
+		"ItemsPropertiesUpdated", object_path, NULL, G_DBUS_SIGNAL_FLAGS_NONE, props_updated_cb, dm, NULL);
+	
+	/* fetch the top level right away, the rest is fetched when opened */
+	item_get_layout(dm, MENU_TREE_ROOT, 1);
+	return dm;
+}
+
+void dbusmenu_lazy_fetch_all(struct dbusmenu_lazy* dm) {
+	if(!dm || dm->fetched_all) return;
+	dm->fetched_all = 1;
+	item_get_layout(dm, MENU_TREE_ROOT, -1);
+}
+
+struct menu_tree* dbusmenu_lazy_get_tree(struct dbusmenu_lazy* dm) {
+	return dm ? dm->tree : NULL;
+}
+
+void dbusmenu_lazy_free(struct dbusmenu_lazy* dm) {
+	if(!dm) return;
+	/* pending calls will see that they were cancelled and not touch dm */
+	g_cancellable_cancel(dm->cancellable);
+	g_object_unref(dm->cancellable);
+	g_dbus_connection_signal_unsubscribe(dm->bus, dm->layout_updated_id);
+	g_dbus_connection_signal_unsubscribe(dm->bus, dm->props_updated_id);
+	menu_tree_free(dm->tree);
+	g_hash_table_destroy(dm->revisions);
+	g_object_unref(dm->bus);
+	g_free(dm->bus_name);
+	g_free(dm->path);
+	g_free(dm);
+}
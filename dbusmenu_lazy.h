@@ -0,0 +1,80 @@
+/*
+ * dbusmenu_lazy.h -- menus for com.canonical.dbusmenu, fetched on demand
+ * 
+ * Copyright 2025 Daniel Kondor <kondor.dani@gmail.com>
+ * 
+ * This is free and unencumbered software released into the public domain.
+ * 
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ * 
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef DBUSMENU_LAZY_H
+#define DBUSMENU_LAZY_H
+
+#include <gio/gio.h>
+#include <menu_tree.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+struct dbusmenu_lazy;
+
+/*
+ * Create a menu for the com.canonical.dbusmenu object at the given bus
+ * name and path. Only the top level of the menu is fetched (asynchronously)
+ * at this point; each submenu is fetched when it is first opened, so the
+ * cost of this does not depend on the size of the whole menu. Calls to
+ * the app time out after timeout_ms milliseconds (-1 means the D-Bus
+ * default), so an app that does not respond results in an empty menu
+ * instead of waiting for a long time.
+ */
+struct dbusmenu_lazy* dbusmenu_lazy_new(GDBusConnection* bus, const char* bus_name,
+		const char* object_path, int timeout_ms);
+
+/*
+ * Get the menu tree, which is filled in as items are fetched. It is owned
+ * by the dbusmenu_lazy instance and is freed with it. Node IDs in the tree
+ * are the IDs of the items in the dbusmenu protocol.
+ */
+struct menu_tree* dbusmenu_lazy_get_tree(struct dbusmenu_lazy* dm);
+
+/*
+ * Fetch the whole menu (all submenus) with one call, e.g. to be able to
+ * search it. Submenus fetched this way are fetched whole again when the
+ * app reports that they changed, while others are still only updated when
+ * they are opened. This is only done once, later calls have no effect.
+ */
+void dbusmenu_lazy_fetch_all(struct dbusmenu_lazy* dm);
+
+/*
+ * Stop watching the menu and free all resources, including the tree.
+ */
+void dbusmenu_lazy_free(struct dbusmenu_lazy* dm);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
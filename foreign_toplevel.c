@@ -28,14 +28,21 @@
  */
 
 
-// needed for strdup
+// needed for pipe and poll
 #define _POSIX_C_SOURCE 200809L
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
 #include "wlr-foreign-toplevel-management-unstable-v1-client-protocol.h"
 #include <foreign_toplevel.h>
+#include <menu_cache.h>
+#include <string_pool.h>
+#include <metrics.h>
+#include <toplevel_trace.h>
 #include <wayland-client.h>
 #include <gdk/gdk.h>
 #include <gdk/gdkwayland.h>
@@ -49,9 +56,124 @@ struct toplevel_manager {
 	struct wl_list toplevels;
 	void (*callback)(void* data, struct toplevel_manager* gr);
 	void* data;
+	void (*change_callback)(void* data, struct toplevel_manager* gr, unsigned int changes);
+	void* change_data;
 	struct toplevel* active;
 	int init_done;
-	char* self;
+	const char* self;
+	struct menu_cache* cache;
+	/* all strings in the properties of toplevels (and self) */
+	struct string_pool* strings;
+	/* bus names of the active app watched in the menu cache (interned) */
+	const char* watched[4];
+	/* recently active apps (struct toplevel*), most recent first */
+	GQueue mru;
+	/* number of apps in mru (besides the active one) to prefetch menus for */
+	unsigned int prefetch;
+	guint prefetch_id;
+	/* limit on the estimated memory used by toplevels and the menu
+	 * proxies they hold (zero: no limit), see toplevel_manager_memory() */
+	size_t budget;
+	unsigned int n_toplevels;
+	unsigned int n_menus;
+	
+	/* activation and changes of the active toplevel not reported yet */
+	struct toplevel* pending;
+	unsigned int changes;
+	unsigned int debounce_ms;
+	guint debounce_id;
+	struct toplevel_manager_stats stats;
+	/* latency measurements (not owned), and the time the pending
+	 * activation was received (monotonic time, in us) */
+	struct metrics* metrics;
+	gint64 pending_time;
+	/* print the annotations received */
+	int debug;
+	/* recording all events received (not owned) */
+	struct toplevel_trace_writer* trace;
+	guint32 next_trace_id;
+	/* outputs seen in the current trace -> their number + 1 */
+	GHashTable* trace_outputs;
+	guint32 next_trace_output;
+	
+	/* outputs (struct toplevel_output*) that toplevels were on or that
+	 * have subscribers, and the toplevel activated last (might be a child
+	 * of active), whose outputs are assigned to the active toplevel */
+	GPtrArray* outputs;
+	struct toplevel* focused;
+	int outputs_moved;
+	unsigned int next_subscriber_id;
+	
+	/* immutable snapshots for other threads: the one published, holding
+	 * a reference to it; the lock is only held while replacing it or
+	 * while a reader acquires its own reference */
+	GMutex snapshot_lock;
+	struct snapshot* snapshot;
+	struct snapshot_table* table; /* used by the published snapshot */
+	int snapshots_enabled;
+	int table_dirty;    /* toplevels or their properties changed */
+	int snapshot_dirty; /* the active toplevel changed */
+	guint64 snapshot_serial;
+	void (*snapshot_callback)(void* data, struct toplevel_manager* gr, const struct toplevel_snapshot* snap);
+	void* snapshot_data;
+	
+	/* indexes of toplevels: app-id or bus name -> GPtrArray of struct toplevel*
+	 * (note: lookup by handle is done using its user data); keys are interned
+	 * strings, owned by the toplevels in the array */
+	GHashTable* by_app_id;
+	GHashTable* by_bus_name;
+	
+	/* if running on a separate thread, this protects everything,
+	 * except the fields below, which are only used on the main thread */
+	GRecMutex lock;
+	struct wl_display* dpy;
+	struct wl_registry* registry;
+	int threaded;
+	struct wl_event_queue* queue;
+	GThread* thread;
+	int stop_pipe[2];
+	guint notify_id;
+	/* proxies to release on the main thread */
+	GPtrArray* orphans;
+	
+	/* for asynchronous construction */
+	struct wl_callback* init_cb;
+	int init_reported;
+	void (*ready)(void* data, struct toplevel_manager* gr, int success);
+	void* ready_data;
+};
+
+/* maximum length of the activation history */
+#define TOPLEVEL_MRU_MAX 16
+
+/* estimated memory held by each menu proxy, including the menu or
+ * actions fetched with it, used for the memory budget */
+#define TOPLEVEL_MENU_COST (16 * 1024)
+
+/* outputs recorded for each toplevel, any beyond this are ignored */
+#define TOPLEVEL_MAX_OUTPUTS 4
+
+struct toplevel_output_subscriber {
+	unsigned int id;
+	toplevel_output_callback callback;
+	void* data;
+};
+
+/* an output with the toplevel last active on it */
+struct toplevel_output {
+	struct wl_output* output;
+	struct toplevel* active;
+	/* changes of active not reported yet (enum toplevel_changes) */
+	unsigned int changes;
+	GArray* subscribers; /* struct toplevel_output_subscriber */
+};
+
+/* menu related proxies we keep for each toplevel */
+enum toplevel_menu_slot {
+	TOPLEVEL_MENUBAR,
+	TOPLEVEL_APP_ACTIONS,
+	TOPLEVEL_WINDOW_ACTIONS,
+	TOPLEVEL_N_MENUS
 };
 
 
@@ -59,11 +181,34 @@ struct toplevel_manager {
 struct toplevel {
 	wfthandle* handle;
 	wfthandle* parent;
+	/* the toplevel that is considered active if this one is activated,
+	 * i.e. the end of the chain of parents; kept up-to-date by
+	 * toplevel_update_roots() */
+	struct toplevel* root;
+	/* toplevels whose parent is this one (linked by child_link), so that
+	 * only these need a new root if the parent of this one changes */
+	struct wl_list children;
+	struct wl_list child_link;
 	struct toplevel_manager* gr;
 	int init_done;
+	/* identifies this toplevel in traces (in the order of creation) */
+	guint32 trace_id;
+	/* outputs this toplevel is on (not owned) and whether these changed
+	 * since the last done event */
+	struct wl_output* outputs[TOPLEVEL_MAX_OUTPUTS];
+	unsigned int n_outputs;
+	int outputs_changed;
+	/* index in the table of the last published snapshot */
+	unsigned int snapshot_index;
+	/* the toplevel is new or its parent changed since the last done event */
+	int table_changed;
+	/* changed properties since the last done event (enum toplevel_changes) */
+	unsigned int changes;
 	struct wl_list link;
 	
 	struct toplevel_properties props;
+	/* references to shared proxies, acquired on demand */
+	struct menu_cache_entry* menus[TOPLEVEL_N_MENUS];
 };
 
 
@@ -71,27 +216,498 @@ struct toplevel {
 #define G_GNUC_UNUSED __attribute__((unused))
 #endif
 
+/* maintaining the indexes */
+
+static GHashTable* toplevel_index_new(void) {
+	return g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)g_ptr_array_unref);
+}
+
+static void toplevel_index_add(GHashTable* index, const char* key, struct toplevel* tl) {
+	if(!key) return;
+	GPtrArray* toplevels = (GPtrArray*)g_hash_table_lookup(index, key);
+	if(!toplevels) {
+		toplevels = g_ptr_array_new();
+		g_hash_table_insert(index, (gpointer)key, toplevels);
+	}
+	g_ptr_array_add(toplevels, tl);
+}
+
+static void toplevel_index_remove(GHashTable* index, const char* key, struct toplevel* tl) {
+	if(!key) return;
+	GPtrArray* toplevels = (GPtrArray*)g_hash_table_lookup(index, key);
+	if(!toplevels) return;
+	g_ptr_array_remove_fast(toplevels, tl);
+	if(!toplevels->len) g_hash_table_remove(index, key);
+}
+
+/* get all bus names used by this toplevel (might be NULL or repeated) */
+static void toplevel_get_bus_names(struct toplevel* tl, const char* names[4]) {
+	names[0] = tl ? tl->props.menubar_bus_name : NULL;
+	names[1] = tl ? tl->props.window_bus_name : NULL;
+	names[2] = tl ? tl->props.application_bus_name : NULL;
+	names[3] = tl ? tl->props.kde_service_name : NULL;
+}
+
+/* add or remove all distinct bus names used by this toplevel */
+static void toplevel_index_bus_names(struct toplevel* tl, int add) {
+	const char* names[4];
+	toplevel_get_bus_names(tl, names);
+	unsigned int i, j;
+	for(i = 0; i < G_N_ELEMENTS(names); i++) {
+		if(!names[i]) continue;
+		for(j = 0; j < i; j++) if(names[i] == names[j]) break;
+		if(j < i) continue; /* already processed */
+		if(add) toplevel_index_add(tl->gr->by_bus_name, names[i], tl);
+		else toplevel_index_remove(tl->gr->by_bus_name, names[i], tl);
+	}
+}
+
+static struct toplevel* toplevel_get_parent(struct toplevel* tl) {
+	return tl->parent ? (struct toplevel*)zwlr_foreign_toplevel_handle_v1_get_user_data(tl->parent) : NULL;
+}
+
+/* the end of the chain of parents of tl; if the chain leads back to tl
+ * (the compositor sent a cycle of parents), tl is used */
+static struct toplevel* toplevel_find_root(struct toplevel* tl) {
+	struct toplevel* root = tl;
+	struct toplevel* parent = toplevel_get_parent(tl);
+	/* note: this also stops on cycles that do not include tl */
+	unsigned int n = tl->gr->n_toplevels;
+	for(; parent && n; n--) {
+		if(parent == tl) return tl;
+		root = parent;
+		parent = toplevel_get_parent(parent);
+	}
+	return root;
+}
+
+static void toplevel_set_root(struct toplevel* tl, struct toplevel* top, struct toplevel* root) {
+	tl->root = root;
+	struct toplevel* child;
+	/* note: descendants only lead back to top if it is in a cycle */
+	wl_list_for_each(child, &(tl->children), child_link)
+		if(child != top) toplevel_set_root(child, top, root);
+}
+
+/* recalculate the root of tl and its descendants after its parent changed */
+static void toplevel_update_roots(struct toplevel* tl) {
+	toplevel_set_root(tl, tl, toplevel_find_root(tl));
+}
+
+/* set the parent of tl, keeping the list of children up-to-date; the
+ * caller should update the roots */
+static void toplevel_set_parent(struct toplevel* tl, wfthandle* parent) {
+	tl->parent = parent;
+	wl_list_remove(&(tl->child_link));
+	wl_list_init(&(tl->child_link));
+	struct toplevel* p = toplevel_get_parent(tl);
+	if(p) wl_list_insert(&(p->children), &(tl->child_link));
+}
+
+/* tracking outputs */
+
+static void toplevel_output_free(struct toplevel_output* o) {
+	g_array_free(o->subscribers, TRUE);
+	g_free(o);
+}
+
+static struct toplevel_output* toplevel_manager_find_output(struct toplevel_manager* gr,
+		struct wl_output* output, int create) {
+	unsigned int i;
+	for(i = 0; i < gr->outputs->len; i++) {
+		struct toplevel_output* o = (struct toplevel_output*)g_ptr_array_index(gr->outputs, i);
+		if(o->output == output) return o;
+	}
+	if(!create) return NULL;
+	struct toplevel_output* o = g_new0(struct toplevel_output, 1);
+	o->output = output;
+	o->subscribers = g_array_new(FALSE, FALSE, sizeof(struct toplevel_output_subscriber));
+	g_ptr_array_add(gr->outputs, o);
+	return o;
+}
+
+/* whether the menus of this toplevel can be used by any callback */
+static int toplevel_is_shown(struct toplevel_manager* gr, struct toplevel* tl) {
+	unsigned int i;
+	if(tl == gr->active) return 1;
+	for(i = 0; i < gr->outputs->len; i++)
+		if(((struct toplevel_output*)g_ptr_array_index(gr->outputs, i))->active == tl) return 1;
+	return 0;
+}
+
+/* make the active toplevel the last active one on all outputs that it or
+ * its activated child window is on */
+static void toplevel_manager_update_outputs(struct toplevel_manager* gr) {
+	struct toplevel* tls[2] = { gr->focused, gr->active };
+	unsigned int i, j;
+	if(!gr->active) return;
+	for(i = 0; i < 2; i++) if(tls[i] && (!i || tls[1] != tls[0])) {
+		for(j = 0; j < tls[i]->n_outputs; j++) {
+			struct toplevel_output* o = toplevel_manager_find_output(gr, tls[i]->outputs[j], 1);
+			if(o->active != gr->active) {
+				o->active = gr->active;
+				o->changes = TOPLEVEL_CHANGED_ALL;
+			}
+		}
+	}
+}
+
+/* call the subscribers of outputs with changes */
+static void toplevel_manager_dispatch_outputs(struct toplevel_manager* gr) {
+	unsigned int i, j;
+	for(i = 0; i < gr->outputs->len; i++) {
+		struct toplevel_output* o = (struct toplevel_output*)g_ptr_array_index(gr->outputs, i);
+		unsigned int changes = o->changes;
+		o->changes = 0;
+		if(!(changes && o->subscribers->len)) continue;
+		/* note: callbacks may add or remove subscribers, or forget this output */
+		struct wl_output* output = o->output;
+		GArray* subscribers = g_array_copy(o->subscribers);
+		for(j = 0; j < subscribers->len; j++) {
+			struct toplevel_output_subscriber* sub = &g_array_index(subscribers, struct toplevel_output_subscriber, j);
+			sub->callback(sub->data, gr, output, changes);
+		}
+		g_array_free(subscribers, TRUE);
+	}
+}
+
+/* snapshots of all toplevels: a table of them (which includes copies of
+ * all strings) can be shared by multiple snapshots, as long as only the
+ * active toplevel changes */
+struct snapshot_table {
+	unsigned int n;
+	struct toplevel_snapshot_entry* entries;
+	/* followed by the entries and strings */
+};
+
+struct snapshot {
+	struct toplevel_snapshot pub;
+	struct snapshot_table* table;
+};
+
+/* copy an interned string into the table's string area, only once */
+static const char* snapshot_table_add_string(GHashTable* copies, char** next, const char* str) {
+	if(!str) return NULL;
+	char* copy = (char*)g_hash_table_lookup(copies, str);
+	if(!copy) {
+		size_t len = strlen(str) + 1;
+		copy = *next;
+		memcpy(copy, str, len);
+		*next += len;
+		g_hash_table_insert(copies, (gpointer)str, copy);
+	}
+	return copy;
+}
+
+/* note: all properties are strings, these are copied as an array */
+#define SNAPSHOT_N_STRINGS (sizeof(struct toplevel_properties) / sizeof(const char*))
+
+static struct snapshot_table* snapshot_table_new(struct toplevel_manager* gr) {
+	struct toplevel* tl;
+	unsigned int n = 0, i;
+	size_t bytes = 0;
+	/* note: strings are interned, so equal ones can be found by their address */
+	GHashTable* copies = g_hash_table_new(g_direct_hash, g_direct_equal);
+	wl_list_for_each(tl, &(gr->toplevels), link) {
+		const char* const* strs = (const char* const*)&(tl->props);
+		for(i = 0; i < SNAPSHOT_N_STRINGS; i++) if(strs[i] && !g_hash_table_contains(copies, strs[i])) {
+			g_hash_table_add(copies, (gpointer)strs[i]);
+			bytes += strlen(strs[i]) + 1;
+		}
+		n++;
+	}
+	g_hash_table_remove_all(copies);
+	
+	struct snapshot_table* table = (struct snapshot_table*)g_atomic_rc_box_alloc0(
+		sizeof(struct snapshot_table) + n * sizeof(struct toplevel_snapshot_entry) + bytes);
+	table->n = n;
+	table->entries = (struct toplevel_snapshot_entry*)(table + 1);
+	char* next = (char*)(table->entries + n);
+	/* note: the list has the most recent toplevel first, store them in
+	 * the order of creation */
+	i = n;
+	wl_list_for_each(tl, &(gr->toplevels), link) {
+		struct toplevel_snapshot_entry* e = &(table->entries[--i]);
+		struct toplevel* parent = toplevel_get_parent(tl);
+		e->id = tl->trace_id;
+		e->parent = parent ? parent->trace_id + 1 : 0;
+		const char* const* strs = (const char* const*)&(tl->props);
+		const char** copy = (const char**)&(e->props);
+		unsigned int j;
+		for(j = 0; j < SNAPSHOT_N_STRINGS; j++) copy[j] = snapshot_table_add_string(copies, &next, strs[j]);
+		tl->snapshot_index = i;
+	}
+	g_hash_table_unref(copies);
+	return table;
+}
+
+static void snapshot_clear(gpointer data) {
+	struct snapshot* snap = (struct snapshot*)data;
+	g_atomic_rc_box_release(snap->table);
+}
+
+/* publish snap (taking over its reference, can be NULL) and release the
+ * one it replaces; readers still using that have their own reference */
+static void toplevel_manager_replace_snapshot(struct toplevel_manager* gr, struct snapshot* snap) {
+	g_mutex_lock(&(gr->snapshot_lock));
+	struct snapshot* old = gr->snapshot;
+	gr->snapshot = snap;
+	g_mutex_unlock(&(gr->snapshot_lock));
+	if(old) g_atomic_rc_box_release_full(old, snapshot_clear);
+}
+
+/* publish a new snapshot if anything changed since the last one */
+static void toplevel_manager_publish(struct toplevel_manager* gr) {
+	if(!(gr->snapshots_enabled && (gr->table_dirty || gr->snapshot_dirty))) return;
+	if(gr->table_dirty || !gr->table) {
+		if(gr->table) g_atomic_rc_box_release(gr->table);
+		gr->table = snapshot_table_new(gr);
+	}
+	gr->table_dirty = 0;
+	gr->snapshot_dirty = 0;
+	
+	struct snapshot* snap = (struct snapshot*)g_atomic_rc_box_alloc0(sizeof(struct snapshot));
+	snap->table = (struct snapshot_table*)g_atomic_rc_box_acquire(gr->table);
+	snap->pub.serial = ++gr->snapshot_serial;
+	snap->pub.n_toplevels = gr->table->n;
+	snap->pub.toplevels = gr->table->entries;
+	snap->pub.active = gr->active ? &(gr->table->entries[gr->active->snapshot_index]) : NULL;
+	
+	toplevel_manager_replace_snapshot(gr, snap);
+	if(gr->snapshot_callback) gr->snapshot_callback(gr->snapshot_data, gr, &(snap->pub));
+}
+
+/* mark the snapshot as outdated; it is published with the next batch */
+static void toplevel_manager_table_changed(struct toplevel_manager* gr) {
+	if(gr->snapshots_enabled) gr->table_dirty = 1;
+}
+
+/* recording events in a trace (if enabled) */
+static void trace_event(struct toplevel* tl, enum toplevel_trace_type type,
+		const char* str0, const char* str1, const char* str2) {
+	struct toplevel_manager* gr = tl->gr;
+	if(!(gr && gr->trace)) return;
+	struct toplevel_trace_event ev = { .type = type, .toplevel = tl->trace_id, .str = { str0, str1, str2 } };
+	toplevel_trace_write(gr->trace, &ev);
+}
+
+static void trace_parent(struct toplevel* tl, wfthandle* parent) {
+	struct toplevel_manager* gr = tl->gr;
+	if(!(gr && gr->trace)) return;
+	struct toplevel* ptl = parent ? (struct toplevel*)zwlr_foreign_toplevel_handle_v1_get_user_data(parent) : NULL;
+	struct toplevel_trace_event ev = { .type = TOPLEVEL_TRACE_PARENT, .toplevel = tl->trace_id,
+		.parent = ptl ? ptl->trace_id + 1 : 0 };
+	toplevel_trace_write(gr->trace, &ev);
+}
+
+static void trace_output(struct toplevel* tl, enum toplevel_trace_type type, struct wl_output* output) {
+	struct toplevel_manager* gr = tl->gr;
+	if(!(gr && gr->trace)) return;
+	guint32 id = GPOINTER_TO_UINT(g_hash_table_lookup(gr->trace_outputs, output));
+	if(!id) {
+		id = ++gr->next_trace_output;
+		g_hash_table_insert(gr->trace_outputs, output, GUINT_TO_POINTER(id));
+	}
+	struct toplevel_trace_event ev = { .type = type, .toplevel = tl->trace_id, .output = id - 1 };
+	toplevel_trace_write(gr->trace, &ev);
+}
+
 /* callbacks */
 
-static void title_cb(G_GNUC_UNUSED void* data, G_GNUC_UNUSED wfthandle* handle,
-		G_GNUC_UNUSED const char* title) {
-	/* don't care */
+static void title_cb(void* data, G_GNUC_UNUSED wfthandle* handle, const char* title) {
+	/* don't care, except for recording it */
+	if(data) trace_event((struct toplevel*)data, TOPLEVEL_TRACE_TITLE, title, NULL, NULL);
 }
 
 static void appid_cb(void* data, G_GNUC_UNUSED wfthandle* handle, const char* app_id) {
 	if(!(app_id && data)) return;
 	struct toplevel* tl = (struct toplevel*)data;
-	free(tl->props.app_id);
-	tl->props.app_id = strdup(app_id);
+	struct toplevel_manager* gr = tl->gr;
+	trace_event(tl, TOPLEVEL_TRACE_APP_ID, app_id, NULL, NULL);
+	if(tl->props.app_id && tl->props.app_id == string_pool_lookup(gr->strings, app_id)) return;
+	toplevel_index_remove(gr->by_app_id, tl->props.app_id, tl);
+	string_pool_release(gr->strings, tl->props.app_id);
+	tl->props.app_id = string_pool_intern(gr->strings, app_id);
+	toplevel_index_add(gr->by_app_id, tl->props.app_id, tl);
+	tl->changes |= TOPLEVEL_CHANGED_APP_ID;
 }
 
-static void output_enter_cb(G_GNUC_UNUSED void* data, G_GNUC_UNUSED wfthandle* handle,
-		G_GNUC_UNUSED struct wl_output* output) {
-	/* don't care */
+static void output_enter_cb(void* data, G_GNUC_UNUSED wfthandle* handle, struct wl_output* output) {
+	if(!(data && output)) return;
+	struct toplevel* tl = (struct toplevel*)data;
+	unsigned int i;
+	trace_output(tl, TOPLEVEL_TRACE_OUTPUT_ENTER, output);
+	for(i = 0; i < tl->n_outputs; i++) if(tl->outputs[i] == output) return;
+	if(tl->n_outputs == TOPLEVEL_MAX_OUTPUTS) return;
+	tl->outputs[tl->n_outputs++] = output;
+	tl->outputs_changed = 1;
 }
-static void output_leave_cb(G_GNUC_UNUSED void* data, G_GNUC_UNUSED wfthandle* handle,
-		G_GNUC_UNUSED struct wl_output* output) {
-	/* don't care */
+
+static void toplevel_leave_output(struct toplevel* tl, struct wl_output* output) {
+	unsigned int i;
+	for(i = 0; i < tl->n_outputs; i++) if(tl->outputs[i] == output) {
+		/* note: the order does not matter */
+		tl->outputs[i] = tl->outputs[--tl->n_outputs];
+		tl->outputs_changed = 1;
+		return;
+	}
+}
+
+static void output_leave_cb(void* data, G_GNUC_UNUSED wfthandle* handle, struct wl_output* output) {
+	if(!(data && output)) return;
+	struct toplevel* tl = (struct toplevel*)data;
+	trace_output(tl, TOPLEVEL_TRACE_OUTPUT_LEAVE, output);
+	toplevel_leave_output(tl, output);
+}
+
+static void toplevel_manager_push_recent(struct toplevel_manager* gr, struct toplevel* tl);
+
+/* watch the bus names of the given toplevel (and stop watching the
+ * previous ones), so that we learn if the app exporting its menu exits
+ * -- only on the main thread, since it uses the menu cache */
+static void toplevel_manager_watch_names(struct toplevel_manager* gr, struct toplevel* tl) {
+	const char* names[4];
+	unsigned int i;
+	toplevel_get_bus_names(gr->cache ? tl : NULL, names);
+	/* note: watch the new names first, so that unchanged ones stay watched */
+	for(i = 0; i < 4; i++) {
+		names[i] = string_pool_intern(gr->strings, names[i]);
+		menu_cache_watch_name(gr->cache, names[i]);
+	}
+	for(i = 0; i < 4; i++) {
+		menu_cache_unwatch_name(gr->cache, gr->watched[i]);
+		string_pool_release(gr->strings, gr->watched[i]);
+		gr->watched[i] = names[i];
+	}
+}
+
+static void toplevel_manager_call(struct toplevel_manager* gr, unsigned int changes) {
+	gint64 start = gr->metrics ? g_get_monotonic_time() : 0;
+	if(gr->callback) gr->callback(gr->data, gr);
+	if(gr->change_callback) gr->change_callback(gr->change_data, gr, changes);
+	if(gr->metrics) {
+		metrics_record(gr->metrics, METRICS_CALLBACK, g_get_monotonic_time() - start);
+		metrics_count(gr->metrics, METRICS_CALLBACKS);
+	}
+}
+
+/* report the last activated toplevel if it is fully known by now, or
+ * the changes of the active toplevel */
+static void toplevel_manager_dispatch(struct toplevel_manager* gr) {
+	struct toplevel* tl = gr->pending;
+	gint64 pending_time = 0;
+	if(tl && tl->init_done) {
+		gr->pending = NULL;
+		pending_time = gr->pending_time;
+		struct toplevel* new_active = tl->root;
+		if(!(gr->self && new_active->props.app_id == gr->self)) {
+			if(new_active != gr->active) {
+				gr->active = new_active;
+				gr->changes = TOPLEVEL_CHANGED_ALL;
+				gr->snapshot_dirty = 1;
+				toplevel_manager_push_recent(gr, new_active);
+			}
+			/* note: a different child window might be on other outputs */
+			gr->focused = tl;
+			gr->outputs_moved = 1;
+		}
+	}
+	if(gr->outputs_moved) {
+		gr->outputs_moved = 0;
+		toplevel_manager_update_outputs(gr);
+	}
+	/* note: callbacks can already use the new snapshot */
+	toplevel_manager_publish(gr);
+	
+	unsigned int changes = gr->changes;
+	gr->changes = 0;
+	if(changes) {
+		/* note: the active app might have been closed */
+		toplevel_manager_watch_names(gr, gr->active);
+		if(gr->active && (changes & TOPLEVEL_CHANGED_ACTIVE)) {
+			gr->stats.callbacks++;
+			/* note: this includes the debounce delay */
+			if(pending_time) metrics_record(gr->metrics, METRICS_STATE_TO_CALLBACK,
+				g_get_monotonic_time() - pending_time);
+		}
+		toplevel_manager_call(gr, changes);
+	}
+	toplevel_manager_dispatch_outputs(gr);
+}
+
+/* release proxies of closed or changed toplevels -- only on the main thread */
+static void toplevel_manager_release_orphans(struct toplevel_manager* gr) {
+	unsigned int i;
+	for(i = 0; i < gr->orphans->len; i++)
+		menu_cache_release((struct menu_cache_entry*)g_ptr_array_index(gr->orphans, i));
+	g_ptr_array_set_size(gr->orphans, 0);
+}
+
+/* report the result of asynchronous construction */
+static void toplevel_manager_report_ready(struct toplevel_manager* gr) {
+	if(!gr->init_reported) return;
+	void (*ready)(void* data, struct toplevel_manager* gr, int success) = gr->ready;
+	gr->ready = NULL;
+	if(ready) ready(gr->ready_data, gr, gr->manager != NULL);
+}
+
+/* runs on the main thread after a timeout or when notified from the
+ * event processing thread */
+static gboolean notify_cb(gpointer data) {
+	struct toplevel_manager* gr = (struct toplevel_manager*)data;
+	g_rec_mutex_lock(&(gr->lock));
+	/* note: the ID might have been replaced if we were about to run
+	 * when a new source was added */
+	guint id = g_source_get_id(g_main_current_source());
+	if(gr->debounce_id == id) gr->debounce_id = 0;
+	if(gr->notify_id == id) gr->notify_id = 0;
+	toplevel_manager_report_ready(gr);
+	toplevel_manager_release_orphans(gr);
+	toplevel_manager_dispatch(gr);
+	g_rec_mutex_unlock(&(gr->lock));
+	return G_SOURCE_REMOVE;
+}
+
+static void toplevel_manager_notify(struct toplevel_manager* gr) {
+	if(!gr->notify_id) gr->notify_id = g_idle_add(notify_cb, gr);
+}
+
+/* called at the end of a batch of events (i.e. on done) */
+static void toplevel_manager_schedule(struct toplevel_manager* gr) {
+	if(gr->debounce_ms) {
+		/* restart the timer, so that only the last activation is reported */
+		if(gr->debounce_id) g_source_remove(gr->debounce_id);
+		gr->debounce_id = g_timeout_add(gr->debounce_ms, notify_cb, gr);
+	}
+	else if(gr->threaded) toplevel_manager_notify(gr);
+	else toplevel_manager_dispatch(gr);
+}
+
+/* called by the menu cache if a watched bus name gets or loses its owner */
+static void toplevel_manager_name_cb(void* data, const char* bus_name, G_GNUC_UNUSED int owned) {
+	struct toplevel_manager* gr = (struct toplevel_manager*)data;
+	g_rec_mutex_lock(&(gr->lock));
+	struct toplevel* tl = gr->active;
+	const char* name = string_pool_lookup(gr->strings, bus_name);
+	if(tl && name) {
+		unsigned int changes = 0;
+		if(tl->props.menubar_bus_name == name) changes |= TOPLEVEL_CHANGED_MENUBAR;
+		if(tl->props.application_bus_name == name) changes |= TOPLEVEL_CHANGED_APP_ACTIONS;
+		if(tl->props.window_bus_name == name) changes |= TOPLEVEL_CHANGED_WINDOW_ACTIONS;
+		if(tl->props.kde_service_name == name) changes |= TOPLEVEL_CHANGED_DBUSMENU;
+		if(changes) {
+			/* the proxies are already dropped by the cache, report this
+			 * so that it can be shown as having no menu */
+			gr->changes |= changes;
+			unsigned int i;
+			for(i = 0; i < gr->outputs->len; i++) {
+				struct toplevel_output* o = (struct toplevel_output*)g_ptr_array_index(gr->outputs, i);
+				if(o->active == tl) o->changes |= changes;
+			}
+			toplevel_manager_schedule(gr);
+		}
+	}
+	g_rec_mutex_unlock(&(gr->lock));
 }
 
 static void state_cb(void* data, G_GNUC_UNUSED wfthandle* handle, struct wl_array* state) {
@@ -102,6 +718,12 @@ static void state_cb(void* data, G_GNUC_UNUSED wfthandle* handle, struct wl_arra
 	int activated = 0;
 	int i;
 	uint32_t* stdata = (uint32_t*)state->data;
+	if(gr->trace) {
+		struct toplevel_trace_event ev = { .type = TOPLEVEL_TRACE_STATE, .toplevel = tl->trace_id };
+		for(i = 0; i*sizeof(uint32_t) < state->size && i < TOPLEVEL_TRACE_MAX_STATES; i++)
+			ev.states[ev.n_states++] = stdata[i];
+		toplevel_trace_write(gr->trace, &ev);
+	}
 	for(i = 0; i*sizeof(uint32_t) < state->size; i++) {
 		if(stdata[i] == ZWLR_FOREIGN_TOPLEVEL_HANDLE_V1_STATE_ACTIVATED) {
             activated = 1;
@@ -109,55 +731,219 @@ static void state_cb(void* data, G_GNUC_UNUSED wfthandle* handle, struct wl_arra
 		}
 	}
 	if(activated) {
-		int orig_init_done = tl->init_done;
-		struct toplevel* new_active = NULL;
-		while(tl) {
-			new_active = tl;
-			if(!tl->parent) break;
-			tl = zwlr_foreign_toplevel_handle_v1_get_user_data(tl->parent);
-		}
-		if(new_active != gr->active) {
-			if(!gr->self || strcmp(gr->self, new_active->props.app_id)) {
-				gr->active = new_active;
-				if(orig_init_done && gr->callback) gr->callback(gr->data, gr);
-			}
+		/* note: we only process this on the next done event, when all
+		 * properties (including the parent) are up-to-date */
+		gr->stats.activations++;
+		/* the previous activation was not reported yet, only this one will be */
+		if(gr->pending) gr->stats.coalesced++;
+		gr->pending = tl;
+		if(gr->metrics) {
+			gr->pending_time = g_get_monotonic_time();
+			metrics_count(gr->metrics, METRICS_STATE_EVENTS);
 		}
-		
-		/*
-		fprintf(stdout, "Activated app with the following DBus properties:\n");
-		fprintf(stdout, "application_id: %s\n",          new_active->gtk_application_id);
-		fprintf(stdout, "app_menu_path: %s\n",           new_active->app_menu_path);
-		fprintf(stdout, "menubar_path: %s\n",            new_active->menubar_path);
-		fprintf(stdout, "window_object_path: %s\n",      new_active->window_object_path);
-		fprintf(stdout, "application_object_path: %s\n", new_active->application_object_path);
-		fprintf(stdout, "unique_bus_name: %s\n",         new_active->unique_bus_name);
-		
-		fprintf(stdout, "kde_service_name: %s\n",        new_active->kde_service_name);
-		fprintf(stdout, "kde_object_path: %s\n",         new_active->kde_object_path); */
 	}
 }
 
 static void done_cb(void* data, G_GNUC_UNUSED wfthandle* handle) {
 	if(!data) return;
 	struct toplevel* tl = (struct toplevel*)data;
+	struct toplevel_manager* gr = tl->gr;
+	trace_event(tl, TOPLEVEL_TRACE_DONE, NULL, NULL, NULL);
 	tl->init_done = 1;
+	/* note: only changes of the active app (globally or on an output) are
+	 * interesting, any others will be reported with TOPLEVEL_CHANGED_ALL
+	 * when activated; we only dispatch if this batch changed anything, so
+	 * that done events of other toplevels do not delay or repeat it */
+	int dirty = (tl == gr->pending);
+	if(tl == gr->active && tl->changes) {
+		gr->changes |= tl->changes;
+		dirty = 1;
+	}
+	if((tl->changes || tl->table_changed) && gr->snapshots_enabled) {
+		toplevel_manager_table_changed(gr);
+		dirty = 1;
+	}
+	tl->table_changed = 0;
+	unsigned int i;
+	for(i = 0; tl->changes && i < gr->outputs->len; i++) {
+		struct toplevel_output* o = (struct toplevel_output*)g_ptr_array_index(gr->outputs, i);
+		if(o->active == tl) {
+			o->changes |= tl->changes;
+			dirty = 1;
+		}
+	}
+	tl->changes = 0;
+	/* the active app moved to a different output */
+	if(tl->outputs_changed && gr->active && (tl == gr->active || tl == gr->focused)) {
+		gr->outputs_moved = 1;
+		dirty = 1;
+	}
+	tl->outputs_changed = 0;
+	if(dirty) toplevel_manager_schedule(gr);
+}
+
+static void toplevel_drop_menu(struct toplevel* tl, enum toplevel_menu_slot slot) {
+	if(tl->menus[slot]) {
+		struct toplevel_manager* gr = tl->gr;
+		if(gr->threaded) {
+			/* proxies should only be touched on the main thread */
+			g_ptr_array_add(gr->orphans, tl->menus[slot]);
+			toplevel_manager_notify(gr);
+		}
+		else menu_cache_release(tl->menus[slot]);
+		tl->menus[slot] = NULL;
+		gr->n_menus--;
+	}
+}
+
+static void toplevel_drop_menus(struct toplevel* tl) {
+	int i;
+	for(i = 0; i < TOPLEVEL_N_MENUS; i++) toplevel_drop_menu(tl, (enum toplevel_menu_slot)i);
+}
+
+/* estimated memory used by all toplevels, the strings in their
+ * properties and the menu proxies held for them */
+static size_t toplevel_manager_memory(struct toplevel_manager* gr) {
+	struct string_pool_stats strings;
+	string_pool_get_stats(gr->strings, &strings);
+	return gr->n_toplevels * sizeof(struct toplevel) + strings.bytes +
+		gr->n_menus * (size_t)TOPLEVEL_MENU_COST;
+}
+
+static int toplevel_manager_over_budget(struct toplevel_manager* gr) {
+	return gr->budget && toplevel_manager_memory(gr) > gr->budget;
+}
+
+/* release the menus of tl to save memory, unless it is shown or keep;
+ * returns whether we are within the budget afterwards */
+static int toplevel_evict_menus(struct toplevel* tl, struct toplevel* keep) {
+	struct toplevel_manager* gr = tl->gr;
+	if(tl != keep && !toplevel_is_shown(gr, tl)) {
+		int i;
+		for(i = 0; i < TOPLEVEL_N_MENUS; i++) if(tl->menus[i]) {
+			toplevel_drop_menu(tl, (enum toplevel_menu_slot)i);
+			gr->stats.evictions++;
+		}
+	}
+	return !toplevel_manager_over_budget(gr);
+}
+
+/* release menus until the estimated memory use is within the budget,
+ * first of apps not active recently, then of the least recently active
+ * ones; note: the toplevels themselves cannot be released */
+static void toplevel_manager_enforce_budget(struct toplevel_manager* gr, struct toplevel* keep) {
+	if(!(gr->n_menus && toplevel_manager_over_budget(gr))) return;
+	struct toplevel* tl;
+	wl_list_for_each(tl, &(gr->toplevels), link)
+		if(!g_queue_find(&(gr->mru), tl) && toplevel_evict_menus(tl, keep)) return;
+	GList* l;
+	for(l = gr->mru.tail; l; l = l->prev)
+		if(toplevel_evict_menus((struct toplevel*)l->data, keep)) return;
+}
+
+/* get the proxy for the given slot, creating it if necessary */
+static GObject* toplevel_get_menu(struct toplevel* tl, enum toplevel_menu_slot slot) {
+	if(!tl->menus[slot] && tl->gr->cache) {
+		const struct toplevel_properties* props = &(tl->props);
+		switch(slot) {
+			case TOPLEVEL_MENUBAR:
+				tl->menus[slot] = menu_cache_acquire(tl->gr->cache, MENU_CACHE_MENU_MODEL,
+					props->menubar_bus_name, props->menubar_path);
+				break;
+			case TOPLEVEL_APP_ACTIONS:
+				tl->menus[slot] = menu_cache_acquire(tl->gr->cache, MENU_CACHE_ACTION_GROUP,
+					props->application_bus_name, props->application_object_path);
+				break;
+			case TOPLEVEL_WINDOW_ACTIONS:
+				tl->menus[slot] = menu_cache_acquire(tl->gr->cache, MENU_CACHE_ACTION_GROUP,
+					props->window_bus_name, props->window_object_path);
+				break;
+			default:
+				break;
+		}
+		if(tl->menus[slot]) {
+			tl->gr->n_menus++;
+			toplevel_manager_enforce_budget(tl->gr, tl);
+		}
+	}
+	return menu_cache_entry_get_object(tl->menus[slot]);
+}
+
+/* runs on the main thread in idle time: make sure that the menus of the
+ * most recently active apps are fetched and subscribed to, and release
+ * the proxies of any others, so that the number of subscriptions is limited */
+static gboolean prefetch_cb(gpointer data) {
+	struct toplevel_manager* gr = (struct toplevel_manager*)data;
+	g_rec_mutex_lock(&(gr->lock));
+	if(gr->prefetch_id == g_source_get_id(g_main_current_source())) gr->prefetch_id = 0;
+	unsigned int n = 0;
+	GList* l;
+	for(l = gr->mru.head; gr->prefetch && gr->cache && l; l = l->next) {
+		struct toplevel* tl = (struct toplevel*)l->data;
+		/* note: the active apps are used already */
+		if(toplevel_is_shown(gr, tl)) continue;
+		if(n++ >= gr->prefetch) toplevel_drop_menus(tl);
+		/* note: over the budget, menus of less recently used apps are
+		 * released instead of being fetched */
+		else if(toplevel_manager_over_budget(gr)) toplevel_evict_menus(tl, NULL);
+		else {
+			GObject* obj = toplevel_get_menu(tl, TOPLEVEL_MENUBAR);
+			/* getting the items subscribes to the menu and fetches it */
+			if(obj) g_menu_model_get_n_items(G_MENU_MODEL(obj));
+			int j;
+			for(j = TOPLEVEL_APP_ACTIONS; j <= TOPLEVEL_WINDOW_ACTIONS; j++) {
+				/* similarly, this fetches the list and state of actions */
+				obj = toplevel_get_menu(tl, (enum toplevel_menu_slot)j);
+				if(obj) g_strfreev(g_action_group_list_actions(G_ACTION_GROUP(obj)));
+			}
+		}
+	}
+	toplevel_manager_release_orphans(gr);
+	g_rec_mutex_unlock(&(gr->lock));
+	return G_SOURCE_REMOVE;
+}
+
+static void toplevel_manager_schedule_prefetch(struct toplevel_manager* gr) {
+	if(gr->prefetch && !gr->prefetch_id)
+		gr->prefetch_id = g_idle_add_full(G_PRIORITY_LOW, prefetch_cb, gr, NULL);
+}
+
+/* add tl as the most recently active app */
+static void toplevel_manager_push_recent(struct toplevel_manager* gr, struct toplevel* tl) {
+	g_queue_remove(&(gr->mru), tl);
+	g_queue_push_head(&(gr->mru), tl);
+	if(g_queue_get_length(&(gr->mru)) > TOPLEVEL_MRU_MAX) {
+		struct toplevel* old = (struct toplevel*)g_queue_pop_tail(&(gr->mru));
+		if(gr->prefetch && !toplevel_is_shown(gr, old)) toplevel_drop_menus(old);
+	}
+	toplevel_manager_enforce_budget(gr, NULL);
+	toplevel_manager_schedule_prefetch(gr);
 }
 
 static void toplevel_free(struct toplevel *tl) {
 	/* note: we can assume that this toplevel is not set as the parent
-	 * of any existing toplevels at this point */
+	 * of any existing toplevels at this point, but others might be freed
+	 * as well, do not leave them with dangling links */
+	struct toplevel *child, *tmp;
+	wl_list_remove(&(tl->child_link));
+	wl_list_for_each_safe(child, tmp, &(tl->children), child_link) wl_list_init(&(child->child_link));
 	
 	zwlr_foreign_toplevel_handle_v1_destroy(tl->handle);
+	toplevel_drop_menus(tl);
+	tl->gr->n_toplevels--;
+	toplevel_index_remove(tl->gr->by_app_id, tl->props.app_id, tl);
+	toplevel_index_bus_names(tl, 0);
 	
-	free(tl->props.app_id);
-	free(tl->props.menubar_path);
-	free(tl->props.menubar_bus_name);
-	free(tl->props.window_object_path);
-	free(tl->props.window_bus_name);
-	free(tl->props.application_object_path);
-	free(tl->props.application_bus_name);
-	free(tl->props.kde_service_name);	
-	free(tl->props.kde_object_path);
+	struct string_pool* strings = tl->gr->strings;
+	string_pool_release(strings, tl->props.app_id);
+	string_pool_release(strings, tl->props.menubar_path);
+	string_pool_release(strings, tl->props.menubar_bus_name);
+	string_pool_release(strings, tl->props.window_object_path);
+	string_pool_release(strings, tl->props.window_bus_name);
+	string_pool_release(strings, tl->props.application_object_path);
+	string_pool_release(strings, tl->props.application_bus_name);
+	string_pool_release(strings, tl->props.kde_service_name);
+	string_pool_release(strings, tl->props.kde_object_path);
 	
 	free(tl);
 }
@@ -165,14 +951,79 @@ static void toplevel_free(struct toplevel *tl) {
 static void closed_cb(void* data, G_GNUC_UNUSED wfthandle* handle) {
 	if(!data) return;
 	struct toplevel* tl = (struct toplevel*)data;
+	struct toplevel_manager* gr = tl->gr;
+	trace_event(tl, TOPLEVEL_TRACE_CLOSED, NULL, NULL, NULL);
+	/* note: there is no active app until the next one is activated,
+	 * report this so that its menu is not shown anymore */
+	int was_active = 0;
+	if(gr->active == tl) {
+		gr->active = NULL;
+		gr->changes = TOPLEVEL_CHANGED_ALL;
+		was_active = 1;
+	}
+	if(gr->pending == tl) gr->pending = NULL;
+	if(gr->focused == tl) gr->focused = NULL;
+	unsigned int i;
+	for(i = 0; i < gr->outputs->len; i++) {
+		struct toplevel_output* o = (struct toplevel_output*)g_ptr_array_index(gr->outputs, i);
+		if(o->active == tl) {
+			o->active = NULL;
+			o->changes = TOPLEVEL_CHANGED_ALL;
+			was_active = 1;
+		}
+	}
+	g_queue_remove(&(gr->mru), tl);
 	wl_list_remove(&(tl->link));
+	
+	/* the compositor should have unset this as a parent already,
+	 * but make sure that we do not keep a dangling reference */
+	struct toplevel *child, *tmp;
+	wl_list_for_each_safe(child, tmp, &(tl->children), child_link) {
+		toplevel_set_parent(child, NULL);
+		toplevel_update_roots(child);
+	}
+	
 	toplevel_free(tl);
+	toplevel_manager_table_changed(gr);
+	if(gr->table_dirty || was_active) toplevel_manager_schedule(gr);
 }
 
-void parent_cb(void* data, G_GNUC_UNUSED wfthandle* handle, wfthandle* parent) {
+static void parent_cb(void* data, G_GNUC_UNUSED wfthandle* handle, wfthandle* parent) {
 	if(!data) return;
 	struct toplevel* tl = (struct toplevel*)data;
-	tl->parent = parent;
+	trace_parent(tl, parent);
+	if(tl->parent == parent) return;
+	toplevel_set_parent(tl, parent);
+	toplevel_update_roots(tl);
+	tl->table_changed = 1;
+	toplevel_manager_table_changed(tl->gr);
+}
+
+/* check if an interned string is equal to str, without allocating anything */
+static int toplevel_string_equal(struct toplevel_manager* gr, const char* interned, const char* str) {
+	if(!str) return interned == NULL;
+	return interned && interned == string_pool_lookup(gr->strings, str);
+}
+
+/* update one (object path, bus name) pair from an annotation event;
+ * returns nonzero if anything changed */
+static int set_annotation(struct toplevel* tl, const char** path, const char** bus_name,
+		const char* new_path, const char* new_bus_name) {
+	struct toplevel_manager* gr = tl->gr;
+	if(toplevel_string_equal(gr, *path, new_path) &&
+		toplevel_string_equal(gr, *bus_name, new_bus_name)) return 0;
+	
+	toplevel_index_bus_names(tl, 0);
+	/* note: intern the new values first, so that a part that did not
+	 * change is not freed and copied again */
+	const char* old_path = *path;
+	const char* old_bus_name = *bus_name;
+	*path = string_pool_intern(gr->strings, new_path);
+	*bus_name = string_pool_intern(gr->strings, new_bus_name);
+	string_pool_release(gr->strings, old_path);
+	string_pool_release(gr->strings, old_bus_name);
+	toplevel_index_bus_names(tl, 1);
+	return 1;
 }
 
 static void client_annotations_cb(void *data, G_GNUC_UNUSED wfthandle* handle,
@@ -180,21 +1031,18 @@ static void client_annotations_cb(void *data, G_GNUC_UNUSED wfthandle* handle,
 	if(!data) return;
 	struct toplevel* tl = (struct toplevel*)data;
 
-	fprintf(stderr, "got client annotations: %s %s %s\n", interface, bus_name, object_path);
+	if(tl->gr && tl->gr->debug)
+		fprintf(stderr, "got client annotations: %s %s %s\n", interface, bus_name, object_path);
+	trace_event(tl, TOPLEVEL_TRACE_CLIENT_ANNOTATION, interface, bus_name, object_path);
 
 	// we only care if this is the application_object_path, which corresponds
 	// to the org.gtk.Actions interface
 	if(!strcmp(interface, "org.gtk.Actions")) {
-		free(tl->props.application_object_path);
-		free(tl->props.application_bus_name);
-		
-		if (object_path != NULL)
-			tl->props.application_object_path = strdup(object_path);
-		else tl->props.application_object_path = NULL;
-
-		if (bus_name != NULL)
-			tl->props.application_bus_name = strdup(bus_name);
-		else tl->props.application_bus_name = NULL;
+		if(set_annotation(tl, &(tl->props.application_object_path), &(tl->props.application_bus_name),
+				object_path, bus_name)) {
+			toplevel_drop_menu(tl, TOPLEVEL_APP_ACTIONS);
+			tl->changes |= TOPLEVEL_CHANGED_APP_ACTIONS;
+		}
 	}
 }
 
@@ -203,43 +1051,28 @@ static void surface_annotations_cb(void *data, G_GNUC_UNUSED wfthandle* handle,
 	if(!data) return;
 	struct toplevel* tl = (struct toplevel*)data;
 
-	fprintf(stderr, "got surface annotations: %s %s %s\n", interface, bus_name, object_path);
+	if(tl->gr && tl->gr->debug)
+		fprintf(stderr, "got surface annotations: %s %s %s\n", interface, bus_name, object_path);
+	trace_event(tl, TOPLEVEL_TRACE_SURFACE_ANNOTATION, interface, bus_name, object_path);
 
 	if(!strcmp(interface, "org.gtk.Actions")) {
-		free(tl->props.window_object_path);
-		free(tl->props.window_bus_name);
-
-		if (object_path != NULL)
-			tl->props.window_object_path = strdup(object_path);
-		else tl->props.window_object_path = NULL;
-
-		if (bus_name != NULL)
-			tl->props.window_bus_name = strdup(bus_name);
-		else tl->props.window_bus_name = NULL;
+		if(set_annotation(tl, &(tl->props.window_object_path), &(tl->props.window_bus_name),
+				object_path, bus_name)) {
+			toplevel_drop_menu(tl, TOPLEVEL_WINDOW_ACTIONS);
+			tl->changes |= TOPLEVEL_CHANGED_WINDOW_ACTIONS;
+		}
 	}
 	else if(!strcmp(interface, "org.gtk.Menus")) {
-		free(tl->props.menubar_path);
-		free(tl->props.menubar_bus_name);
-
-		if (object_path != NULL)
-			tl->props.menubar_path = strdup(object_path);
-		else tl->props.menubar_path = NULL;
-
-		if (bus_name != NULL)
-			tl->props.menubar_bus_name = strdup(bus_name);
-		else tl->props.menubar_bus_name = NULL;
+		if(set_annotation(tl, &(tl->props.menubar_path), &(tl->props.menubar_bus_name),
+				object_path, bus_name)) {
+			toplevel_drop_menu(tl, TOPLEVEL_MENUBAR);
+			tl->changes |= TOPLEVEL_CHANGED_MENUBAR;
+		}
 	}
 	else if (!strcmp(interface, "com.canonical.dbusmenu")) {
-		free(tl->props.kde_object_path);
-		free(tl->props.kde_service_name);
-
-		if (object_path != NULL)
-			tl->props.kde_object_path = strdup(object_path);
-		else tl->props.kde_object_path = NULL;
-
-		if (bus_name != NULL)
-			tl->props.kde_service_name = strdup(bus_name);
-		else tl->props.kde_service_name = NULL;
+		if(set_annotation(tl, &(tl->props.kde_object_path), &(tl->props.kde_service_name),
+				object_path, bus_name))
+			tl->changes |= TOPLEVEL_CHANGED_DBUSMENU;
 	}
 }
 
@@ -268,11 +1101,22 @@ static void new_toplevel(void *data, G_GNUC_UNUSED struct zwlr_foreign_toplevel_
 	struct toplevel_manager* gr = (struct toplevel_manager*)data;
 	struct toplevel* tl = (struct toplevel*)calloc(1, sizeof(struct toplevel));
 	if(!tl) {
-		/* TODO: error message */
+		/* destroy the handle, so that the compositor does not keep sending events for it */
+		fprintf(stderr, "Cannot allocate memory for a new toplevel, ignoring it!\n");
+		zwlr_foreign_toplevel_handle_v1_destroy(handle);
+		gr->stats.dropped++;
 		return;
 	}
 	tl->handle = handle;
+	tl->root = tl;
+	wl_list_init(&(tl->children));
+	wl_list_init(&(tl->child_link));
 	tl->gr = gr;
+	gr->n_toplevels++;
+	tl->trace_id = gr->next_trace_id++;
+	tl->table_changed = 1;
+	toplevel_manager_table_changed(gr);
+	trace_event(tl, TOPLEVEL_TRACE_TOPLEVEL, NULL, NULL, NULL);
 	wl_list_insert(&(gr->toplevels), &(tl->link));
 	
 	/* note: we cannot do anything as long as we get app_id */
@@ -280,8 +1124,13 @@ static void new_toplevel(void *data, G_GNUC_UNUSED struct zwlr_foreign_toplevel_
 }
 
 /* sent when toplevel management is no longer available -- this will happen after stopping */
-static void toplevel_manager_finished(G_GNUC_UNUSED void *data,
+static void toplevel_manager_finished(void *data,
 		struct zwlr_foreign_toplevel_manager_v1 *manager) {
+	struct toplevel_manager* gr = (struct toplevel_manager*)data;
+	if(gr && gr->trace) {
+		struct toplevel_trace_event ev = { .type = TOPLEVEL_TRACE_FINISHED };
+		toplevel_trace_write(gr->trace, &ev);
+	}
     zwlr_foreign_toplevel_manager_v1_destroy(manager);
 }
 
@@ -297,11 +1146,13 @@ static void registry_global_add_cb(void *data, struct wl_registry *registry,
 		uint32_t v = zwlr_foreign_toplevel_manager_v1_interface.version;
 		if(version < v) v = version;
 		gr->manager = wl_registry_bind(registry, id, &zwlr_foreign_toplevel_manager_v1_interface, v);
-		if(gr->manager)
+		if(gr->manager) {
 			zwlr_foreign_toplevel_manager_v1_add_listener(gr->manager, &toplevel_manager_interface, gr);
-		else { /* TODO: handle error */ }
+			/* we need one more roundtrip to get the initial list of toplevels */
+			gr->init_done = 0;
+		}
+		else fprintf(stderr, "Cannot bind the wlr-foreign-toplevel interface!\n");
 	}
-	gr->init_done = 0;
 }
 
 static void registry_global_remove_cb(G_GNUC_UNUSED void *data,
@@ -314,68 +1165,552 @@ static const struct wl_registry_listener registry_listener = {
 	registry_global_remove_cb
 };
 
-struct toplevel_manager* toplevel_manager_new() {
+/* we got all globals after asynchronous construction */
+static void init_sync_done(void* data, struct wl_callback* cb, G_GNUC_UNUSED uint32_t serial) {
+	struct toplevel_manager* gr = (struct toplevel_manager*)data;
+	wl_callback_destroy(cb);
+	gr->init_cb = NULL;
+	gr->init_reported = 1;
+	if(!gr->manager)
+		fprintf(stderr, "Could not bind wlr-foreign-toplevel interface, your compositor might not support this protocol\n");
+	/* note: the callback should run on the main thread */
+	if(gr->threaded) toplevel_manager_notify(gr);
+	else toplevel_manager_report_ready(gr);
+}
+
+static const struct wl_callback_listener init_sync_listener = {
+	.done = init_sync_done
+};
+
+/* event processing for TOPLEVEL_MANAGER_THREADED */
+static gpointer toplevel_manager_thread(gpointer data) {
+	struct toplevel_manager* gr = (struct toplevel_manager*)data;
+	struct pollfd fds[2];
+	fds[0].fd = wl_display_get_fd(gr->dpy);
+	fds[0].events = POLLIN;
+	fds[1].fd = gr->stop_pipe[0];
+	fds[1].events = POLLIN;
+	
+	while(1) {
+		while(wl_display_prepare_read_queue(gr->dpy, gr->queue) != 0) {
+			g_rec_mutex_lock(&(gr->lock));
+			wl_display_dispatch_queue_pending(gr->dpy, gr->queue);
+			g_rec_mutex_unlock(&(gr->lock));
+		}
+		wl_display_flush(gr->dpy);
+		
+		fds[0].revents = fds[1].revents = 0;
+		if(poll(fds, 2, -1) < 0) {
+			wl_display_cancel_read(gr->dpy);
+			if(errno == EINTR) continue;
+			break;
+		}
+		if(fds[1].revents) {
+			wl_display_cancel_read(gr->dpy);
+			break;
+		}
+		if(fds[0].revents & POLLIN) {
+			if(wl_display_read_events(gr->dpy) < 0) break;
+		}
+		else {
+			wl_display_cancel_read(gr->dpy);
+			if(fds[0].revents & (POLLERR | POLLHUP)) break;
+		}
+		
+		g_rec_mutex_lock(&(gr->lock));
+		wl_display_dispatch_queue_pending(gr->dpy, gr->queue);
+		g_rec_mutex_unlock(&(gr->lock));
+	}
+	return NULL;
+}
+
+/* free resources of a manager that is not running anymore */
+static void toplevel_manager_destroy(struct toplevel_manager* gr) {
+	if(gr->registry) wl_registry_destroy(gr->registry);
+	if(gr->queue) wl_event_queue_destroy(gr->queue);
+	if(gr->stop_pipe[0] >= 0) close(gr->stop_pipe[0]);
+	if(gr->stop_pipe[1] >= 0) close(gr->stop_pipe[1]);
+	g_ptr_array_free(gr->orphans, TRUE);
+	g_ptr_array_free(gr->outputs, TRUE);
+	g_hash_table_destroy(gr->trace_outputs);
+	/* note: readers may keep their snapshots, these are refcounted */
+	toplevel_manager_replace_snapshot(gr, NULL);
+	g_mutex_clear(&(gr->snapshot_lock));
+	if(gr->table) g_atomic_rc_box_release(gr->table);
+	g_hash_table_destroy(gr->by_app_id);
+	g_hash_table_destroy(gr->by_bus_name);
+	string_pool_free(gr->strings);
+	g_rec_mutex_clear(&(gr->lock));
+}
+
+/* common part of creating a new manager: set up everything up to
+ * getting the registry */
+static struct toplevel_manager* toplevel_manager_create(struct wl_display* dpy, unsigned int flags) {
+	if(!dpy) {
+		GdkDisplay *gdkdsp = gdk_display_get_default();
+		if (GDK_IS_WAYLAND_DISPLAY (gdkdsp))
+			dpy = gdk_wayland_display_get_wl_display(gdkdsp);
+		
+		if(!dpy) {
+			fprintf(stderr, "Cannot connect to Wayland display, not running in a Wayland session?\n");
+			return NULL;
+		}
+	}
+	
 	struct toplevel_manager* gr = (struct toplevel_manager*)calloc(1, sizeof(struct toplevel_manager));
 	if(!gr) return NULL;
 	
-	struct wl_display* dpy = NULL;
-	GdkDisplay *gdkdsp = gdk_display_get_default();
-	if (GDK_IS_WAYLAND_DISPLAY (gdkdsp))
-		dpy = gdk_wayland_display_get_wl_display(gdkdsp);
+	wl_list_init(&(gr->toplevels));
+	g_queue_init(&(gr->mru));
+	g_rec_mutex_init(&(gr->lock));
+	gr->orphans = g_ptr_array_new();
+	gr->outputs = g_ptr_array_new_with_free_func((GDestroyNotify)toplevel_output_free);
+	gr->trace_outputs = g_hash_table_new(g_direct_hash, g_direct_equal);
+	g_mutex_init(&(gr->snapshot_lock));
+	gr->by_app_id = toplevel_index_new();
+	gr->by_bus_name = toplevel_index_new();
+	gr->strings = string_pool_new();
+	gr->stop_pipe[0] = gr->stop_pipe[1] = -1;
+	gr->dpy = dpy;
+	gr->threaded = (flags & TOPLEVEL_MANAGER_THREADED) ? 1 : 0;
 	
-	if(!dpy) {
-		fprintf(stderr, "Cannot connect to Wayland display, not running in a Wayland session?\n");
-		free(gr);
-		return NULL;
+	if(gr->threaded) {
+		/* used to stop the thread */
+		if(pipe(gr->stop_pipe)) {
+			fprintf(stderr, "Cannot create pipe for event processing thread!\n");
+			gr->stop_pipe[0] = gr->stop_pipe[1] = -1;
+			toplevel_manager_destroy(gr);
+			free(gr);
+			return NULL;
+		}
+		/* all objects created from the registry will use our queue */
+		gr->queue = wl_display_create_queue(dpy);
 	}
 	
-	wl_list_init(&(gr->toplevels));
+	return gr;
+}
+
+/* get the registry, using our queue if needed */
+static void toplevel_manager_start(struct toplevel_manager* gr, int async) {
+	struct wl_display* wrapper = gr->dpy;
+	if(gr->queue) {
+		wrapper = wl_proxy_create_wrapper(gr->dpy);
+		wl_proxy_set_queue((struct wl_proxy*)wrapper, gr->queue);
+	}
 	
-	struct wl_registry* registry = wl_display_get_registry(dpy);
-	wl_registry_add_listener(registry, &registry_listener, gr);
+	gr->registry = wl_display_get_registry(wrapper);
+	wl_registry_add_listener(gr->registry, &registry_listener, gr);
+	if(async) {
+		gr->init_cb = wl_display_sync(wrapper);
+		wl_callback_add_listener(gr->init_cb, &init_sync_listener, gr);
+	}
+	
+	if(wrapper != gr->dpy) wl_proxy_wrapper_destroy(wrapper);
+}
+
+struct toplevel_manager* toplevel_manager_new_full(struct wl_display* dpy, unsigned int flags) {
+	struct toplevel_manager* gr = toplevel_manager_create(dpy, flags);
+	if(!gr) return NULL;
+	
+	toplevel_manager_start(gr, 0);
 	do {
 		gr->init_done = 1;
-		wl_display_roundtrip(dpy);
+		if(gr->queue) wl_display_roundtrip_queue(gr->dpy, gr->queue);
+		else wl_display_roundtrip(gr->dpy);
 	}
 	while(!gr->init_done);
 	
 	if(!gr->manager) {
 		fprintf(stderr, "Could not bind wlr-foreign-toplevel interface, your compositor might not support this protocol\n");
+		toplevel_manager_destroy(gr);
 		free(gr);
 		return NULL;
 	}
+	
+	if(gr->threaded) gr->thread = g_thread_new("toplevel_manager", toplevel_manager_thread, gr);
+	return gr;
+}
+
+struct toplevel_manager* toplevel_manager_new_async(struct wl_display* dpy, unsigned int flags,
+		void (*ready)(void* data, struct toplevel_manager* gr, int success), void* data) {
+	struct toplevel_manager* gr = toplevel_manager_create(dpy, flags);
+	if(!gr) return NULL;
+	
+	gr->ready = ready;
+	gr->ready_data = data;
+	toplevel_manager_start(gr, 1);
+	wl_display_flush(gr->dpy);
+	if(gr->threaded) gr->thread = g_thread_new("toplevel_manager", toplevel_manager_thread, gr);
 	return gr;
 }
 
+struct toplevel_manager* toplevel_manager_new_for_display(struct wl_display* dpy) {
+	if(!dpy) return NULL;
+	return toplevel_manager_new_full(dpy, 0);
+}
+
+struct toplevel_manager* toplevel_manager_new() {
+	return toplevel_manager_new_full(NULL, 0);
+}
+
 const struct toplevel_properties* toplevel_manager_get_active_app(struct toplevel_manager* gr) {
-	if(gr && gr->active) return &(gr->active->props);
-	return NULL;
+	if(!gr) return NULL;
+	g_rec_mutex_lock(&(gr->lock));
+	const struct toplevel_properties* props = gr->active ? &(gr->active->props) : NULL;
+	g_rec_mutex_unlock(&(gr->lock));
+	return props;
 }
 
 void toplevel_manager_set_callback(struct toplevel_manager* gr,
 		void (*callback)(void* data, struct toplevel_manager* gr), void* data) {
 	if(gr) {
+		g_rec_mutex_lock(&(gr->lock));
 		gr->callback = callback;
 		gr->data = data;
+		g_rec_mutex_unlock(&(gr->lock));
 	}
 }
 
+void toplevel_manager_set_change_callback(struct toplevel_manager* gr,
+		void (*callback)(void* data, struct toplevel_manager* gr, unsigned int changes), void* data) {
+	if(!gr) return;
+	g_rec_mutex_lock(&(gr->lock));
+	gr->change_callback = callback;
+	gr->change_data = data;
+	g_rec_mutex_unlock(&(gr->lock));
+}
+
+void toplevel_manager_set_menu_cache(struct toplevel_manager* gr, struct menu_cache* cache) {
+	if(!gr) return;
+	g_rec_mutex_lock(&(gr->lock));
+	/* existing proxies belong to the previous cache */
+	struct toplevel* tl;
+	wl_list_for_each(tl, &(gr->toplevels), link) toplevel_drop_menus(tl);
+	toplevel_manager_release_orphans(gr);
+	toplevel_manager_watch_names(gr, NULL);
+	menu_cache_remove_name_callback(gr->cache, toplevel_manager_name_cb, gr);
+	gr->cache = cache;
+	menu_cache_add_name_callback(gr->cache, toplevel_manager_name_cb, gr);
+	toplevel_manager_watch_names(gr, gr->active);
+	toplevel_manager_schedule_prefetch(gr);
+	g_rec_mutex_unlock(&(gr->lock));
+}
+
+static GObject* toplevel_manager_get_menu(struct toplevel_manager* gr, enum toplevel_menu_slot slot) {
+	if(!gr) return NULL;
+	g_rec_mutex_lock(&(gr->lock));
+	GObject* obj = gr->active ? toplevel_get_menu(gr->active, slot) : NULL;
+	g_rec_mutex_unlock(&(gr->lock));
+	return obj;
+}
+
+GMenuModel* toplevel_manager_get_menu_model(struct toplevel_manager* gr) {
+	return (GMenuModel*)toplevel_manager_get_menu(gr, TOPLEVEL_MENUBAR);
+}
+
+GActionGroup* toplevel_manager_get_app_actions(struct toplevel_manager* gr) {
+	return (GActionGroup*)toplevel_manager_get_menu(gr, TOPLEVEL_APP_ACTIONS);
+}
+
+GActionGroup* toplevel_manager_get_window_actions(struct toplevel_manager* gr) {
+	return (GActionGroup*)toplevel_manager_get_menu(gr, TOPLEVEL_WINDOW_ACTIONS);
+}
+
+void toplevel_manager_set_snapshots(struct toplevel_manager* gr, int enable) {
+	if(!gr) return;
+	g_rec_mutex_lock(&(gr->lock));
+	gr->snapshots_enabled = enable ? 1 : 0;
+	if(enable) {
+		/* publish the current state right away */
+		gr->table_dirty = 1;
+		toplevel_manager_publish(gr);
+	}
+	else toplevel_manager_replace_snapshot(gr, NULL);
+	g_rec_mutex_unlock(&(gr->lock));
+}
+
+void toplevel_manager_set_snapshot_callback(struct toplevel_manager* gr,
+		void (*callback)(void* data, struct toplevel_manager* gr, const struct toplevel_snapshot* snap), void* data) {
+	if(!gr) return;
+	g_rec_mutex_lock(&(gr->lock));
+	gr->snapshot_callback = callback;
+	gr->snapshot_data = data;
+	g_rec_mutex_unlock(&(gr->lock));
+}
+
+const struct toplevel_snapshot* toplevel_manager_get_snapshot(struct toplevel_manager* gr) {
+	if(!gr) return NULL;
+	/* note: the lock keeps the writer from releasing the snapshot before
+	 * we have our own reference; it is never held for longer than that */
+	g_mutex_lock(&(gr->snapshot_lock));
+	struct snapshot* snap = gr->snapshot;
+	if(snap) g_atomic_rc_box_acquire(snap);
+	g_mutex_unlock(&(gr->snapshot_lock));
+	return snap ? &(snap->pub) : NULL;
+}
+
+const struct toplevel_snapshot* toplevel_snapshot_ref(const struct toplevel_snapshot* snap) {
+	if(snap) g_atomic_rc_box_acquire((gpointer)snap);
+	return snap;
+}
+
+void toplevel_snapshot_unref(const struct toplevel_snapshot* snap) {
+	if(snap) g_atomic_rc_box_release_full((gpointer)snap, snapshot_clear);
+}
+
+unsigned int toplevel_manager_add_output_callback(struct toplevel_manager* gr, struct wl_output* output,
+		toplevel_output_callback callback, void* data) {
+	if(!(gr && output && callback)) return 0;
+	g_rec_mutex_lock(&(gr->lock));
+	struct toplevel_output* o = toplevel_manager_find_output(gr, output, 1);
+	struct toplevel_output_subscriber sub = { ++gr->next_subscriber_id, callback, data };
+	if(!sub.id) sub.id = ++gr->next_subscriber_id; /* 0 is used for errors */
+	g_array_append_val(o->subscribers, sub);
+	g_rec_mutex_unlock(&(gr->lock));
+	return sub.id;
+}
+
+void toplevel_manager_remove_output_callback(struct toplevel_manager* gr, unsigned int id) {
+	if(!(gr && id)) return;
+	g_rec_mutex_lock(&(gr->lock));
+	unsigned int i, j;
+	for(i = 0; i < gr->outputs->len; i++) {
+		struct toplevel_output* o = (struct toplevel_output*)g_ptr_array_index(gr->outputs, i);
+		for(j = 0; j < o->subscribers->len; j++)
+			if(g_array_index(o->subscribers, struct toplevel_output_subscriber, j).id == id) {
+				g_array_remove_index(o->subscribers, j);
+				g_rec_mutex_unlock(&(gr->lock));
+				return;
+			}
+	}
+	g_rec_mutex_unlock(&(gr->lock));
+}
+
+void toplevel_manager_forget_output(struct toplevel_manager* gr, struct wl_output* output) {
+	if(!(gr && output)) return;
+	g_rec_mutex_lock(&(gr->lock));
+	struct toplevel* tl;
+	wl_list_for_each(tl, &(gr->toplevels), link) toplevel_leave_output(tl, output);
+	struct toplevel_output* o = toplevel_manager_find_output(gr, output, 0);
+	if(o) g_ptr_array_remove_fast(gr->outputs, o);
+	g_hash_table_remove(gr->trace_outputs, output);
+	g_rec_mutex_unlock(&(gr->lock));
+}
+
+/* get the toplevel last active on the given output */
+static struct toplevel* toplevel_manager_get_output_active(struct toplevel_manager* gr, struct wl_output* output) {
+	struct toplevel_output* o = output ? toplevel_manager_find_output(gr, output, 0) : NULL;
+	return o ? o->active : NULL;
+}
+
+const struct toplevel_properties* toplevel_manager_get_active_app_on_output(struct toplevel_manager* gr,
+		struct wl_output* output) {
+	if(!gr) return NULL;
+	g_rec_mutex_lock(&(gr->lock));
+	struct toplevel* tl = toplevel_manager_get_output_active(gr, output);
+	g_rec_mutex_unlock(&(gr->lock));
+	return tl ? &(tl->props) : NULL;
+}
+
+static GObject* toplevel_manager_get_menu_on_output(struct toplevel_manager* gr, struct wl_output* output,
+		enum toplevel_menu_slot slot) {
+	if(!gr) return NULL;
+	g_rec_mutex_lock(&(gr->lock));
+	struct toplevel* tl = toplevel_manager_get_output_active(gr, output);
+	GObject* obj = tl ? toplevel_get_menu(tl, slot) : NULL;
+	g_rec_mutex_unlock(&(gr->lock));
+	return obj;
+}
+
+GMenuModel* toplevel_manager_get_menu_model_on_output(struct toplevel_manager* gr, struct wl_output* output) {
+	return (GMenuModel*)toplevel_manager_get_menu_on_output(gr, output, TOPLEVEL_MENUBAR);
+}
+
+GActionGroup* toplevel_manager_get_app_actions_on_output(struct toplevel_manager* gr, struct wl_output* output) {
+	return (GActionGroup*)toplevel_manager_get_menu_on_output(gr, output, TOPLEVEL_APP_ACTIONS);
+}
+
+GActionGroup* toplevel_manager_get_window_actions_on_output(struct toplevel_manager* gr, struct wl_output* output) {
+	return (GActionGroup*)toplevel_manager_get_menu_on_output(gr, output, TOPLEVEL_WINDOW_ACTIONS);
+}
+
+unsigned int toplevel_manager_find_by_app_id(struct toplevel_manager* gr, const char* app_id,
+		const struct toplevel_properties** out, unsigned int max_count) {
+	if(!(gr && app_id)) return 0;
+	g_rec_mutex_lock(&(gr->lock));
+	const char* key = string_pool_lookup(gr->strings, app_id);
+	GPtrArray* toplevels = key ? (GPtrArray*)g_hash_table_lookup(gr->by_app_id, key) : NULL;
+	unsigned int n = toplevels ? toplevels->len : 0;
+	unsigned int i;
+	for(i = 0; i < n && i < max_count; i++)
+		out[i] = &(((struct toplevel*)g_ptr_array_index(toplevels, i))->props);
+	g_rec_mutex_unlock(&(gr->lock));
+	return n;
+}
+
+const struct toplevel_properties* toplevel_manager_find_by_bus_name(struct toplevel_manager* gr,
+		const char* bus_name) {
+	if(!(gr && bus_name)) return NULL;
+	g_rec_mutex_lock(&(gr->lock));
+	const char* key = string_pool_lookup(gr->strings, bus_name);
+	GPtrArray* toplevels = key ? (GPtrArray*)g_hash_table_lookup(gr->by_bus_name, key) : NULL;
+	const struct toplevel_properties* props = NULL;
+	if(toplevels) props = &(((struct toplevel*)g_ptr_array_index(toplevels, 0))->root->props);
+	g_rec_mutex_unlock(&(gr->lock));
+	return props;
+}
+
+void toplevel_manager_refresh(struct toplevel_manager* gr) {
+	if(!gr) return;
+	g_rec_mutex_lock(&(gr->lock));
+	if(gr->active) toplevel_manager_call(gr, TOPLEVEL_CHANGED_ALL);
+	unsigned int i;
+	for(i = 0; i < gr->outputs->len; i++) {
+		struct toplevel_output* o = (struct toplevel_output*)g_ptr_array_index(gr->outputs, i);
+		if(o->active) o->changes = TOPLEVEL_CHANGED_ALL;
+	}
+	toplevel_manager_dispatch_outputs(gr);
+	g_rec_mutex_unlock(&(gr->lock));
+}
+
+void toplevel_manager_set_debounce(struct toplevel_manager* gr, unsigned int ms) {
+	if(!gr) return;
+	g_rec_mutex_lock(&(gr->lock));
+	gr->debounce_ms = ms;
+	g_rec_mutex_unlock(&(gr->lock));
+}
+
+void toplevel_manager_set_memory_budget(struct toplevel_manager* gr, size_t bytes) {
+	if(!gr) return;
+	g_rec_mutex_lock(&(gr->lock));
+	gr->budget = bytes;
+	toplevel_manager_enforce_budget(gr, NULL);
+	toplevel_manager_release_orphans(gr);
+	g_rec_mutex_unlock(&(gr->lock));
+}
+
+void toplevel_manager_set_prefetch(struct toplevel_manager* gr, unsigned int n_apps) {
+	if(!gr) return;
+	g_rec_mutex_lock(&(gr->lock));
+	gr->prefetch = (n_apps < TOPLEVEL_MRU_MAX) ? n_apps : TOPLEVEL_MRU_MAX - 1;
+	toplevel_manager_schedule_prefetch(gr);
+	g_rec_mutex_unlock(&(gr->lock));
+}
+
+void toplevel_manager_set_metrics(struct toplevel_manager* gr, struct metrics* metrics) {
+	if(!gr) return;
+	g_rec_mutex_lock(&(gr->lock));
+	gr->metrics = metrics;
+	gr->pending_time = 0;
+	g_rec_mutex_unlock(&(gr->lock));
+}
+
+/* write the current state of all toplevels to a newly set trace, so that
+ * it can be replayed on its own; note: titles are not kept, so these
+ * are missing until they change */
+static void toplevel_manager_trace_existing(struct toplevel_manager* gr) {
+	struct toplevel* tl;
+	struct toplevel* activated = gr->pending ? gr->pending : gr->active;
+	/* note: new toplevels are inserted at the head of the list */
+	wl_list_for_each_reverse(tl, &(gr->toplevels), link)
+		trace_event(tl, TOPLEVEL_TRACE_TOPLEVEL, NULL, NULL, NULL);
+	wl_list_for_each_reverse(tl, &(gr->toplevels), link) {
+		const struct toplevel_properties* props = &(tl->props);
+		if(props->app_id) trace_event(tl, TOPLEVEL_TRACE_APP_ID, props->app_id, NULL, NULL);
+		if(tl->parent) trace_parent(tl, tl->parent);
+		if(props->application_object_path) trace_event(tl, TOPLEVEL_TRACE_CLIENT_ANNOTATION,
+			"org.gtk.Actions", props->application_bus_name, props->application_object_path);
+		if(props->menubar_path) trace_event(tl, TOPLEVEL_TRACE_SURFACE_ANNOTATION,
+			"org.gtk.Menus", props->menubar_bus_name, props->menubar_path);
+		if(props->window_object_path) trace_event(tl, TOPLEVEL_TRACE_SURFACE_ANNOTATION,
+			"org.gtk.Actions", props->window_bus_name, props->window_object_path);
+		if(props->kde_object_path) trace_event(tl, TOPLEVEL_TRACE_SURFACE_ANNOTATION,
+			"com.canonical.dbusmenu", props->kde_service_name, props->kde_object_path);
+		unsigned int i;
+		for(i = 0; i < tl->n_outputs; i++) trace_output(tl, TOPLEVEL_TRACE_OUTPUT_ENTER, tl->outputs[i]);
+		if(tl == activated) {
+			struct toplevel_trace_event ev = { .type = TOPLEVEL_TRACE_STATE, .toplevel = tl->trace_id,
+				.n_states = 1, .states = { ZWLR_FOREIGN_TOPLEVEL_HANDLE_V1_STATE_ACTIVATED } };
+			toplevel_trace_write(gr->trace, &ev);
+		}
+		if(tl->init_done) trace_event(tl, TOPLEVEL_TRACE_DONE, NULL, NULL, NULL);
+	}
+}
+
+void toplevel_manager_set_trace(struct toplevel_manager* gr, struct toplevel_trace_writer* trace) {
+	if(!gr) return;
+	g_rec_mutex_lock(&(gr->lock));
+	gr->trace = trace;
+	/* note: outputs are numbered from zero in each trace */
+	g_hash_table_remove_all(gr->trace_outputs);
+	gr->next_trace_output = 0;
+	if(trace) toplevel_manager_trace_existing(gr);
+	g_rec_mutex_unlock(&(gr->lock));
+}
+
+void toplevel_manager_set_debug(struct toplevel_manager* gr, int debug) {
+	if(!gr) return;
+	g_rec_mutex_lock(&(gr->lock));
+	gr->debug = debug;
+	g_rec_mutex_unlock(&(gr->lock));
+}
+
+void toplevel_manager_get_stats(struct toplevel_manager* gr, struct toplevel_manager_stats* stats) {
+	if(!(gr && stats)) return;
+	g_rec_mutex_lock(&(gr->lock));
+	*stats = gr->stats;
+	struct string_pool_stats strings;
+	string_pool_get_stats(gr->strings, &strings);
+	stats->memory = toplevel_manager_memory(gr);
+	stats->menus = gr->n_menus;
+	g_rec_mutex_unlock(&(gr->lock));
+	stats->strings = strings.strings;
+	stats->string_refs = strings.references;
+	stats->string_bytes = strings.bytes;
+	stats->string_bytes_saved = strings.bytes_saved;
+}
+
 void toplevel_manager_set_self(struct toplevel_manager* gr, const char* self_id) {
 	if(!gr) return;
-	free(gr->self);
-	if(self_id) gr->self = strdup(self_id);
-	else gr->self = NULL;
+	g_rec_mutex_lock(&(gr->lock));
+	const char* old_self = gr->self;
+	gr->self = string_pool_intern(gr->strings, self_id);
+	string_pool_release(gr->strings, old_self);
+	g_rec_mutex_unlock(&(gr->lock));
 }
 
 void toplevel_manager_free(struct toplevel_manager* gr) {
 	if(!gr) return;
+	if(gr->thread) {
+		char c = 0;
+		if(write(gr->stop_pipe[1], &c, 1) != 1)
+			fprintf(stderr, "Cannot stop event processing thread!\n");
+		else g_thread_join(gr->thread);
+		gr->thread = NULL;
+	}
+	/* everything below runs on the main thread, so proxies can be
+	 * released directly instead of scheduling notify_cb() */
+	gr->threaded = 0;
+	if(gr->init_cb) {
+		wl_callback_destroy(gr->init_cb);
+		gr->init_cb = NULL;
+	}
+	gr->ready = NULL;
 	/* stop listening and also free all existing toplevels */
-	/* set user data to null -- this will stop adding newly reported toplevels */
-	zwlr_foreign_toplevel_manager_v1_set_user_data(gr->manager, NULL);
-	/* this will send the finished signal and result in destroying manager later */
-	zwlr_foreign_toplevel_manager_v1_stop(gr->manager);
-	gr->manager = NULL;
-	free(gr->self);
+	if(gr->manager) {
+		/* set user data to null -- this will stop adding newly reported toplevels */
+		zwlr_foreign_toplevel_manager_v1_set_user_data(gr->manager, NULL);
+		/* this will send the finished signal and result in destroying manager later */
+		zwlr_foreign_toplevel_manager_v1_stop(gr->manager);
+		gr->manager = NULL;
+	}
+	string_pool_release(gr->strings, gr->self);
+	gr->self = NULL;
+	gr->pending = NULL;
+	gr->trace = NULL;
+	gr->focused = NULL;
+	g_ptr_array_set_size(gr->outputs, 0);
+	g_queue_clear(&(gr->mru));
 	/* destroy all existing toplevel handles */
 	struct toplevel* tl;
 	struct toplevel* tmp;
@@ -383,6 +1718,18 @@ void toplevel_manager_free(struct toplevel_manager* gr) {
 		wl_list_remove(&(tl->link));
 		toplevel_free(tl);
 	}
+	toplevel_manager_release_orphans(gr);
+	toplevel_manager_watch_names(gr, NULL);
+	menu_cache_remove_name_callback(gr->cache, toplevel_manager_name_cb, gr);
+	/* nobody else will dispatch our queue, process the finished event here */
+	if(gr->queue) wl_display_roundtrip_queue(gr->dpy, gr->queue);
+	/* note: after everything that could schedule these */
+	if(gr->debounce_id) g_source_remove(gr->debounce_id);
+	gr->debounce_id = 0;
+	if(gr->notify_id) g_source_remove(gr->notify_id);
+	gr->notify_id = 0;
+	if(gr->prefetch_id) g_source_remove(gr->prefetch_id);
+	gr->prefetch_id = 0;
+	toplevel_manager_destroy(gr);
+	free(gr);
 }
-
-
@@ -31,25 +31,52 @@
 #ifndef FOREIGN_TOPLEVEL_H
 #define FOREIGN_TOPLEVEL_H
 
+#include <gio/gio.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 
 struct toplevel_manager;
+struct menu_cache;
+struct metrics;
+struct toplevel_trace_writer;
+struct wl_display;
+struct wl_output;
 
-/* properties of toplevels we care about */
+/* properties of toplevels we care about; strings are interned by the
+ * manager, so equal values of the same manager share the same pointer */
 struct toplevel_properties {
-	char* app_id;
-	char *menubar_path;
-	char *menubar_bus_name;
-	char *window_object_path;
-	char *window_bus_name;
-	char *application_object_path;
-	char *application_bus_name;
+	const char* app_id;
+	const char *menubar_path;
+	const char *menubar_bus_name;
+	const char *window_object_path;
+	const char *window_bus_name;
+	const char *application_object_path;
+	const char *application_bus_name;
+	
+	const char *kde_service_name;
+	const char *kde_object_path;
+};
+
+/* counters about activation events, see toplevel_manager_get_stats() */
+struct toplevel_manager_stats {
+	unsigned long activations; /* activation events received */
+	unsigned long callbacks;   /* times a newly activated app was reported */
+	unsigned long coalesced;   /* activations replaced by a later one before they were reported */
+	
+	/* memory used by the strings in toplevel_properties */
+	unsigned long strings;     /* distinct strings stored */
+	unsigned long string_refs; /* references to them from all toplevels */
+	size_t string_bytes;       /* bytes used by the strings */
+	size_t string_bytes_saved; /* bytes that would be used in addition without interning */
 	
-	char *kde_service_name;
-	char *kde_object_path;
+	/* memory use, see toplevel_manager_set_memory_budget() */
+	size_t memory;             /* estimated bytes used by toplevels and menu proxies */
+	unsigned int menus;        /* menu proxies currently held */
+	unsigned long evictions;   /* menu proxies released to stay within the budget */
+	unsigned long dropped;     /* toplevels ignored because memory could not be allocated */
 };
 
 /*
@@ -57,22 +84,257 @@ struct toplevel_properties {
  */
 struct toplevel_manager* toplevel_manager_new();
 
+/* flags for toplevel_manager_new_full() */
+enum toplevel_manager_flags {
+	/* Process toplevel events on a separate thread, using a dedicated
+	 * event queue. Callbacks are still called on the main thread (the
+	 * thread running the default GLib main context). */
+	TOPLEVEL_MANAGER_THREADED = 1
+};
+
+/*
+ * Create a new manager on the given Wayland connection (or the one used
+ * by GDK if dpy is NULL), with a combination of the above flags.
+ */
+struct toplevel_manager* toplevel_manager_new_full(struct wl_display* dpy, unsigned int flags);
+
 /*
- * Get info about the last activated app (if any).
+ * Create a new manager without waiting for the compositor. The ready
+ * callback is called on the main thread when the protocol has been bound
+ * (success is nonzero) or when it turns out that it is not supported
+ * (success is zero, the manager should be freed in this case). Toplevels
+ * and activations are reported afterwards as usual.
+ */
+struct toplevel_manager* toplevel_manager_new_async(struct wl_display* dpy, unsigned int flags,
+		void (*ready)(void* data, struct toplevel_manager* gr, int success), void* data);
+
+/*
+ * Create a new manager using the given Wayland connection instead of
+ * the one used by GDK. Events are dispatched from the default queue
+ * of the display, so the caller is responsible for dispatching them.
+ */
+struct toplevel_manager* toplevel_manager_new_for_display(struct wl_display* dpy);
+
+/*
+ * Get info about the last activated app (if any). With
+ * TOPLEVEL_MANAGER_THREADED, this is only safe to use from the callback.
  */
 const struct toplevel_properties* toplevel_manager_get_active_app(struct toplevel_manager* gr);
 
+/*
+ * Set the cache used to create menu and action group proxies for
+ * toplevels (see menu_cache.h). Proxies are created on demand and are
+ * kept while the toplevel exists and its annotations do not change,
+ * so switching back to an app does not need to fetch its menu again.
+ * The cache must outlive the manager or be unset before freeing it.
+ */
+void toplevel_manager_set_menu_cache(struct toplevel_manager* gr, struct menu_cache* cache);
+
+/*
+ * Get the menu model and action groups of the last activated app (if any).
+ * These are owned by the manager and remain valid until the next callback
+ * or until the menu cache is changed.
+ */
+GMenuModel* toplevel_manager_get_menu_model(struct toplevel_manager* gr);
+GActionGroup* toplevel_manager_get_app_actions(struct toplevel_manager* gr);
+GActionGroup* toplevel_manager_get_window_actions(struct toplevel_manager* gr);
+
 /* 
  * Set our own app-id; apps with this ID will be ignored.
  */
 void toplevel_manager_set_self(struct toplevel_manager* gr, const char* self_id);
 
 /* 
- * Set the callback function to be called when a new toplevel is activated.
+ * Set the callback function to be called when a new toplevel is activated
+ * or the properties of the active one change. It is also called when the
+ * active toplevel is closed, after which there is no active app until the
+ * next one is activated.
  */
 void toplevel_manager_set_callback(struct toplevel_manager* gr,
 		void (*callback)(void* data, struct toplevel_manager* gr), void* data);
 
+/* what changed about the active app, see toplevel_manager_set_change_callback() */
+enum toplevel_changes {
+	TOPLEVEL_CHANGED_ACTIVE         = 1,  /* a different toplevel became active */
+	TOPLEVEL_CHANGED_APP_ID         = 2,
+	TOPLEVEL_CHANGED_MENUBAR        = 4,  /* org.gtk.Menus annotation */
+	TOPLEVEL_CHANGED_APP_ACTIONS    = 8,  /* org.gtk.Actions client annotation */
+	TOPLEVEL_CHANGED_WINDOW_ACTIONS = 16, /* org.gtk.Actions surface annotation */
+	TOPLEVEL_CHANGED_DBUSMENU       = 32, /* com.canonical.dbusmenu annotation */
+	TOPLEVEL_CHANGED_ALL            = 63
+};
+
+/*
+ * Set a callback that is told which properties of the active app changed
+ * (a combination of the above flags). All flags are set when a different
+ * toplevel is activated; changes of the annotations of the already active
+ * toplevel are reported only with the affected flags, so that only the
+ * corresponding proxies need to be replaced. Can be used together with
+ * the callback set by toplevel_manager_set_callback().
+ */
+void toplevel_manager_set_change_callback(struct toplevel_manager* gr,
+		void (*callback)(void* data, struct toplevel_manager* gr, unsigned int changes), void* data);
+
+/*
+ * Immutable snapshots of all toplevels and the active app, which can be
+ * used from any thread. A new snapshot is published after each batch of
+ * changes (when the callbacks are called, or when only the list of
+ * toplevels changed). Getting the current snapshot never waits for
+ * event processing (it only takes a lock held while a snapshot is
+ * replaced); it stays valid until it is unreferenced, even after the
+ * manager is freed, while the manager releases its own reference as
+ * soon as a new snapshot replaces it. Publishing has to
+ * be enabled first (it is off by default, since it costs copying the
+ * properties of all toplevels whenever any of them changes).
+ */
+struct toplevel_snapshot_entry {
+	guint32 id;     /* unique for each toplevel (in the order of creation) */
+	guint32 parent; /* the parent's ID + 1, or 0 if there is none */
+	struct toplevel_properties props; /* strings are owned by the snapshot */
+};
+
+struct toplevel_snapshot {
+	guint64 serial; /* increases with each snapshot published */
+	unsigned int n_toplevels;
+	const struct toplevel_snapshot_entry* toplevels; /* in the order of creation */
+	const struct toplevel_snapshot_entry* active;    /* the active app or NULL */
+};
+
+void toplevel_manager_set_snapshots(struct toplevel_manager* gr, int enable);
+/* get a new reference to the current snapshot (NULL if not enabled) */
+const struct toplevel_snapshot* toplevel_manager_get_snapshot(struct toplevel_manager* gr);
+const struct toplevel_snapshot* toplevel_snapshot_ref(const struct toplevel_snapshot* snap);
+void toplevel_snapshot_unref(const struct toplevel_snapshot* snap);
+
+/*
+ * Set a function to call each time a new snapshot is published (e.g. to
+ * copy it elsewhere, see toplevel_share.h). It is called on the thread
+ * processing the changes with the manager locked, so it should be quick;
+ * snap is valid during the call (use toplevel_snapshot_ref() to keep it).
+ */
+void toplevel_manager_set_snapshot_callback(struct toplevel_manager* gr,
+		void (*callback)(void* data, struct toplevel_manager* gr, const struct toplevel_snapshot* snap), void* data);
+
+/*
+ * Per-output tracking, so that one manager can serve panels on several
+ * monitors. The compositor reports which outputs each toplevel is on
+ * (only outputs bound by the client on the same connection are reported,
+ * e.g. the ones bound by GDK). Each output has its own last active
+ * toplevel: the last one activated while it (or the activated child
+ * window) was on that output, or that moved to it while active.
+ * Subscribers of an output are called on the main thread, with the same
+ * flags as the change callback, when a different toplevel becomes the
+ * last active one on the output or when its properties change. If that
+ * toplevel is closed, they are called with all flags set, and there is
+ * no active app on the output until the next one is activated there.
+ * Note: an app exiting while its window stays open (so that its menu is
+ * gone) is only detected for the globally active one.
+ * Returns an ID to remove the callback, or 0 on error.
+ */
+typedef void (*toplevel_output_callback)(void* data, struct toplevel_manager* gr,
+		struct wl_output* output, unsigned int changes);
+unsigned int toplevel_manager_add_output_callback(struct toplevel_manager* gr, struct wl_output* output,
+		toplevel_output_callback callback, void* data);
+void toplevel_manager_remove_output_callback(struct toplevel_manager* gr, unsigned int id);
+
+/*
+ * Get the last active app on an output, and its menu and action groups,
+ * with the same restrictions as toplevel_manager_get_active_app() and
+ * toplevel_manager_get_menu_model().
+ */
+const struct toplevel_properties* toplevel_manager_get_active_app_on_output(struct toplevel_manager* gr,
+		struct wl_output* output);
+GMenuModel* toplevel_manager_get_menu_model_on_output(struct toplevel_manager* gr, struct wl_output* output);
+GActionGroup* toplevel_manager_get_app_actions_on_output(struct toplevel_manager* gr, struct wl_output* output);
+GActionGroup* toplevel_manager_get_window_actions_on_output(struct toplevel_manager* gr, struct wl_output* output);
+
+/*
+ * Forget about an output that was removed (including its subscribers),
+ * so that a new output reusing the same address is not confused with it.
+ */
+void toplevel_manager_forget_output(struct toplevel_manager* gr, struct wl_output* output);
+
+/*
+ * Find all toplevels with the given app-id (including dialogs and other
+ * child windows). Stores up to max_count of them in out and returns the
+ * total number found. The same restrictions apply to the returned
+ * pointers as for toplevel_manager_get_active_app().
+ */
+unsigned int toplevel_manager_find_by_app_id(struct toplevel_manager* gr, const char* app_id,
+		const struct toplevel_properties** out, unsigned int max_count);
+
+/*
+ * Find the toplevel which has any D-Bus interface on the given bus name.
+ * If it is a child window, its root (what would be the active app when
+ * activated) is returned.
+ */
+const struct toplevel_properties* toplevel_manager_find_by_bus_name(struct toplevel_manager* gr,
+		const char* bus_name);
+
+/*
+ * Call the callbacks again for the currently active app (if any), e.g.
+ * after setting the menu cache, reporting all properties as changed.
+ */
+void toplevel_manager_refresh(struct toplevel_manager* gr);
+
+/*
+ * Activations are reported at the end of each batch of events from the
+ * compositor (on the protocol's done event). Optionally, the report can
+ * be delayed by the given time (in milliseconds), restarting the timer
+ * on each activation, so that only the final active toplevel is reported
+ * after a series of quick switches. Zero (the default) disables this.
+ */
+void toplevel_manager_set_debounce(struct toplevel_manager* gr, unsigned int ms);
+
+/*
+ * Keep the menus of the given number of recently active apps (besides
+ * the active one) fetched and up-to-date, so that switching back to
+ * them shows their menu immediately. Menus are fetched in idle time on
+ * the main thread after each activation, using the menu cache. Proxies
+ * of apps used less recently are released, limiting the number of D-Bus
+ * subscriptions we keep. Zero (the default) disables this; proxies are
+ * then kept for as long as the toplevel exists.
+ */
+void toplevel_manager_set_prefetch(struct toplevel_manager* gr, unsigned int n_apps);
+
+/*
+ * Limit the memory used by the manager to approximately the given number
+ * of bytes (zero, the default, means no limit). This is estimated from the
+ * number of toplevels, the strings in their properties and the menu
+ * proxies held (including the menus fetched with them). If it is exceeded,
+ * proxies are released, starting with apps that were not active recently,
+ * and menus are not prefetched for more apps. Menus of shown toplevels are
+ * always kept, so the limit can be exceeded if there are many toplevels.
+ * The number of proxies released is included in the stats.
+ */
+void toplevel_manager_set_memory_budget(struct toplevel_manager* gr, size_t bytes);
+
+/*
+ * Record latencies on the path from the compositor's activation events to
+ * our callbacks in the given metrics (see metrics.h): the time from an
+ * activated state event to the callback being called, and the time spent
+ * in the callbacks. The metrics are not owned and have to be kept valid
+ * until this manager is freed or this function is called with NULL.
+ */
+void toplevel_manager_set_metrics(struct toplevel_manager* gr, struct metrics* metrics);
+
+/*
+ * Record all events received from the compositor in the given trace (see
+ * toplevel_trace.h), so that they can be replayed later. The current
+ * state of existing toplevels is written first, so the trace is
+ * self-contained. The writer is not owned and has to be kept valid until
+ * this manager is freed or this function is called with NULL.
+ */
+void toplevel_manager_set_trace(struct toplevel_manager* gr, struct toplevel_trace_writer* trace);
+
+/* Print the D-Bus annotations received for debugging (off by default). */
+void toplevel_manager_set_debug(struct toplevel_manager* gr, int debug);
+
+/*
+ * Get counters about activations processed so far and the memory used.
+ */
+void toplevel_manager_get_stats(struct toplevel_manager* gr, struct toplevel_manager_stats* stats);
+
 /* Stop listening to toplevel events and free all resources associated
  * with this instance.
  */
@@ -0,0 +1,293 @@
+/*
+ * gmenu_source.c -- fill a menu tree from a GMenuModel
+ * 
+ * Copyright 2025 Daniel Kondor <kondor.dani@gmail.com>
+ * 
+ * This is free and unencumbered software released into the public domain.
+ * 
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ * 
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <gmenu_source.h>
+#include <string.h>
+
+/* menus can link to themselves, do not follow links beyond this */
+#define GMENU_SOURCE_MAX_DEPTH 16
+
+
+/* a model that is shown as the children of a node */
+struct gmenu_watch {
+	struct gmenu_source* gs;
+	GMenuModel* model;
+	guint32 node;
+	unsigned int depth;
+};
+
+struct gmenu_group {
+	struct gmenu_source* gs;
+	char* prefix;
+	GActionGroup* group;
+};
+
+struct gmenu_source {
+	struct menu_tree* tree;
+	GHashTable* watches; /* node -> struct gmenu_watch* */
+	GPtrArray* groups;   /* struct gmenu_group* */
+};
+
+
+static void gmenu_import(struct gmenu_source* gs, GMenuModel* model, guint32 node, guint32 after,
+	gint first, gint n, unsigned int depth);
+
+static struct gmenu_group* gmenu_find_group(struct gmenu_source* gs, const char* prefix, size_t len) {
+	guint i;
+	for(i = 0; i < gs->groups->len; i++) {
+		struct gmenu_group* g = (struct gmenu_group*)g_ptr_array_index(gs->groups, i);
+		if(strlen(g->prefix) == len && !strncmp(g->prefix, prefix, len)) return g;
+	}
+	return NULL;
+}
+
+/* find the action group for an action name (with prefix) and the
+ * name of the action in it */
+static struct gmenu_group* gmenu_find_action(struct gmenu_source* gs, const char* action, const char** name) {
+	const char* dot = strchr(action, '.');
+	if(!dot) return NULL;
+	*name = dot + 1;
+	return gmenu_find_group(gs, action, dot - action);
+}
+
+/* flags of an item, based on the current state of its action */
+static unsigned int gmenu_item_flags(struct gmenu_source* gs, const struct menu_node* n) {
+	if(n->kind != MENU_NODE_ITEM) return MENU_NODE_ENABLED | MENU_NODE_VISIBLE;
+	/* items without an action are shown as disabled */
+	unsigned int flags = MENU_NODE_VISIBLE;
+	const char* name = NULL;
+	struct gmenu_group* g = n->action ? gmenu_find_action(gs, n->action, &name) : NULL;
+	gboolean enabled;
+	GVariant* state = NULL;
+	if(!(g && g_action_group_query_action(g->group, name, &enabled, NULL, NULL, NULL, &state))) return flags;
+	
+	if(enabled) flags |= MENU_NODE_ENABLED;
+	if(state) {
+		/* same logic as GTK: a boolean state without a target is a check
+		 * box, a state of the same type as the target is a radio button */
+		if(!n->target && g_variant_is_of_type(state, G_VARIANT_TYPE_BOOLEAN)) {
+			flags |= MENU_NODE_CHECK;
+			if(g_variant_get_boolean(state)) flags |= MENU_NODE_TOGGLED;
+		}
+		else if(n->target && g_variant_is_of_type(state, g_variant_get_type(n->target))) {
+			flags |= MENU_NODE_RADIO;
+			if(g_variant_equal(state, n->target)) flags |= MENU_NODE_TOGGLED;
+		}
+		g_variant_unref(state);
+	}
+	return flags;
+}
+
+/* update the flags of items using the given action (or all actions of
+ * the group if name is NULL) */
+static void gmenu_update_actions(struct gmenu_source* gs, const char* prefix, const char* name) {
+	size_t len = strlen(prefix);
+	guint32 i, size = menu_tree_get_size(gs->tree);
+	/* note: actions change rarely, so we just check all items */
+	for(i = 0; i < size; i++) {
+		const struct menu_node* n = menu_tree_get_node(gs->tree, i);
+		if(!(n && n->action && !strncmp(n->action, prefix, len) && n->action[len] == '.')) continue;
+		if(name && strcmp(n->action + len + 1, name)) continue;
+		menu_tree_set_flags(gs->tree, i, gmenu_item_flags(gs, n));
+	}
+}
+
+static void action_added_cb(G_GNUC_UNUSED GActionGroup* group, const char* name, gpointer data) {
+	struct gmenu_group* g = (struct gmenu_group*)data;
+	gmenu_update_actions(g->gs, g->prefix, name);
+}
+
+static void action_enabled_cb(G_GNUC_UNUSED GActionGroup* group, const char* name,
+		G_GNUC_UNUSED gboolean enabled, gpointer data) {
+	struct gmenu_group* g = (struct gmenu_group*)data;
+	gmenu_update_actions(g->gs, g->prefix, name);
+}
+
+static void action_state_cb(G_GNUC_UNUSED GActionGroup* group, const char* name,
+		G_GNUC_UNUSED GVariant* state, gpointer data) {
+	struct gmenu_group* g = (struct gmenu_group*)data;
+	gmenu_update_actions(g->gs, g->prefix, name);
+}
+
+static void gmenu_group_free(gpointer data) {
+	struct gmenu_group* g = (struct gmenu_group*)data;
+	g_signal_handlers_disconnect_by_data(g->group, g);
+	g_object_unref(g->group);
+	g_free(g->prefix);
+	g_free(g);
+}
+
+
+static void gmenu_watch_free(gpointer data) {
+	struct gmenu_watch* w = (struct gmenu_watch*)data;
+	g_signal_handlers_disconnect_by_data(w->model, w);
+	g_object_unref(w->model);
+	g_free(w);
+}
+
+/* stop watching the models of all descendants of node */
+static void gmenu_unwatch_children(struct gmenu_source* gs, guint32 node) {
+	const struct menu_node* n = menu_tree_get_node(gs->tree, node);
+	guint32 child = n ? n->first_child : MENU_TREE_NONE;
+	while(child != MENU_TREE_NONE) {
+		g_hash_table_remove(gs->watches, GUINT_TO_POINTER(child));
+		gmenu_unwatch_children(gs, child);
+		child = menu_tree_get_node(gs->tree, child)->next;
+	}
+}
+
+static void items_changed_cb(G_GNUC_UNUSED GMenuModel* model, gint position,
+		gint removed, gint added, gpointer data) {
+	struct gmenu_watch* w = (struct gmenu_watch*)data;
+	struct gmenu_source* gs = w->gs;
+	/* note: each item of the model is a child of w->node (sections
+	 * have their own model), so positions are the same */
+	guint32 after = MENU_TREE_NONE;
+	guint32 child = menu_tree_get_node(gs->tree, w->node)->first_child;
+	gint i;
+	for(i = 0; i < position && child != MENU_TREE_NONE; i++) {
+		after = child;
+		child = menu_tree_get_node(gs->tree, child)->next;
+	}
+	for(i = 0; i < removed && child != MENU_TREE_NONE; i++) {
+		guint32 next = menu_tree_get_node(gs->tree, child)->next;
+		g_hash_table_remove(gs->watches, GUINT_TO_POINTER(child));
+		gmenu_unwatch_children(gs, child);
+		menu_tree_remove(gs->tree, child);
+		child = next;
+	}
+	gmenu_import(gs, w->model, w->node, after, position, added, w->depth);
+	menu_tree_children_changed(gs->tree, w->node);
+}
+
+static void gmenu_watch(struct gmenu_source* gs, GMenuModel* model, guint32 node, unsigned int depth) {
+	struct gmenu_watch* w = g_new(struct gmenu_watch, 1);
+	w->gs = gs;
+	w->model = g_object_ref(model);
+	w->node = node;
+	w->depth = depth;
+	g_hash_table_insert(gs->watches, GUINT_TO_POINTER(node), w);
+	g_signal_connect(model, "items-changed", G_CALLBACK(items_changed_cb), w);
+	/* note: for GDBusMenuModel, this starts fetching its contents */
+	gmenu_import(gs, model, node, MENU_TREE_NONE, 0, g_menu_model_get_n_items(model), depth);
+}
+
+/* add n items of model from first as children of node, after its child after
+ * (or as the first ones if after is MENU_TREE_NONE) */
+static void gmenu_import(struct gmenu_source* gs, GMenuModel* model, guint32 node, guint32 after,
+		gint first, gint n, unsigned int depth) {
+	gint i;
+	for(i = first; i < first + n; i++) {
+		char* label = NULL;
+		char* action = NULL;
+		char* accel = NULL;
+		g_menu_model_get_item_attribute(model, i, G_MENU_ATTRIBUTE_LABEL, "s", &label);
+		g_menu_model_get_item_attribute(model, i, G_MENU_ATTRIBUTE_ACTION, "s", &action);
+		GVariant* target = g_menu_model_get_item_attribute_value(model, i, G_MENU_ATTRIBUTE_TARGET, NULL);
+		/* note: there is no constant for this, GTK uses the same name */
+		g_menu_model_get_item_attribute(model, i, "accel", "s", &accel);
+		/* note: this is already a serialized GIcon */
+		GVariant* icon = g_menu_model_get_item_attribute_value(model, i, G_MENU_ATTRIBUTE_ICON, NULL);
+		enum menu_node_kind kind = MENU_NODE_SECTION;
+		GMenuModel* link = g_menu_model_get_item_link(model, i, G_MENU_LINK_SECTION);
+		if(!link) {
+			link = g_menu_model_get_item_link(model, i, G_MENU_LINK_SUBMENU);
+			kind = link ? MENU_NODE_SUBMENU : MENU_NODE_ITEM;
+		}
+		
+		guint32 c = menu_tree_insert(gs->tree, node, after, kind, -1, label, action, target, 0);
+		if(c != MENU_TREE_NONE) {
+			after = c;
+			menu_tree_set_flags(gs->tree, c, gmenu_item_flags(gs, menu_tree_get_node(gs->tree, c)));
+			if(icon) menu_tree_set_icon(gs->tree, c, icon);
+			if(accel) menu_tree_set_accel(gs->tree, c, accel);
+			if(link && depth < GMENU_SOURCE_MAX_DEPTH) gmenu_watch(gs, link, c, depth + 1);
+		}
+		if(link) g_object_unref(link);
+		if(target) g_variant_unref(target);
+		if(icon) g_variant_unref(icon);
+		g_free(accel);
+		g_free(action);
+		g_free(label);
+	}
+}
+
+
+static void gmenu_activate(void* data, struct menu_tree* tree, guint32 node, G_GNUC_UNUSED guint32 timestamp) {
+	struct gmenu_source* gs = (struct gmenu_source*)data;
+	const struct menu_node* n = menu_tree_get_node(tree, node);
+	const char* name = NULL;
+	struct gmenu_group* g = n->action ? gmenu_find_action(gs, n->action, &name) : NULL;
+	if(g) g_action_group_activate_action(g->group, name, n->target);
+}
+
+static const struct menu_tree_backend gmenu_backend = { gmenu_activate, NULL, NULL };
+
+struct gmenu_source* gmenu_source_new(GMenuModel* model) {
+	if(!model) return NULL;
+	struct gmenu_source* gs = g_new0(struct gmenu_source, 1);
+	gs->tree = menu_tree_new();
+	gs->watches = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, gmenu_watch_free);
+	gs->groups = g_ptr_array_new_with_free_func(gmenu_group_free);
+	menu_tree_set_backend(gs->tree, &gmenu_backend, gs);
+	gmenu_watch(gs, model, MENU_TREE_ROOT, 0);
+	return gs;
+}
+
+struct menu_tree* gmenu_source_get_tree(struct gmenu_source* gs) {
+	return gs ? gs->tree : NULL;
+}
+
+void gmenu_source_set_action_group(struct gmenu_source* gs, const char* prefix, GActionGroup* group) {
+	if(!(gs && prefix)) return;
+	struct gmenu_group* g = gmenu_find_group(gs, prefix, strlen(prefix));
+	if(g && g->group == group) return;
+	if(g) g_ptr_array_remove(gs->groups, g);
+	if(group) {
+		g = g_new(struct gmenu_group, 1);
+		g->gs = gs;
+		g->prefix = g_strdup(prefix);
+		g->group = g_object_ref(group);
+		g_signal_connect(group, "action-added", G_CALLBACK(action_added_cb), g);
+		g_signal_connect(group, "action-removed", G_CALLBACK(action_added_cb), g);
+		g_signal_connect(group, "action-enabled-changed", G_CALLBACK(action_enabled_cb), g);
+		g_signal_connect(group, "action-state-changed", G_CALLBACK(action_state_cb), g);
+		g_ptr_array_add(gs->groups, g);
+	}
+	gmenu_update_actions(gs, prefix, NULL);
+}
+
+void gmenu_source_free(struct gmenu_source* gs) {
+	if(!gs) return;
+	g_hash_table_destroy(gs->watches);
+	g_ptr_array_free(gs->groups, TRUE);
+	menu_tree_free(gs->tree);
+	g_free(gs);
+}
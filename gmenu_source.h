@@ -0,0 +1,68 @@
+/*
+ * gmenu_source.h -- fill a menu tree from a GMenuModel
+ * 
+ * Copyright 2025 Daniel Kondor <kondor.dani@gmail.com>
+ * 
+ * This is free and unencumbered software released into the public domain.
+ * 
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ * 
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef GMENU_SOURCE_H
+#define GMENU_SOURCE_H
+
+#include <gio/gio.h>
+#include <menu_tree.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+struct gmenu_source;
+
+/*
+ * Create a menu tree with the contents of model (typically a
+ * GDBusMenuModel), including all submenus and sections, and keep it
+ * up-to-date as the model changes. Items are enabled and show their
+ * state based on the action groups added with
+ * gmenu_source_set_action_group(); activating them activates the action.
+ */
+struct gmenu_source* gmenu_source_new(GMenuModel* model);
+
+/* get the tree; it is owned by the source and is freed with it */
+struct menu_tree* gmenu_source_get_tree(struct gmenu_source* gs);
+
+/*
+ * Set the action group used for actions with the given prefix (e.g. "app"
+ * or "win"); a NULL group removes it.
+ */
+void gmenu_source_set_action_group(struct gmenu_source* gs, const char* prefix, GActionGroup* group);
+
+void gmenu_source_free(struct gmenu_source* gs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,265 @@
+/*
+ * icon_cache.c -- shared cache of decoded menu icons
+ * 
+ * Copyright 2025 Daniel Kondor <kondor.dani@gmail.com>
+ * 
+ * This is free and unencumbered software released into the public domain.
+ * 
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ * 
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+#include <icon_cache.h>
+#include <string.h>
+
+/* larger icons are not decoded (they are not meant for menus) */
+#define ICON_CACHE_MAX_DATA (1024 * 1024)
+
+struct icon_cache_waiter {
+	icon_cache_ready ready;
+	void* data;
+};
+
+struct icon_cache_entry {
+	GBytes* icon;       /* key, i.e. the encoded image */
+	GdkPixbuf* pixbuf;  /* NULL if the image is not valid or not decoded yet */
+	GList* link;        /* in the LRU list, NULL while decoding */
+	GArray* waiters;    /* struct icon_cache_waiter, while decoding */
+};
+
+/* an icon decoded by a worker */
+struct icon_job {
+	GBytes* icon;
+	GdkPixbuf* pixbuf;
+};
+
+struct icon_cache {
+	GHashTable* entries;     /* GBytes -> struct icon_cache_entry*, key owned by the entry */
+	GQueue lru;              /* struct icon_cache_entry* that are decoded, most recent first */
+	unsigned int max_icons;
+	int size;
+	GThreadPool* pool;
+	gint closing;            /* workers should skip the remaining jobs */
+	GMutex lock;             /* protects done and idle_id, shared with the workers */
+	GQueue done;             /* struct icon_job*, waiting for the main thread */
+	guint idle_id;
+	struct icon_cache_stats stats;
+};
+
+
+static void entry_free(gpointer p) {
+	struct icon_cache_entry* e = (struct icon_cache_entry*)p;
+	g_bytes_unref(e->icon);
+	if(e->pixbuf) g_object_unref(e->pixbuf);
+	if(e->waiters) g_array_free(e->waiters, TRUE);
+	g_free(e);
+}
+
+static void job_free(struct icon_job* job) {
+	g_bytes_unref(job->icon);
+	if(job->pixbuf) g_object_unref(job->pixbuf);
+	g_free(job);
+}
+
+static gsize pixbuf_bytes(GdkPixbuf* pixbuf) {
+	return pixbuf ? gdk_pixbuf_get_byte_length(pixbuf) : 0;
+}
+
+/* scale down large images while they are loaded */
+static void size_prepared_cb(GdkPixbufLoader* loader, gint width, gint height, gpointer data) {
+	int size = GPOINTER_TO_INT(data);
+	if(size <= 0 || (width <= size && height <= size)) return;
+	if(width >= height) gdk_pixbuf_loader_set_size(loader, size, MAX(1, height * size / width));
+	else gdk_pixbuf_loader_set_size(loader, MAX(1, width * size / height), size);
+}
+
+GdkPixbuf* icon_cache_decode(GBytes* icon, int size) {
+	gsize len = 0;
+	const guchar* buf = icon ? g_bytes_get_data(icon, &len) : NULL;
+	if(!(buf && len) || len > ICON_CACHE_MAX_DATA) return NULL;
+	
+	GdkPixbufLoader* loader = gdk_pixbuf_loader_new();
+	g_signal_connect(loader, "size-prepared", G_CALLBACK(size_prepared_cb), GINT_TO_POINTER(size));
+	gboolean ok = gdk_pixbuf_loader_write(loader, buf, len, NULL);
+	/* note: the loader needs to be closed even after an error */
+	ok = gdk_pixbuf_loader_close(loader, NULL) && ok;
+	GdkPixbuf* pixbuf = ok ? gdk_pixbuf_loader_get_pixbuf(loader) : NULL;
+	if(pixbuf) g_object_ref(pixbuf);
+	g_object_unref(loader);
+	return pixbuf;
+}
+
+GBytes* icon_cache_get_data(GVariant* icon) {
+	const char* kind;
+	GVariant* v;
+	if(!(icon && g_variant_is_of_type(icon, G_VARIANT_TYPE("(sv)")))) return NULL;
+	g_variant_get(icon, "(&sv)", &kind, &v);
+	/* note: this does not copy the data */
+	GBytes* ret = (!strcmp(kind, "bytes") && g_variant_is_of_type(v, G_VARIANT_TYPE_BYTESTRING)) ?
+		g_variant_get_data_as_bytes(v) : NULL;
+	g_variant_unref(v);
+	return ret;
+}
+
+
+/* move the results of the workers to the cache and notify the waiters */
+static gboolean icon_cache_done_cb(gpointer data) {
+	struct icon_cache* c = (struct icon_cache*)data;
+	GQueue done = G_QUEUE_INIT;
+	g_mutex_lock(&c->lock);
+	done = c->done;
+	g_queue_init(&c->done);
+	c->idle_id = 0;
+	g_mutex_unlock(&c->lock);
+	
+	struct icon_job* job;
+	while((job = (struct icon_job*)g_queue_pop_head(&done))) {
+		struct icon_cache_entry* e = g_hash_table_lookup(c->entries, job->icon);
+		/* note: entries are only removed after they are decoded */
+		e->pixbuf = job->pixbuf;
+		job->pixbuf = NULL;
+		if(!e->pixbuf) c->stats.failed++;
+		c->stats.pending--;
+		c->stats.bytes += pixbuf_bytes(e->pixbuf);
+		g_queue_push_head(&c->lru, e);
+		e->link = c->lru.head;
+		
+		/* note: the waiters might request more icons, which can evict
+		 * this one; the key is kept by the job */
+		GArray* waiters = e->waiters;
+		e->waiters = NULL;
+		while(c->lru.length > c->max_icons) {
+			struct icon_cache_entry* old = (struct icon_cache_entry*)g_queue_pop_tail(&c->lru);
+			c->stats.bytes -= pixbuf_bytes(old->pixbuf);
+			c->stats.evicted++;
+			g_hash_table_remove(c->entries, old->icon);
+		}
+		guint i;
+		for(i = 0; i < waiters->len; i++) {
+			struct icon_cache_waiter* w = &g_array_index(waiters, struct icon_cache_waiter, i);
+			w->ready(w->data, job->icon);
+		}
+		g_array_free(waiters, TRUE);
+		job_free(job);
+	}
+	return G_SOURCE_REMOVE;
+}
+
+static void icon_cache_worker(gpointer data, gpointer user_data) {
+	struct icon_job* job = (struct icon_job*)data;
+	struct icon_cache* c = (struct icon_cache*)user_data;
+	if(!g_atomic_int_get(&c->closing)) job->pixbuf = icon_cache_decode(job->icon, c->size);
+	g_mutex_lock(&c->lock);
+	g_queue_push_tail(&c->done, job);
+	if(!c->idle_id) c->idle_id = g_idle_add(icon_cache_done_cb, c);
+	g_mutex_unlock(&c->lock);
+}
+
+
+struct icon_cache* icon_cache_new(unsigned int max_icons, int size, unsigned int threads) {
+	struct icon_cache* c = g_new0(struct icon_cache, 1);
+	c->entries = g_hash_table_new_full(g_bytes_hash, g_bytes_equal, NULL, entry_free);
+	g_queue_init(&c->lru);
+	c->max_icons = max_icons ? max_icons : 1;
+	c->size = size;
+	g_mutex_init(&c->lock);
+	g_queue_init(&c->done);
+	/* note: this cannot fail for non-exclusive pools */
+	c->pool = g_thread_pool_new(icon_cache_worker, c, threads ? (gint)threads : 1, FALSE, NULL);
+	return c;
+}
+
+int icon_cache_lookup(struct icon_cache* c, GBytes* icon, GdkPixbuf** pixbuf, icon_cache_ready ready, void* data) {
+	*pixbuf = NULL;
+	if(!(c && icon)) return 1;
+	struct icon_cache_entry* e = g_hash_table_lookup(c->entries, icon);
+	if(e && e->link) {
+		c->stats.hits++;
+		/* move it to the front of the LRU list */
+		g_queue_unlink(&c->lru, e->link);
+		g_queue_push_head_link(&c->lru, e->link);
+		if(e->pixbuf) *pixbuf = g_object_ref(e->pixbuf);
+		return 1;
+	}
+	
+	if(!e) {
+		c->stats.misses++;
+		c->stats.pending++;
+		e = g_new0(struct icon_cache_entry, 1);
+		e->icon = g_bytes_ref(icon);
+		e->waiters = g_array_new(FALSE, FALSE, sizeof(struct icon_cache_waiter));
+		g_hash_table_insert(c->entries, e->icon, e);
+		struct icon_job* job = g_new0(struct icon_job, 1);
+		job->icon = g_bytes_ref(icon);
+		g_thread_pool_push(c->pool, job, NULL);
+	}
+	if(ready) {
+		guint i;
+		for(i = 0; i < e->waiters->len; i++) {
+			struct icon_cache_waiter* w = &g_array_index(e->waiters, struct icon_cache_waiter, i);
+			if(w->ready == ready && w->data == data) return 0;
+		}
+		struct icon_cache_waiter w = { ready, data };
+		g_array_append_val(e->waiters, w);
+	}
+	return 0;
+}
+
+void icon_cache_cancel(struct icon_cache* c, void* data) {
+	if(!c) return;
+	GHashTableIter it;
+	gpointer value;
+	g_hash_table_iter_init(&it, c->entries);
+	while(g_hash_table_iter_next(&it, NULL, &value)) {
+		struct icon_cache_entry* e = (struct icon_cache_entry*)value;
+		guint i;
+		for(i = 0; e->waiters && i < e->waiters->len; ) {
+			if(g_array_index(e->waiters, struct icon_cache_waiter, i).data == data)
+				g_array_remove_index_fast(e->waiters, i);
+			else i++;
+		}
+	}
+}
+
+void icon_cache_get_stats(struct icon_cache* c, struct icon_cache_stats* stats) {
+	if(!c) {
+		memset(stats, 0, sizeof(struct icon_cache_stats));
+		return;
+	}
+	*stats = c->stats;
+	stats->icons = c->lru.length;
+}
+
+void icon_cache_free(struct icon_cache* c) {
+	if(!c) return;
+	/* note: queued jobs are still run (without decoding), so that they are freed below */
+	g_atomic_int_set(&c->closing, 1);
+	g_thread_pool_free(c->pool, FALSE, TRUE);
+	if(c->idle_id) g_source_remove(c->idle_id);
+	struct icon_job* job;
+	while((job = (struct icon_job*)g_queue_pop_head(&c->done))) job_free(job);
+	g_queue_clear(&c->lru);
+	g_hash_table_destroy(c->entries);
+	g_mutex_clear(&c->lock);
+	g_free(c);
+}
@@ -0,0 +1,111 @@
+/*
+ * icon_cache.h -- shared cache of decoded menu icons
+ * 
+ * Copyright 2025 Daniel Kondor <kondor.dani@gmail.com>
+ * 
+ * This is free and unencumbered software released into the public domain.
+ * 
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ * 
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+#ifndef ICON_CACHE_H
+#define ICON_CACHE_H
+
+#include <gio/gio.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*
+ * Icons sent as image data (icon-data of com.canonical.dbusmenu items,
+ * GBytesIcon in org.gtk.Menus) are decoded by a pool of worker threads
+ * and kept in a cache limited to a number of icons, which drops the
+ * least recently used ones. Icons are found by their contents, so the
+ * same icon used by several items, apps or rebuilt menus is decoded
+ * only once. All functions should be called from the main thread.
+ */
+struct icon_cache;
+
+/*
+ * Called on the main thread when the icon with the given data is
+ * decoded (or failed to decode); use icon_cache_lookup() to get it.
+ */
+typedef void (*icon_cache_ready)(void* data, GBytes* icon);
+
+struct icon_cache_stats {
+	unsigned long hits;
+	unsigned long misses;   /* icons that needed to be decoded */
+	unsigned long failed;   /* icons that could not be decoded */
+	unsigned long evicted;
+	unsigned int icons;     /* icons currently cached */
+	unsigned int pending;   /* icons being decoded */
+	gsize bytes;            /* size of the cached images */
+};
+
+/*
+ * Create a new cache that keeps at most max_icons icons, scaled to fit
+ * size x size pixels, using up to threads worker threads.
+ */
+struct icon_cache* icon_cache_new(unsigned int max_icons, int size, unsigned int threads);
+
+/*
+ * Get the image data from a serialized GIcon (as stored in menu_node)
+ * if it needs decoding, i.e. it is a GBytesIcon; returns a new reference
+ * or NULL for other icons (e.g. themed icons), which can be loaded by
+ * GTK directly.
+ */
+GBytes* icon_cache_get_data(GVariant* icon);
+
+/*
+ * Look up the decoded version of icon. Returns nonzero if it is known
+ * and stores a new reference to it in pixbuf (this is NULL if the data
+ * is not a valid image). Otherwise, it is decoded in the background and
+ * ready is called with data when done; it is called only once for the
+ * same icon, ready and data, even if requested multiple times.
+ */
+int icon_cache_lookup(struct icon_cache* c, GBytes* icon, GdkPixbuf** pixbuf, icon_cache_ready ready, void* data);
+
+/* do not call ready for any of the icons requested with data anymore */
+void icon_cache_cancel(struct icon_cache* c, void* data);
+
+/*
+ * Decode icon synchronously, scaled to fit size x size pixels (if it is
+ * larger). Returns a new reference or NULL if icon is not a valid image.
+ * Can be called from any thread.
+ */
+GdkPixbuf* icon_cache_decode(GBytes* icon, int size);
+
+void icon_cache_get_stats(struct icon_cache* c, struct icon_cache_stats* stats);
+
+/* free the cache, waiting for any icons currently being decoded */
+void icon_cache_free(struct icon_cache* c);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
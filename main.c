@@ -30,100 +30,557 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <wayland-client.h>
 #include <foreign_toplevel.h>
+#include <menu_cache.h>
 #include <glib.h>
 #include <gtk/gtk.h>
-#include <libdbusmenu-gtk/menu.h>
+#include <dbusmenu_lazy.h>
+#include <gmenu_source.h>
+#include <menu_render.h>
+#include <menu_search.h>
+#include <menu_accel.h>
+#include <prerealize.h>
+#include <menu_snapshot.h>
+#include <metrics.h>
+#include <toplevel_trace.h>
+#include <icon_cache.h>
 
 GtkWidget *menu_btn = NULL;
 GtkWidget *app_id_lbl = NULL;
 GDBusConnection *bus = NULL;
-GtkMenu *dbus_menu = NULL;
+struct menu_cache *cache = NULL;
+/* menu shown: a tree filled from either org.gtk.Menus or com.canonical.dbusmenu */
+struct gmenu_source *gmenu_src = NULL;
+struct dbusmenu_lazy *dbus_menu = NULL;
+struct menu_render *render = NULL;
+struct icon_cache *icons = NULL; /* shared by all menus shown */
+GActionGroup *app_actions = NULL;
+GActionGroup *win_actions = NULL;
+char *menu_app_id = NULL; /* app the menu shown belongs to */
+int menu_indexed = 0;     /* the menu shown can be searched (i.e. it is not a snapshot) */
+guint fetch_all_id = 0;   /* idle source fetching the rest of dbus_menu */
 
-static void tl_cb(void*, struct toplevel_manager* gr) {
-	const struct toplevel_properties *props = toplevel_manager_get_active_app(gr);
-	const char* app_id = props->app_id;
-	printf("Activated app: %s\n", app_id ? app_id : "(null)");
-	
-	gtk_label_set_label(GTK_LABEL(app_id_lbl), app_id);
-	
-	gtk_widget_insert_action_group(menu_btn, "app", NULL);
-	gtk_widget_insert_action_group(menu_btn, "win", NULL);
-	gtk_menu_button_set_menu_model(GTK_MENU_BUTTON(menu_btn), NULL);
+/* searching in the menus of the active and recently used apps */
+struct app_menu {
+	char *app_id;
+	struct gmenu_source *gmenu;
+	struct dbusmenu_lazy *dbus;
+};
+struct menu_search *search = NULL;
+GQueue recent_menus = G_QUEUE_INIT; /* struct app_menu*, most recent first */
+unsigned int search_recent = 2;
+GtkWidget *search_entry = NULL;
+GtkWidget *search_list = NULL;
+#define SEARCH_MAX_RESULTS 20
+/* accelerators of the menu shown, which can be activated without showing it,
+ * by pressing them in our window or on DBus (at METRICS_OBJECT_PATH) */
+struct menu_accel *accels = NULL;
+int use_gtk_menu = 0;
+int menu_timeout = 2000;
+struct prerealize *prerealized = NULL;
+/* latencies and event counts, available on DBus while running */
+struct metrics *metrics = NULL;
+#define METRICS_BUS_NAME "io.github.dkondor.GtkGlobalMenuTest"
+#define METRICS_OBJECT_PATH "/io/github/dkondor/GtkGlobalMenuTest"
+guint metrics_name_id = 0;
+/* measuring the time from clicking on the menu button until the menu is drawn */
+gint64 click_time = 0;
+/* measuring the time from activating an app until the contents of its menu are known */
+gint64 menu_wait_time = 0;
+struct menu_tree *menu_wait_tree = NULL;
+
+/* menu widgets are prepared in idle time, in slices of at most this long (us) */
+#define PREREALIZE_SLICE 3000
+/* menus saved on disk, shown until the real menu of an app is available */
+struct menu_snapshot_store *snapshots = NULL;
+GMenuModel *live_model = NULL;
+char *live_app_id = NULL;
+gulong live_changed_id = 0;
+int showing_snapshot = 0;
+guint snapshot_save_id = 0;
+/* save the menu of an app after it did not change for this long (ms) */
+#define SNAPSHOT_SAVE_DELAY 2000
+struct toplevel_manager *gr = NULL;
+gint64 start_time = 0;
+int exit_code = 0;
+int debug = 0; /* GLOBAL_MENU_DEBUG is set: print details of what is happening */
+
+static void log_startup(const char* phase) {
+	fprintf(stderr, "Startup: %s after %.1f ms\n", phase, (g_get_monotonic_time() - start_time) / 1000.0);
+}
+
+/* whether the app exporting a menu is (as far as we know) still running */
+static int name_available(const char* bus_name) {
+	return cache && bus_name && menu_cache_get_name_state(cache, bus_name) != MENU_CACHE_NAME_UNOWNED;
+}
+
+/* whether we can use the GTK menu implementation for this app */
+static int has_gtk_menu(const struct toplevel_properties *props) {
+	return props->menubar_path && name_available(props->menubar_bus_name) &&
+		((props->window_object_path && name_available(props->window_bus_name)) ||
+		 (props->application_object_path && name_available(props->application_bus_name)));
+}
+
+static gboolean menu_draw_cb(GtkWidget*, cairo_t*, gpointer) {
+	if(click_time) {
+		gint64 us = g_get_monotonic_time() - click_time;
+		double ms = us / 1000.0;
+		click_time = 0;
+		metrics_record(metrics, METRICS_CLICK_TO_VISIBLE, us);
+		metrics_count(metrics, METRICS_POPUPS);
+		if(debug) printf("Menu visible %.1f ms after click%s\n", ms,
+			prerealize_is_done(prerealized) ? "" : " (was not fully prepared)");
+	}
+	return FALSE;
+}
+
+static void menu_ready(void) {
+	if(menu_wait_time) {
+		metrics_record(metrics, METRICS_CALLBACK_TO_MENU, g_get_monotonic_time() - menu_wait_time);
+		menu_wait_time = 0;
+	}
+}
+
+/* the first items of the menu shown arrived */
+static void menu_ready_cb(void*, struct menu_tree* tree, guint32 node, enum menu_tree_change change) {
+	if(node == MENU_TREE_ROOT && change == MENU_TREE_CHANGED_CHILDREN &&
+			menu_tree_get_node(tree, MENU_TREE_ROOT)->first_child != MENU_TREE_NONE)
+		menu_ready();
+}
+
+static gboolean fetch_all_cb(void*);
+
+/* the top level of dbus_menu arrived: the rest is fetched when there is nothing else to do */
+static void top_level_cb(void*, struct menu_tree* tree, guint32 node, enum menu_tree_change change) {
+	if(node == MENU_TREE_ROOT && change == MENU_TREE_CHANGED_CHILDREN && !fetch_all_id &&
+			menu_tree_get_node(tree, MENU_TREE_ROOT)->first_child != MENU_TREE_NONE)
+		fetch_all_id = g_idle_add_full(G_PRIORITY_LOW, fetch_all_cb, NULL, NULL);
+}
+
+/* fetch the submenus of dbus_menu, so that the accelerators in them are known */
+static gboolean fetch_all_cb(void*) {
+	fetch_all_id = 0;
+	menu_tree_remove_listener(dbusmenu_lazy_get_tree(dbus_menu), top_level_cb, NULL);
+	dbusmenu_lazy_fetch_all(dbus_menu);
+	return G_SOURCE_REMOVE;
+}
+
+static void render_changed_cb(void*, struct menu_render*) {
+	prerealize_update(prerealized);
+}
+
+static struct menu_tree* app_menu_tree(struct app_menu *m) {
+	return m->gmenu ? gmenu_source_get_tree(m->gmenu) : dbusmenu_lazy_get_tree(m->dbus);
+}
+
+static void app_menu_free(struct app_menu *m) {
+	menu_search_remove_tree(search, app_menu_tree(m));
+	gmenu_source_free(m->gmenu);
+	dbusmenu_lazy_free(m->dbus);
+	g_free(m->app_id);
+	g_free(m);
+}
+
+/* forget the menu of an app that is shown again */
+static void remove_recent_menu(const char *app_id) {
+	GList *l;
+	for(l = recent_menus.head; l && app_id; l = l->next) {
+		struct app_menu *m = (struct app_menu*)l->data;
+		if(!strcmp(m->app_id, app_id)) {
+			g_queue_delete_link(&recent_menus, l);
+			app_menu_free(m);
+			return;
+		}
+	}
+}
+
+/* remove the menu shown; if keep_recent is nonzero, it is kept for
+ * searching, as the menu of a recently used app */
+static void clear_menu(int keep_recent) {
+	menu_accel_set_tree(accels, NULL);
+	if(menu_wait_tree) menu_tree_remove_listener(menu_wait_tree, menu_ready_cb, NULL);
+	menu_wait_tree = NULL;
+	if(dbus_menu) menu_tree_remove_listener(dbusmenu_lazy_get_tree(dbus_menu), top_level_cb, NULL);
+	if(fetch_all_id) g_source_remove(fetch_all_id);
+	fetch_all_id = 0;
+	prerealize_free(prerealized);
+	prerealized = NULL;
 	gtk_menu_button_set_popup(GTK_MENU_BUTTON(menu_btn), NULL);
-	if (dbus_menu) {
-		g_object_unref(dbus_menu);
-		dbus_menu = NULL;
+	menu_render_free(render);
+	render = NULL;
+	if(gmenu_src || dbus_menu) {
+		struct app_menu *m = g_new(struct app_menu, 1);
+		m->app_id = menu_app_id;
+		m->gmenu = gmenu_src;
+		m->dbus = dbus_menu;
+		menu_app_id = NULL;
+		if(keep_recent && menu_indexed && m->app_id && search_recent) {
+			g_queue_push_head(&recent_menus, m);
+			while(recent_menus.length > search_recent)
+				app_menu_free((struct app_menu*)g_queue_pop_tail(&recent_menus));
+		}
+		else app_menu_free(m);
+	}
+	gmenu_src = NULL;
+	dbus_menu = NULL;
+	menu_indexed = 0;
+}
+
+/* show the menu tree of either implementation; its widgets are built in
+ * idle time, so that clicking on the button only needs to show them */
+static void show_menu_tree(struct menu_tree* tree, const char *app_id, int indexed) {
+	menu_app_id = g_strdup(app_id);
+	menu_indexed = indexed;
+	if(indexed) {
+		menu_search_add_tree(search, tree, app_id);
+		menu_accel_set_tree(accels, tree);
+		metrics_count(metrics, METRICS_MENUS_SHOWN);
+		/* note: snapshots do not count, only the real menu */
+		if(menu_tree_get_node(tree, MENU_TREE_ROOT)->first_child != MENU_TREE_NONE) menu_ready();
+		else if(menu_wait_time) {
+			menu_wait_tree = tree;
+			menu_tree_add_listener(tree, menu_ready_cb, NULL);
+		}
+	}
+	render = menu_render_new(tree, icons);
+	GtkWidget *menu = GTK_WIDGET(menu_render_get_menu(render));
+	gtk_menu_button_set_popup(GTK_MENU_BUTTON(menu_btn), menu);
+	prerealized = prerealize_new(menu, PREREALIZE_SLICE);
+	g_signal_connect(menu, "draw", G_CALLBACK(menu_draw_cb), NULL);
+	menu_render_set_changed_callback(render, render_changed_cb, NULL);
+}
+
+static void show_gtk_menu(GMenuModel* model, const char *app_id, int snapshot) {
+	clear_menu(0);
+	gmenu_src = gmenu_source_new(model);
+	gmenu_source_set_action_group(gmenu_src, "app", app_actions);
+	gmenu_source_set_action_group(gmenu_src, "win", win_actions);
+	show_menu_tree(gmenu_source_get_tree(gmenu_src), app_id, !snapshot);
+}
+
+static void save_snapshot(void) {
+	if(live_model && live_app_id && menu_snapshot_store_save(snapshots, live_app_id, live_model) > 0 && debug)
+		printf("Saved menu snapshot of %s\n", live_app_id);
+}
+
+static gboolean save_snapshot_cb(gpointer) {
+	snapshot_save_id = 0;
+	save_snapshot();
+	return G_SOURCE_REMOVE;
+}
+
+static void live_menu_changed_cb(GMenuModel* model, gint, gint, gint, gpointer) {
+	/* replace the snapshot as soon as the real menu arrives */
+	if(showing_snapshot && g_menu_model_get_n_items(model) > 0) {
+		showing_snapshot = 0;
+		show_gtk_menu(model, live_app_id, 0);
 	}
+	if(snapshot_save_id) g_source_remove(snapshot_save_id);
+	snapshot_save_id = g_timeout_add(SNAPSHOT_SAVE_DELAY, save_snapshot_cb, NULL);
+}
+
+/* stop tracking the menu of the previous app; it is saved first, since
+ * by now its submenus were likely loaded as well */
+static void live_menu_stop(void) {
+	if(snapshot_save_id) {
+		g_source_remove(snapshot_save_id);
+		snapshot_save_id = 0;
+	}
+	if(live_model) {
+		save_snapshot();
+		g_signal_handler_disconnect(live_model, live_changed_id);
+		g_object_unref(live_model);
+		live_model = NULL;
+		live_changed_id = 0;
+	}
+	g_free(live_app_id);
+	live_app_id = NULL;
+	showing_snapshot = 0;
+}
+
+static void live_menu_start(GMenuModel* model, const char* app_id) {
+	if(!app_id) return;
+	live_model = g_object_ref(model);
+	live_app_id = g_strdup(app_id);
+	live_changed_id = g_signal_connect(model, "items-changed", G_CALLBACK(live_menu_changed_cb), NULL);
+}
+
+/* show the menu of the active app; the previous one should be cleared already */
+static void update_menu(struct toplevel_manager* gr, const struct toplevel_properties *props) {
+	remove_recent_menu(props->app_id);
 	
-	if(props->menubar_path && props->menubar_bus_name &&
-		((props->window_object_path && props->window_bus_name) ||
-		 (props->application_object_path && props->application_bus_name))) {
+	use_gtk_menu = has_gtk_menu(props);
+	if(use_gtk_menu) {
 		// try using the GTK menu implementation
-		GDBusMenuModel *model = g_dbus_menu_model_get(bus, props->menubar_bus_name, props->menubar_path);
+		GMenuModel *model = toplevel_manager_get_menu_model(gr);
 		if(model) {
-			gtk_menu_button_set_menu_model(GTK_MENU_BUTTON(menu_btn), G_MENU_MODEL(model));
-			g_object_unref(model);
-			
-			if(props->application_object_path) {
-				GDBusActionGroup *grp = g_dbus_action_group_get(bus, props->application_bus_name, props->application_object_path);
-				if(grp) {
-					gtk_widget_insert_action_group(menu_btn, "app", G_ACTION_GROUP(grp));
-					g_object_unref(grp);
-				}
-				else fprintf(stderr, "Error retrieving app action group!\n");
-			}
-			if(props->window_object_path) {
-				GDBusActionGroup *grp = g_dbus_action_group_get(bus, props->window_bus_name, props->window_object_path);
-				if(grp) {
-					gtk_widget_insert_action_group(menu_btn, "win", G_ACTION_GROUP(grp));
-					g_object_unref(grp);
-				}
-				else fprintf(stderr, "Error retrieving window action group!\n");
+			live_menu_start(model, props->app_id);
+			/* the menu is fetched asynchronously; until it arrives,
+			 * show the last saved version (with all items disabled) */
+			GMenuModel *snapshot = NULL;
+			if(g_menu_model_get_n_items(model) == 0)
+				snapshot = menu_snapshot_store_load(snapshots, props->app_id);
+			if(snapshot) {
+				showing_snapshot = 1;
+				show_gtk_menu(snapshot, props->app_id, 1);
+				g_object_unref(snapshot);
 			}
+			else show_gtk_menu(model, props->app_id, 0);
 		}
 		else fprintf(stderr, "Error retrieving menu model!\n");
 	}
-	else if(props->kde_service_name && props->kde_object_path) {
-		// alternatively use the KDE / com.canonical.dbusmenu implementation
-		DbusmenuGtkMenu *menu = dbusmenu_gtkmenu_new(props->kde_service_name, props->kde_object_path);
-		if(menu) {
-			g_object_ref_sink(menu);
-			gtk_menu_button_set_popup(GTK_MENU_BUTTON(menu_btn), GTK_WIDGET(menu));
-			gtk_widget_show_all(GTK_WIDGET(menu));
-			dbus_menu = GTK_MENU(menu);
+	else if(bus && props->kde_object_path && name_available(props->kde_service_name)) {
+		// alternatively use the KDE / com.canonical.dbusmenu implementation;
+		// only the top level is fetched here, submenus are fetched when opened
+		dbus_menu = dbusmenu_lazy_new(bus, props->kde_service_name, props->kde_object_path, menu_timeout);
+		if(dbus_menu) {
+			show_menu_tree(dbusmenu_lazy_get_tree(dbus_menu), props->app_id, 1);
+			/* note: the accelerators of items in submenus are only known once these
+			 * are fetched; this is done after the top level arrived, in idle time */
+			menu_tree_add_listener(dbusmenu_lazy_get_tree(dbus_menu), top_level_cb, NULL);
 		}
 	}
+	else if(cache && (props->menubar_bus_name || props->kde_service_name))
+		printf("No menu available (the app exporting it is not running)\n");
+	gtk_widget_set_sensitive(menu_btn, render != NULL);
+}
+
+static void update_app_actions(struct toplevel_manager* gr, const struct toplevel_properties *props) {
+	GActionGroup *grp = NULL;
+	if(props->application_object_path && name_available(props->application_bus_name)) {
+		grp = toplevel_manager_get_app_actions(gr);
+		if(!grp) fprintf(stderr, "Error retrieving app action group!\n");
+	}
+	g_set_object(&app_actions, grp);
+	gmenu_source_set_action_group(gmenu_src, "app", grp);
+}
+
+static void update_window_actions(struct toplevel_manager* gr, const struct toplevel_properties *props) {
+	GActionGroup *grp = NULL;
+	if(props->window_object_path && name_available(props->window_bus_name)) {
+		grp = toplevel_manager_get_window_actions(gr);
+		if(!grp) fprintf(stderr, "Error retrieving window action group!\n");
+	}
+	g_set_object(&win_actions, grp);
+	gmenu_source_set_action_group(gmenu_src, "win", grp);
+}
+
+static void tl_cb(void*, struct toplevel_manager* gr, unsigned int changes) {
+	const struct toplevel_properties *props = toplevel_manager_get_active_app(gr);
+	if(!props) return;
+	const char* app_id = props->app_id;
+	if(changes & TOPLEVEL_CHANGED_ACTIVE) menu_wait_time = g_get_monotonic_time();
+	if(changes & TOPLEVEL_CHANGED_ACTIVE) printf("Activated app: %s\n", app_id ? app_id : "(null)");
+	else if(debug) printf("Changed menu of app: %s (0x%x)\n", app_id ? app_id : "(null)", changes);
+	
+	/* only replace what changed, e.g. if just the window actions change,
+	 * the menu model can be kept */
+	if(changes & TOPLEVEL_CHANGED_APP_ID) gtk_label_set_label(GTK_LABEL(app_id_lbl), app_id);
+	/* note: which menu is used depends on the action groups as well */
+	int replace = (changes & (TOPLEVEL_CHANGED_MENUBAR | TOPLEVEL_CHANGED_DBUSMENU)) ||
+		has_gtk_menu(props) != use_gtk_menu;
+	if(replace) {
+		/* the menu of the previous app is kept for searching, together with
+		 * its action groups, so it has to be removed before replacing them */
+		live_menu_stop();
+		clear_menu(changes & TOPLEVEL_CHANGED_ACTIVE);
+	}
+	if(changes & TOPLEVEL_CHANGED_APP_ACTIONS) update_app_actions(gr, props);
+	if(changes & TOPLEVEL_CHANGED_WINDOW_ACTIONS) update_window_actions(gr, props);
+	if(replace) update_menu(gr, props);
+}
+
+static gboolean button_release_cb(GtkWidget*, GdkEventButton* ev, gpointer) {
+	/* note: this runs before the button handles the click */
+	if(ev->button == GDK_BUTTON_PRIMARY) click_time = g_get_monotonic_time();
+	return FALSE;
 }
 
 static void clicked_cb(GtkButton* btn, gpointer) {
 	/* show the menu when the button is clicked -- no idea why this is necessary */
-	if(dbus_menu) gtk_menu_popup_at_widget(dbus_menu, GTK_WIDGET(btn), GDK_GRAVITY_SOUTH_WEST, GDK_GRAVITY_NORTH_WEST, NULL);
+	if(render) gtk_menu_popup_at_widget(menu_render_get_menu(render), GTK_WIDGET(btn), GDK_GRAVITY_SOUTH_WEST, GDK_GRAVITY_NORTH_WEST, NULL);
+}
+
+
+/* searching menus: a list of matching items is shown while typing */
+static void fetch_all_menus(void) {
+	/* com.canonical.dbusmenu submenus are only fetched when opened,
+	 * get them all once the user starts searching */
+	GList *l;
+	dbusmenu_lazy_fetch_all(dbus_menu);
+	for(l = recent_menus.head; l; l = l->next) dbusmenu_lazy_fetch_all(((struct app_menu*)l->data)->dbus);
+}
+
+static void clear_child(GtkWidget* w, gpointer) {
+	gtk_widget_destroy(w);
+}
+
+static void search_changed_cb(GtkSearchEntry* entry, gpointer) {
+	struct menu_search_result results[SEARCH_MAX_RESULTS];
+	fetch_all_menus();
+	gtk_container_foreach(GTK_CONTAINER(search_list), clear_child, NULL);
+	
+	gint64 t0 = g_get_monotonic_time();
+	guint i, n = menu_search_query(search, gtk_entry_get_text(GTK_ENTRY(entry)), results, SEARCH_MAX_RESULTS);
+	gint64 us = g_get_monotonic_time() - t0;
+	metrics_record(metrics, METRICS_SEARCH, us);
+	metrics_count(metrics, METRICS_SEARCHES);
+	
+	for(i = 0; i < n; i++) {
+		char *text = g_strdup_printf("%s (%s)", results[i].path, results[i].name);
+		GtkWidget *lbl = gtk_label_new(text);
+		g_free(text);
+		gtk_label_set_xalign(GTK_LABEL(lbl), 0.0);
+		gtk_label_set_ellipsize(GTK_LABEL(lbl), PANGO_ELLIPSIZE_START);
+		GtkWidget *row = gtk_list_box_row_new();
+		gtk_container_add(GTK_CONTAINER(row), lbl);
+		gtk_widget_set_sensitive(row, results[i].enabled);
+		/* note: results are only valid until the menus change, so the
+		 * item is looked up again when activated */
+		g_object_set_data_full(G_OBJECT(row), "app", g_strdup(results[i].name), g_free);
+		g_object_set_data_full(G_OBJECT(row), "path", g_strdup(results[i].path), g_free);
+		gtk_widget_show_all(row);
+		gtk_container_add(GTK_CONTAINER(search_list), row);
+	}
+}
+
+static void search_row_activated_cb(GtkListBox*, GtkListBoxRow* row, gpointer) {
+	struct menu_search_result results[SEARCH_MAX_RESULTS];
+	const char *app = (const char*)g_object_get_data(G_OBJECT(row), "app");
+	const char *path = (const char*)g_object_get_data(G_OBJECT(row), "path");
+	guint i, n = menu_search_query(search, gtk_entry_get_text(GTK_ENTRY(search_entry)), results, SEARCH_MAX_RESULTS);
+	for(i = 0; i < n; i++) if(results[i].enabled && !strcmp(results[i].name, app) && !strcmp(results[i].path, path)) {
+		/* this calls the app / win action or sends a dbusmenu event */
+		menu_tree_activate(results[i].tree, results[i].node, gtk_get_current_event_time());
+		gtk_entry_set_text(GTK_ENTRY(search_entry), "");
+		return;
+	}
+}
+
+/* keys not handled by our window activate items of the menu shown
+ * directly, without building or showing the menu */
+static gboolean key_press_cb(GtkWidget*, GdkEventKey* ev, gpointer) {
+	GdkModifierType mods = ev->state & gtk_accelerator_get_default_mod_mask();
+	if(!menu_accel_activate(accels, ev->keyval, mods, ev->time)) return FALSE;
+	if(debug) {
+		char *name = gtk_accelerator_name(ev->keyval, mods);
+		printf("Activated menu item with %s\n", name);
+		g_free(name);
+	}
+	return TRUE;
+}
+
+static void search_activate_cb(GtkEntry*, gpointer) {
+	GtkListBoxRow *row = gtk_list_box_get_row_at_index(GTK_LIST_BOX(search_list), 0);
+	if(row && gtk_widget_get_sensitive(GTK_WIDGET(row))) search_row_activated_cb(GTK_LIST_BOX(search_list), row, NULL);
 }
 
 
 #define SELF_NAME "gtk_global_menu_test"
 
+static void manager_ready_cb(void*, struct toplevel_manager*, int success) {
+	if(!success) {
+		fprintf(stderr, "Cannot create grabber interface!\n");
+		exit_code = 1;
+		gtk_main_quit();
+		return;
+	}
+	log_startup("toplevel tracking ready");
+}
+
+static void bus_ready_cb(GObject*, GAsyncResult* res, gpointer) {
+	GError *err = NULL;
+	bus = g_bus_get_finish(res, &err);
+	if(!bus) {
+		fprintf(stderr, "Cannot connect to DBus: %s\n", err->message);
+		g_error_free(err);
+		exit_code = 1;
+		gtk_main_quit();
+		return;
+	}
+	log_startup("DBus connection ready");
+	
+	/* e.g. gdbus call --session --dest io.github.dkondor.GtkGlobalMenuTest
+	 *   --object-path /io/github/dkondor/GtkGlobalMenuTest
+	 *   --method io.github.dkondor.GtkGlobalMenuTest.Metrics.GetHistograms */
+	if(metrics_export(metrics, bus, METRICS_OBJECT_PATH, &err))
+		metrics_name_id = g_bus_own_name_on_connection(bus, METRICS_BUS_NAME,
+			G_BUS_NAME_OWNER_FLAGS_DO_NOT_QUEUE, NULL, NULL, NULL, NULL);
+	else {
+		fprintf(stderr, "Cannot export metrics: %s\n", err->message);
+		g_clear_error(&err);
+	}
+	/* e.g. gdbus call ... --method io.github.dkondor.GtkGlobalMenuTest.Accels.Activate '<Primary>q' */
+	if(!menu_accel_export(accels, bus, METRICS_OBJECT_PATH, &err)) {
+		fprintf(stderr, "Cannot export accelerators: %s\n", err->message);
+		g_clear_error(&err);
+	}
+	
+	cache = menu_cache_new(bus);
+	toplevel_manager_set_menu_cache(gr, cache);
+	/* show the menu of the app that was activated before */
+	toplevel_manager_refresh(gr);
+}
+
 int main() {
+	start_time = g_get_monotonic_time();
 	gtk_init(NULL, NULL);
 	
-	struct toplevel_manager* gr = toplevel_manager_new();
+	/* process toplevel events on a separate thread, so that a busy
+	 * compositor does not block our UI; we do not wait for the
+	 * compositor or DBus before showing our window */
+	gr = toplevel_manager_new_async(NULL, TOPLEVEL_MANAGER_THREADED, manager_ready_cb, NULL);
 	if(!gr) {
 		fprintf(stderr, "Cannot create grabber interface!\n");
 		return 1;
 	}
-	
-	bus = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
-	if(!bus)
-	{
-		fprintf(stderr, "Cannot connect to DBus!\n");
-		toplevel_manager_free(gr);
-		return 1;
-	}
+	g_bus_get(G_BUS_TYPE_SESSION, NULL, bus_ready_cb, NULL);
 	
 	g_set_prgname(SELF_NAME);
 	toplevel_manager_set_self(gr, SELF_NAME);
+	metrics = metrics_new();
+	toplevel_manager_set_metrics(gr, metrics);
+	/* print the DBus annotations of toplevels as received */
+	debug = g_getenv("GLOBAL_MENU_DEBUG") != NULL;
+	if(debug) toplevel_manager_set_debug(gr, 1);
+	/* record all toplevel events, to be replayed by bench/trace_replay */
+	struct toplevel_trace_writer *trace = NULL;
+	const char* trace_path = g_getenv("GLOBAL_MENU_TRACE");
+	if(trace_path) {
+		GError *err = NULL;
+		trace = toplevel_trace_writer_new(trace_path, &err);
+		if(trace) toplevel_manager_set_trace(gr, trace);
+		else {
+			fprintf(stderr, "Cannot record trace: %s\n", err->message);
+			g_error_free(err);
+		}
+	}
+	
+	/* optionally wait for quick app switches to settle (in ms) */
+	const char* debounce = g_getenv("GLOBAL_MENU_DEBOUNCE");
+	if(debounce) toplevel_manager_set_debounce(gr, (unsigned int)strtoul(debounce, NULL, 10));
+	/* keep the menus of recently used apps ready */
+	const char* prefetch = g_getenv("GLOBAL_MENU_PREFETCH");
+	toplevel_manager_set_prefetch(gr, prefetch ? (unsigned int)strtoul(prefetch, NULL, 10) : 4);
+	/* limit on the memory used for toplevels and menus (in KiB) */
+	const char* budget = g_getenv("GLOBAL_MENU_MEMORY_BUDGET");
+	if(budget) toplevel_manager_set_memory_budget(gr, (size_t)strtoul(budget, NULL, 10) * 1024);
+	/* timeout for calls to apps for their menu (in ms) */
+	const char* timeout = g_getenv("GLOBAL_MENU_TIMEOUT");
+	if(timeout) menu_timeout = (int)strtol(timeout, NULL, 10);
+	/* number of apps besides the active one whose menus are searched */
+	const char* recent = g_getenv("GLOBAL_MENU_SEARCH_RECENT");
+	if(recent) search_recent = (unsigned int)strtoul(recent, NULL, 10);
+	search = menu_search_new();
+	accels = menu_accel_new();
+	/* icons of menu items, decoded in the background */
+	gint icon_width, icon_height;
+	gtk_icon_size_lookup(GTK_ICON_SIZE_MENU, &icon_width, &icon_height);
+	icons = icon_cache_new(512, MAX(icon_width, icon_height), 2);
+	/* menus shown before the app responds */
+	if(!g_getenv("GLOBAL_MENU_NO_SNAPSHOTS")) snapshots = menu_snapshot_store_new(NULL);
 	
 	GtkWidget *win = gtk_window_new(GTK_WINDOW_TOPLEVEL);
 	gtk_window_set_title(GTK_WINDOW(win), "Gtk global menu test");
@@ -140,18 +597,66 @@ int main() {
 	menu_btn = gtk_menu_button_new();
 	gtk_button_set_label(GTK_BUTTON(menu_btn), "Show menu");
 	g_signal_connect(G_OBJECT(menu_btn), "clicked", G_CALLBACK(clicked_cb), NULL);
+	g_signal_connect(G_OBJECT(menu_btn), "button-release-event", G_CALLBACK(button_release_cb), NULL);
 	gtk_container_add(GTK_CONTAINER(vbox), menu_btn);
+	
+	search_entry = gtk_search_entry_new();
+	gtk_entry_set_placeholder_text(GTK_ENTRY(search_entry), "Search menus");
+	g_signal_connect(G_OBJECT(search_entry), "search-changed", G_CALLBACK(search_changed_cb), NULL);
+	g_signal_connect(G_OBJECT(search_entry), "activate", G_CALLBACK(search_activate_cb), NULL);
+	gtk_container_add(GTK_CONTAINER(vbox), search_entry);
+	search_list = gtk_list_box_new();
+	g_signal_connect(G_OBJECT(search_list), "row-activated", G_CALLBACK(search_row_activated_cb), NULL);
+	GtkWidget *scroll = gtk_scrolled_window_new(NULL, NULL);
+	gtk_widget_set_vexpand(scroll, TRUE);
+	gtk_container_add(GTK_CONTAINER(scroll), search_list);
+	gtk_container_add(GTK_CONTAINER(vbox), scroll);
 	gtk_container_add(GTK_CONTAINER(win), vbox);
+	/* note: after the focused widget, e.g. the search entry, had the chance to handle the key */
+	g_signal_connect_after(G_OBJECT(win), "key-press-event", G_CALLBACK(key_press_cb), NULL);
 	
 	g_signal_connect(G_OBJECT(win), "destroy", gtk_main_quit, NULL);
 	
 	gtk_widget_show_all(win);
+	log_startup("window shown");
 	
-	toplevel_manager_set_callback(gr, tl_cb, NULL);
+	toplevel_manager_set_change_callback(gr, tl_cb, NULL);
 	gtk_main();
 	
+	struct toplevel_manager_stats stats;
+	toplevel_manager_get_stats(gr, &stats);
+	printf("Activations: %lu, reported: %lu, coalesced: %lu\n",
+		stats.activations, stats.callbacks, stats.coalesced);
+	printf("Strings: %lu stored for %lu references, %zu bytes (%zu bytes saved)\n",
+		stats.strings, stats.string_refs, stats.string_bytes, stats.string_bytes_saved);
+	/* note: toplevels of the same app share the entries of the cache */
+	printf("Memory: %zu bytes estimated, %u menu proxies in %u cache entries (%lu released for the budget), %lu toplevels dropped\n",
+		stats.memory, stats.menus, menu_cache_get_size(cache), stats.evictions, stats.dropped);
+	
+	metrics_print(metrics, stdout);
+	struct icon_cache_stats icon_stats;
+	icon_cache_get_stats(icons, &icon_stats);
+	if(icon_stats.hits || icon_stats.misses)
+		printf("Icons: %u cached (%zu bytes), %lu hits, %lu decoded (%lu failed), %lu evicted\n",
+			icon_stats.icons, icon_stats.bytes, icon_stats.hits, icon_stats.misses,
+			icon_stats.failed, icon_stats.evicted);
+	
+	live_menu_stop();
+	clear_menu(0);
+	struct app_menu *m;
+	while((m = (struct app_menu*)g_queue_pop_head(&recent_menus))) app_menu_free(m);
+	menu_search_free(search);
+	menu_accel_free(accels);
+	g_clear_object(&app_actions);
+	g_clear_object(&win_actions);
+	menu_snapshot_store_free(snapshots);
+	/* note: after all renderers are freed */
+	icon_cache_free(icons);
 	toplevel_manager_free(gr);
+	if(trace && !toplevel_trace_writer_free(trace)) fprintf(stderr, "Error writing trace to %s\n", trace_path);
+	menu_cache_free(cache);
+	if(metrics_name_id) g_bus_unown_name(metrics_name_id);
+	metrics_free(metrics);
 	
-	return 0;
+	return exit_code;
 }
-
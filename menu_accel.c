@@ -0,0 +1,349 @@
+/*
+ * menu_accel.c -- index of the accelerators of menu items
+ * 
+ * Copyright 2025 Daniel Kondor <kondor.dani@gmail.com>
+ * 
+ * This is free and unencumbered software released into the public domain.
+ * 
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ * 
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+#include <menu_accel.h>
+#include <dbus_export.h>
+#include <string.h>
+
+#define ACCEL_INTERFACE "io.github.dkondor.GtkGlobalMenuTest.Accels"
+
+/* keys are stored as the keyval (which fits in 25 bits), with these
+ * bits for the modifiers above it */
+#define ACCEL_KEYVAL_MASK 0x1ffffffu
+#define ACCEL_MODS_SHIFT 25
+
+static const struct {
+	const char* name;
+	GdkModifierType mask;
+} accel_modifiers[] = {
+	{ "Primary", GDK_CONTROL_MASK },
+	{ "Control", GDK_CONTROL_MASK },
+	{ "Ctrl",    GDK_CONTROL_MASK },
+	{ "Ctl",     GDK_CONTROL_MASK },
+	{ "Shift",   GDK_SHIFT_MASK },
+	{ "Shft",    GDK_SHIFT_MASK },
+	{ "Alt",     GDK_MOD1_MASK },
+	{ "Mod1",    GDK_MOD1_MASK },
+	{ "Super",   GDK_SUPER_MASK },
+	{ "Hyper",   GDK_HYPER_MASK },
+	{ "Meta",    GDK_META_MASK }
+};
+
+/* modifiers used in keys, in the order of their bits */
+static const GdkModifierType accel_key_mods[] = {
+	GDK_SHIFT_MASK, GDK_CONTROL_MASK, GDK_MOD1_MASK, GDK_SUPER_MASK, GDK_HYPER_MASK, GDK_META_MASK
+};
+
+static const char introspection_xml[] =
+	"<node>"
+	"  <interface name='" ACCEL_INTERFACE "'>"
+	"    <method name='Activate'>"
+	"      <arg type='s' name='accel' direction='in'/>"
+	"      <arg type='b' name='activated' direction='out'/>"
+	"    </method>"
+	"    <method name='List'>"
+	"      <!-- accelerator, label of the item -->"
+	"      <arg type='a(ss)' name='accels' direction='out'/>"
+	"    </method>"
+	"  </interface>"
+	"</node>";
+
+
+/* the accelerator of a node; nodes with the same key are chained, in the
+ * order they were indexed, starting from the one in the index */
+struct accel_entry {
+	guint32 key;  /* 0: none */
+	guint32 next; /* next node with the same key, or MENU_TREE_NONE */
+};
+
+struct menu_accel {
+	struct menu_tree* tree;
+	GHashTable* index;  /* key -> first node with it + 1 */
+	GArray* nodes;      /* struct accel_entry, by node index */
+	guint n_accels;     /* nodes with a key */
+	struct dbus_export export;
+};
+
+
+static guint32 accel_key(guint keyval, GdkModifierType mods) {
+	guint32 key = gdk_keyval_to_lower(keyval) & ACCEL_KEYVAL_MASK;
+	guint i;
+	for(i = 0; i < G_N_ELEMENTS(accel_key_mods); i++)
+		if(mods & accel_key_mods[i]) key |= 1u << (ACCEL_MODS_SHIFT + i);
+	return key;
+}
+
+/* key of the accelerator of an item, or 0 if it has none */
+static guint32 accel_node_key(const struct menu_node* n) {
+	guint keyval;
+	GdkModifierType mods;
+	if(!(n && n->kind == MENU_NODE_ITEM && n->accel && menu_accel_parse(n->accel, &keyval, &mods))) return 0;
+	return accel_key(keyval, mods);
+}
+
+static struct accel_entry* accel_entry(struct menu_accel* ma, guint32 node) {
+	return &g_array_index(ma->nodes, struct accel_entry, node);
+}
+
+static guint32 accel_get_key(struct menu_accel* ma, guint32 node) {
+	return (node < ma->nodes->len) ? accel_entry(ma, node)->key : 0;
+}
+
+static guint32 accel_first(struct menu_accel* ma, guint32 key) {
+	return GPOINTER_TO_UINT(g_hash_table_lookup(ma->index, GUINT_TO_POINTER(key))) - 1;
+}
+
+static void accel_remove(struct menu_accel* ma, guint32 node) {
+	guint32 key = accel_get_key(ma, node);
+	if(!key) return;
+	struct accel_entry* e = accel_entry(ma, node);
+	guint32 first = accel_first(ma, key);
+	if(first == node) {
+		if(e->next == MENU_TREE_NONE) g_hash_table_remove(ma->index, GUINT_TO_POINTER(key));
+		else g_hash_table_insert(ma->index, GUINT_TO_POINTER(key), GUINT_TO_POINTER(e->next + 1));
+	}
+	else {
+		/* note: chains are short, only items sharing an accelerator are in them */
+		guint32 prev = first;
+		while(accel_entry(ma, prev)->next != node) prev = accel_entry(ma, prev)->next;
+		accel_entry(ma, prev)->next = e->next;
+	}
+	e->key = 0;
+	e->next = MENU_TREE_NONE;
+	ma->n_accels--;
+}
+
+/* index the current accelerator of node, if it changed */
+static void accel_update(struct menu_accel* ma, guint32 node) {
+	guint32 key = accel_node_key(menu_tree_get_node(ma->tree, node));
+	if(key == accel_get_key(ma, node)) return;
+	accel_remove(ma, node);
+	if(!key) return;
+	if(node >= ma->nodes->len) g_array_set_size(ma->nodes, menu_tree_get_size(ma->tree));
+	struct accel_entry* e = accel_entry(ma, node);
+	e->key = key;
+	e->next = MENU_TREE_NONE;
+	ma->n_accels++;
+	guint32 last = accel_first(ma, key);
+	if(last == MENU_TREE_NONE) {
+		g_hash_table_insert(ma->index, GUINT_TO_POINTER(key), GUINT_TO_POINTER(node + 1));
+		return;
+	}
+	while(accel_entry(ma, last)->next != MENU_TREE_NONE) last = accel_entry(ma, last)->next;
+	accel_entry(ma, last)->next = node;
+}
+
+/* the first enabled and visible item with key, or MENU_TREE_NONE; first
+ * is set to the first one that has it, even if it cannot be used */
+static guint32 accel_find(struct menu_accel* ma, guint32 key, guint32* first) {
+	guint32 node = accel_first(ma, key);
+	*first = node;
+	for(; node != MENU_TREE_NONE; node = accel_entry(ma, node)->next) {
+		const struct menu_node* n = menu_tree_get_node(ma->tree, node);
+		if((n->flags & MENU_NODE_ENABLED) && (n->flags & MENU_NODE_VISIBLE)) return node;
+	}
+	return MENU_TREE_NONE;
+}
+
+/* forget about all descendants of node */
+static void accel_remove_children(struct menu_accel* ma, guint32 node) {
+	const struct menu_node* n = menu_tree_get_node(ma->tree, node);
+	guint32 child = n ? n->first_child : MENU_TREE_NONE;
+	while(child != MENU_TREE_NONE) {
+		accel_remove(ma, child);
+		accel_remove_children(ma, child);
+		child = menu_tree_get_node(ma->tree, child)->next;
+	}
+}
+
+/* index all descendants of node */
+static void accel_add_children(struct menu_accel* ma, guint32 node) {
+	const struct menu_node* n = menu_tree_get_node(ma->tree, node);
+	guint32 child = n ? n->first_child : MENU_TREE_NONE;
+	for(; child != MENU_TREE_NONE; child = menu_tree_get_node(ma->tree, child)->next) {
+		accel_update(ma, child);
+		accel_add_children(ma, child);
+	}
+}
+
+static void tree_changed_cb(void* data, G_GNUC_UNUSED struct menu_tree* tree, guint32 node, enum menu_tree_change change) {
+	struct menu_accel* ma = (struct menu_accel*)data;
+	switch(change) {
+		case MENU_TREE_REMOVING:
+			accel_remove(ma, node);
+			accel_remove_children(ma, node);
+			break;
+		case MENU_TREE_CLEARING:
+			accel_remove_children(ma, node);
+			break;
+		case MENU_TREE_CHANGED_CHILDREN:
+			accel_add_children(ma, node);
+			break;
+		case MENU_TREE_CHANGED_PROPERTIES:
+			accel_update(ma, node);
+			break;
+	}
+}
+
+
+struct menu_accel* menu_accel_new(void) {
+	struct menu_accel* ma = g_new0(struct menu_accel, 1);
+	ma->index = g_hash_table_new(g_direct_hash, g_direct_equal);
+	ma->nodes = g_array_new(FALSE, TRUE, sizeof(struct accel_entry));
+	return ma;
+}
+
+void menu_accel_set_tree(struct menu_accel* ma, struct menu_tree* tree) {
+	if(!ma || ma->tree == tree) return;
+	if(ma->tree) menu_tree_remove_listener(ma->tree, tree_changed_cb, ma);
+	g_hash_table_remove_all(ma->index);
+	g_array_set_size(ma->nodes, 0);
+	ma->n_accels = 0;
+	ma->tree = tree;
+	if(tree) {
+		accel_add_children(ma, MENU_TREE_ROOT);
+		menu_tree_add_listener(tree, tree_changed_cb, ma);
+	}
+}
+
+gboolean menu_accel_parse(const char* accel, guint* keyval, GdkModifierType* mods) {
+	GdkModifierType m = 0;
+	if(!(accel && keyval && mods)) return FALSE;
+	while(*accel == '<') {
+		const char* end = strchr(accel, '>');
+		if(!end) return FALSE;
+		size_t len = (size_t)(end - accel - 1);
+		guint i;
+		for(i = 0; i < G_N_ELEMENTS(accel_modifiers); i++)
+			if(strlen(accel_modifiers[i].name) == len && !g_ascii_strncasecmp(accel + 1, accel_modifiers[i].name, len)) break;
+		if(i == G_N_ELEMENTS(accel_modifiers)) return FALSE;
+		m |= accel_modifiers[i].mask;
+		accel = end + 1;
+	}
+	if(!*accel) return FALSE;
+	guint k = gdk_keyval_from_name(accel);
+	if(k == GDK_KEY_VoidSymbol || !k) {
+		/* a single character, e.g. one sent by a dbusmenu app */
+		gunichar c = g_utf8_get_char_validated(accel, -1);
+		if(c == (gunichar)-1 || c == (gunichar)-2 || *g_utf8_next_char(accel)) return FALSE;
+		k = gdk_unicode_to_keyval(c);
+	}
+	*keyval = k;
+	*mods = m;
+	return TRUE;
+}
+
+guint32 menu_accel_lookup(struct menu_accel* ma, guint keyval, GdkModifierType mods) {
+	if(!(ma && ma->tree)) return MENU_TREE_NONE;
+	guint32 first, first2;
+	guint32 node = accel_find(ma, accel_key(keyval, mods), &first);
+	/* Shift might be needed to type the key itself (e.g. "+" on some
+	 * layouts); note: for letters, the keyval is lowercase in keys */
+	if(node == MENU_TREE_NONE && (mods & GDK_SHIFT_MASK) && gdk_keyval_to_upper(keyval) == gdk_keyval_to_lower(keyval)) {
+		node = accel_find(ma, accel_key(keyval, mods & ~GDK_SHIFT_MASK), &first2);
+		if(first == MENU_TREE_NONE) first = first2;
+	}
+	/* note: if none of the items can be used, the caller can tell by their flags */
+	return (node != MENU_TREE_NONE) ? node : first;
+}
+
+gboolean menu_accel_activate(struct menu_accel* ma, guint keyval, GdkModifierType mods, guint32 timestamp) {
+	guint32 node = menu_accel_lookup(ma, keyval, mods);
+	const struct menu_node* n = (node != MENU_TREE_NONE) ? menu_tree_get_node(ma->tree, node) : NULL;
+	if(!(n && (n->flags & MENU_NODE_ENABLED) && (n->flags & MENU_NODE_VISIBLE))) return FALSE;
+	menu_tree_activate(ma->tree, node, timestamp);
+	return TRUE;
+}
+
+gboolean menu_accel_activate_name(struct menu_accel* ma, const char* accel, guint32 timestamp) {
+	guint keyval;
+	GdkModifierType mods;
+	return menu_accel_parse(accel, &keyval, &mods) && menu_accel_activate(ma, keyval, mods, timestamp);
+}
+
+guint menu_accel_get_n_accels(struct menu_accel* ma) {
+	return ma ? ma->n_accels : 0;
+}
+
+
+/* D-Bus interface */
+
+static GVariant* menu_accel_list_variant(struct menu_accel* ma) {
+	GVariantBuilder b;
+	g_variant_builder_init(&b, G_VARIANT_TYPE("a(ss)"));
+	GHashTableIter it;
+	gpointer key;
+	g_hash_table_iter_init(&it, ma->index);
+	while(g_hash_table_iter_next(&it, &key, NULL)) {
+		guint32 first;
+		guint32 node = accel_find(ma, GPOINTER_TO_UINT(key), &first);
+		const struct menu_node* n = menu_tree_get_node(ma->tree, (node != MENU_TREE_NONE) ? node : first);
+		g_variant_builder_add(&b, "(ss)", n->accel, n->label ? n->label : "");
+	}
+	return g_variant_builder_end(&b);
+}
+
+static void method_call_cb(G_GNUC_UNUSED GDBusConnection* bus, G_GNUC_UNUSED const char* sender,
+		G_GNUC_UNUSED const char* path, G_GNUC_UNUSED const char* iface, const char* method,
+		GVariant* params, GDBusMethodInvocation* invocation, gpointer data) {
+	struct menu_accel* ma = (struct menu_accel*)data;
+	if(!strcmp(method, "Activate")) {
+		const char* accel;
+		g_variant_get(params, "(&s)", &accel);
+		/* note: we do not know the time of the keypress */
+		gboolean ret = menu_accel_activate_name(ma, accel, 0);
+		g_dbus_method_invocation_return_value(invocation, g_variant_new("(b)", ret));
+	}
+	else if(!strcmp(method, "List"))
+		g_dbus_method_invocation_return_value(invocation, g_variant_new("(@a(ss))", menu_accel_list_variant(ma)));
+	else g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD,
+		"Unknown method: %s", method);
+}
+
+static const GDBusInterfaceVTable menu_accel_vtable = { method_call_cb, NULL, NULL, { NULL } };
+
+int menu_accel_export(struct menu_accel* ma, GDBusConnection* bus, const char* object_path, GError** error) {
+	if(!ma) return 0;
+	return dbus_export_register(&(ma->export), bus, object_path, introspection_xml, &menu_accel_vtable, ma, error);
+}
+
+void menu_accel_unexport(struct menu_accel* ma) {
+	if(ma) dbus_export_unregister(&(ma->export));
+}
+
+void menu_accel_free(struct menu_accel* ma) {
+	if(!ma) return;
+	menu_accel_unexport(ma);
+	menu_accel_set_tree(ma, NULL);
+	g_hash_table_destroy(ma->index);
+	g_array_free(ma->nodes, TRUE);
+	g_free(ma);
+}
@@ -0,0 +1,110 @@
+/*
+ * menu_accel.h -- index of the accelerators of menu items
+ * 
+ * Copyright 2025 Daniel Kondor <kondor.dani@gmail.com>
+ * 
+ * This is free and unencumbered software released into the public domain.
+ * 
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ * 
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+#ifndef MENU_ACCEL_H
+#define MENU_ACCEL_H
+
+#include <gio/gio.h>
+#include <gdk/gdk.h>
+#include <menu_tree.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*
+ * Index of the accelerators of the items in a menu tree (e.g. the menu
+ * of the active app), so that they can be activated without showing the
+ * menu, e.g. by keybindings of a panel or from a launcher. The index is
+ * updated as the tree changes; looking up an accelerator is a single
+ * hash table lookup (followed by the other items with the same
+ * accelerator, if the first one is disabled or hidden), and activating
+ * it is done by the tree's backend, i.e. it results in one D-Bus call
+ * to the app (activating the action or sending a dbusmenu "clicked"
+ * event).
+ */
+struct menu_accel;
+
+struct menu_accel* menu_accel_new(void);
+
+/*
+ * Index the accelerators of tree (not owned), replacing the previous
+ * one; NULL removes it. The tree should be removed before it is freed.
+ */
+void menu_accel_set_tree(struct menu_accel* ma, struct menu_tree* tree);
+
+/*
+ * Parse an accelerator in the format used by GTK (e.g. "<Primary>q" or
+ * "<Control><Shift>s"), as used by menu items. Returns FALSE if it is
+ * not valid.
+ */
+gboolean menu_accel_parse(const char* accel, guint* keyval, GdkModifierType* mods);
+
+/*
+ * Find the item with the given key and modifiers (e.g. of a key press
+ * event), returning MENU_TREE_NONE if there is none. Modifiers other than
+ * Shift, Control, Alt, Super, Hyper and Meta are ignored; Shift is also
+ * ignored if it is not part of any matching accelerator and does not
+ * change the case of keyval (as it might be needed to type the key). If
+ * more than one item has the same accelerator, the first one indexed that
+ * is enabled and visible is used (or the first one, if none of them are).
+ */
+guint32 menu_accel_lookup(struct menu_accel* ma, guint keyval, GdkModifierType mods);
+
+/*
+ * Activate the item with the given key and modifiers or accelerator
+ * (see menu_accel_parse()), if there is one and it is enabled. Returns
+ * whether an item was activated.
+ */
+gboolean menu_accel_activate(struct menu_accel* ma, guint keyval, GdkModifierType mods, guint32 timestamp);
+gboolean menu_accel_activate_name(struct menu_accel* ma, const char* accel, guint32 timestamp);
+
+/* get the number of items with an accelerator */
+guint menu_accel_get_n_accels(struct menu_accel* ma);
+
+/*
+ * Make it possible to activate accelerators on the given connection at
+ * object_path, with the io.github.dkondor.GtkGlobalMenuTest.Accels
+ * interface, which has the Activate(s accel) -> (b activated) and
+ * List() -> (a(ss) accel, label) methods. Returns nonzero on success.
+ * The object is removed by menu_accel_free() or menu_accel_unexport().
+ */
+int menu_accel_export(struct menu_accel* ma, GDBusConnection* bus, const char* object_path, GError** error);
+void menu_accel_unexport(struct menu_accel* ma);
+
+void menu_accel_free(struct menu_accel* ma);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,246 @@
+/*
+ * menu_cache.c -- shared cache of D-Bus menu and action group proxies
+ * 
+ * Copyright 2025 Daniel Kondor <kondor.dani@gmail.com>
+ * 
+ * This is free and unencumbered software released into the public domain.
+ * 
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ * 
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <menu_cache.h>
+
+
+struct menu_cache {
+	GDBusConnection* bus;
+	GHashTable* entries; /* key -> struct menu_cache_entry*, key owned by the entry */
+	GHashTable* names;   /* bus name -> struct menu_cache_name*, key owned by it */
+	GArray* callbacks;   /* struct menu_cache_callback */
+};
+
+/* a watched bus name */
+struct menu_cache_name {
+	struct menu_cache* cache;
+	char* name;
+	guint watch_id;
+	unsigned int refs;
+	enum menu_cache_name_state state;
+};
+
+struct menu_cache_callback {
+	void (*callback)(void* data, const char* bus_name, int owned);
+	void* data;
+};
+
+struct menu_cache_entry {
+	struct menu_cache* cache;
+	char* key;
+	enum menu_cache_kind kind;
+	struct menu_cache_name* owner;
+	char* object_path;
+	GObject* object; /* created on demand */
+	unsigned int refs;
+};
+
+
+static void name_free(gpointer data) {
+	struct menu_cache_name* name = (struct menu_cache_name*)data;
+	g_bus_unwatch_name(name->watch_id);
+	g_free(name->name);
+	g_free(name);
+}
+
+static void name_notify(struct menu_cache_name* name, int owned) {
+	struct menu_cache* cache = name->cache;
+	guint i;
+	for(i = 0; i < cache->callbacks->len; i++) {
+		struct menu_cache_callback* cb = &g_array_index(cache->callbacks, struct menu_cache_callback, i);
+		cb->callback(cb->data, name->name, owned);
+	}
+}
+
+static void name_appeared_cb(G_GNUC_UNUSED GDBusConnection* bus, G_GNUC_UNUSED const char* bus_name,
+		G_GNUC_UNUSED const char* owner, gpointer data) {
+	struct menu_cache_name* name = (struct menu_cache_name*)data;
+	enum menu_cache_name_state old = name->state;
+	name->state = MENU_CACHE_NAME_OWNED;
+	/* note: while unknown, we assumed that the name has an owner */
+	if(old == MENU_CACHE_NAME_UNOWNED) name_notify(name, 1);
+}
+
+static void name_vanished_cb(G_GNUC_UNUSED GDBusConnection* bus, G_GNUC_UNUSED const char* bus_name,
+		gpointer data) {
+	struct menu_cache_name* name = (struct menu_cache_name*)data;
+	if(name->state == MENU_CACHE_NAME_UNOWNED) return;
+	name->state = MENU_CACHE_NAME_UNOWNED;
+	
+	/* drop proxies, so that nobody waits for calls to a dead exporter */
+	GHashTableIter it;
+	gpointer value;
+	g_hash_table_iter_init(&it, name->cache->entries);
+	while(g_hash_table_iter_next(&it, NULL, &value)) {
+		struct menu_cache_entry* entry = (struct menu_cache_entry*)value;
+		if(entry->owner == name) g_clear_object(&(entry->object));
+	}
+	name_notify(name, 0);
+}
+
+static struct menu_cache_name* name_watch(struct menu_cache* cache, const char* bus_name) {
+	struct menu_cache_name* name = g_hash_table_lookup(cache->names, bus_name);
+	if(name) {
+		name->refs++;
+		return name;
+	}
+	name = g_new0(struct menu_cache_name, 1);
+	name->cache = cache;
+	name->name = g_strdup(bus_name);
+	name->refs = 1;
+	name->state = MENU_CACHE_NAME_UNKNOWN;
+	/* note: this does not start the app if it is not running */
+	name->watch_id = g_bus_watch_name_on_connection(cache->bus, bus_name, G_BUS_NAME_WATCHER_FLAGS_NONE,
+		name_appeared_cb, name_vanished_cb, name, NULL);
+	g_hash_table_insert(cache->names, name->name, name);
+	return name;
+}
+
+static void name_unwatch(struct menu_cache_name* name) {
+	/* this will free name as well */
+	if(!--name->refs) g_hash_table_remove(name->cache->names, name->name);
+}
+
+static void entry_free(gpointer data) {
+	struct menu_cache_entry* entry = (struct menu_cache_entry*)data;
+	g_clear_object(&(entry->object));
+	name_unwatch(entry->owner);
+	g_free(entry->object_path);
+	g_free(entry->key);
+	g_free(entry);
+}
+
+struct menu_cache* menu_cache_new(GDBusConnection* bus) {
+	if(!bus) return NULL;
+	struct menu_cache* cache = g_new0(struct menu_cache, 1);
+	cache->bus = g_object_ref(bus);
+	cache->entries = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, entry_free);
+	cache->names = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, name_free);
+	cache->callbacks = g_array_new(FALSE, FALSE, sizeof(struct menu_cache_callback));
+	return cache;
+}
+
+struct menu_cache_entry* menu_cache_acquire(struct menu_cache* cache,
+		enum menu_cache_kind kind, const char* bus_name, const char* object_path) {
+	if(!(cache && bus_name && object_path)) return NULL;
+	
+	/* note: bus names and object paths cannot contain newlines */
+	char* key = g_strdup_printf("%d\n%s\n%s", (int)kind, bus_name, object_path);
+	struct menu_cache_entry* entry = g_hash_table_lookup(cache->entries, key);
+	if(entry) {
+		g_free(key);
+		entry->refs++;
+		return entry;
+	}
+	
+	entry = g_new0(struct menu_cache_entry, 1);
+	entry->cache = cache;
+	entry->key = key;
+	entry->kind = kind;
+	entry->owner = name_watch(cache, bus_name);
+	entry->object_path = g_strdup(object_path);
+	entry->refs = 1;
+	g_hash_table_insert(cache->entries, key, entry);
+	return entry;
+}
+
+GObject* menu_cache_entry_get_object(struct menu_cache_entry* entry) {
+	if(!entry || entry->owner->state == MENU_CACHE_NAME_UNOWNED) return NULL;
+	if(!entry->object) {
+		GDBusConnection* bus = entry->cache->bus;
+		const char* bus_name = entry->owner->name;
+		switch(entry->kind) {
+			case MENU_CACHE_MENU_MODEL:
+				entry->object = (GObject*)g_dbus_menu_model_get(bus, bus_name, entry->object_path);
+				break;
+			case MENU_CACHE_ACTION_GROUP:
+				entry->object = (GObject*)g_dbus_action_group_get(bus, bus_name, entry->object_path);
+				break;
+		}
+	}
+	return entry->object;
+}
+
+void menu_cache_release(struct menu_cache_entry* entry) {
+	if(!entry) return;
+	if(--entry->refs) return;
+	/* this will free the entry as well */
+	g_hash_table_remove(entry->cache->entries, entry->key);
+}
+
+void menu_cache_watch_name(struct menu_cache* cache, const char* bus_name) {
+	if(cache && bus_name) name_watch(cache, bus_name);
+}
+
+void menu_cache_unwatch_name(struct menu_cache* cache, const char* bus_name) {
+	if(!(cache && bus_name)) return;
+	struct menu_cache_name* name = g_hash_table_lookup(cache->names, bus_name);
+	if(name) name_unwatch(name);
+}
+
+enum menu_cache_name_state menu_cache_get_name_state(struct menu_cache* cache, const char* bus_name) {
+	if(!(cache && bus_name)) return MENU_CACHE_NAME_UNKNOWN;
+	struct menu_cache_name* name = g_hash_table_lookup(cache->names, bus_name);
+	return name ? name->state : MENU_CACHE_NAME_UNKNOWN;
+}
+
+void menu_cache_add_name_callback(struct menu_cache* cache,
+		void (*callback)(void* data, const char* bus_name, int owned), void* data) {
+	if(!(cache && callback)) return;
+	struct menu_cache_callback cb = { callback, data };
+	g_array_append_val(cache->callbacks, cb);
+}
+
+void menu_cache_remove_name_callback(struct menu_cache* cache,
+		void (*callback)(void* data, const char* bus_name, int owned), void* data) {
+	if(!cache) return;
+	guint i;
+	for(i = 0; i < cache->callbacks->len; i++) {
+		struct menu_cache_callback* cb = &g_array_index(cache->callbacks, struct menu_cache_callback, i);
+		if(cb->callback == callback && cb->data == data) {
+			g_array_remove_index(cache->callbacks, i);
+			return;
+		}
+	}
+}
+
+unsigned int menu_cache_get_size(struct menu_cache* cache) {
+	return cache ? g_hash_table_size(cache->entries) : 0;
+}
+
+void menu_cache_free(struct menu_cache* cache) {
+	if(!cache) return;
+	/* note: entries unwatch their names, so these need to be freed first */
+	g_hash_table_destroy(cache->entries);
+	g_hash_table_destroy(cache->names);
+	g_array_free(cache->callbacks, TRUE);
+	g_object_unref(cache->bus);
+	g_free(cache);
+}
@@ -0,0 +1,127 @@
+/*
+ * menu_cache.h -- shared cache of D-Bus menu and action group proxies
+ * 
+ * Copyright 2025 Daniel Kondor <kondor.dani@gmail.com>
+ * 
+ * This is free and unencumbered software released into the public domain.
+ * 
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ * 
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef MENU_CACHE_H
+#define MENU_CACHE_H
+
+#include <gio/gio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+struct menu_cache;
+struct menu_cache_entry;
+
+/* type of proxy stored in a cache entry */
+enum menu_cache_kind {
+	MENU_CACHE_MENU_MODEL,   /* GDBusMenuModel (org.gtk.Menus) */
+	MENU_CACHE_ACTION_GROUP  /* GDBusActionGroup (org.gtk.Actions) */
+};
+
+/*
+ * Create a new cache for proxies on the given bus connection.
+ */
+struct menu_cache* menu_cache_new(GDBusConnection* bus);
+
+/* whether a bus name has an owner, see menu_cache_get_name_state() */
+enum menu_cache_name_state {
+	MENU_CACHE_NAME_UNKNOWN, /* not watched or not known yet */
+	MENU_CACHE_NAME_OWNED,
+	MENU_CACHE_NAME_UNOWNED
+};
+
+/*
+ * Get a reference to the entry for the given bus name and object path,
+ * creating it if it does not exist yet. Entries are shared among all
+ * users asking for the same (kind, bus name, object path) and are kept
+ * alive until the last reference is released. The bus name is watched
+ * while the entry exists.
+ */
+struct menu_cache_entry* menu_cache_acquire(struct menu_cache* cache,
+		enum menu_cache_kind kind, const char* bus_name, const char* object_path);
+
+/*
+ * Get the proxy object stored in an entry (GDBusMenuModel or
+ * GDBusActionGroup, depending on the kind). The returned object is
+ * owned by the entry. Returns NULL if the bus name is known to have no
+ * owner (e.g. the app crashed); in this case, the proxy is dropped and
+ * is created again if the name gets an owner later.
+ */
+GObject* menu_cache_entry_get_object(struct menu_cache_entry* entry);
+
+/*
+ * Release a reference acquired by menu_cache_acquire(). The proxy is
+ * destroyed when the last reference is released.
+ */
+void menu_cache_release(struct menu_cache_entry* entry);
+
+/*
+ * Watch whether the given bus name has an owner. Calls can be nested;
+ * the name is watched until the same number of calls to
+ * menu_cache_unwatch_name().
+ */
+void menu_cache_watch_name(struct menu_cache* cache, const char* bus_name);
+void menu_cache_unwatch_name(struct menu_cache* cache, const char* bus_name);
+
+/*
+ * Get whether the given bus name has an owner, as far as we know. This
+ * is only known for names that are watched (including ones used by
+ * entries) and only after the bus has answered.
+ */
+enum menu_cache_name_state menu_cache_get_name_state(struct menu_cache* cache, const char* bus_name);
+
+/*
+ * Add or remove a callback that is called when a watched name gets
+ * or loses its owner. Proxies for names that lost their owner are
+ * dropped before calling this.
+ */
+void menu_cache_add_name_callback(struct menu_cache* cache,
+		void (*callback)(void* data, const char* bus_name, int owned), void* data);
+void menu_cache_remove_name_callback(struct menu_cache* cache,
+		void (*callback)(void* data, const char* bus_name, int owned), void* data);
+
+/*
+ * Get the number of entries currently held by the cache.
+ */
+unsigned int menu_cache_get_size(struct menu_cache* cache);
+
+/*
+ * Free the cache. All entries should be released before calling this.
+ */
+void menu_cache_free(struct menu_cache* cache);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
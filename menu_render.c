@@ -0,0 +1,547 @@
+/*
+ * menu_render.c -- show a menu tree as a GTK menu
+ * 
+ * Copyright 2025 Daniel Kondor <kondor.dani@gmail.com>
+ * 
+ * This is free and unencumbered software released into the public domain.
+ * 
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ * 
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <menu_render.h>
+
+/* widgets created for a node */
+struct render_slot {
+	GtkWidget* item;      /* GtkMenuItem (for sections: their label, if any) */
+	GtkWidget* separator; /* added before item where a section starts or ends */
+	GtkWidget* menu;      /* GtkMenu, for submenus and the root */
+	int pending;          /* the node is in pending */
+};
+
+struct menu_render {
+	struct menu_tree* tree;
+	struct icon_cache* icons;
+	GArray* slots; /* struct render_slot, by node index */
+	int updating;  /* we are changing widgets, ignore their signals */
+	void (*changed)(void* data, struct menu_render* mr);
+	void* changed_data;
+	/* nodes whose properties changed, applied together once per frame */
+	GArray* pending; /* guint32 */
+	/* icons being decoded: GBytes (image data) -> GArray of guint32 nodes showing them */
+	GHashTable* icon_nodes;
+	guint flush_id;  /* tick callback of the root menu while it is shown, idle source otherwise */
+	int flush_tick;
+};
+
+/* state while collecting the items of a menu */
+struct render_ctx {
+	GPtrArray* widgets; /* the items (and separators) of the menu, in order */
+	int need_separator; /* a section started or ended */
+};
+
+#define NODE_KEY "menu-render-node"
+/* for items with an icon: the GtkImage and the label next to it */
+#define IMAGE_KEY "menu-render-image"
+#define LABEL_KEY "menu-render-label"
+
+
+static void render_menu(struct menu_render* mr, guint32 node);
+static void render_add_icon(GtkWidget* w);
+
+static struct render_slot* render_slot(struct menu_render* mr, guint32 node) {
+	if(node >= mr->slots->len) g_array_set_size(mr->slots, menu_tree_get_size(mr->tree));
+	return (node < mr->slots->len) ? &g_array_index(mr->slots, struct render_slot, node) : NULL;
+}
+
+static guint32 widget_node(GtkWidget* w) {
+	return GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(w), NODE_KEY)) - 1;
+}
+
+static void widget_set_node(GtkWidget* w, guint32 node) {
+	g_object_set_data(G_OBJECT(w), NODE_KEY, GUINT_TO_POINTER(node + 1));
+}
+
+/* the widget is destroyed (together with its parent), forget about it */
+static void widget_destroy_cb(GtkWidget* w, gpointer data) {
+	struct menu_render* mr = (struct menu_render*)data;
+	guint32 node = widget_node(w);
+	struct render_slot* slot = (node < mr->slots->len) ? &g_array_index(mr->slots, struct render_slot, node) : NULL;
+	/* note: the node might be used by a new widget already */
+	if(slot && slot->item == w) slot->item = NULL;
+	if(slot && slot->separator == w) slot->separator = NULL;
+	if(slot && slot->menu == w) slot->menu = NULL;
+}
+
+/* the closest node that has a menu (i.e. not a section) */
+static guint32 render_menu_node(struct menu_render* mr, guint32 node) {
+	const struct menu_node* n = menu_tree_get_node(mr->tree, node);
+	while(n && n->kind == MENU_NODE_SECTION) {
+		node = n->parent;
+		n = menu_tree_get_node(mr->tree, node);
+	}
+	return n ? node : MENU_TREE_NONE;
+}
+
+static void render_icon_ready(void* data, GBytes* icon);
+
+/* remember that node shows data once it is decoded */
+static void render_icon_wait(struct menu_render* mr, GBytes* data, guint32 node) {
+	GArray* nodes = g_hash_table_lookup(mr->icon_nodes, data);
+	if(!nodes) {
+		nodes = g_array_new(FALSE, FALSE, sizeof(guint32));
+		g_hash_table_insert(mr->icon_nodes, g_bytes_ref(data), nodes);
+	}
+	guint i;
+	for(i = 0; i < nodes->len; i++) if(g_array_index(nodes, guint32, i) == node) return;
+	g_array_append_val(nodes, node);
+}
+
+/* show the icon of node (n) in image, or keep it empty until it is decoded */
+static void render_icon(struct menu_render* mr, guint32 node, const struct menu_node* n, GtkImage* image) {
+	GBytes* data = icon_cache_get_data(n->icon);
+	if(data) {
+		GdkPixbuf* pixbuf = NULL;
+		if(mr->icons) {
+			if(!icon_cache_lookup(mr->icons, data, &pixbuf, render_icon_ready, mr))
+				render_icon_wait(mr, data, node);
+		}
+		else {
+			gint width, height;
+			gtk_icon_size_lookup(GTK_ICON_SIZE_MENU, &width, &height);
+			pixbuf = icon_cache_decode(data, MAX(width, height));
+		}
+		if(pixbuf) {
+			gtk_image_set_from_pixbuf(image, pixbuf);
+			g_object_unref(pixbuf);
+		}
+		else gtk_image_clear(image);
+		g_bytes_unref(data);
+		return;
+	}
+	
+	/* note: GTK loads themed and file icons itself (and caches them) */
+	GIcon* gicon = n->icon ? g_icon_deserialize(n->icon) : NULL;
+	if(gicon) {
+		gtk_image_set_from_gicon(image, gicon, GTK_ICON_SIZE_MENU);
+		g_object_unref(gicon);
+	}
+	else gtk_image_clear(image);
+}
+
+/* an icon was decoded, show it in all items that were waiting for it */
+static void render_icon_ready(void* data, GBytes* icon) {
+	struct menu_render* mr = (struct menu_render*)data;
+	gpointer key;
+	GArray* nodes;
+	if(!g_hash_table_steal_extended(mr->icon_nodes, icon, &key, (gpointer*)&nodes)) return;
+	guint i;
+	for(i = 0; i < nodes->len; i++) {
+		guint32 node = g_array_index(nodes, guint32, i);
+		GtkWidget* w = (node < mr->slots->len) ? g_array_index(mr->slots, struct render_slot, node).item : NULL;
+		GtkWidget* image = w ? g_object_get_data(G_OBJECT(w), IMAGE_KEY) : NULL;
+		const struct menu_node* n = image ? menu_tree_get_node(mr->tree, node) : NULL;
+		GBytes* data = n ? icon_cache_get_data(n->icon) : NULL;
+		if(!data) continue;
+		/* note: the node might show a different icon by now */
+		if(g_bytes_equal(data, icon)) render_icon(mr, node, n, GTK_IMAGE(image));
+		g_bytes_unref(data);
+	}
+	g_bytes_unref((GBytes*)key);
+	g_array_free(nodes, TRUE);
+}
+
+/* update the widget of node from its properties */
+static void render_apply(struct menu_render* mr, guint32 node) {
+	const struct menu_node* n = menu_tree_get_node(mr->tree, node);
+	struct render_slot* slot = render_slot(mr, node);
+	GtkWidget* w = slot ? slot->item : NULL;
+	if(!(n && w)) return;
+	
+	mr->updating = 1;
+	GtkWidget* label = g_object_get_data(G_OBJECT(w), LABEL_KEY);
+	if(label) {
+		gtk_label_set_text_with_mnemonic(GTK_LABEL(label), n->label ? n->label : "");
+		render_icon(mr, node, n, GTK_IMAGE(g_object_get_data(G_OBJECT(w), IMAGE_KEY)));
+	}
+	else if(n->kind != MENU_NODE_SEPARATOR) {
+		gtk_menu_item_set_use_underline(GTK_MENU_ITEM(w), TRUE);
+		gtk_menu_item_set_label(GTK_MENU_ITEM(w), n->label ? n->label : "");
+		/* note: this is a GtkAccelLabel created by GtkMenuItem */
+		label = gtk_bin_get_child(GTK_BIN(w));
+	}
+	/* note: the accelerator is only shown here, it is handled by menu_accel */
+	if(label && GTK_IS_ACCEL_LABEL(label)) {
+		guint key = 0;
+		GdkModifierType mods = 0;
+		if(n->accel) gtk_accelerator_parse(n->accel, &key, &mods);
+		gtk_accel_label_set_accel(GTK_ACCEL_LABEL(label), key, mods);
+	}
+	/* note: the label of a section is only a heading */
+	gtk_widget_set_sensitive(w, n->kind != MENU_NODE_SECTION && (n->flags & MENU_NODE_ENABLED));
+	gtk_widget_set_visible(w, n->kind == MENU_NODE_SECTION || (n->flags & MENU_NODE_VISIBLE));
+	if(GTK_IS_CHECK_MENU_ITEM(w)) {
+		gtk_check_menu_item_set_active(GTK_CHECK_MENU_ITEM(w), !!(n->flags & MENU_NODE_TOGGLED));
+		gtk_check_menu_item_set_inconsistent(GTK_CHECK_MENU_ITEM(w), !!(n->flags & MENU_NODE_INCONSISTENT));
+	}
+	mr->updating = 0;
+}
+
+static void item_activate_cb(GtkMenuItem* w, gpointer data) {
+	struct menu_render* mr = (struct menu_render*)data;
+	if(mr->updating || gtk_menu_item_get_submenu(w)) return;
+	guint32 node = widget_node(GTK_WIDGET(w));
+	menu_tree_activate(mr->tree, node, gtk_get_current_event_time());
+	/* check boxes toggle themselves; show the state of the tree until
+	 * the backend reports a change */
+	render_apply(mr, node);
+}
+
+static void menu_show_cb(GtkWidget* menu, gpointer data) {
+	struct menu_render* mr = (struct menu_render*)data;
+	menu_tree_opened(mr->tree, widget_node(menu), gtk_get_current_event_time());
+}
+
+static void menu_hide_cb(GtkWidget* menu, gpointer data) {
+	struct menu_render* mr = (struct menu_render*)data;
+	menu_tree_closed(mr->tree, widget_node(menu), gtk_get_current_event_time());
+}
+
+static GtkWidget* render_new_menu(struct menu_render* mr, guint32 node) {
+	GtkWidget* menu = gtk_menu_new();
+	widget_set_node(menu, node);
+	render_slot(mr, node)->menu = menu;
+	g_signal_connect(menu, "show", G_CALLBACK(menu_show_cb), mr);
+	g_signal_connect(menu, "hide", G_CALLBACK(menu_hide_cb), mr);
+	g_signal_connect(menu, "destroy", G_CALLBACK(widget_destroy_cb), mr);
+	return menu;
+}
+
+/* items of this node show an icon next to their label */
+static int render_has_icon(const struct menu_node* n) {
+	return n->icon && n->kind != MENU_NODE_SEPARATOR && n->kind != MENU_NODE_SECTION;
+}
+
+/* create the widget of node, which is added to its menu by render_menu() */
+static void render_new_item(struct menu_render* mr, guint32 node) {
+	const struct menu_node* n = menu_tree_get_node(mr->tree, node);
+	GtkWidget* w;
+	switch(n->kind) {
+		case MENU_NODE_SEPARATOR:
+			w = gtk_separator_menu_item_new();
+			break;
+		case MENU_NODE_ITEM:
+			if(n->flags & (MENU_NODE_CHECK | MENU_NODE_RADIO)) {
+				w = gtk_check_menu_item_new();
+				gtk_check_menu_item_set_draw_as_radio(GTK_CHECK_MENU_ITEM(w), !!(n->flags & MENU_NODE_RADIO));
+			}
+			else w = gtk_menu_item_new();
+			break;
+		default:
+			w = gtk_menu_item_new();
+			break;
+	}
+	
+	if(render_has_icon(n)) render_add_icon(w);
+	widget_set_node(w, node);
+	render_slot(mr, node)->item = w;
+	g_signal_connect(w, "destroy", G_CALLBACK(widget_destroy_cb), mr);
+	if(n->kind != MENU_NODE_SEPARATOR && n->kind != MENU_NODE_SECTION)
+		g_signal_connect(w, "activate", G_CALLBACK(item_activate_cb), mr);
+	if(n->kind == MENU_NODE_SUBMENU) {
+		gtk_menu_item_set_submenu(GTK_MENU_ITEM(w), render_new_menu(mr, node));
+		render_menu(mr, node);
+	}
+	render_apply(mr, node);
+}
+
+/* destroy the widgets of node (or only those of its children) */
+static void render_destroy(struct menu_render* mr, guint32 node, int children) {
+	const struct menu_node* n = menu_tree_get_node(mr->tree, node);
+	struct render_slot* slot = render_slot(mr, node);
+	if(!(n && slot)) return;
+	if(!children) {
+		/* note: this clears the slot, and destroys the submenu as well */
+		if(slot->separator) gtk_widget_destroy(slot->separator);
+		if(slot->item) gtk_widget_destroy(slot->item);
+		/* the items of a section are in the menu of its parent */
+		if(n->kind != MENU_NODE_SECTION) return;
+	}
+	guint32 child;
+	for(child = n->first_child; child != MENU_TREE_NONE; child = menu_tree_get_node(mr->tree, child)->next)
+		render_destroy(mr, child, 0);
+}
+
+/* add the widget of node to the menu, after a separator if needed */
+static void render_add(struct menu_render* mr, struct render_ctx* ctx, guint32 node) {
+	struct render_slot* slot = render_slot(mr, node);
+	if(!slot->item) render_new_item(mr, node);
+	/* note: an existing submenu might have new descendants */
+	else if(slot->menu) render_menu(mr, node);
+	/* note: slots might be moved by new items */
+	slot = render_slot(mr, node);
+	if(ctx->need_separator && ctx->widgets->len) {
+		if(!slot->separator) {
+			slot->separator = gtk_separator_menu_item_new();
+			widget_set_node(slot->separator, node);
+			g_signal_connect(slot->separator, "destroy", G_CALLBACK(widget_destroy_cb), mr);
+			gtk_widget_show(slot->separator);
+		}
+		g_ptr_array_add(ctx->widgets, slot->separator);
+	}
+	else if(slot->separator) gtk_widget_destroy(slot->separator);
+	ctx->need_separator = 0;
+	g_ptr_array_add(ctx->widgets, slot->item);
+}
+
+/* collect the widgets for the children of node, creating the missing ones */
+static void render_children(struct menu_render* mr, struct render_ctx* ctx, guint32 node) {
+	const struct menu_node* n = menu_tree_get_node(mr->tree, node);
+	guint32 child = n ? n->first_child : MENU_TREE_NONE;
+	for(; child != MENU_TREE_NONE; child = menu_tree_get_node(mr->tree, child)->next) {
+		const struct menu_node* c = menu_tree_get_node(mr->tree, child);
+		if(c->kind != MENU_NODE_SECTION) {
+			render_add(mr, ctx, child);
+			continue;
+		}
+		ctx->need_separator = 1;
+		if(c->label) render_add(mr, ctx, child);
+		else {
+			/* the section lost its label */
+			struct render_slot* slot = render_slot(mr, child);
+			if(slot->separator) gtk_widget_destroy(slot->separator);
+			if(slot->item) gtk_widget_destroy(slot->item);
+		}
+		render_children(mr, ctx, child);
+		ctx->need_separator = 1;
+	}
+}
+
+/* put widgets into menu in this order, and destroy the items not among them */
+static void render_place(GtkWidget* menu, GPtrArray* widgets) {
+	GList* children = gtk_container_get_children(GTK_CONTAINER(menu));
+	GList* l = children;
+	guint n = g_list_length(children);
+	guint i;
+	for(i = 0; i < widgets->len; i++) {
+		GtkWidget* w = g_ptr_array_index(widgets, i);
+		/* note: items normally keep their order, only new ones are inserted */
+		if(l && l->data == w) {
+			l = l->next;
+			continue;
+		}
+		if(gtk_widget_get_parent(w) == menu) gtk_menu_reorder_child(GTK_MENU(menu), w, (gint)i);
+		else {
+			gtk_menu_shell_insert(GTK_MENU_SHELL(menu), w, (gint)i);
+			n++;
+		}
+	}
+	g_list_free(children);
+	if(n <= widgets->len) return;
+	
+	/* the rest are left over from nodes that are gone */
+	children = gtk_container_get_children(GTK_CONTAINER(menu));
+	for(l = g_list_nth(children, widgets->len); l; l = l->next) gtk_widget_destroy(GTK_WIDGET(l->data));
+	g_list_free(children);
+}
+
+/* add an (empty) icon and a label to an item, filled in by render_apply() */
+static void render_add_icon(GtkWidget* w) {
+	gint width, height;
+	GtkWidget* box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 6);
+	GtkWidget* image = gtk_image_new();
+	GtkWidget* label = gtk_accel_label_new("");
+	/* note: keep the space of the icon, so that the menu does not change size when it is ready */
+	gtk_icon_size_lookup(GTK_ICON_SIZE_MENU, &width, &height);
+	gtk_widget_set_size_request(image, width, height);
+	gtk_label_set_use_underline(GTK_LABEL(label), TRUE);
+	gtk_label_set_xalign(GTK_LABEL(label), 0.0f);
+	gtk_accel_label_set_accel_widget(GTK_ACCEL_LABEL(label), w);
+	gtk_box_pack_start(GTK_BOX(box), image, FALSE, FALSE, 0);
+	gtk_box_pack_start(GTK_BOX(box), label, TRUE, TRUE, 0);
+	gtk_container_add(GTK_CONTAINER(w), box);
+	gtk_widget_show_all(box);
+	g_object_set_data(G_OBJECT(w), IMAGE_KEY, image);
+	g_object_set_data(G_OBJECT(w), LABEL_KEY, label);
+}
+
+/* bring the items of the menu of node (and of its submenus) up-to-date
+ * with the tree; only missing widgets are created */
+static void render_menu(struct menu_render* mr, guint32 node) {
+	struct render_slot* slot = render_slot(mr, node);
+	if(!(slot && slot->menu)) return;
+	GtkWidget* menu = slot->menu;
+	struct render_ctx ctx = { g_ptr_array_new(), 0 };
+	render_children(mr, &ctx, node);
+	render_place(menu, ctx.widgets);
+	g_ptr_array_free(ctx.widgets, TRUE);
+}
+
+/* update the widget of node after its properties changed; returns nonzero if anything was done */
+static int render_update(struct menu_render* mr, guint32 node) {
+	const struct menu_node* n = menu_tree_get_node(mr->tree, node);
+	struct render_slot* slot = render_slot(mr, node);
+	if(!(n && slot && slot->item)) return 0;
+	int check = !!(n->flags & (MENU_NODE_CHECK | MENU_NODE_RADIO));
+	int icon = !!g_object_get_data(G_OBJECT(slot->item), IMAGE_KEY);
+	/* a different kind of widget is needed, replace only this one */
+	if(check != !!GTK_IS_CHECK_MENU_ITEM(slot->item) || icon != render_has_icon(n)) {
+		gtk_widget_destroy(slot->item);
+		render_menu(mr, render_menu_node(mr, n->parent));
+	}
+	else render_apply(mr, node);
+	return 1;
+}
+
+static GtkWidget* render_root(struct menu_render* mr) {
+	return g_array_index(mr->slots, struct render_slot, MENU_TREE_ROOT).menu;
+}
+
+static void render_cancel_flush(struct menu_render* mr) {
+	if(!mr->flush_id) return;
+	if(mr->flush_tick) gtk_widget_remove_tick_callback(render_root(mr), mr->flush_id);
+	else g_source_remove(mr->flush_id);
+	mr->flush_id = 0;
+}
+
+/* apply all pending changes */
+static void render_flush(struct menu_render* mr) {
+	guint i;
+	int changed = 0;
+	render_cancel_flush(mr);
+	for(i = 0; i < mr->pending->len; i++) {
+		guint32 node = g_array_index(mr->pending, guint32, i);
+		/* note: slots might be moved by updates */
+		struct render_slot* slot = render_slot(mr, node);
+		if(!(slot && slot->pending)) continue;
+		slot->pending = 0;
+		if(render_update(mr, node)) changed = 1;
+	}
+	g_array_set_size(mr->pending, 0);
+	if(changed && mr->changed) mr->changed(mr->changed_data, mr);
+}
+
+static gboolean render_flush_idle(gpointer data) {
+	struct menu_render* mr = (struct menu_render*)data;
+	mr->flush_id = 0;
+	render_flush(mr);
+	return G_SOURCE_REMOVE;
+}
+
+static gboolean render_flush_tick(G_GNUC_UNUSED GtkWidget* w, G_GNUC_UNUSED GdkFrameClock* clock, gpointer data) {
+	struct menu_render* mr = (struct menu_render*)data;
+	mr->flush_id = 0;
+	render_flush(mr);
+	return G_SOURCE_REMOVE;
+}
+
+/* tick callbacks do not run while the menu is hidden */
+static void root_unmap_cb(G_GNUC_UNUSED GtkWidget* w, gpointer data) {
+	struct menu_render* mr = (struct menu_render*)data;
+	if(mr->flush_id && mr->flush_tick) render_flush(mr);
+}
+
+static void render_schedule(struct menu_render* mr, guint32 node) {
+	struct render_slot* slot = render_slot(mr, node);
+	if(!(slot && slot->item) || slot->pending) return;
+	slot->pending = 1;
+	g_array_append_val(mr->pending, node);
+	if(mr->flush_id) return;
+	/* note: while the menu is shown, apply changes right before the next
+	 * frame, so that apps changing many items only cause one update */
+	GtkWidget* root = render_root(mr);
+	mr->flush_tick = gtk_widget_get_mapped(root);
+	if(mr->flush_tick) mr->flush_id = gtk_widget_add_tick_callback(root, render_flush_tick, mr, NULL);
+	else mr->flush_id = g_idle_add_full(G_PRIORITY_HIGH_IDLE, render_flush_idle, mr, NULL);
+}
+
+static void tree_changed_cb(void* data, struct menu_tree* tree, guint32 node, enum menu_tree_change change) {
+	struct menu_render* mr = (struct menu_render*)data;
+	const struct menu_node* n = menu_tree_get_node(tree, node);
+	struct render_slot* slot = render_slot(mr, node);
+	if(!(n && slot)) return;
+	
+	/* note: widgets refer to nodes by index, so they need to be changed right
+	 * away; the menu is fixed up (e.g. separators) once the new children are added */
+	switch(change) {
+		case MENU_TREE_REMOVING:
+			render_destroy(mr, node, 0);
+			break;
+		case MENU_TREE_CLEARING:
+			render_destroy(mr, node, 1);
+			break;
+		case MENU_TREE_CHANGED_CHILDREN:
+			render_menu(mr, render_menu_node(mr, node));
+			if(mr->changed) mr->changed(mr->changed_data, mr);
+			break;
+		default:
+			/* a section got or lost its label */
+			if(n->kind == MENU_NODE_SECTION && !n->label != !slot->item) {
+				render_menu(mr, render_menu_node(mr, node));
+				if(mr->changed) mr->changed(mr->changed_data, mr);
+			}
+			else render_schedule(mr, node);
+			break;
+	}
+}
+
+struct menu_render* menu_render_new(struct menu_tree* tree, struct icon_cache* icons) {
+	if(!tree) return NULL;
+	struct menu_render* mr = g_new0(struct menu_render, 1);
+	mr->tree = tree;
+	mr->icons = icons;
+	mr->slots = g_array_new(FALSE, TRUE, sizeof(struct render_slot));
+	mr->pending = g_array_new(FALSE, FALSE, sizeof(guint32));
+	mr->icon_nodes = g_hash_table_new_full(g_bytes_hash, g_bytes_equal,
+		(GDestroyNotify)g_bytes_unref, (GDestroyNotify)g_array_unref);
+	GtkWidget* menu = render_new_menu(mr, MENU_TREE_ROOT);
+	g_object_ref_sink(menu);
+	g_signal_connect(menu, "unmap", G_CALLBACK(root_unmap_cb), mr);
+	render_menu(mr, MENU_TREE_ROOT);
+	menu_tree_add_listener(tree, tree_changed_cb, mr);
+	return mr;
+}
+
+GtkMenu* menu_render_get_menu(struct menu_render* mr) {
+	return mr ? GTK_MENU(g_array_index(mr->slots, struct render_slot, MENU_TREE_ROOT).menu) : NULL;
+}
+
+void menu_render_set_changed_callback(struct menu_render* mr,
+		void (*callback)(void* data, struct menu_render* mr), void* data) {
+	if(!mr) return;
+	mr->changed = callback;
+	mr->changed_data = data;
+}
+
+void menu_render_free(struct menu_render* mr) {
+	if(!mr) return;
+	menu_tree_remove_listener(mr->tree, tree_changed_cb, mr);
+	icon_cache_cancel(mr->icons, mr);
+	render_cancel_flush(mr);
+	GtkWidget* menu = g_array_index(mr->slots, struct render_slot, MENU_TREE_ROOT).menu;
+	gtk_widget_destroy(menu);
+	g_object_unref(menu);
+	g_array_free(mr->slots, TRUE);
+	g_array_free(mr->pending, TRUE);
+	g_hash_table_destroy(mr->icon_nodes);
+	g_free(mr);
+}
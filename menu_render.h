@@ -0,0 +1,80 @@
+/*
+ * menu_render.h -- show a menu tree as a GTK menu
+ * 
+ * Copyright 2025 Daniel Kondor <kondor.dani@gmail.com>
+ * 
+ * This is free and unencumbered software released into the public domain.
+ * 
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ * 
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef MENU_RENDER_H
+#define MENU_RENDER_H
+
+#include <gtk/gtk.h>
+#include <menu_tree.h>
+#include <icon_cache.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+struct menu_render;
+
+/*
+ * Create a GtkMenu showing the contents of tree (including all submenus)
+ * and keep it up-to-date as the tree changes. Sections are shown inline,
+ * separated from other items. Activating an item or opening a submenu
+ * calls the backend of the tree.
+ *
+ * Icons with image data are decoded by icons (which can be shared by
+ * any number of renderers, and should be freed after them); items show
+ * an empty space of the size of the icon until it is ready. If icons is
+ * NULL, they are decoded when the item is created.
+ */
+struct menu_render* menu_render_new(struct menu_tree* tree, struct icon_cache* icons);
+
+/*
+ * Get the menu widget. It is owned by the renderer and is destroyed with
+ * it, so it should not be used by other widgets by then.
+ */
+GtkMenu* menu_render_get_menu(struct menu_render* mr);
+
+/*
+ * Set a function to call after the menu widgets changed (e.g. after
+ * items were added).
+ */
+void menu_render_set_changed_callback(struct menu_render* mr,
+		void (*callback)(void* data, struct menu_render* mr), void* data);
+
+/*
+ * Free the renderer and destroy the menu widget; the tree is not affected.
+ */
+void menu_render_free(struct menu_render* mr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,447 @@
+/*
+ * menu_search.c -- search menu items by their label
+ * 
+ * Copyright 2025 Daniel Kondor <kondor.dani@gmail.com>
+ * 
+ * This is free and unencumbered software released into the public domain.
+ * 
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ * 
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <menu_search.h>
+#include <string.h>
+
+/* remove entries of removed items from the index once there are this many */
+#define SEARCH_COMPACT_MIN 4096
+/* at most this many trigrams of a query are used */
+#define SEARCH_MAX_TRIGRAMS 64
+#define SEARCH_SEPARATOR " > "
+
+
+struct search_source {
+	struct menu_search* ms;
+	struct menu_tree* tree;
+	char* name;
+	GArray* node_entry; /* guint32, entry index + 1 by node (0: none) */
+};
+
+struct search_entry {
+	struct search_source* source; /* NULL if the item was removed */
+	guint32 node;
+	const char* label; /* label of the node when indexed, only used for comparison */
+	char* path;        /* shown to the user */
+	char* key;         /* path normalized for searching */
+	guint32 label_pos; /* position of the item's own label in key */
+	int searchable;    /* this is an item (not a submenu) */
+};
+
+struct menu_search {
+	GPtrArray* sources;   /* struct search_source* */
+	GArray* entries;      /* struct search_entry */
+	guint n_dead;         /* removed entries still in entries */
+	guint n_items;        /* searchable entries */
+	GHashTable* trigrams; /* trigram -> GArray of guint32 entry indices, in increasing order */
+	GArray* counts;       /* guint16 by entry, used while searching */
+};
+
+
+/* remove mnemonics: "_x" -> "x", "__" -> "_" */
+static char* search_strip_mnemonics(const char* label) {
+	char* ret = g_new(char, strlen(label) + 1);
+	char* out = ret;
+	for(; *label; label++) {
+		if(*label == '_') {
+			if(label[1] != '_') continue;
+			label++;
+		}
+		*out++ = *label;
+	}
+	*out = 0;
+	return ret;
+}
+
+/* note: this only ignores case, which is good enough for labels */
+static char* search_normalize(const char* str) {
+	return g_utf8_casefold(str, -1);
+}
+
+static guint32 search_trigram(const char* s) {
+	return ((guint32)(guchar)s[0] << 16) | ((guint32)(guchar)s[1] << 8) | (guint32)(guchar)s[2];
+}
+
+static void search_index_entry(struct menu_search* ms, guint32 e) {
+	const char* key = g_array_index(ms->entries, struct search_entry, e).key;
+	size_t i, len = strlen(key);
+	for(i = 0; i + 3 <= len; i++) {
+		gpointer t = GUINT_TO_POINTER(search_trigram(key + i));
+		GArray* list = (GArray*)g_hash_table_lookup(ms->trigrams, t);
+		if(!list) {
+			list = g_array_new(FALSE, FALSE, sizeof(guint32));
+			g_hash_table_insert(ms->trigrams, t, list);
+		}
+		/* entries are added in order, so repeated trigrams are adjacent */
+		else if(g_array_index(list, guint32, list->len - 1) == e) continue;
+		g_array_append_val(list, e);
+	}
+}
+
+static struct search_entry* search_node_entry(struct search_source* src, guint32 node) {
+	if(node >= src->node_entry->len) return NULL;
+	guint32 e = g_array_index(src->node_entry, guint32, node);
+	return e ? &g_array_index(src->ms->entries, struct search_entry, e - 1) : NULL;
+}
+
+static void search_kill_entry(struct search_source* src, guint32 node) {
+	struct search_entry* entry = search_node_entry(src, node);
+	if(!entry) return;
+	struct menu_search* ms = src->ms;
+	g_array_index(src->node_entry, guint32, node) = 0;
+	if(entry->searchable) ms->n_items--;
+	entry->source = NULL;
+	g_free(entry->path);
+	g_free(entry->key);
+	entry->path = entry->key = NULL;
+	ms->n_dead++;
+}
+
+/* forget about all descendants of node */
+static void search_kill_children(struct search_source* src, guint32 node) {
+	const struct menu_node* n = menu_tree_get_node(src->tree, node);
+	guint32 child = n ? n->first_child : MENU_TREE_NONE;
+	while(child != MENU_TREE_NONE) {
+		search_kill_entry(src, child);
+		search_kill_children(src, child);
+		child = menu_tree_get_node(src->tree, child)->next;
+	}
+}
+
+/* add an entry for node, whose parent menus have the given path */
+static struct search_entry* search_add_entry(struct search_source* src, guint32 node, const char* prefix) {
+	struct menu_search* ms = src->ms;
+	const struct menu_node* n = menu_tree_get_node(src->tree, node);
+	search_kill_entry(src, node);
+	
+	char* label = search_strip_mnemonics(n->label ? n->label : "");
+	char* label_key = search_normalize(label);
+	struct search_entry entry;
+	entry.source = src;
+	entry.node = node;
+	entry.label = n->label;
+	entry.path = *prefix ? g_strconcat(prefix, SEARCH_SEPARATOR, label, NULL) : g_strdup(label);
+	char* prefix_key = search_normalize(prefix);
+	entry.key = *prefix ? g_strconcat(prefix_key, SEARCH_SEPARATOR, label_key, NULL) : g_strdup(label_key);
+	entry.label_pos = (guint32)(strlen(entry.key) - strlen(label_key));
+	entry.searchable = (n->kind == MENU_NODE_ITEM && *label_key);
+	g_free(prefix_key);
+	g_free(label_key);
+	g_free(label);
+	
+	guint32 e = ms->entries->len;
+	g_array_append_val(ms->entries, entry);
+	if(node >= src->node_entry->len) g_array_set_size(src->node_entry, menu_tree_get_size(src->tree));
+	g_array_index(src->node_entry, guint32, node) = e + 1;
+	if(entry.searchable) {
+		search_index_entry(ms, e);
+		ms->n_items++;
+	}
+	return &g_array_index(ms->entries, struct search_entry, e);
+}
+
+/* add all descendants of node, whose menu has the given path */
+static void search_add_children(struct search_source* src, guint32 node, const char* prefix) {
+	const struct menu_node* n = menu_tree_get_node(src->tree, node);
+	guint32 child = n ? n->first_child : MENU_TREE_NONE;
+	for(; child != MENU_TREE_NONE; child = menu_tree_get_node(src->tree, child)->next) {
+		const struct menu_node* c = menu_tree_get_node(src->tree, child);
+		switch(c->kind) {
+			case MENU_NODE_SECTION:
+				/* note: section labels are not part of the path */
+				search_add_children(src, child, prefix);
+				break;
+			case MENU_NODE_ITEM:
+				search_add_entry(src, child, prefix);
+				break;
+			case MENU_NODE_SUBMENU: {
+				/* note: the path is copied, entries can move */
+				char* path = g_strdup(search_add_entry(src, child, prefix)->path);
+				search_add_children(src, child, path);
+				g_free(path);
+				break;
+			}
+			default:
+				break;
+		}
+	}
+}
+
+/*
+ * Add entries for the descendants of node that do not have one yet
+ * (the others were not changed, entries of removed ones were already
+ * removed when they were removed from the tree).
+ */
+static void search_update_children(struct search_source* src, guint32 node, const char* prefix) {
+	const struct menu_node* n = menu_tree_get_node(src->tree, node);
+	guint32 child = n ? n->first_child : MENU_TREE_NONE;
+	for(; child != MENU_TREE_NONE; child = menu_tree_get_node(src->tree, child)->next) {
+		const struct menu_node* c = menu_tree_get_node(src->tree, child);
+		struct search_entry* entry = search_node_entry(src, child);
+		switch(c->kind) {
+			case MENU_NODE_SECTION:
+				search_update_children(src, child, prefix);
+				break;
+			case MENU_NODE_ITEM:
+				if(!entry) search_add_entry(src, child, prefix);
+				break;
+			case MENU_NODE_SUBMENU: {
+				/* note: new descendants can be anywhere below */
+				char* path = g_strdup(entry ? entry->path : search_add_entry(src, child, prefix)->path);
+				if(entry) search_update_children(src, child, path);
+				else search_add_children(src, child, path);
+				g_free(path);
+				break;
+			}
+			default:
+				break;
+		}
+	}
+}
+
+/* remove entries of removed items from the index */
+static void search_compact(struct menu_search* ms) {
+	GArray* old = ms->entries;
+	ms->entries = g_array_new(FALSE, FALSE, sizeof(struct search_entry));
+	g_hash_table_remove_all(ms->trigrams);
+	guint i;
+	for(i = 0; i < old->len; i++) {
+		struct search_entry* entry = &g_array_index(old, struct search_entry, i);
+		if(!entry->source) continue;
+		guint32 e = ms->entries->len;
+		g_array_append_val(ms->entries, *entry);
+		g_array_index(entry->source->node_entry, guint32, entry->node) = e + 1;
+		if(entry->searchable) search_index_entry(ms, e);
+	}
+	g_array_free(old, TRUE);
+	ms->n_dead = 0;
+}
+
+/* compact if most entries are of removed items, so that the index does
+ * not keep growing while menus change (even if nobody searches) */
+static void search_maybe_compact(struct menu_search* ms) {
+	if(ms->n_dead >= SEARCH_COMPACT_MIN && ms->n_dead > ms->entries->len / 2) search_compact(ms);
+}
+
+/* path of the menu that contains the children of node */
+static const char* search_menu_path(struct search_source* src, guint32 node) {
+	const struct menu_node* n = menu_tree_get_node(src->tree, node);
+	while(n && n->kind == MENU_NODE_SECTION) {
+		node = n->parent;
+		n = menu_tree_get_node(src->tree, node);
+	}
+	struct search_entry* entry = (n && node != MENU_TREE_ROOT) ? search_node_entry(src, node) : NULL;
+	return entry ? entry->path : "";
+}
+
+static void tree_changed_cb(void* data, struct menu_tree* tree, guint32 node, enum menu_tree_change change) {
+	struct search_source* src = (struct search_source*)data;
+	const struct menu_node* n = menu_tree_get_node(tree, node);
+	if(!n) return;
+	char* prefix;
+	switch(change) {
+		case MENU_TREE_REMOVING:
+			search_kill_entry(src, node);
+			search_kill_children(src, node);
+			break;
+		case MENU_TREE_CLEARING:
+			search_kill_children(src, node);
+			break;
+		case MENU_TREE_CHANGED_CHILDREN:
+			prefix = g_strdup(search_menu_path(src, node));
+			search_update_children(src, node, prefix);
+			g_free(prefix);
+			break;
+		case MENU_TREE_CHANGED_PROPERTIES: {
+			/* only the label matters, which is compared by pointer
+			 * since labels are interned by the tree */
+			struct search_entry* entry = search_node_entry(src, node);
+			if(!entry || entry->label == n->label) break;
+			prefix = g_strdup(search_menu_path(src, n->parent));
+			search_add_entry(src, node, prefix);
+			g_free(prefix);
+			/* the path of items in a submenu includes its label */
+			if(n->kind == MENU_NODE_SUBMENU) {
+				prefix = g_strdup(search_menu_path(src, node));
+				search_add_children(src, node, prefix);
+				g_free(prefix);
+			}
+			break;
+		}
+	}
+	search_maybe_compact(src->ms);
+}
+
+
+struct menu_search* menu_search_new(void) {
+	struct menu_search* ms = g_new0(struct menu_search, 1);
+	ms->sources = g_ptr_array_new();
+	ms->entries = g_array_new(FALSE, FALSE, sizeof(struct search_entry));
+	ms->trigrams = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)g_array_unref);
+	ms->counts = g_array_new(FALSE, TRUE, sizeof(guint16));
+	return ms;
+}
+
+void menu_search_add_tree(struct menu_search* ms, struct menu_tree* tree, const char* name) {
+	if(!(ms && tree)) return;
+	struct search_source* src = g_new(struct search_source, 1);
+	src->ms = ms;
+	src->tree = tree;
+	src->name = g_strdup(name ? name : "");
+	src->node_entry = g_array_new(FALSE, TRUE, sizeof(guint32));
+	g_ptr_array_add(ms->sources, src);
+	search_add_children(src, MENU_TREE_ROOT, "");
+	menu_tree_add_listener(tree, tree_changed_cb, src);
+}
+
+void menu_search_remove_tree(struct menu_search* ms, struct menu_tree* tree) {
+	if(!(ms && tree)) return;
+	guint i;
+	for(i = 0; i < ms->sources->len; i++) {
+		struct search_source* src = (struct search_source*)g_ptr_array_index(ms->sources, i);
+		if(src->tree != tree) continue;
+		menu_tree_remove_listener(tree, tree_changed_cb, src);
+		guint32 node;
+		for(node = 0; node < src->node_entry->len; node++) search_kill_entry(src, node);
+		g_array_free(src->node_entry, TRUE);
+		g_free(src->name);
+		g_free(src);
+		g_ptr_array_remove_index(ms->sources, i);
+		search_maybe_compact(ms);
+		return;
+	}
+}
+
+
+/* score of an entry, given the number of matching trigrams (if any) */
+static int search_score(const struct search_entry* entry, const char* query, int matched, int total) {
+	int score = total ? (100 * matched) / total : 0;
+	const char* pos = strstr(entry->key, query);
+	if(pos) {
+		score += 100;
+		/* matches in the label of the item itself are better */
+		if(pos >= entry->key + entry->label_pos) score += 50;
+		if(pos == entry->key + entry->label_pos) score += 25;
+	}
+	/* prefer shorter paths */
+	score -= (int)(strlen(entry->key) / 8);
+	return score;
+}
+
+/* add a result, keeping the best max_results in order */
+static guint search_add_result(struct menu_search_result* results, guint n, guint max_results,
+		const struct search_entry* entry, int score) {
+	const struct menu_node* node = menu_tree_get_node(entry->source->tree, entry->node);
+	int enabled = node && (node->flags & MENU_NODE_ENABLED) && (node->flags & MENU_NODE_VISIBLE);
+	/* disabled items are shown, but after the others */
+	if(!enabled) score -= 1000;
+	if(n == max_results && results[n - 1].score >= score) return n;
+	guint i = (n < max_results) ? n++ : n - 1;
+	for(; i > 0 && results[i - 1].score < score; i--) results[i] = results[i - 1];
+	results[i].tree = entry->source->tree;
+	results[i].node = entry->node;
+	results[i].name = entry->source->name;
+	results[i].path = entry->path;
+	results[i].enabled = enabled;
+	results[i].score = score;
+	return n;
+}
+
+guint menu_search_query(struct menu_search* ms, const char* query,
+		struct menu_search_result* results, guint max_results) {
+	if(!(ms && query && results && max_results)) return 0;
+	
+	char* stripped = g_strstrip(g_strdup(query));
+	char* q = search_normalize(stripped);
+	g_free(stripped);
+	size_t len = strlen(q);
+	guint n = 0;
+	guint i;
+	
+	if(len && len < 3) {
+		/* too short for trigrams, check all items */
+		for(i = 0; i < ms->entries->len; i++) {
+			const struct search_entry* entry = &g_array_index(ms->entries, struct search_entry, i);
+			if(entry->source && entry->searchable && strstr(entry->key, q))
+				n = search_add_result(results, n, max_results, entry, search_score(entry, q, 0, 0));
+		}
+	}
+	else if(len) {
+		/* count the trigrams of the query that appear in each item */
+		guint32 trigrams[SEARCH_MAX_TRIGRAMS];
+		int n_trigrams = 0, j;
+		for(i = 0; i + 3 <= len && n_trigrams < SEARCH_MAX_TRIGRAMS; i++) {
+			guint32 t = search_trigram(q + i);
+			for(j = 0; j < n_trigrams && trigrams[j] != t; j++);
+			if(j == n_trigrams) trigrams[n_trigrams++] = t;
+		}
+		
+		g_array_set_size(ms->counts, ms->entries->len);
+		guint16* counts = (guint16*)ms->counts->data;
+		GArray* touched = g_array_new(FALSE, FALSE, sizeof(guint32));
+		for(j = 0; j < n_trigrams; j++) {
+			GArray* list = (GArray*)g_hash_table_lookup(ms->trigrams, GUINT_TO_POINTER(trigrams[j]));
+			if(!list) continue;
+			for(i = 0; i < list->len; i++) {
+				guint32 e = g_array_index(list, guint32, i);
+				if(!counts[e]++) g_array_append_val(touched, e);
+			}
+		}
+		
+		/* allow about a third of the trigrams to be missing (typos) */
+		int needed = n_trigrams - n_trigrams / 3;
+		for(i = 0; i < touched->len; i++) {
+			guint32 e = g_array_index(touched, guint32, i);
+			const struct search_entry* entry = &g_array_index(ms->entries, struct search_entry, e);
+			if(entry->source && counts[e] >= needed)
+				n = search_add_result(results, n, max_results, entry, search_score(entry, q, counts[e], n_trigrams));
+			counts[e] = 0;
+		}
+		g_array_free(touched, TRUE);
+	}
+	
+	g_free(q);
+	return n;
+}
+
+guint menu_search_get_n_items(struct menu_search* ms) {
+	return ms ? ms->n_items : 0;
+}
+
+void menu_search_free(struct menu_search* ms) {
+	if(!ms) return;
+	while(ms->sources->len)
+		menu_search_remove_tree(ms, ((struct search_source*)g_ptr_array_index(ms->sources, 0))->tree);
+	g_ptr_array_free(ms->sources, TRUE);
+	g_array_free(ms->entries, TRUE);
+	g_hash_table_destroy(ms->trigrams);
+	g_array_free(ms->counts, TRUE);
+	g_free(ms);
+}
@@ -0,0 +1,88 @@
+/*
+ * menu_search.h -- search menu items by their label
+ * 
+ * Copyright 2025 Daniel Kondor <kondor.dani@gmail.com>
+ * 
+ * This is free and unencumbered software released into the public domain.
+ * 
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ * 
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef MENU_SEARCH_H
+#define MENU_SEARCH_H
+
+#include <glib.h>
+#include <menu_tree.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*
+ * Index of the items in a set of menu trees (e.g. the menus of the
+ * active and recently used apps), which can be searched by a part of
+ * their label or path (e.g. "file open"). The index is updated as the
+ * trees change, only re-indexing the parts that changed. Items are found
+ * by the trigrams (three-byte sequences) in their path, so searching is
+ * fast even with many items, and small typos are tolerated.
+ */
+struct menu_search;
+
+struct menu_search_result {
+	struct menu_tree* tree;
+	guint32 node;
+	const char* name; /* name given to the tree in menu_search_add_tree() */
+	const char* path; /* labels of the item and its submenus, separated by " > " */
+	int enabled;      /* the item can be activated */
+	int score;        /* higher is better */
+};
+
+struct menu_search* menu_search_new(void);
+
+/*
+ * Add a tree to the index, under the given name (e.g. the app ID). The
+ * tree should be removed before it is freed.
+ */
+void menu_search_add_tree(struct menu_search* ms, struct menu_tree* tree, const char* name);
+void menu_search_remove_tree(struct menu_search* ms, struct menu_tree* tree);
+
+/*
+ * Search for items matching query and store at most max_results of the
+ * best ones in results, in decreasing order of score. Returns the number
+ * of results stored. Results are valid until the index or any of the
+ * trees is next changed; to activate one, use menu_tree_activate().
+ */
+guint menu_search_query(struct menu_search* ms, const char* query,
+	struct menu_search_result* results, guint max_results);
+
+/* get the number of items indexed */
+guint menu_search_get_n_items(struct menu_search* ms);
+
+void menu_search_free(struct menu_search* ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
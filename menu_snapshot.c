@@ -0,0 +1,310 @@
+/*
+ * menu_snapshot.c -- on-disk cache of the menu structure of apps
+ * 
+ * Copyright 2025 Daniel Kondor <kondor.dani@gmail.com>
+ * 
+ * This is free and unencumbered software released into the public domain.
+ * 
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ * 
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <menu_snapshot.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <glib/gstdio.h>
+
+/*
+ * File format (one file per app, native byte order, since it is only a
+ * local cache): a header, followed by the nodes of the menu tree in
+ * pre-order, followed by all strings (each terminated by a zero byte).
+ */
+
+#define SNAPSHOT_MAGIC "GMSN"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_SUFFIX ".menu"
+#define SNAPSHOT_NONE 0xffffffffu
+/* limits to avoid pathological menus (e.g. with a cycle of submenus) */
+#define SNAPSHOT_MAX_NODES 65536
+#define SNAPSHOT_MAX_DEPTH 16
+
+struct snapshot_header {
+	char magic[4];
+	guint32 version;
+	guint32 n_nodes;
+	guint32 strings_size;
+	guint32 checksum; /* of everything after the header */
+};
+
+enum snapshot_node_kind {
+	SNAPSHOT_ITEM,
+	SNAPSHOT_SUBMENU,
+	SNAPSHOT_SECTION
+};
+
+struct snapshot_node {
+	guint32 kind;
+	guint32 parent; /* index of the parent node + 1, 0 for the top level */
+	guint32 label;  /* offset in strings, or SNAPSHOT_NONE */
+	guint32 action; /* detailed action name, or SNAPSHOT_NONE */
+};
+
+struct menu_snapshot_store {
+	char* dir;
+	GHashTable* files; /* app_id -> GMappedFile* */
+};
+
+
+/* FNV-1a */
+static guint32 snapshot_checksum(const char* data, gsize len) {
+	guint32 h = 2166136261u;
+	gsize i;
+	for(i = 0; i < len; i++) {
+		h ^= (guchar)data[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+static char* snapshot_path(struct menu_snapshot_store* store, const char* app_id) {
+	char* escaped = g_uri_escape_string(app_id, NULL, FALSE);
+	char* name = g_strconcat(escaped, SNAPSHOT_SUFFIX, NULL);
+	char* path = g_build_filename(store->dir, name, NULL);
+	g_free(name);
+	g_free(escaped);
+	return path;
+}
+
+static void snapshot_map(struct menu_snapshot_store* store, const char* app_id, const char* path) {
+	GMappedFile* file = g_mapped_file_new(path, FALSE, NULL);
+	if(file) g_hash_table_insert(store->files, g_strdup(app_id), file);
+}
+
+struct menu_snapshot_store* menu_snapshot_store_new(const char* dir) {
+	struct menu_snapshot_store* store = g_new0(struct menu_snapshot_store, 1);
+	store->dir = dir ? g_strdup(dir) : g_build_filename(g_get_user_cache_dir(), "gtk_global_menu_test", "menus", NULL);
+	store->files = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_mapped_file_unref);
+	
+	GDir* d = g_dir_open(store->dir, 0, NULL);
+	if(d) {
+		const char* name;
+		while((name = g_dir_read_name(d))) {
+			if(!g_str_has_suffix(name, SNAPSHOT_SUFFIX)) continue;
+			char* escaped = g_strndup(name, strlen(name) - strlen(SNAPSHOT_SUFFIX));
+			char* app_id = g_uri_unescape_string(escaped, NULL);
+			if(app_id) {
+				char* path = g_build_filename(store->dir, name, NULL);
+				snapshot_map(store, app_id, path);
+				g_free(path);
+			}
+			g_free(app_id);
+			g_free(escaped);
+		}
+		g_dir_close(d);
+	}
+	return store;
+}
+
+
+/* reading */
+
+static const char* snapshot_string(const char* strings, guint32 size, guint32 offset) {
+	return (offset < size) ? strings + offset : NULL;
+}
+
+static GMenuModel* snapshot_build(const char* data, gsize len) {
+	struct snapshot_header h;
+	if(len < sizeof(h)) return NULL;
+	memcpy(&h, data, sizeof(h));
+	if(memcmp(h.magic, SNAPSHOT_MAGIC, 4) || h.version != SNAPSHOT_VERSION ||
+		h.n_nodes > SNAPSHOT_MAX_NODES) return NULL;
+	if(len != sizeof(h) + (gsize)h.n_nodes * sizeof(struct snapshot_node) + h.strings_size) return NULL;
+	if(h.strings_size && data[len - 1]) return NULL;
+	if(snapshot_checksum(data + sizeof(h), len - sizeof(h)) != h.checksum) return NULL;
+	
+	const struct snapshot_node* nodes = (const struct snapshot_node*)(data + sizeof(h));
+	const char* strings = data + sizeof(h) + (gsize)h.n_nodes * sizeof(struct snapshot_node);
+	GMenu* root = g_menu_new();
+	/* menus created for submenus and sections, by node index */
+	GMenu** menus = g_new0(GMenu*, h.n_nodes ? h.n_nodes : 1);
+	int ok = 1;
+	guint32 i;
+	for(i = 0; i < h.n_nodes; i++) {
+		const struct snapshot_node* node = nodes + i;
+		if(node->parent > i || (node->parent && !menus[node->parent - 1])) {
+			ok = 0;
+			break;
+		}
+		GMenu* container = node->parent ? menus[node->parent - 1] : root;
+		const char* label = snapshot_string(strings, h.strings_size, node->label);
+		const char* action = snapshot_string(strings, h.strings_size, node->action);
+		switch(node->kind) {
+			case SNAPSHOT_SUBMENU:
+				menus[i] = g_menu_new();
+				g_menu_append_submenu(container, label, G_MENU_MODEL(menus[i]));
+				break;
+			case SNAPSHOT_SECTION:
+				menus[i] = g_menu_new();
+				g_menu_append_section(container, label, G_MENU_MODEL(menus[i]));
+				break;
+			default: {
+				/* refer to an action that does not exist, so that the item
+				 * is shown as insensitive, but keep the original name */
+				char* detailed = g_strconcat("snapshot.", action ? action : "none", NULL);
+				if(!g_action_parse_detailed_name(detailed, NULL, NULL, NULL)) {
+					g_free(detailed);
+					detailed = g_strdup("snapshot.none");
+				}
+				g_menu_append(container, label, detailed);
+				g_free(detailed);
+				break;
+			}
+		}
+	}
+	
+	for(i = 0; i < h.n_nodes; i++) if(menus[i]) g_object_unref(menus[i]);
+	g_free(menus);
+	if(!ok) {
+		g_object_unref(root);
+		return NULL;
+	}
+	return G_MENU_MODEL(root);
+}
+
+GMenuModel* menu_snapshot_store_load(struct menu_snapshot_store* store, const char* app_id) {
+	if(!(store && app_id)) return NULL;
+	GMappedFile* file = g_hash_table_lookup(store->files, app_id);
+	if(!file) return NULL;
+	return snapshot_build(g_mapped_file_get_contents(file), g_mapped_file_get_length(file));
+}
+
+
+/* writing */
+
+struct snapshot_writer {
+	GByteArray* nodes;
+	GString* strings;
+	guint32 n_nodes;
+};
+
+static guint32 writer_add_string(struct snapshot_writer* w, const char* str) {
+	if(!str) return SNAPSHOT_NONE;
+	guint32 offset = (guint32)w->strings->len;
+	/* note: this includes the terminating zero byte */
+	g_string_append_len(w->strings, str, strlen(str) + 1);
+	return offset;
+}
+
+static void writer_add_menu(struct snapshot_writer* w, GMenuModel* model, guint32 parent, unsigned int depth) {
+	gint i, n = g_menu_model_get_n_items(model);
+	for(i = 0; i < n && w->n_nodes < SNAPSHOT_MAX_NODES; i++) {
+		char* label = NULL;
+		char* action = NULL;
+		char* detailed = NULL;
+		g_menu_model_get_item_attribute(model, i, G_MENU_ATTRIBUTE_LABEL, "s", &label);
+		if(g_menu_model_get_item_attribute(model, i, G_MENU_ATTRIBUTE_ACTION, "s", &action)) {
+			GVariant* target = g_menu_model_get_item_attribute_value(model, i, G_MENU_ATTRIBUTE_TARGET, NULL);
+			detailed = g_action_print_detailed_name(action, target);
+			if(target) g_variant_unref(target);
+		}
+		GMenuModel* link = g_menu_model_get_item_link(model, i, G_MENU_LINK_SECTION);
+		struct snapshot_node node;
+		node.kind = SNAPSHOT_SECTION;
+		if(!link) {
+			link = g_menu_model_get_item_link(model, i, G_MENU_LINK_SUBMENU);
+			node.kind = link ? SNAPSHOT_SUBMENU : SNAPSHOT_ITEM;
+		}
+		node.parent = parent;
+		node.label = writer_add_string(w, label);
+		node.action = writer_add_string(w, detailed);
+		g_byte_array_append(w->nodes, (const guint8*)&node, sizeof(node));
+		guint32 index = w->n_nodes++;
+		
+		if(link) {
+			if(depth < SNAPSHOT_MAX_DEPTH) writer_add_menu(w, link, index + 1, depth + 1);
+			g_object_unref(link);
+		}
+		g_free(detailed);
+		g_free(action);
+		g_free(label);
+	}
+}
+
+int menu_snapshot_store_save(struct menu_snapshot_store* store, const char* app_id, GMenuModel* model) {
+	if(!(store && app_id && model)) return -1;
+	struct snapshot_writer w;
+	w.nodes = g_byte_array_new();
+	w.strings = g_string_new(NULL);
+	w.n_nodes = 0;
+	writer_add_menu(&w, model, 0, 0);
+	
+	int ret = 0;
+	if(w.n_nodes) {
+		struct snapshot_header h;
+		memcpy(h.magic, SNAPSHOT_MAGIC, 4);
+		h.version = SNAPSHOT_VERSION;
+		h.n_nodes = w.n_nodes;
+		h.strings_size = (guint32)w.strings->len;
+		GByteArray* data = g_byte_array_sized_new(sizeof(h) + w.nodes->len + w.strings->len);
+		g_byte_array_append(data, (const guint8*)&h, sizeof(h));
+		g_byte_array_append(data, w.nodes->data, w.nodes->len);
+		g_byte_array_append(data, (const guint8*)w.strings->str, w.strings->len);
+		h.checksum = snapshot_checksum((const char*)data->data + sizeof(h), data->len - sizeof(h));
+		memcpy(data->data, &h, sizeof(h));
+		
+		/* only write if something changed */
+		GMappedFile* old = g_hash_table_lookup(store->files, app_id);
+		if(!(old && g_mapped_file_get_length(old) == data->len &&
+				!memcmp(g_mapped_file_get_contents(old), data->data, data->len))) {
+			GError* err = NULL;
+			char* path = snapshot_path(store, app_id);
+			/* note: this writes a temporary file and renames it */
+			if(g_mkdir_with_parents(store->dir, 0700) == 0 &&
+					g_file_set_contents_full(path, (const char*)data->data, data->len,
+						G_FILE_SET_CONTENTS_CONSISTENT, 0600, &err)) {
+				g_hash_table_remove(store->files, app_id);
+				snapshot_map(store, app_id, path);
+				ret = 1;
+			}
+			else {
+				fprintf(stderr, "Cannot save menu snapshot for %s: %s\n", app_id,
+					err ? err->message : g_strerror(errno));
+				g_clear_error(&err);
+				ret = -1;
+			}
+			g_free(path);
+		}
+		g_byte_array_unref(data);
+	}
+	
+	g_byte_array_unref(w.nodes);
+	g_string_free(w.strings, TRUE);
+	return ret;
+}
+
+void menu_snapshot_store_free(struct menu_snapshot_store* store) {
+	if(!store) return;
+	g_hash_table_destroy(store->files);
+	g_free(store->dir);
+	g_free(store);
+}
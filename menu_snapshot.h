@@ -0,0 +1,79 @@
+/*
+ * menu_snapshot.h -- on-disk cache of the menu structure of apps
+ * 
+ * Copyright 2025 Daniel Kondor <kondor.dani@gmail.com>
+ * 
+ * This is free and unencumbered software released into the public domain.
+ * 
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ * 
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef MENU_SNAPSHOT_H
+#define MENU_SNAPSHOT_H
+
+#include <gio/gio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+struct menu_snapshot_store;
+
+/*
+ * Open the snapshot store in the given directory, or in a subdirectory
+ * of the user's cache directory if dir is NULL. All existing snapshots
+ * are memory-mapped right away, so that loading them later is fast.
+ */
+struct menu_snapshot_store* menu_snapshot_store_new(const char* dir);
+
+/*
+ * Get the last saved menu of the given app as a new GMenu (or NULL if
+ * there is none). It has the labels and structure of the original menu,
+ * but items refer to actions in the "snapshot" namespace (i.e. the
+ * original action name prefixed by "snapshot."), which does not exist,
+ * so all items are shown as insensitive until the real menu is available.
+ */
+GMenuModel* menu_snapshot_store_load(struct menu_snapshot_store* store, const char* app_id);
+
+/*
+ * Save the current contents of model (including all submenus and sections
+ * that are available) for the given app. Only writes the file if the menu
+ * changed since it was last saved; the file is replaced atomically, so a
+ * crash cannot leave a corrupted snapshot. Returns 1 if the snapshot was
+ * written, 0 if it did not change and -1 on error.
+ */
+int menu_snapshot_store_save(struct menu_snapshot_store* store, const char* app_id, GMenuModel* model);
+
+/*
+ * Free the store, unmapping all snapshots. Menus returned by
+ * menu_snapshot_store_load() remain valid.
+ */
+void menu_snapshot_store_free(struct menu_snapshot_store* store);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
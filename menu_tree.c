@@ -0,0 +1,316 @@
+/*
+ * menu_tree.c -- compact representation of a menu, shared by all
+ *   menu implementations
+ * 
+ * Copyright 2025 Daniel Kondor <kondor.dani@gmail.com>
+ * 
+ * This is free and unencumbered software released into the public domain.
+ * 
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ * 
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <menu_tree.h>
+#include <string_pool.h>
+#include <string.h>
+
+
+struct menu_tree_listener_data {
+	menu_tree_listener listener;
+	void* data;
+};
+
+struct menu_tree {
+	GArray* nodes;        /* struct menu_node */
+	guint32 free_list;    /* unused nodes, linked by their next field */
+	guint32 n_items;      /* nodes in use, without the root */
+	GHashTable* ids;      /* backend ID -> index + 1 */
+	struct string_pool* strings;
+	const struct menu_tree_backend* backend;
+	void* backend_data;
+	GArray* listeners;    /* struct menu_tree_listener_data */
+};
+
+
+static struct menu_node* tree_node(struct menu_tree* tree, guint32 node) {
+	if(!tree || node >= tree->nodes->len) return NULL;
+	struct menu_node* n = &g_array_index(tree->nodes, struct menu_node, node);
+	return (n->kind == MENU_NODE_FREE) ? NULL : n;
+}
+
+static void tree_notify(struct menu_tree* tree, guint32 node, enum menu_tree_change change) {
+	guint i;
+	/* note: listeners should not add or remove listeners */
+	for(i = 0; i < tree->listeners->len; i++) {
+		struct menu_tree_listener_data* l = &g_array_index(tree->listeners, struct menu_tree_listener_data, i);
+		l->listener(l->data, tree, node, change);
+	}
+}
+
+struct menu_tree* menu_tree_new(void) {
+	struct menu_tree* tree = g_new0(struct menu_tree, 1);
+	tree->nodes = g_array_new(FALSE, TRUE, sizeof(struct menu_node));
+	tree->free_list = MENU_TREE_NONE;
+	tree->ids = g_hash_table_new(g_direct_hash, g_direct_equal);
+	tree->strings = string_pool_new();
+	tree->listeners = g_array_new(FALSE, FALSE, sizeof(struct menu_tree_listener_data));
+	
+	struct menu_node root = { NULL, NULL, NULL, NULL, NULL, MENU_TREE_NONE, MENU_TREE_NONE, MENU_TREE_NONE,
+		MENU_TREE_NONE, 0, 0, MENU_NODE_SUBMENU, MENU_NODE_ENABLED | MENU_NODE_VISIBLE };
+	g_array_append_val(tree->nodes, root);
+	g_hash_table_insert(tree->ids, GINT_TO_POINTER(0), GUINT_TO_POINTER(MENU_TREE_ROOT + 1));
+	return tree;
+}
+
+void menu_tree_set_backend(struct menu_tree* tree, const struct menu_tree_backend* backend, void* data) {
+	if(!tree) return;
+	tree->backend = backend;
+	tree->backend_data = data;
+}
+
+void menu_tree_add_listener(struct menu_tree* tree, menu_tree_listener listener, void* data) {
+	if(!(tree && listener)) return;
+	struct menu_tree_listener_data l = { listener, data };
+	g_array_append_val(tree->listeners, l);
+}
+
+void menu_tree_remove_listener(struct menu_tree* tree, menu_tree_listener listener, void* data) {
+	if(!tree) return;
+	guint i;
+	for(i = 0; i < tree->listeners->len; i++) {
+		struct menu_tree_listener_data* l = &g_array_index(tree->listeners, struct menu_tree_listener_data, i);
+		if(l->listener == listener && l->data == data) {
+			g_array_remove_index(tree->listeners, i);
+			return;
+		}
+	}
+}
+
+const struct menu_node* menu_tree_get_node(struct menu_tree* tree, guint32 node) {
+	return tree_node(tree, node);
+}
+
+guint32 menu_tree_get_size(struct menu_tree* tree) {
+	return tree ? tree->nodes->len : 0;
+}
+
+guint32 menu_tree_get_n_items(struct menu_tree* tree) {
+	return tree ? tree->n_items : 0;
+}
+
+guint32 menu_tree_find_id(struct menu_tree* tree, gint32 id) {
+	if(!tree || id < 0) return MENU_TREE_NONE;
+	return GPOINTER_TO_UINT(g_hash_table_lookup(tree->ids, GINT_TO_POINTER(id))) - 1;
+}
+
+guint32 menu_tree_insert(struct menu_tree* tree, guint32 parent, guint32 after, enum menu_node_kind kind,
+		gint32 id, const char* label, const char* action, GVariant* target, unsigned int flags) {
+	if(!tree_node(tree, parent) || kind == MENU_NODE_FREE) return MENU_TREE_NONE;
+	if(after != MENU_TREE_NONE && !(tree_node(tree, after) && tree_node(tree, after)->parent == parent))
+		return MENU_TREE_NONE;
+	if(id >= 0 && g_hash_table_contains(tree->ids, GINT_TO_POINTER(id))) return MENU_TREE_NONE;
+	
+	guint32 i = tree->free_list;
+	if(i != MENU_TREE_NONE) tree->free_list = g_array_index(tree->nodes, struct menu_node, i).next;
+	else {
+		i = tree->nodes->len;
+		/* note: this can move the array */
+		g_array_set_size(tree->nodes, i + 1);
+	}
+	struct menu_node* n = &g_array_index(tree->nodes, struct menu_node, i);
+	struct menu_node* p = &g_array_index(tree->nodes, struct menu_node, parent);
+	n->label = string_pool_intern(tree->strings, label);
+	n->action = string_pool_intern(tree->strings, action);
+	n->target = target ? g_variant_ref_sink(target) : NULL;
+	n->icon = NULL;
+	n->accel = NULL;
+	n->parent = parent;
+	n->first_child = n->last_child = MENU_TREE_NONE;
+	n->id = (id >= 0) ? id : -1;
+	n->data = 0;
+	n->kind = (guint16)kind;
+	n->flags = (guint16)flags;
+	
+	if(after == MENU_TREE_NONE) {
+		n->next = p->first_child;
+		p->first_child = i;
+	}
+	else {
+		struct menu_node* a = &g_array_index(tree->nodes, struct menu_node, after);
+		n->next = a->next;
+		a->next = i;
+	}
+	if(n->next == MENU_TREE_NONE) p->last_child = i;
+	if(id >= 0) g_hash_table_insert(tree->ids, GINT_TO_POINTER(id), GUINT_TO_POINTER(i + 1));
+	tree->n_items++;
+	return i;
+}
+
+guint32 menu_tree_append(struct menu_tree* tree, guint32 parent, enum menu_node_kind kind,
+		gint32 id, const char* label, const char* action, GVariant* target, unsigned int flags) {
+	const struct menu_node* p = tree_node(tree, parent);
+	if(!p) return MENU_TREE_NONE;
+	return menu_tree_insert(tree, parent, p->last_child, kind, id, label, action, target, flags);
+}
+
+static void node_release(struct menu_tree* tree, guint32 node) {
+	struct menu_node* n = &g_array_index(tree->nodes, struct menu_node, node);
+	string_pool_release(tree->strings, n->label);
+	string_pool_release(tree->strings, n->action);
+	string_pool_release(tree->strings, n->accel);
+	if(n->target) g_variant_unref(n->target);
+	if(n->icon) g_variant_unref(n->icon);
+	if(n->id >= 0) g_hash_table_remove(tree->ids, GINT_TO_POINTER(n->id));
+	memset(n, 0, sizeof(struct menu_node));
+	n->kind = MENU_NODE_FREE;
+	n->next = tree->free_list;
+	tree->free_list = node;
+	tree->n_items--;
+}
+
+static void tree_clear_children(struct menu_tree* tree, guint32 node) {
+	struct menu_node* n = &g_array_index(tree->nodes, struct menu_node, node);
+	guint32 child = n->first_child;
+	n->first_child = n->last_child = MENU_TREE_NONE;
+	while(child != MENU_TREE_NONE) {
+		tree_clear_children(tree, child);
+		guint32 next = g_array_index(tree->nodes, struct menu_node, child).next;
+		node_release(tree, child);
+		child = next;
+	}
+}
+
+void menu_tree_clear_children(struct menu_tree* tree, guint32 node) {
+	struct menu_node* n = tree_node(tree, node);
+	if(!(n && n->first_child != MENU_TREE_NONE)) return;
+	tree_notify(tree, node, MENU_TREE_CLEARING);
+	tree_clear_children(tree, node);
+}
+
+void menu_tree_remove(struct menu_tree* tree, guint32 node) {
+	struct menu_node* n = tree_node(tree, node);
+	if(!n || node == MENU_TREE_ROOT) return;
+	tree_notify(tree, node, MENU_TREE_REMOVING);
+	/* note: listeners do not change the tree, n is still valid */
+	struct menu_node* p = &g_array_index(tree->nodes, struct menu_node, n->parent);
+	if(p->first_child == node) {
+		p->first_child = n->next;
+		if(p->last_child == node) p->last_child = MENU_TREE_NONE;
+	}
+	else {
+		guint32 prev = p->first_child;
+		while(g_array_index(tree->nodes, struct menu_node, prev).next != node)
+			prev = g_array_index(tree->nodes, struct menu_node, prev).next;
+		g_array_index(tree->nodes, struct menu_node, prev).next = n->next;
+		if(p->last_child == node) p->last_child = prev;
+	}
+	tree_clear_children(tree, node);
+	node_release(tree, node);
+}
+
+void menu_tree_children_changed(struct menu_tree* tree, guint32 node) {
+	if(tree_node(tree, node)) tree_notify(tree, node, MENU_TREE_CHANGED_CHILDREN);
+}
+
+void menu_tree_set_label(struct menu_tree* tree, guint32 node, const char* label) {
+	struct menu_node* n = tree_node(tree, node);
+	if(!n) return;
+	if(n->label && label && string_pool_lookup(tree->strings, label) == n->label) return;
+	if(!(n->label || label)) return;
+	const char* old = n->label;
+	n->label = string_pool_intern(tree->strings, label);
+	string_pool_release(tree->strings, old);
+	tree_notify(tree, node, MENU_TREE_CHANGED_PROPERTIES);
+}
+
+void menu_tree_set_flags(struct menu_tree* tree, guint32 node, unsigned int flags) {
+	struct menu_node* n = tree_node(tree, node);
+	if(!n || n->flags == (guint16)flags) return;
+	n->flags = (guint16)flags;
+	tree_notify(tree, node, MENU_TREE_CHANGED_PROPERTIES);
+}
+
+void menu_tree_set_icon(struct menu_tree* tree, guint32 node, GVariant* icon) {
+	struct menu_node* n = tree_node(tree, node);
+	if(!n) return;
+	if(icon) g_variant_ref_sink(icon);
+	/* note: icons are rarely changed, so comparing the data is OK */
+	if(n->icon == icon || (n->icon && icon && g_variant_equal(n->icon, icon))) {
+		if(icon) g_variant_unref(icon);
+		return;
+	}
+	if(n->icon) g_variant_unref(n->icon);
+	n->icon = icon;
+	tree_notify(tree, node, MENU_TREE_CHANGED_PROPERTIES);
+}
+
+void menu_tree_set_accel(struct menu_tree* tree, guint32 node, const char* accel) {
+	struct menu_node* n = tree_node(tree, node);
+	if(!n) return;
+	if(accel && !*accel) accel = NULL;
+	if(n->accel && accel && string_pool_lookup(tree->strings, accel) == n->accel) return;
+	if(!(n->accel || accel)) return;
+	const char* old = n->accel;
+	n->accel = string_pool_intern(tree->strings, accel);
+	string_pool_release(tree->strings, old);
+	tree_notify(tree, node, MENU_TREE_CHANGED_PROPERTIES);
+}
+
+void menu_tree_set_data(struct menu_tree* tree, guint32 node, guint32 data) {
+	struct menu_node* n = tree_node(tree, node);
+	if(n) n->data = data;
+}
+
+void menu_tree_activate(struct menu_tree* tree, guint32 node, guint32 timestamp) {
+	if(tree_node(tree, node) && tree->backend && tree->backend->activate)
+		tree->backend->activate(tree->backend_data, tree, node, timestamp);
+}
+
+void menu_tree_opened(struct menu_tree* tree, guint32 node, guint32 timestamp) {
+	if(tree_node(tree, node) && tree->backend && tree->backend->opened)
+		tree->backend->opened(tree->backend_data, tree, node, timestamp);
+}
+
+void menu_tree_closed(struct menu_tree* tree, guint32 node, guint32 timestamp) {
+	if(tree_node(tree, node) && tree->backend && tree->backend->closed)
+		tree->backend->closed(tree->backend_data, tree, node, timestamp);
+}
+
+gsize menu_tree_get_memory(struct menu_tree* tree) {
+	if(!tree) return 0;
+	struct string_pool_stats stats;
+	string_pool_get_stats(tree->strings, &stats);
+	/* note: GHashTable uses about three pointers per entry */
+	return sizeof(struct menu_tree) + tree->nodes->len * sizeof(struct menu_node) + stats.bytes +
+		g_hash_table_size(tree->ids) * 3 * sizeof(gpointer);
+}
+
+void menu_tree_free(struct menu_tree* tree) {
+	if(!tree) return;
+	/* note: listeners are not notified anymore */
+	tree_clear_children(tree, MENU_TREE_ROOT);
+	g_array_free(tree->nodes, TRUE);
+	g_hash_table_destroy(tree->ids);
+	string_pool_free(tree->strings);
+	g_array_free(tree->listeners, TRUE);
+	g_free(tree);
+}
@@ -0,0 +1,217 @@
+/*
+ * menu_tree.h -- compact representation of a menu, shared by all
+ *   menu implementations
+ * 
+ * Copyright 2025 Daniel Kondor <kondor.dani@gmail.com>
+ * 
+ * This is free and unencumbered software released into the public domain.
+ * 
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ * 
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef MENU_TREE_H
+#define MENU_TREE_H
+
+#include <glib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*
+ * A menu is stored as a flat array of nodes, which refer to each other
+ * by their index. Index 0 is always the root (the top level menu).
+ * Labels and action names are stored only once per tree. Nodes are
+ * filled in by a backend (e.g. from an org.gtk.Menus or a
+ * com.canonical.dbusmenu object), which is also called when the user
+ * interacts with the menu, and can be shown by a renderer that only
+ * needs to know about the tree.
+ */
+struct menu_tree;
+
+#define MENU_TREE_ROOT 0u
+#define MENU_TREE_NONE 0xffffffffu
+
+enum menu_node_kind {
+	MENU_NODE_FREE,      /* unused slot */
+	MENU_NODE_ITEM,
+	MENU_NODE_SEPARATOR,
+	MENU_NODE_SUBMENU,   /* item with a submenu; also the root */
+	MENU_NODE_SECTION    /* group of items shown inline, with an optional label */
+};
+
+enum menu_node_flags {
+	MENU_NODE_ENABLED = 1,
+	MENU_NODE_VISIBLE = 2,
+	MENU_NODE_CHECK = 4,        /* has a check box ... */
+	MENU_NODE_RADIO = 8,        /* ... or a radio button */
+	MENU_NODE_TOGGLED = 16,     /* the check box or radio button is active */
+	MENU_NODE_INCONSISTENT = 32 /* its state is not known */
+};
+
+struct menu_node {
+	const char* label;  /* with mnemonics (underscores), NULL if none */
+	const char* action; /* action name (including any prefix), NULL if none */
+	GVariant* target;   /* target of the action, NULL if none */
+	GVariant* icon;     /* serialized GIcon (see g_icon_serialize()), NULL if none */
+	const char* accel;  /* accelerator (e.g. "<Primary>q", see menu_accel.h), NULL if none */
+	guint32 parent;
+	guint32 first_child;
+	guint32 last_child;
+	guint32 next;       /* next sibling */
+	gint32 id;          /* ID of the item used by the backend, -1 if none */
+	guint32 data;       /* free to use by the backend, 0 for new nodes */
+	guint16 kind;       /* enum menu_node_kind */
+	guint16 flags;      /* enum menu_node_flags */
+};
+
+/*
+ * Functions called when the user interacts with the menu; all are optional.
+ * opened() and closed() are called for submenus (including the root).
+ * timestamp is the time of the event causing this, or 0 if not known.
+ */
+struct menu_tree_backend {
+	void (*activate)(void* data, struct menu_tree* tree, guint32 node, guint32 timestamp);
+	void (*opened)(void* data, struct menu_tree* tree, guint32 node, guint32 timestamp);
+	void (*closed)(void* data, struct menu_tree* tree, guint32 node, guint32 timestamp);
+};
+
+/* what changed in a node, see menu_tree_listener */
+enum menu_tree_change {
+	MENU_TREE_CHANGED_PROPERTIES, /* the properties of the node itself */
+	MENU_TREE_CHANGED_CHILDREN,   /* the children (or other descendants) were replaced */
+	MENU_TREE_CLEARING,           /* the descendants are about to be removed */
+	MENU_TREE_REMOVING            /* the node and its descendants are about to be removed */
+};
+
+/*
+ * Called when the tree changed. For MENU_TREE_CLEARING and
+ * MENU_TREE_REMOVING, the nodes to be removed are still present, so that
+ * listeners can forget about them.
+ */
+typedef void (*menu_tree_listener)(void* data, struct menu_tree* tree, guint32 node, enum menu_tree_change change);
+
+
+/* create a new tree with only an empty root */
+struct menu_tree* menu_tree_new(void);
+
+void menu_tree_set_backend(struct menu_tree* tree, const struct menu_tree_backend* backend, void* data);
+
+void menu_tree_add_listener(struct menu_tree* tree, menu_tree_listener listener, void* data);
+void menu_tree_remove_listener(struct menu_tree* tree, menu_tree_listener listener, void* data);
+
+/*
+ * Get a node by its index, or NULL if there is no such node. The result
+ * is only valid until the tree is next modified.
+ */
+const struct menu_node* menu_tree_get_node(struct menu_tree* tree, guint32 node);
+
+/*
+ * Get the size of the node array, i.e. all valid indices are smaller
+ * than this, and the number of nodes actually used (without the root).
+ */
+guint32 menu_tree_get_size(struct menu_tree* tree);
+guint32 menu_tree_get_n_items(struct menu_tree* tree);
+
+/*
+ * Find a node by the backend's ID; returns MENU_TREE_NONE if not found.
+ * The root always has ID 0.
+ */
+guint32 menu_tree_find_id(struct menu_tree* tree, gint32 id);
+
+/*
+ * Add a new node as the last child of parent and return its index (or
+ * MENU_TREE_NONE if parent is invalid, or if id >= 0 is already used).
+ * A floating target is sunk. Listeners are not notified, the caller
+ * should call menu_tree_children_changed() after it is done.
+ */
+guint32 menu_tree_append(struct menu_tree* tree, guint32 parent, enum menu_node_kind kind,
+	gint32 id, const char* label, const char* action, GVariant* target, unsigned int flags);
+
+/*
+ * Add a new node as a child of parent, after its child after (or as the
+ * first child if after is MENU_TREE_NONE), the same way as above.
+ */
+guint32 menu_tree_insert(struct menu_tree* tree, guint32 parent, guint32 after, enum menu_node_kind kind,
+	gint32 id, const char* label, const char* action, GVariant* target, unsigned int flags);
+
+/*
+ * Remove node (not the root) with all its descendants. Listeners are
+ * notified before this (with MENU_TREE_REMOVING), but not after; the
+ * caller should call menu_tree_children_changed() for the parent.
+ */
+void menu_tree_remove(struct menu_tree* tree, guint32 node);
+
+/*
+ * Remove all descendants of node. Listeners are notified before this
+ * (with MENU_TREE_CLEARING), but not after; the caller should call
+ * menu_tree_children_changed() after it added the new children.
+ */
+void menu_tree_clear_children(struct menu_tree* tree, guint32 node);
+
+/* notify listeners that the children of node changed */
+void menu_tree_children_changed(struct menu_tree* tree, guint32 node);
+
+/*
+ * Change properties of a node; listeners are notified if anything changed.
+ */
+void menu_tree_set_label(struct menu_tree* tree, guint32 node, const char* label);
+void menu_tree_set_flags(struct menu_tree* tree, guint32 node, unsigned int flags);
+
+/*
+ * Set the icon of a node, as a serialized GIcon (a floating reference is
+ * sunk), or NULL to remove it. Icons with image data should use the
+ * ('bytes', <ay>) form of GBytesIcon, so that renderers can decode them
+ * in the background.
+ */
+void menu_tree_set_icon(struct menu_tree* tree, guint32 node, GVariant* icon);
+
+/*
+ * Set the accelerator of a node, in the format of gtk_accelerator_parse()
+ * (e.g. "<Control><Shift>s"), or NULL to remove it. Accelerators are
+ * only shown and indexed; they are not handled by the tree.
+ */
+void menu_tree_set_accel(struct menu_tree* tree, guint32 node, const char* accel);
+
+/* set the data field of a node; listeners are not notified */
+void menu_tree_set_data(struct menu_tree* tree, guint32 node, guint32 data);
+
+/*
+ * Called by renderers when the user interacts with the menu; these
+ * call the corresponding function of the backend.
+ */
+void menu_tree_activate(struct menu_tree* tree, guint32 node, guint32 timestamp);
+void menu_tree_opened(struct menu_tree* tree, guint32 node, guint32 timestamp);
+void menu_tree_closed(struct menu_tree* tree, guint32 node, guint32 timestamp);
+
+/* get the memory used by the tree, including strings (approximately) */
+gsize menu_tree_get_memory(struct menu_tree* tree);
+
+void menu_tree_free(struct menu_tree* tree);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
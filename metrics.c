@@ -0,0 +1,233 @@
+/*
+ * metrics.c -- latency histograms and event counters
+ * 
+ * Copyright 2025 Daniel Kondor <kondor.dani@gmail.com>
+ * 
+ * This is free and unencumbered software released into the public domain.
+ * 
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ * 
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <metrics.h>
+#include <dbus_export.h>
+#include <string.h>
+
+#define METRICS_INTERFACE "io.github.dkondor.GtkGlobalMenuTest.Metrics"
+
+struct metrics {
+	GMutex lock;
+	struct metrics_histogram histograms[METRICS_N_HISTOGRAMS];
+	guint64 counters[METRICS_N_COUNTERS];
+	struct dbus_export export;
+};
+
+static const char* const histogram_names[METRICS_N_HISTOGRAMS] = {
+	"state_to_callback",
+	"callback",
+	"callback_to_menu",
+	"click_to_visible",
+	"search"
+};
+
+static const char* const counter_names[METRICS_N_COUNTERS] = {
+	"state_events",
+	"callbacks",
+	"menus_shown",
+	"popups",
+	"searches"
+};
+
+static const char introspection_xml[] =
+	"<node>"
+	"  <interface name='" METRICS_INTERFACE "'>"
+	"    <method name='GetHistograms'>"
+	"      <!-- name, count, sum (us), max (us), (bucket upper bound (us), count) for non-empty buckets -->"
+	"      <arg type='a(sttta(tt))' name='histograms' direction='out'/>"
+	"    </method>"
+	"    <method name='GetCounters'>"
+	"      <arg type='a{st}' name='counters' direction='out'/>"
+	"    </method>"
+	"    <method name='Reset'/>"
+	"  </interface>"
+	"</node>";
+
+
+struct metrics* metrics_new(void) {
+	struct metrics* m = g_new0(struct metrics, 1);
+	g_mutex_init(&(m->lock));
+	return m;
+}
+
+void metrics_record(struct metrics* m, enum metrics_histogram_id id, gint64 us) {
+	if(!m || id >= METRICS_N_HISTOGRAMS) return;
+	guint64 v = (us > 0) ? (guint64)us : 0;
+	/* the number of bits needed for v, i.e. 2^(i-1) <= v < 2^i */
+	unsigned int i = v ? g_bit_storage(v) : 0;
+	if(i >= METRICS_N_BUCKETS) i = METRICS_N_BUCKETS - 1;
+	g_mutex_lock(&(m->lock));
+	struct metrics_histogram* h = &(m->histograms[id]);
+	h->count++;
+	h->sum_us += v;
+	if(v > h->max_us) h->max_us = v;
+	h->buckets[i]++;
+	g_mutex_unlock(&(m->lock));
+}
+
+void metrics_count(struct metrics* m, enum metrics_counter_id id) {
+	if(!m || id >= METRICS_N_COUNTERS) return;
+	g_mutex_lock(&(m->lock));
+	m->counters[id]++;
+	g_mutex_unlock(&(m->lock));
+}
+
+const char* metrics_histogram_name(enum metrics_histogram_id id) {
+	return (id < METRICS_N_HISTOGRAMS) ? histogram_names[id] : NULL;
+}
+
+const char* metrics_counter_name(enum metrics_counter_id id) {
+	return (id < METRICS_N_COUNTERS) ? counter_names[id] : NULL;
+}
+
+void metrics_get_histogram(struct metrics* m, enum metrics_histogram_id id, struct metrics_histogram* h) {
+	if(!(m && h && id < METRICS_N_HISTOGRAMS)) return;
+	g_mutex_lock(&(m->lock));
+	*h = m->histograms[id];
+	g_mutex_unlock(&(m->lock));
+}
+
+guint64 metrics_get_counter(struct metrics* m, enum metrics_counter_id id) {
+	if(!(m && id < METRICS_N_COUNTERS)) return 0;
+	g_mutex_lock(&(m->lock));
+	guint64 ret = m->counters[id];
+	g_mutex_unlock(&(m->lock));
+	return ret;
+}
+
+/* upper end of bucket i (for the last bucket, this is only its lower end) */
+static guint64 bucket_bound(unsigned int i) {
+	return (i < METRICS_N_BUCKETS - 1) ? ((guint64)1 << i) : ((guint64)1 << (i - 1));
+}
+
+guint64 metrics_histogram_percentile(const struct metrics_histogram* h, double p) {
+	if(!(h && h->count)) return 0;
+	guint64 target = (guint64)(p / 100.0 * h->count);
+	if(target >= h->count) target = h->count - 1;
+	guint64 seen = 0;
+	unsigned int i;
+	for(i = 0; i < METRICS_N_BUCKETS; i++) {
+		seen += h->buckets[i];
+		if(seen > target) break;
+	}
+	guint64 bound = bucket_bound(i < METRICS_N_BUCKETS ? i : METRICS_N_BUCKETS - 1);
+	/* the maximum is known exactly, this is better for the top bucket */
+	return (bound > h->max_us) ? h->max_us : bound;
+}
+
+void metrics_reset(struct metrics* m) {
+	if(!m) return;
+	g_mutex_lock(&(m->lock));
+	memset(m->histograms, 0, sizeof(m->histograms));
+	memset(m->counters, 0, sizeof(m->counters));
+	g_mutex_unlock(&(m->lock));
+}
+
+void metrics_print(struct metrics* m, FILE* f) {
+	if(!m) return;
+	unsigned int i;
+	for(i = 0; i < METRICS_N_HISTOGRAMS; i++) {
+		struct metrics_histogram h;
+		metrics_get_histogram(m, (enum metrics_histogram_id)i, &h);
+		if(!h.count) continue;
+		fprintf(f, "%-18s n = %6" G_GUINT64_FORMAT ", avg %9.2f ms, p50 < %9.2f ms, p99 < %9.2f ms, max %9.2f ms\n",
+			histogram_names[i], h.count, h.sum_us / (1000.0 * h.count),
+			metrics_histogram_percentile(&h, 50.0) / 1000.0,
+			metrics_histogram_percentile(&h, 99.0) / 1000.0, h.max_us / 1000.0);
+	}
+	for(i = 0; i < METRICS_N_COUNTERS; i++) {
+		guint64 n = metrics_get_counter(m, (enum metrics_counter_id)i);
+		if(n) fprintf(f, "%-18s %" G_GUINT64_FORMAT "\n", counter_names[i], n);
+	}
+}
+
+
+/* D-Bus interface */
+
+static GVariant* metrics_histograms_variant(struct metrics* m) {
+	GVariantBuilder b;
+	g_variant_builder_init(&b, G_VARIANT_TYPE("a(sttta(tt))"));
+	unsigned int i, j;
+	for(i = 0; i < METRICS_N_HISTOGRAMS; i++) {
+		struct metrics_histogram h;
+		metrics_get_histogram(m, (enum metrics_histogram_id)i, &h);
+		GVariantBuilder buckets;
+		g_variant_builder_init(&buckets, G_VARIANT_TYPE("a(tt)"));
+		for(j = 0; j < METRICS_N_BUCKETS; j++) if(h.buckets[j])
+			/* note: the last bucket is unbounded */
+			g_variant_builder_add(&buckets, "(tt)", (j < METRICS_N_BUCKETS - 1) ? bucket_bound(j) : G_MAXUINT64, h.buckets[j]);
+		g_variant_builder_add(&b, "(sttta(tt))", histogram_names[i], h.count, h.sum_us, h.max_us, &buckets);
+	}
+	return g_variant_builder_end(&b);
+}
+
+static GVariant* metrics_counters_variant(struct metrics* m) {
+	GVariantBuilder b;
+	g_variant_builder_init(&b, G_VARIANT_TYPE("a{st}"));
+	unsigned int i;
+	for(i = 0; i < METRICS_N_COUNTERS; i++)
+		g_variant_builder_add(&b, "{st}", counter_names[i], metrics_get_counter(m, (enum metrics_counter_id)i));
+	return g_variant_builder_end(&b);
+}
+
+static void method_call_cb(G_GNUC_UNUSED GDBusConnection* bus, G_GNUC_UNUSED const char* sender,
+		G_GNUC_UNUSED const char* path, G_GNUC_UNUSED const char* iface, const char* method,
+		G_GNUC_UNUSED GVariant* params, GDBusMethodInvocation* invocation, gpointer data) {
+	struct metrics* m = (struct metrics*)data;
+	if(!strcmp(method, "GetHistograms"))
+		g_dbus_method_invocation_return_value(invocation, g_variant_new("(@a(sttta(tt)))", metrics_histograms_variant(m)));
+	else if(!strcmp(method, "GetCounters"))
+		g_dbus_method_invocation_return_value(invocation, g_variant_new("(@a{st})", metrics_counters_variant(m)));
+	else if(!strcmp(method, "Reset")) {
+		metrics_reset(m);
+		g_dbus_method_invocation_return_value(invocation, NULL);
+	}
+	else g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD,
+		"Unknown method: %s", method);
+}
+
+static const GDBusInterfaceVTable metrics_vtable = { method_call_cb, NULL, NULL, { NULL } };
+
+int metrics_export(struct metrics* m, GDBusConnection* bus, const char* object_path, GError** error) {
+	if(!m) return 0;
+	return dbus_export_register(&(m->export), bus, object_path, introspection_xml, &metrics_vtable, m, error);
+}
+
+void metrics_unexport(struct metrics* m) {
+	if(m) dbus_export_unregister(&(m->export));
+}
+
+void metrics_free(struct metrics* m) {
+	if(!m) return;
+	metrics_unexport(m);
+	g_mutex_clear(&(m->lock));
+	g_free(m);
+}
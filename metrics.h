@@ -0,0 +1,118 @@
+/*
+ * metrics.h -- latency histograms and event counters
+ * 
+ * Copyright 2025 Daniel Kondor <kondor.dani@gmail.com>
+ * 
+ * This is free and unencumbered software released into the public domain.
+ * 
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ * 
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdio.h>
+#include <gio/gio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+struct metrics;
+
+/* latencies measured */
+enum metrics_histogram_id {
+	METRICS_STATE_TO_CALLBACK, /* activated state event -> change callback called */
+	METRICS_CALLBACK,          /* time spent in the change callback */
+	METRICS_CALLBACK_TO_MENU,  /* change callback -> contents of the new menu available */
+	METRICS_CLICK_TO_VISIBLE,  /* click on the menu button -> menu drawn */
+	METRICS_SEARCH,            /* time to search menus */
+	METRICS_N_HISTOGRAMS
+};
+
+/* events counted */
+enum metrics_counter_id {
+	METRICS_STATE_EVENTS,     /* activated state events received */
+	METRICS_CALLBACKS,        /* change callbacks */
+	METRICS_MENUS_SHOWN,      /* menus (re)created for the active app */
+	METRICS_POPUPS,           /* menus shown by clicking */
+	METRICS_SEARCHES,
+	METRICS_N_COUNTERS
+};
+
+/* bucket i counts values in [2^(i-1), 2^i) us, the last one all larger values */
+#define METRICS_N_BUCKETS 24
+
+struct metrics_histogram {
+	guint64 count;
+	guint64 sum_us;
+	guint64 max_us;
+	guint64 buckets[METRICS_N_BUCKETS];
+};
+
+/*
+ * Create a new set of (empty) histograms and counters. Recording is
+ * thread-safe and cheap (a mutex that is rarely contended), so it can be
+ * done on hot paths. All functions accept NULL, which does nothing, so
+ * callers do not need to check if metrics are collected.
+ */
+struct metrics* metrics_new(void);
+
+void metrics_record(struct metrics* m, enum metrics_histogram_id id, gint64 us);
+void metrics_count(struct metrics* m, enum metrics_counter_id id);
+
+const char* metrics_histogram_name(enum metrics_histogram_id id);
+const char* metrics_counter_name(enum metrics_counter_id id);
+
+/* get a copy of a histogram or the value of a counter */
+void metrics_get_histogram(struct metrics* m, enum metrics_histogram_id id, struct metrics_histogram* h);
+guint64 metrics_get_counter(struct metrics* m, enum metrics_counter_id id);
+
+/*
+ * Get an upper bound of the given percentile (0 -- 100) of the values
+ * in a histogram, i.e. the upper end of the bucket it falls in.
+ */
+guint64 metrics_histogram_percentile(const struct metrics_histogram* h, double p);
+
+void metrics_reset(struct metrics* m);
+
+/* print a summary of all histograms and counters that are not empty */
+void metrics_print(struct metrics* m, FILE* f);
+
+/*
+ * Make the metrics available on the given connection at object_path, with
+ * the io.github.dkondor.GtkGlobalMenuTest.Metrics interface, which has the
+ * GetHistograms(), GetCounters() and Reset() methods. Returns nonzero on
+ * success. The object is removed by metrics_free() or metrics_unexport().
+ */
+int metrics_export(struct metrics* m, GDBusConnection* bus, const char* object_path, GError** error);
+void metrics_unexport(struct metrics* m);
+
+void metrics_free(struct metrics* m);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
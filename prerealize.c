@@ -0,0 +1,125 @@
+/*
+ * prerealize.c -- prepare widgets in idle time, before they are shown
+ * 
+ * Copyright 2025 Daniel Kondor <kondor.dani@gmail.com>
+ * 
+ * This is free and unencumbered software released into the public domain.
+ * 
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ * 
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <prerealize.h>
+
+
+struct prerealize {
+	GtkWidget* widget;
+	gint64 slice_us;
+	GQueue queue;      /* widgets to process, we hold a reference to each */
+	guint idle_id;
+	int restart;       /* contents changed while processing */
+	unsigned int n_widgets;
+};
+
+
+static void prerealize_clear_queue(struct prerealize* pr) {
+	GtkWidget* w;
+	while((w = (GtkWidget*)g_queue_pop_head(&(pr->queue)))) g_object_unref(w);
+}
+
+static void push_child(GtkWidget* child, gpointer data) {
+	g_queue_push_tail(&(((struct prerealize*)data)->queue), g_object_ref(child));
+}
+
+/* process one widget and add its children to the queue */
+static void prerealize_widget(struct prerealize* pr, GtkWidget* w) {
+	if(gtk_widget_in_destruction(w)) return;
+	/* note: this calculates the CSS style and lays out any text,
+	 * which is most of the work done when first showing a menu */
+	gtk_widget_get_preferred_size(w, NULL, NULL);
+	pr->n_widgets++;
+	if(GTK_IS_CONTAINER(w)) gtk_container_forall(GTK_CONTAINER(w), push_child, pr);
+	/* submenus of GtkMenu are not children of their items */
+	if(GTK_IS_MENU_ITEM(w)) {
+		GtkWidget* submenu = gtk_menu_item_get_submenu(GTK_MENU_ITEM(w));
+		if(submenu) push_child(submenu, pr);
+	}
+}
+
+static gboolean prerealize_idle(gpointer data) {
+	struct prerealize* pr = (struct prerealize*)data;
+	gint64 end = g_get_monotonic_time() + pr->slice_us;
+	do {
+		GtkWidget* w = (GtkWidget*)g_queue_pop_head(&(pr->queue));
+		if(!w) {
+			if(!pr->restart) {
+				pr->idle_id = 0;
+				return G_SOURCE_REMOVE;
+			}
+			/* start again from the top, unchanged widgets are fast to process */
+			pr->restart = 0;
+			w = g_object_ref(pr->widget);
+		}
+		prerealize_widget(pr, w);
+		g_object_unref(w);
+	}
+	while(g_get_monotonic_time() < end);
+	return G_SOURCE_CONTINUE;
+}
+
+void prerealize_update(struct prerealize* pr) {
+	if(!pr) return;
+	if(pr->idle_id) {
+		pr->restart = 1;
+		return;
+	}
+	/* the top-level window is created here, this is cheap */
+	if(!gtk_widget_get_realized(pr->widget)) gtk_widget_realize(pr->widget);
+	g_queue_push_tail(&(pr->queue), g_object_ref(pr->widget));
+	pr->idle_id = g_idle_add_full(G_PRIORITY_DEFAULT_IDLE, prerealize_idle, pr, NULL);
+}
+
+struct prerealize* prerealize_new(GtkWidget* widget, gint64 slice_us) {
+	if(!widget) return NULL;
+	struct prerealize* pr = g_new0(struct prerealize, 1);
+	pr->widget = g_object_ref(widget);
+	pr->slice_us = slice_us;
+	g_queue_init(&(pr->queue));
+	prerealize_update(pr);
+	return pr;
+}
+
+int prerealize_is_done(struct prerealize* pr) {
+	return pr ? !pr->idle_id : 1;
+}
+
+unsigned int prerealize_get_n_widgets(struct prerealize* pr) {
+	return pr ? pr->n_widgets : 0;
+}
+
+void prerealize_free(struct prerealize* pr) {
+	if(!pr) return;
+	if(pr->idle_id) g_source_remove(pr->idle_id);
+	prerealize_clear_queue(pr);
+	g_object_unref(pr->widget);
+	g_free(pr);
+}
@@ -0,0 +1,75 @@
+/*
+ * prerealize.h -- prepare widgets in idle time, before they are shown
+ * 
+ * Copyright 2025 Daniel Kondor <kondor.dani@gmail.com>
+ * 
+ * This is free and unencumbered software released into the public domain.
+ * 
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ * 
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef PREREALIZE_H
+#define PREREALIZE_H
+
+#include <gtk/gtk.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+struct prerealize;
+
+/*
+ * Start preparing the given widget (typically a popup menu or popover)
+ * and all its children in idle callbacks: realize it and calculate the
+ * style and size of each child, so that showing it later only needs to
+ * map it. Each idle callback runs for at most slice_us microseconds, so
+ * the main loop is never blocked for long.
+ */
+struct prerealize* prerealize_new(GtkWidget* widget, gint64 slice_us);
+
+/*
+ * Prepare the widget again after its contents changed (e.g. from the
+ * changed callback of menu_render).
+ */
+void prerealize_update(struct prerealize* pr);
+
+/*
+ * Get whether the widget is fully prepared (i.e. there is nothing left
+ * to do) and the number of widgets prepared so far.
+ */
+int prerealize_is_done(struct prerealize* pr);
+unsigned int prerealize_get_n_widgets(struct prerealize* pr);
+
+/*
+ * Stop and free all resources. The widget itself is not affected.
+ */
+void prerealize_free(struct prerealize* pr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
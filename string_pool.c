@@ -0,0 +1,107 @@
+/*
+ * string_pool.c -- refcounted pool of interned strings
+ * 
+ * Copyright 2025 Daniel Kondor <kondor.dani@gmail.com>
+ * 
+ * This is free and unencumbered software released into the public domain.
+ * 
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ * 
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <string_pool.h>
+#include <glib.h>
+#include <string.h>
+
+
+struct string_pool {
+	GHashTable* strings; /* string -> struct string_pool_entry*, key owned by the entry */
+	unsigned long references;
+	size_t bytes;
+	size_t bytes_referenced;
+};
+
+struct string_pool_entry {
+	unsigned int refs;
+	unsigned int len;
+	char str[];
+};
+
+
+static struct string_pool_entry* entry_from_str(const char* str) {
+	return (struct string_pool_entry*)(str - offsetof(struct string_pool_entry, str));
+}
+
+struct string_pool* string_pool_new(void) {
+	struct string_pool* pool = g_new0(struct string_pool, 1);
+	pool->strings = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, g_free);
+	return pool;
+}
+
+const char* string_pool_intern(struct string_pool* pool, const char* str) {
+	if(!(pool && str)) return NULL;
+	struct string_pool_entry* entry = g_hash_table_lookup(pool->strings, str);
+	if(!entry) {
+		size_t len = strlen(str);
+		entry = g_malloc(sizeof(struct string_pool_entry) + len + 1);
+		entry->refs = 0;
+		entry->len = (unsigned int)len;
+		memcpy(entry->str, str, len + 1);
+		g_hash_table_insert(pool->strings, entry->str, entry);
+		pool->bytes += len + 1;
+	}
+	entry->refs++;
+	pool->references++;
+	pool->bytes_referenced += entry->len + 1;
+	return entry->str;
+}
+
+const char* string_pool_lookup(struct string_pool* pool, const char* str) {
+	if(!(pool && str)) return NULL;
+	struct string_pool_entry* entry = g_hash_table_lookup(pool->strings, str);
+	return entry ? entry->str : NULL;
+}
+
+void string_pool_release(struct string_pool* pool, const char* str) {
+	if(!(pool && str)) return;
+	struct string_pool_entry* entry = entry_from_str(str);
+	pool->references--;
+	pool->bytes_referenced -= entry->len + 1;
+	if(--entry->refs) return;
+	pool->bytes -= entry->len + 1;
+	/* this will free the entry as well */
+	g_hash_table_remove(pool->strings, entry->str);
+}
+
+void string_pool_get_stats(struct string_pool* pool, struct string_pool_stats* stats) {
+	if(!(pool && stats)) return;
+	stats->strings = g_hash_table_size(pool->strings);
+	stats->references = pool->references;
+	stats->bytes = pool->bytes;
+	stats->bytes_saved = pool->bytes_referenced - pool->bytes;
+}
+
+void string_pool_free(struct string_pool* pool) {
+	if(!pool) return;
+	g_hash_table_destroy(pool->strings);
+	g_free(pool);
+}
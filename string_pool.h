@@ -0,0 +1,93 @@
+/*
+ * string_pool.h -- refcounted pool of interned strings
+ * 
+ * Copyright 2025 Daniel Kondor <kondor.dani@gmail.com>
+ * 
+ * This is free and unencumbered software released into the public domain.
+ * 
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ * 
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef STRING_POOL_H
+#define STRING_POOL_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+struct string_pool;
+
+/* memory usage of a pool, see string_pool_get_stats() */
+struct string_pool_stats {
+	unsigned long strings;    /* distinct strings stored */
+	unsigned long references; /* references held to them */
+	size_t bytes;             /* bytes used by the stored strings */
+	size_t bytes_saved;       /* bytes that separate copies for each reference would use in addition */
+};
+
+/*
+ * Create a new, empty pool. A pool is not thread-safe; callers need to
+ * use their own locking if it is shared among threads.
+ */
+struct string_pool* string_pool_new(void);
+
+/*
+ * Get a reference to the pooled copy of str, adding it to the pool if
+ * it is not there yet. Equal strings interned in the same pool are
+ * always returned as the same pointer, so they can be compared with ==.
+ * Returns NULL if str is NULL.
+ */
+const char* string_pool_intern(struct string_pool* pool, const char* str);
+
+/*
+ * Get the pooled copy of str without taking a reference, or NULL if it
+ * is not in the pool. Useful to compare a string with pooled ones
+ * without allocating anything.
+ */
+const char* string_pool_lookup(struct string_pool* pool, const char* str);
+
+/*
+ * Release a reference returned by string_pool_intern(). The string is
+ * freed when the last reference is released. NULL is ignored.
+ */
+void string_pool_release(struct string_pool* pool, const char* str);
+
+/*
+ * Get the current memory usage of the pool.
+ */
+void string_pool_get_stats(struct string_pool* pool, struct string_pool_stats* stats);
+
+/*
+ * Free the pool. All references should be released before calling this.
+ */
+void string_pool_free(struct string_pool* pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -0,0 +1,145 @@
+/*
+ * toplevel_daemon.c -- share the state of toplevels with other processes
+ * 
+ * Copyright 2025 Daniel Kondor <kondor.dani@gmail.com>
+ * 
+ * This is free and unencumbered software released into the public domain.
+ * 
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ * 
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <glib.h>
+#include <glib-unix.h>
+#include <gdk/gdk.h>
+#include <foreign_toplevel.h>
+#include <toplevel_share.h>
+
+static GMainLoop* loop = NULL;
+static const char* share_path = NULL;
+static struct toplevel_share* share = NULL;
+static int exit_code = 0;
+
+static gboolean quit_cb(G_GNUC_UNUSED gpointer data) {
+	g_main_loop_quit(loop);
+	return G_SOURCE_CONTINUE;
+}
+
+static void manager_ready_cb(G_GNUC_UNUSED void* data, struct toplevel_manager* gr, int success) {
+	GError* err = NULL;
+	if(!success) {
+		fprintf(stderr, "Cannot create grabber interface!\n");
+		exit_code = 1;
+		g_main_loop_quit(loop);
+		return;
+	}
+	share = toplevel_share_new(gr, share_path, &err);
+	if(!share) {
+		fprintf(stderr, "Cannot share toplevels: %s\n", err->message);
+		g_error_free(err);
+		exit_code = 1;
+		g_main_loop_quit(loop);
+	}
+}
+
+/* the only process using the protocol */
+static int run_daemon(void) {
+	gdk_init(NULL, NULL);
+	struct toplevel_manager* gr = toplevel_manager_new_async(NULL, TOPLEVEL_MANAGER_THREADED, manager_ready_cb, NULL);
+	if(!gr) {
+		fprintf(stderr, "Cannot create grabber interface!\n");
+		return 1;
+	}
+	g_main_loop_run(loop);
+	toplevel_share_free(share);
+	toplevel_manager_free(gr);
+	return exit_code;
+}
+
+
+/* example client: print the active app whenever it changes */
+struct watch_state {
+	char app_id[256];
+	unsigned int n_toplevels;
+	guint64 serial;
+};
+
+static void watch_read(void* data, const struct toplevel_share_view* view) {
+	struct watch_state* st = (struct watch_state*)data;
+	struct toplevel_snapshot_entry e;
+	st->app_id[0] = 0;
+	st->n_toplevels = view->n_toplevels;
+	st->serial = view->serial;
+	if(view->active >= 0 && toplevel_share_view_get(view, (unsigned int)view->active, &e) && e.props.app_id)
+		g_strlcpy(st->app_id, e.props.app_id, sizeof(st->app_id));
+}
+
+static void watch_cb(void* data, struct toplevel_share_client* c) {
+	struct watch_state* last = (struct watch_state*)data;
+	struct watch_state st;
+	if(!toplevel_share_client_is_connected(c)) {
+		fprintf(stderr, "Daemon disconnected\n");
+		g_main_loop_quit(loop);
+		return;
+	}
+	if(!toplevel_share_client_read(c, watch_read, &st) || st.serial == last->serial) return;
+	if(strcmp(st.app_id, last->app_id)) printf("%s (%u toplevels)\n", st.app_id[0] ? st.app_id : "-", st.n_toplevels);
+	*last = st;
+}
+
+static int run_watch(void) {
+	GError* err = NULL;
+	struct watch_state last = { "", 0, 0 };
+	struct toplevel_share_client* c = toplevel_share_client_new(share_path, NULL, watch_cb, &last, &err);
+	if(!c) {
+		fprintf(stderr, "Cannot connect: %s\n", err->message);
+		g_error_free(err);
+		return 1;
+	}
+	watch_cb(&last, c);
+	g_main_loop_run(loop);
+	toplevel_share_client_free(c);
+	return 0;
+}
+
+/*
+ * usage: toplevel_daemon [--watch] [socket]
+ * With --watch, connect to a running daemon and print the active app.
+ */
+int main(int argc, char** argv) {
+	int watch = 0;
+	int i;
+	for(i = 1; i < argc; i++) {
+		if(!strcmp(argv[i], "--watch")) watch = 1;
+		else share_path = argv[i];
+	}
+	loop = g_main_loop_new(NULL, FALSE);
+	g_unix_signal_add(SIGINT, quit_cb, NULL);
+	g_unix_signal_add(SIGTERM, quit_cb, NULL);
+	int ret = watch ? run_watch() : run_daemon();
+	g_main_loop_unref(loop);
+	return ret;
+}
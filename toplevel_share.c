@@ -0,0 +1,506 @@
+/*
+ * toplevel_share.c -- sharing the state of toplevels with other processes
+ * 
+ * Copyright 2025 Daniel Kondor <kondor.dani@gmail.com>
+ * 
+ * This is free and unencumbered software released into the public domain.
+ * 
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ * 
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+#define _GNU_SOURCE /* memfd_create() */
+
+#include <toplevel_share.h>
+#include <gio/gunixconnection.h>
+#include <gio/gunixsocketaddress.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* note: added in Linux 5.1, might be missing from older headers */
+#ifndef F_SEAL_FUTURE_WRITE
+#define F_SEAL_FUTURE_WRITE 0x0010
+#endif
+
+/* note: only the pages actually used take up memory */
+#define SHARE_CAPACITY (4u << 20)
+/* times a client tries to read while the daemon is writing */
+#define SHARE_READ_TRIES 1000
+
+G_STATIC_ASSERT(sizeof(struct toplevel_properties) == TOPLEVEL_SHARE_N_PROPS * sizeof(const char*));
+
+static const size_t share_props[TOPLEVEL_SHARE_N_PROPS] = {
+	offsetof(struct toplevel_properties, app_id),
+	offsetof(struct toplevel_properties, menubar_path),
+	offsetof(struct toplevel_properties, menubar_bus_name),
+	offsetof(struct toplevel_properties, window_object_path),
+	offsetof(struct toplevel_properties, window_bus_name),
+	offsetof(struct toplevel_properties, application_object_path),
+	offsetof(struct toplevel_properties, application_bus_name),
+	offsetof(struct toplevel_properties, kde_service_name),
+	offsetof(struct toplevel_properties, kde_object_path)
+};
+
+#define SHARE_PROP(props, i) (*(const char**)((char*)(props) + share_props[i]))
+
+/* the records start right after the header */
+#define SHARE_RECORDS sizeof(struct toplevel_share_header)
+
+char* toplevel_share_default_path(void) {
+	return g_build_filename(g_get_user_runtime_dir(), "gtk-global-menu-toplevels", NULL);
+}
+
+
+/* a connected client, as seen by the daemon */
+struct share_peer {
+	struct toplevel_share* s;
+	GSocketConnection* conn;
+	GSource* source; /* to notice when the client disconnects */
+};
+
+struct toplevel_share {
+	struct toplevel_manager* gr;
+	char* path;
+	int fd;
+	char* map;
+	guint32 capacity;
+	guint32 slots;       /* records that fit before the strings */
+	guint32 pos;         /* end of the strings written so far */
+	GHashTable* strings; /* string -> offset, for all strings written since the last reset */
+	GSocketService* service;
+	int listening;       /* the socket at path is ours */
+	GMutex lock;         /* protects peers; snapshots might be written on another thread */
+	GPtrArray* peers;    /* struct share_peer* */
+	unsigned long writes;
+};
+
+
+/* forget all strings and records, so that the next write starts over */
+static void share_reset(struct toplevel_share* s, guint32 slots) {
+	g_hash_table_remove_all(s->strings);
+	s->slots = slots;
+	s->pos = SHARE_RECORDS + slots * sizeof(struct toplevel_share_record);
+	memset(s->map + SHARE_RECORDS, 0, slots * sizeof(struct toplevel_share_record));
+}
+
+/*
+ * Offset of str in the shared memory, appending it if it was not written
+ * before. old is the offset of the same property in the previous version
+ * of the record, which usually has the same value (records are cleared
+ * on reset, so this is always a string written since then).
+ */
+static guint32 share_string(struct toplevel_share* s, const char* str, guint32 old, int* full) {
+	if(!str) return 0;
+	if(old && !strcmp(s->map + old, str)) return old;
+	guint32 off = GPOINTER_TO_UINT(g_hash_table_lookup(s->strings, str));
+	if(off) return off;
+	size_t len = strlen(str) + 1;
+	/* note: the last byte is never written, so that it stays 0 */
+	if(len > s->capacity - 1 - s->pos) {
+		*full = 1;
+		return 0;
+	}
+	off = s->pos;
+	memcpy(s->map + off, str, len);
+	s->pos += (guint32)len;
+	g_hash_table_insert(s->strings, g_strdup(str), GUINT_TO_POINTER(off));
+	return off;
+}
+
+/* write the records of snap, only touching those that changed; returns zero if the strings did not fit */
+static int share_records(struct toplevel_share* s, const struct toplevel_snapshot* snap, guint32 n) {
+	struct toplevel_share_record* records = (struct toplevel_share_record*)(s->map + SHARE_RECORDS);
+	int full = 0;
+	guint32 i, j;
+	for(i = 0; i < n; i++) {
+		const struct toplevel_snapshot_entry* e = &(snap->toplevels[i]);
+		struct toplevel_share_record r;
+		r.id = e->id;
+		r.parent = e->parent;
+		for(j = 0; j < TOPLEVEL_SHARE_N_PROPS; j++)
+			r.props[j] = share_string(s, SHARE_PROP(&(e->props), j), records[i].props[j], &full);
+		if(memcmp(&r, &(records[i]), sizeof(r))) records[i] = r;
+	}
+	return !full;
+}
+
+/*
+ * Copy a new snapshot to the shared memory and wake up the clients.
+ * Strings are only appended, so only new records and strings are
+ * written (i.e. only the pages actually changed are touched); once the
+ * memory is full, everything is written again from the start.
+ */
+static void share_write(void* data, G_GNUC_UNUSED struct toplevel_manager* gr, const struct toplevel_snapshot* snap) {
+	struct toplevel_share* s = (struct toplevel_share*)data;
+	struct toplevel_share_header* h = (struct toplevel_share_header*)s->map;
+	guint32 seq = h->seq;
+	guint32 flags = 0;
+	guint32 i;
+	
+	/* note: we are the only writer; readers check that seq is even and
+	 * did not change while they were reading */
+	g_atomic_int_set((gint*)&(h->seq), (gint)(seq + 1));
+	atomic_thread_fence(memory_order_release);
+	
+	guint32 n = snap->n_toplevels;
+	guint32 max = (s->capacity - 1 - SHARE_RECORDS) / sizeof(struct toplevel_share_record);
+	if(n > max) {
+		n = max;
+		flags |= TOPLEVEL_SHARE_TRUNCATED;
+	}
+	if(n > s->slots) share_reset(s, MIN(MAX(n, 2 * s->slots), max));
+	if(!share_records(s, snap, n)) {
+		share_reset(s, s->slots);
+		if(!share_records(s, snap, n)) flags |= TOPLEVEL_SHARE_TRUNCATED;
+	}
+	
+	gint32 active = snap->active ? (gint32)(snap->active - snap->toplevels) : -1;
+	h->serial = snap->serial;
+	h->n_toplevels = n;
+	h->active = (active >= 0 && (guint32)active < n) ? active : -1;
+	h->size = s->pos;
+	h->flags = flags;
+	g_atomic_int_set((gint*)&(h->seq), (gint)(seq + 2));
+	s->writes++;
+	
+	/* note: if a client has not read the previous wakeup yet, it
+	 * will read this snapshot anyway, so it is OK if this fails */
+	g_mutex_lock(&(s->lock));
+	for(i = 0; i < s->peers->len; i++) {
+		struct share_peer* p = (struct share_peer*)g_ptr_array_index(s->peers, i);
+		GSocket* socket = g_socket_connection_get_socket(p->conn);
+		g_socket_send_with_blocking(socket, "u", 1, FALSE, NULL, NULL);
+	}
+	g_mutex_unlock(&(s->lock));
+}
+
+static void peer_free(struct share_peer* p) {
+	g_source_destroy(p->source);
+	g_source_unref(p->source);
+	g_io_stream_close(G_IO_STREAM(p->conn), NULL, NULL);
+	g_object_unref(p->conn);
+	g_free(p);
+}
+
+/* clients do not send anything; this means they disconnected */
+static gboolean peer_cb(GSocket* socket, G_GNUC_UNUSED GIOCondition cond, gpointer data) {
+	struct share_peer* p = (struct share_peer*)data;
+	struct toplevel_share* s = p->s;
+	char buf[64];
+	GError* err = NULL;
+	gssize ret = g_socket_receive_with_blocking(socket, buf, sizeof(buf), FALSE, NULL, &err);
+	if(ret > 0 || (ret < 0 && g_error_matches(err, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK))) {
+		g_clear_error(&err);
+		return G_SOURCE_CONTINUE;
+	}
+	g_clear_error(&err);
+	g_mutex_lock(&(s->lock));
+	g_ptr_array_remove_fast(s->peers, p);
+	g_mutex_unlock(&(s->lock));
+	peer_free(p);
+	return G_SOURCE_REMOVE;
+}
+
+static gboolean incoming_cb(G_GNUC_UNUSED GSocketService* service, GSocketConnection* conn,
+		G_GNUC_UNUSED GObject* source_object, gpointer data) {
+	struct toplevel_share* s = (struct toplevel_share*)data;
+	/* note: the connection is new, so this does not block */
+	if(!(G_IS_UNIX_CONNECTION(conn) && g_unix_connection_send_fd(G_UNIX_CONNECTION(conn), s->fd, NULL, NULL)))
+		return TRUE;
+	
+	struct share_peer* p = g_new0(struct share_peer, 1);
+	p->s = s;
+	p->conn = (GSocketConnection*)g_object_ref(conn);
+	GSocket* socket = g_socket_connection_get_socket(conn);
+	g_socket_set_blocking(socket, FALSE);
+	p->source = g_socket_create_source(socket, G_IO_IN | G_IO_HUP | G_IO_ERR, NULL);
+	g_source_set_callback(p->source, G_SOURCE_FUNC(peer_cb), p, NULL);
+	g_source_attach(p->source, NULL);
+	g_mutex_lock(&(s->lock));
+	g_ptr_array_add(s->peers, p);
+	g_mutex_unlock(&(s->lock));
+	return TRUE;
+}
+
+/* check if a daemon is listening on the socket at path */
+static int share_is_alive(GSocketAddress* addr) {
+	GSocketClient* client = g_socket_client_new();
+	GSocketConnection* conn = g_socket_client_connect(client, G_SOCKET_CONNECTABLE(addr), NULL, NULL);
+	int ret = (conn != NULL);
+	if(conn) g_object_unref(conn);
+	g_object_unref(client);
+	return ret;
+}
+
+static int share_listen(struct toplevel_share* s, GError** error) {
+	GSocketAddress* addr = g_unix_socket_address_new(s->path);
+	GError* err = NULL;
+	s->service = g_socket_service_new();
+	int ret = g_socket_listener_add_address(G_SOCKET_LISTENER(s->service), addr,
+		G_SOCKET_TYPE_STREAM, G_SOCKET_PROTOCOL_DEFAULT, NULL, NULL, &err);
+	/* note: remove a stale socket left by a daemon that crashed */
+	if(!ret && g_error_matches(err, G_IO_ERROR, G_IO_ERROR_ADDRESS_IN_USE) && !share_is_alive(addr)) {
+		g_clear_error(&err);
+		unlink(s->path);
+		ret = g_socket_listener_add_address(G_SOCKET_LISTENER(s->service), addr,
+			G_SOCKET_TYPE_STREAM, G_SOCKET_PROTOCOL_DEFAULT, NULL, NULL, &err);
+	}
+	g_object_unref(addr);
+	if(!ret) {
+		g_propagate_error(error, err);
+		return 0;
+	}
+	s->listening = 1;
+	g_signal_connect(s->service, "incoming", G_CALLBACK(incoming_cb), s);
+	g_socket_service_start(s->service);
+	return 1;
+}
+
+static int share_map(struct toplevel_share* s, GError** error) {
+	s->capacity = SHARE_CAPACITY;
+	s->fd = memfd_create("toplevel-share", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if(s->fd < 0 || ftruncate(s->fd, s->capacity) < 0 ||
+			fcntl(s->fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW) < 0) {
+		int err = errno;
+		g_set_error(error, G_IO_ERROR, g_io_error_from_errno(err), "Cannot create shared memory: %s", g_strerror(err));
+		return 0;
+	}
+	void* map = mmap(NULL, s->capacity, PROT_READ | PROT_WRITE, MAP_SHARED, s->fd, 0);
+	if(map == MAP_FAILED) {
+		int err = errno;
+		g_set_error(error, G_IO_ERROR, g_io_error_from_errno(err), "Cannot map shared memory: %s", g_strerror(err));
+		return 0;
+	}
+	s->map = (char*)map;
+	/* note: our mapping stays writable, but clients cannot map the fd
+	 * they receive (or reopen it) for writing anymore */
+	if(fcntl(s->fd, F_ADD_SEALS, F_SEAL_FUTURE_WRITE | F_SEAL_SEAL) < 0) {
+		int err = errno;
+		g_set_error(error, G_IO_ERROR, g_io_error_from_errno(err), "Cannot seal shared memory: %s", g_strerror(err));
+		return 0;
+	}
+	s->pos = SHARE_RECORDS;
+	struct toplevel_share_header* h = (struct toplevel_share_header*)s->map;
+	h->magic = TOPLEVEL_SHARE_MAGIC;
+	h->version = TOPLEVEL_SHARE_VERSION;
+	h->capacity = s->capacity;
+	h->size = SHARE_RECORDS;
+	h->active = -1;
+	return 1;
+}
+
+struct toplevel_share* toplevel_share_new(struct toplevel_manager* gr, const char* path, GError** error) {
+	if(!gr) return NULL;
+	struct toplevel_share* s = g_new0(struct toplevel_share, 1);
+	s->gr = gr;
+	s->fd = -1;
+	s->path = path ? g_strdup(path) : toplevel_share_default_path();
+	s->strings = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	s->peers = g_ptr_array_new();
+	g_mutex_init(&(s->lock));
+	if(!(share_map(s, error) && share_listen(s, error))) {
+		toplevel_share_free(s);
+		return NULL;
+	}
+	/* note: enabling snapshots publishes (and so writes) the current state */
+	toplevel_manager_set_snapshot_callback(gr, share_write, s);
+	toplevel_manager_set_snapshots(gr, 1);
+	return s;
+}
+
+unsigned int toplevel_share_get_n_clients(struct toplevel_share* s) {
+	if(!s) return 0;
+	g_mutex_lock(&(s->lock));
+	unsigned int n = s->peers->len;
+	g_mutex_unlock(&(s->lock));
+	return n;
+}
+
+void toplevel_share_free(struct toplevel_share* s) {
+	if(!s) return;
+	if(s->map) toplevel_manager_set_snapshot_callback(s->gr, NULL, NULL);
+	if(s->service) {
+		g_socket_service_stop(s->service);
+		g_socket_listener_close(G_SOCKET_LISTENER(s->service));
+		g_object_unref(s->service);
+	}
+	if(s->listening) unlink(s->path);
+	g_ptr_array_foreach(s->peers, (GFunc)peer_free, NULL);
+	g_ptr_array_free(s->peers, TRUE);
+	if(s->map) munmap(s->map, s->capacity);
+	if(s->fd >= 0) close(s->fd);
+	g_hash_table_destroy(s->strings);
+	g_mutex_clear(&(s->lock));
+	g_free(s->path);
+	g_free(s);
+}
+
+
+struct toplevel_share_client {
+	GSocketConnection* conn;
+	GSource* source;
+	const char* map;
+	guint32 capacity;
+	int connected;
+	toplevel_share_callback callback;
+	void* data;
+};
+
+/* read all wakeups (only the latest snapshot matters) */
+static gboolean client_cb(GSocket* socket, G_GNUC_UNUSED GIOCondition cond, gpointer data) {
+	struct toplevel_share_client* c = (struct toplevel_share_client*)data;
+	char buf[64];
+	while(1) {
+		GError* err = NULL;
+		gssize ret = g_socket_receive_with_blocking(socket, buf, sizeof(buf), FALSE, NULL, &err);
+		if(ret > 0) continue;
+		if(ret < 0 && g_error_matches(err, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK)) {
+			g_error_free(err);
+			break;
+		}
+		g_clear_error(&err);
+		c->connected = 0;
+		break;
+	}
+	if(c->callback) c->callback(c->data, c);
+	return c->connected ? G_SOURCE_CONTINUE : G_SOURCE_REMOVE;
+}
+
+static int client_map(struct toplevel_share_client* c, int fd, GError** error) {
+	struct stat st;
+	if(fstat(fd, &st) < 0 || st.st_size < (off_t)(SHARE_RECORDS + 1) || st.st_size > (off_t)G_MAXUINT32) {
+		g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Invalid shared memory received");
+		return 0;
+	}
+	c->capacity = (guint32)st.st_size;
+	void* map = mmap(NULL, c->capacity, PROT_READ, MAP_SHARED, fd, 0);
+	if(map == MAP_FAILED) {
+		int err = errno;
+		g_set_error(error, G_IO_ERROR, g_io_error_from_errno(err), "Cannot map shared memory: %s", g_strerror(err));
+		return 0;
+	}
+	c->map = (const char*)map;
+	const struct toplevel_share_header* h = (const struct toplevel_share_header*)c->map;
+	if(h->magic != TOPLEVEL_SHARE_MAGIC || h->version != TOPLEVEL_SHARE_VERSION || h->capacity != c->capacity) {
+		g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED, "Unsupported shared memory format");
+		return 0;
+	}
+	return 1;
+}
+
+struct toplevel_share_client* toplevel_share_client_new(const char* path, GMainContext* context,
+		toplevel_share_callback callback, void* data, GError** error) {
+	struct toplevel_share_client* c = g_new0(struct toplevel_share_client, 1);
+	c->callback = callback;
+	c->data = data;
+	char* default_path = path ? NULL : toplevel_share_default_path();
+	GSocketAddress* addr = g_unix_socket_address_new(path ? path : default_path);
+	GSocketClient* client = g_socket_client_new();
+	c->conn = g_socket_client_connect(client, G_SOCKET_CONNECTABLE(addr), NULL, error);
+	g_object_unref(client);
+	g_object_unref(addr);
+	g_free(default_path);
+	if(!c->conn) {
+		toplevel_share_client_free(c);
+		return NULL;
+	}
+	
+	int fd = G_IS_UNIX_CONNECTION(c->conn) ? g_unix_connection_receive_fd(G_UNIX_CONNECTION(c->conn), NULL, error) : -1;
+	int ret = (fd >= 0) && client_map(c, fd, error);
+	if(fd >= 0) close(fd);
+	if(!ret) {
+		toplevel_share_client_free(c);
+		return NULL;
+	}
+	
+	c->connected = 1;
+	GSocket* socket = g_socket_connection_get_socket(c->conn);
+	g_socket_set_blocking(socket, FALSE);
+	c->source = g_socket_create_source(socket, G_IO_IN | G_IO_HUP | G_IO_ERR, NULL);
+	g_source_set_callback(c->source, G_SOURCE_FUNC(client_cb), c, NULL);
+	g_source_attach(c->source, context);
+	return c;
+}
+
+int toplevel_share_client_is_connected(struct toplevel_share_client* c) {
+	return c ? c->connected : 0;
+}
+
+int toplevel_share_view_get(const struct toplevel_share_view* view, unsigned int i,
+		struct toplevel_snapshot_entry* entry) {
+	if(!(view && i < view->n_toplevels)) return 0;
+	const struct toplevel_share_record* r = (const struct toplevel_share_record*)(view->base + SHARE_RECORDS) + i;
+	unsigned int j;
+	entry->id = r->id;
+	entry->parent = r->parent;
+	for(j = 0; j < TOPLEVEL_SHARE_N_PROPS; j++) {
+		guint32 off = r->props[j];
+		/* note: the last byte is always 0, so strings end within the memory */
+		SHARE_PROP(&(entry->props), j) = (off >= SHARE_RECORDS && off < view->capacity) ? view->base + off : NULL;
+	}
+	return 1;
+}
+
+int toplevel_share_client_read(struct toplevel_share_client* c, toplevel_share_reader reader, void* data) {
+	if(!(c && c->map && reader)) return 0;
+	const struct toplevel_share_header* h = (const struct toplevel_share_header*)c->map;
+	guint32 max = (c->capacity - 1 - SHARE_RECORDS) / sizeof(struct toplevel_share_record);
+	unsigned int i;
+	for(i = 0; i < SHARE_READ_TRIES; i++) {
+		guint32 seq = (guint32)g_atomic_int_get((const gint*)&(h->seq));
+		if(seq & 1) {
+			g_thread_yield();
+			continue;
+		}
+		struct toplevel_share_view view;
+		view.serial = h->serial;
+		view.n_toplevels = MIN(h->n_toplevels, max);
+		view.active = (h->active >= 0 && (guint32)h->active < view.n_toplevels) ? h->active : -1;
+		view.base = c->map;
+		view.capacity = c->capacity;
+		reader(data, &view);
+		atomic_thread_fence(memory_order_acquire);
+		if((guint32)g_atomic_int_get((const gint*)&(h->seq)) == seq) return 1;
+	}
+	return 0;
+}
+
+void toplevel_share_client_free(struct toplevel_share_client* c) {
+	if(!c) return;
+	if(c->source) {
+		g_source_destroy(c->source);
+		g_source_unref(c->source);
+	}
+	if(c->conn) {
+		g_io_stream_close(G_IO_STREAM(c->conn), NULL, NULL);
+		g_object_unref(c->conn);
+	}
+	if(c->map) munmap((void*)c->map, c->capacity);
+	g_free(c);
+}
@@ -0,0 +1,166 @@
+/*
+ * toplevel_share.h -- sharing the state of toplevels with other processes
+ * 
+ * Copyright 2025 Daniel Kondor <kondor.dani@gmail.com>
+ * 
+ * This is free and unencumbered software released into the public domain.
+ * 
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ * 
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+#ifndef TOPLEVEL_SHARE_H
+#define TOPLEVEL_SHARE_H
+
+#include <gio/gio.h>
+#include <foreign_toplevel.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*
+ * One process (the daemon) binds the toplevel protocol and shares the
+ * snapshots of its manager (see toplevel_manager_get_snapshot()) with
+ * any number of clients (panels, docks, etc.). Snapshots are written to
+ * a shared memory region (a memfd, sealed so that clients can only map
+ * it read-only), which clients read without copying, guarded by a
+ * sequence counter. Only the records and strings that changed are
+ * written for each snapshot. The daemon listens on
+ * a Unix socket: new clients receive the memfd once, then a single byte
+ * each time a new snapshot was written (these are not queued if the
+ * client is behind, since only the latest snapshot is of interest). So
+ * serving more clients costs only a non-blocking send each.
+ *
+ * The layout of the shared memory is given below, for clients that do
+ * not use this code. All values are in the native byte order; string
+ * offsets are from the start of the memory (0 means NULL) and strings
+ * are NUL-terminated; the last byte of the memory is always 0.
+ */
+#define TOPLEVEL_SHARE_MAGIC 0x544c4753u /* "SGLT" */
+#define TOPLEVEL_SHARE_VERSION 1u
+
+enum toplevel_share_flags {
+	TOPLEVEL_SHARE_TRUNCATED = 1 /* not all toplevels or strings fit */
+};
+
+struct toplevel_share_header {
+	guint32 magic;
+	guint32 version;
+	guint32 seq;         /* odd while the contents are written, increased by 2 for each snapshot */
+	guint32 capacity;    /* size of the shared memory */
+	guint64 serial;      /* of the snapshot (see struct toplevel_snapshot) */
+	guint32 n_toplevels; /* number of records following this header */
+	gint32 active;       /* index of the record of the active app or -1 */
+	guint32 size;        /* bytes used, including strings */
+	guint32 flags;       /* enum toplevel_share_flags */
+};
+
+/* the properties of struct toplevel_properties, in the same order */
+#define TOPLEVEL_SHARE_N_PROPS 9
+
+struct toplevel_share_record {
+	guint32 id;
+	guint32 parent; /* the parent's ID + 1, or 0 */
+	guint32 props[TOPLEVEL_SHARE_N_PROPS];
+};
+
+
+/* default socket path: $XDG_RUNTIME_DIR/gtk-global-menu-toplevels (to be freed) */
+char* toplevel_share_default_path(void);
+
+struct toplevel_share;
+
+/*
+ * Start sharing the snapshots of gr on a socket at path (or the default
+ * path if NULL). Snapshots are enabled on gr; it has to be kept until
+ * the share is freed. Fails if another daemon is listening at the same
+ * path. Connections are accepted on the default main context.
+ */
+struct toplevel_share* toplevel_share_new(struct toplevel_manager* gr, const char* path, GError** error);
+
+unsigned int toplevel_share_get_n_clients(struct toplevel_share* s);
+
+/* stop sharing, disconnect all clients and remove the socket */
+void toplevel_share_free(struct toplevel_share* s);
+
+
+/* the client side */
+struct toplevel_share_client;
+
+/*
+ * Called on the client's main context after a new snapshot was written
+ * (possibly several of them) or if the daemon disconnected.
+ */
+typedef void (*toplevel_share_callback)(void* data, struct toplevel_share_client* c);
+
+/*
+ * Connect to a daemon at path (or the default path if NULL) and map its
+ * shared memory. Notifications are delivered on context (or on the
+ * default main context if NULL).
+ */
+struct toplevel_share_client* toplevel_share_client_new(const char* path, GMainContext* context,
+		toplevel_share_callback callback, void* data, GError** error);
+
+/* whether the daemon is still connected; if not, the last state can still be read */
+int toplevel_share_client_is_connected(struct toplevel_share_client* c);
+
+/* the contents of the shared memory, valid only during a toplevel_share_reader call */
+struct toplevel_share_view {
+	guint64 serial;
+	unsigned int n_toplevels;
+	int active; /* index of the active app or -1 */
+	const char* base;
+	guint32 capacity;
+};
+
+/*
+ * Get toplevel i from view; strings point into the shared memory. Returns
+ * nonzero on success (i.e. if i is valid).
+ */
+int toplevel_share_view_get(const struct toplevel_share_view* view, unsigned int i,
+		struct toplevel_snapshot_entry* entry);
+
+/*
+ * Called with the current contents of the shared memory. If the daemon
+ * writes a new snapshot meanwhile, the contents may be inconsistent, and
+ * it is called again: anything it produced before should be discarded.
+ * Reading is always safe in that strings stay within the shared memory.
+ */
+typedef void (*toplevel_share_reader)(void* data, const struct toplevel_share_view* view);
+
+/*
+ * Read the current snapshot without copying, calling reader until it saw
+ * a consistent version. Returns zero if this did not succeed after many
+ * tries (the daemon is writing continuously) or if not mapped.
+ */
+int toplevel_share_client_read(struct toplevel_share_client* c, toplevel_share_reader reader, void* data);
+
+void toplevel_share_client_free(struct toplevel_share_client* c);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
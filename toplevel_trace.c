@@ -0,0 +1,289 @@
+/*
+ * toplevel_trace.c -- compact binary traces of foreign toplevel events
+ * 
+ * Copyright 2025 Daniel Kondor <kondor.dani@gmail.com>
+ * 
+ * This is free and unencumbered software released into the public domain.
+ * 
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ * 
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <toplevel_trace.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+static const char trace_magic[4] = { 'G', 'T', 'L', 'T' };
+#define TRACE_VERSION 2
+/* oldest version that can be read (without output events) */
+#define TRACE_MIN_VERSION 1
+#define TRACE_HEADER_SIZE 8
+/* maximum length of a varint encoding a 64-bit number */
+#define VARINT_MAX 10
+
+struct toplevel_trace_writer {
+	FILE* f;
+	int error;
+	gint64 start;
+	gint64 last;
+	guint64 events;
+	/* strings written so far -> index + 1 */
+	GHashTable* strings;
+};
+
+struct toplevel_trace_reader {
+	GMappedFile* file;
+	const guint8* data;
+	const guint8* pos;
+	const guint8* end;
+	gint64 time_us;
+	/* strings seen so far (owned) */
+	GPtrArray* strings;
+};
+
+
+/* writing */
+
+static void write_bytes(struct toplevel_trace_writer* w, const void* data, size_t len) {
+	if(len && fwrite(data, 1, len, w->f) != len) w->error = 1;
+}
+
+static void write_varint(struct toplevel_trace_writer* w, guint64 x) {
+	guint8 buf[VARINT_MAX];
+	size_t len = 0;
+	do {
+		guint8 b = x & 0x7f;
+		x >>= 7;
+		buf[len++] = x ? (b | 0x80) : b;
+	} while(x);
+	write_bytes(w, buf, len);
+}
+
+/* strings are written as 0 for NULL, their index + 1 if already written,
+ * or the next index + 1 followed by the length and the contents */
+static void write_string(struct toplevel_trace_writer* w, const char* str) {
+	if(!str) {
+		write_varint(w, 0);
+		return;
+	}
+	guint idx = GPOINTER_TO_UINT(g_hash_table_lookup(w->strings, str));
+	if(idx) {
+		write_varint(w, idx);
+		return;
+	}
+	idx = g_hash_table_size(w->strings) + 1;
+	g_hash_table_insert(w->strings, g_strdup(str), GUINT_TO_POINTER(idx));
+	size_t len = strlen(str);
+	write_varint(w, idx);
+	write_varint(w, len);
+	write_bytes(w, str, len);
+}
+
+struct toplevel_trace_writer* toplevel_trace_writer_new(const char* path, GError** error) {
+	FILE* f = fopen(path, "wb");
+	if(!f) {
+		int err = errno;
+		g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(err),
+			"Cannot open %s: %s", path, g_strerror(err));
+		return NULL;
+	}
+	struct toplevel_trace_writer* w = g_new0(struct toplevel_trace_writer, 1);
+	w->f = f;
+	w->start = g_get_monotonic_time();
+	w->last = w->start;
+	w->strings = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	guint8 header[TRACE_HEADER_SIZE] = { 0 };
+	memcpy(header, trace_magic, sizeof(trace_magic));
+	header[4] = TRACE_VERSION;
+	write_bytes(w, header, sizeof(header));
+	return w;
+}
+
+void toplevel_trace_write(struct toplevel_trace_writer* w, const struct toplevel_trace_event* ev) {
+	if(!(w && ev) || ev->type < TOPLEVEL_TRACE_TOPLEVEL || ev->type >= TOPLEVEL_TRACE_N_TYPES) return;
+	gint64 now = g_get_monotonic_time();
+	guint8 type = (guint8)ev->type;
+	write_bytes(w, &type, 1);
+	write_varint(w, (now > w->last) ? (guint64)(now - w->last) : 0);
+	if(now > w->last) w->last = now;
+	write_varint(w, ev->toplevel);
+	unsigned int i, n;
+	switch(ev->type) {
+		case TOPLEVEL_TRACE_TITLE:
+		case TOPLEVEL_TRACE_APP_ID:
+			write_string(w, ev->str[0]);
+			break;
+		case TOPLEVEL_TRACE_STATE:
+			n = (ev->n_states < TOPLEVEL_TRACE_MAX_STATES) ? ev->n_states : TOPLEVEL_TRACE_MAX_STATES;
+			write_varint(w, n);
+			for(i = 0; i < n; i++) write_varint(w, ev->states[i]);
+			break;
+		case TOPLEVEL_TRACE_PARENT:
+			write_varint(w, ev->parent);
+			break;
+		case TOPLEVEL_TRACE_OUTPUT_ENTER:
+		case TOPLEVEL_TRACE_OUTPUT_LEAVE:
+			write_varint(w, ev->output);
+			break;
+		case TOPLEVEL_TRACE_CLIENT_ANNOTATION:
+		case TOPLEVEL_TRACE_SURFACE_ANNOTATION:
+			for(i = 0; i < 3; i++) write_string(w, ev->str[i]);
+			break;
+		default:
+			break;
+	}
+	w->events++;
+}
+
+guint64 toplevel_trace_writer_get_events(struct toplevel_trace_writer* w) {
+	return w ? w->events : 0;
+}
+
+int toplevel_trace_writer_free(struct toplevel_trace_writer* w) {
+	if(!w) return 0;
+	if(fclose(w->f)) w->error = 1;
+	int ret = !w->error;
+	g_hash_table_unref(w->strings);
+	g_free(w);
+	return ret;
+}
+
+
+/* reading */
+
+static int read_varint(struct toplevel_trace_reader* r, guint64* x) {
+	guint64 ret = 0;
+	unsigned int shift;
+	for(shift = 0; shift < 7 * VARINT_MAX; shift += 7) {
+		if(r->pos >= r->end) return 0;
+		guint8 b = *(r->pos++);
+		ret |= (guint64)(b & 0x7f) << shift;
+		if(!(b & 0x80)) {
+			*x = ret;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static int read_u32(struct toplevel_trace_reader* r, guint32* x) {
+	guint64 tmp;
+	if(!read_varint(r, &tmp) || tmp > G_MAXUINT32) return 0;
+	*x = (guint32)tmp;
+	return 1;
+}
+
+static int read_string(struct toplevel_trace_reader* r, const char** str) {
+	guint64 idx, len;
+	if(!read_varint(r, &idx)) return 0;
+	if(!idx) {
+		*str = NULL;
+		return 1;
+	}
+	if(idx <= r->strings->len) {
+		*str = (const char*)g_ptr_array_index(r->strings, idx - 1);
+		return 1;
+	}
+	/* a new string has to have the next index */
+	if(idx != (guint64)r->strings->len + 1) return 0;
+	if(!read_varint(r, &len) || len > (guint64)(r->end - r->pos)) return 0;
+	char* tmp = g_strndup((const char*)r->pos, len);
+	r->pos += len;
+	g_ptr_array_add(r->strings, tmp);
+	*str = tmp;
+	return 1;
+}
+
+struct toplevel_trace_reader* toplevel_trace_reader_new(const char* path, GError** error) {
+	GMappedFile* file = g_mapped_file_new(path, FALSE, error);
+	if(!file) return NULL;
+	const guint8* data = (const guint8*)g_mapped_file_get_contents(file);
+	size_t len = g_mapped_file_get_length(file);
+	if(len < TRACE_HEADER_SIZE || memcmp(data, trace_magic, sizeof(trace_magic)) ||
+			data[4] < TRACE_MIN_VERSION || data[4] > TRACE_VERSION) {
+		g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "%s is not a supported trace file", path);
+		g_mapped_file_unref(file);
+		return NULL;
+	}
+	struct toplevel_trace_reader* r = g_new0(struct toplevel_trace_reader, 1);
+	r->file = file;
+	r->data = data;
+	r->end = data + len;
+	r->strings = g_ptr_array_new_with_free_func(g_free);
+	toplevel_trace_reader_rewind(r);
+	return r;
+}
+
+int toplevel_trace_reader_next(struct toplevel_trace_reader* r, struct toplevel_trace_event* ev) {
+	if(!(r && ev) || r->pos >= r->end) return 0;
+	memset(ev, 0, sizeof(*ev));
+	guint8 type = *(r->pos++);
+	guint64 dt;
+	if(!type || type >= TOPLEVEL_TRACE_N_TYPES) return -1;
+	if(!(read_varint(r, &dt) && read_u32(r, &(ev->toplevel)))) return -1;
+	ev->type = (enum toplevel_trace_type)type;
+	r->time_us += (gint64)dt;
+	ev->time_us = r->time_us;
+	
+	guint32 n;
+	unsigned int i;
+	switch(ev->type) {
+		case TOPLEVEL_TRACE_TITLE:
+		case TOPLEVEL_TRACE_APP_ID:
+			if(!read_string(r, &(ev->str[0]))) return -1;
+			break;
+		case TOPLEVEL_TRACE_STATE:
+			if(!read_u32(r, &n) || n > TOPLEVEL_TRACE_MAX_STATES) return -1;
+			for(i = 0; i < n; i++) if(!read_u32(r, &(ev->states[i]))) return -1;
+			ev->n_states = n;
+			break;
+		case TOPLEVEL_TRACE_PARENT:
+			if(!read_u32(r, &(ev->parent))) return -1;
+			break;
+		case TOPLEVEL_TRACE_OUTPUT_ENTER:
+		case TOPLEVEL_TRACE_OUTPUT_LEAVE:
+			if(!read_u32(r, &(ev->output))) return -1;
+			break;
+		case TOPLEVEL_TRACE_CLIENT_ANNOTATION:
+		case TOPLEVEL_TRACE_SURFACE_ANNOTATION:
+			for(i = 0; i < 3; i++) if(!read_string(r, &(ev->str[i]))) return -1;
+			break;
+		default:
+			break;
+	}
+	return 1;
+}
+
+void toplevel_trace_reader_rewind(struct toplevel_trace_reader* r) {
+	if(!r) return;
+	r->pos = r->data + TRACE_HEADER_SIZE;
+	r->time_us = 0;
+	g_ptr_array_set_size(r->strings, 0);
+}
+
+void toplevel_trace_reader_free(struct toplevel_trace_reader* r) {
+	if(!r) return;
+	g_ptr_array_unref(r->strings);
+	g_mapped_file_unref(r->file);
+	g_free(r);
+}
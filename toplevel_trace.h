@@ -0,0 +1,127 @@
+/*
+ * toplevel_trace.h -- compact binary traces of foreign toplevel events
+ * 
+ * Copyright 2025 Daniel Kondor <kondor.dani@gmail.com>
+ * 
+ * This is free and unencumbered software released into the public domain.
+ * 
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ * 
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef TOPLEVEL_TRACE_H
+#define TOPLEVEL_TRACE_H
+
+#include <glib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*
+ * A trace records the events of the wlr-foreign-toplevel-management
+ * protocol received by a toplevel manager, with the time they arrived,
+ * so that they can be replayed later without the compositor (e.g. to
+ * reproduce problems or to benchmark the manager on a real workload).
+ *
+ * Format: a header ("GTLT", a version byte and three zero bytes),
+ * followed by records of a type byte and unsigned LEB128 varints: the
+ * time since the previous record (in us), the toplevel's ID and the
+ * arguments of the event. Strings are stored once; later references
+ * use their index. Outputs are numbered in the order they first appear
+ * (version 1 traces do not have output events).
+ */
+
+enum toplevel_trace_type {
+	TOPLEVEL_TRACE_TOPLEVEL = 1, /* new toplevel announced */
+	TOPLEVEL_TRACE_TITLE,
+	TOPLEVEL_TRACE_APP_ID,
+	TOPLEVEL_TRACE_STATE,
+	TOPLEVEL_TRACE_PARENT,
+	TOPLEVEL_TRACE_CLIENT_ANNOTATION,
+	TOPLEVEL_TRACE_SURFACE_ANNOTATION,
+	TOPLEVEL_TRACE_DONE,
+	TOPLEVEL_TRACE_CLOSED,
+	TOPLEVEL_TRACE_FINISHED,  /* the manager is finished (no toplevel) */
+	TOPLEVEL_TRACE_OUTPUT_ENTER,
+	TOPLEVEL_TRACE_OUTPUT_LEAVE,
+	TOPLEVEL_TRACE_N_TYPES
+};
+
+/* states beyond this are not recorded */
+#define TOPLEVEL_TRACE_MAX_STATES 8
+
+struct toplevel_trace_event {
+	enum toplevel_trace_type type;
+	gint64 time_us;   /* since the start of the trace */
+	guint32 toplevel; /* toplevels are numbered in the order they were announced */
+	guint32 parent;   /* for TOPLEVEL_TRACE_PARENT: the parent's ID + 1, or 0 if unset */
+	guint32 output;   /* for TOPLEVEL_TRACE_OUTPUT_ENTER and _LEAVE */
+	unsigned int n_states;
+	guint32 states[TOPLEVEL_TRACE_MAX_STATES];
+	/* title or app-id, or interface, bus name and object path for annotations */
+	const char* str[3];
+};
+
+
+struct toplevel_trace_writer;
+
+/* create (or truncate) a trace file; returns NULL and sets error on failure */
+struct toplevel_trace_writer* toplevel_trace_writer_new(const char* path, GError** error);
+
+/*
+ * Add an event to the trace. The time is taken when this is called (the
+ * time_us field is ignored). Writes are buffered; strings do not need to
+ * remain valid after this returns.
+ */
+void toplevel_trace_write(struct toplevel_trace_writer* w, const struct toplevel_trace_event* ev);
+
+/* number of events written so far */
+guint64 toplevel_trace_writer_get_events(struct toplevel_trace_writer* w);
+
+/* flush and close the trace; returns nonzero if everything was written successfully */
+int toplevel_trace_writer_free(struct toplevel_trace_writer* w);
+
+
+struct toplevel_trace_reader;
+
+/* open a trace file (it is memory-mapped); returns NULL and sets error on failure */
+struct toplevel_trace_reader* toplevel_trace_reader_new(const char* path, GError** error);
+
+/*
+ * Read the next event. Returns 1 on success, 0 at the end of the trace
+ * and -1 if the trace is corrupted. Strings in ev remain valid until the
+ * reader is rewound or freed.
+ */
+int toplevel_trace_reader_next(struct toplevel_trace_reader* r, struct toplevel_trace_event* ev);
+
+/* start again from the first event */
+void toplevel_trace_reader_rewind(struct toplevel_trace_reader* r);
+
+void toplevel_trace_reader_free(struct toplevel_trace_reader* r);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif